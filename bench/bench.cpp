@@ -0,0 +1,625 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "../src/gltf.h"
+#include "../src/gltfreader.hpp"
+#include "../src/base64.hpp"
+#include "../src/lighting.hpp"
+
+// CPU hot paths of the viewer on synthetic scenes, no window and no GL context
+
+// every heap allocation of the bench is counted, the parsers are compared by the peak they add
+static std::atomic<size_t> heaplive(0);
+static std::atomic<size_t> heappeak(0);
+
+void *operator new(size_t size)
+{
+	void *ptr = malloc(size ? size : 1);
+	if (ptr == nullptr) { throw std::bad_alloc(); }
+	const size_t bytes = malloc_usable_size(ptr);
+	const size_t live = heaplive.fetch_add(bytes) + bytes;
+	size_t peak = heappeak.load();
+	while (live > peak && !heappeak.compare_exchange_weak(peak, live));
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	if (ptr == nullptr) { return; }
+	heaplive.fetch_sub(malloc_usable_size(ptr));
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+// heap bytes in use, the peak starts over from here
+static size_t reset_heap_peak(void)
+{
+	const size_t live = heaplive.load();
+	heappeak.store(live);
+
+	return live;
+}
+
+struct scene_params {
+	const char *name;
+	uint32_t nodes; /* animated hierarchy */
+	uint32_t depth; /* nodes per chain, the hierarchy is nodes / depth chains */
+	uint32_t meshes; /* hierarchy nodes that carry the mesh */
+	uint32_t vertices; /* per mesh, rounded down to a square grid */
+	uint32_t joints; /* skeleton of the skinned mesh, 0 for none */
+	uint32_t keyframes; /* per channel, 0 for no animation */
+};
+
+static const struct scene_params SCENES[] = {
+	{ "small", 64, 4, 64, 256, 16, 32 },
+	{ "deep", 1024, 256, 64, 64, 0, 16 },
+	{ "wide", 8192, 2, 256, 64, 0, 16 },
+	{ "skeleton", 16, 4, 4, 1024, 128, 64 },
+	{ "keyframes", 64, 4, 4, 256, 64, 4096 },
+	{ "meshes", 8, 2, 8, 262144, 0, 0 },
+	{ "manifest", 131072, 8, 8192, 16, 0, 0 },
+};
+
+// decoded bytes of embedded buffers and images as exporters write them: a small texture, a typical PNG, a mesh, a scan
+static const size_t BASE64_SIZES[] = { 64 << 10, 1 << 20, 8 << 20, 48 << 20 };
+// local lights binned per run, the smallest stays below CLUSTER_PARALLEL_LIGHTS
+static const uint32_t CLUSTER_LIGHTS[] = { 32, 512, 4096 };
+
+struct sample_stats {
+	size_t count;
+	double mean;
+	double stddev;
+	double median;
+	double min;
+	double max;
+	double ci95; /* half width of the 95% confidence interval of the mean */
+};
+
+struct scene_results {
+	std::vector<double> parse, stream, textures, meshes, animations, skins, import, animation, pose;
+	size_t document = 0; /* bytes of glTF JSON */
+	size_t parsepeak = 0; /* heap bytes added while parsing, the same on every run */
+	size_t streampeak = 0;
+};
+
+struct base64_results {
+	std::vector<double> tinygltf, scalar, simd, document;
+};
+
+struct cluster_results {
+	std::vector<double> binning;
+	size_t pairs = 0; /* light and cluster pairs found, the same on every run */
+};
+
+static const char *BASE64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64(const std::vector<unsigned char> &data)
+{
+	std::string out;
+	out.reserve((data.size() + 2) / 3 * 4);
+	for (size_t i = 0; i < data.size(); i += 3) {
+		uint32_t bits = uint32_t(data[i]) << 16;
+		if (i + 1 < data.size()) { bits |= uint32_t(data[i + 1]) << 8; }
+		if (i + 2 < data.size()) { bits |= data[i + 2]; }
+		out += BASE64[(bits >> 18) & 63];
+		out += BASE64[(bits >> 12) & 63];
+		out += i + 1 < data.size() ? BASE64[(bits >> 6) & 63] : '=';
+		out += i + 2 < data.size() ? BASE64[bits & 63] : '=';
+	}
+
+	return out;
+}
+
+// appends plain data to the buffer and describes it with a view and an accessor
+struct gltf_writer {
+	std::vector<unsigned char> buffer;
+	std::string views;
+	std::string accessors;
+	int viewcount = 0;
+	int accessorcount = 0;
+
+	int add(const void *data, size_t size, size_t count, int componenttype, const char *type, const std::string &extra = "")
+	{
+		while (buffer.size() % 4) { buffer.push_back(0); }
+		const size_t offset = buffer.size();
+		buffer.insert(buffer.end(), static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+
+		views += std::string(viewcount ? "," : "") + "{\"buffer\":0,\"byteOffset\":" + std::to_string(offset) + ",\"byteLength\":" + std::to_string(size) + "}";
+		accessors += std::string(accessorcount ? "," : "") + "{\"bufferView\":" + std::to_string(viewcount) + ",\"componentType\":" + std::to_string(componenttype) + ",\"count\":" + std::to_string(count) + ",\"type\":\"" + type + "\"" + extra + "}";
+		viewcount++;
+
+		return accessorcount++;
+	}
+};
+
+// a square grid in the XY plane, optionally weighted to the joints along its height
+static std::string gen_mesh(struct gltf_writer &writer, uint32_t vertices, uint32_t joints)
+{
+	const uint32_t side = std::max(2u, uint32_t(std::sqrt(double(vertices))));
+	const uint32_t count = side * side;
+	std::vector<float> positions, normals, uvs, weights;
+	std::vector<uint16_t> jointindices;
+	for (uint32_t y = 0; y < side; y++) {
+		for (uint32_t x = 0; x < side; x++) {
+			const float u = float(x) / float(side - 1), v = float(y) / float(side - 1);
+			positions.insert(positions.end(), { u, v, 0.f });
+			normals.insert(normals.end(), { 0.f, 0.f, 1.f });
+			uvs.insert(uvs.end(), { u, v });
+			if (joints) {
+				const uint16_t joint = uint16_t(std::min(uint32_t(v * joints), joints - 1));
+				jointindices.insert(jointindices.end(), { joint, uint16_t(std::min(joint + 1u, joints - 1)), 0, 0 });
+				weights.insert(weights.end(), { 0.75f, 0.25f, 0.f, 0.f });
+			}
+		}
+	}
+	std::vector<uint32_t> indices;
+	for (uint32_t y = 0; y + 1 < side; y++) {
+		for (uint32_t x = 0; x + 1 < side; x++) {
+			const uint32_t i = y * side + x;
+			indices.insert(indices.end(), { i, i + 1, i + side, i + 1, i + side + 1, i + side });
+		}
+	}
+
+	const int position = writer.add(positions.data(), positions.size() * sizeof(float), count, 5126, "VEC3", ",\"min\":[0,0,0],\"max\":[1,1,0]");
+	const int normal = writer.add(normals.data(), normals.size() * sizeof(float), count, 5126, "VEC3");
+	const int uv = writer.add(uvs.data(), uvs.size() * sizeof(float), count, 5126, "VEC2");
+	const int index = writer.add(indices.data(), indices.size() * sizeof(uint32_t), indices.size(), 5125, "SCALAR");
+	std::string attributes = "\"POSITION\":" + std::to_string(position) + ",\"NORMAL\":" + std::to_string(normal) + ",\"TEXCOORD_0\":" + std::to_string(uv);
+	if (joints) {
+		const int joint = writer.add(jointindices.data(), jointindices.size() * sizeof(uint16_t), count, 5123, "VEC4");
+		const int weight = writer.add(weights.data(), weights.size() * sizeof(float), count, 5126, "VEC4");
+		attributes += ",\"JOINTS_0\":" + std::to_string(joint) + ",\"WEIGHTS_0\":" + std::to_string(weight);
+	}
+
+	return "{\"primitives\":[{\"attributes\":{" + attributes + "},\"indices\":" + std::to_string(index) + "}]}";
+}
+
+// glTF JSON with the buffer embedded as a data URI, so parsing includes the base64 decode like real files
+static std::string gen_scene(const struct scene_params &params)
+{
+	struct gltf_writer writer;
+	std::string meshes = gen_mesh(writer, params.vertices, 0);
+	if (params.joints) { meshes += "," + gen_mesh(writer, params.vertices, params.joints); }
+
+	// chains of depth nodes hang off the scene root, every node is offset from its parent
+	std::string nodes;
+	std::vector<std::vector<int>> children(params.nodes);
+	std::vector<int> roots;
+	for (uint32_t i = 0; i < params.nodes; i++) {
+		if (i % params.depth == 0) {
+			roots.push_back(int(i));
+		} else {
+			children[i - 1].push_back(int(i));
+		}
+	}
+	auto list = [](const std::vector<int> &items) {
+		std::string out;
+		for (size_t i = 0; i < items.size(); i++) { out += (i ? "," : "") + std::to_string(items[i]); }
+		return out;
+	};
+	for (uint32_t i = 0; i < params.nodes; i++) {
+		nodes += std::string(i ? "," : "") + "{\"translation\":[0.1,0.2,0],\"rotation\":[0,0,0.0499792,0.9987503]";
+		if (i < params.meshes) { nodes += ",\"mesh\":0"; }
+		if (!children[i].empty()) { nodes += ",\"children\":[" + list(children[i]) + "]"; }
+		nodes += "}";
+	}
+
+	// the skeleton is one chain, the skinned mesh node sits next to it
+	std::string skins;
+	std::vector<int> joints;
+	if (params.joints) {
+		const uint32_t first = params.nodes;
+		for (uint32_t j = 0; j < params.joints; j++) {
+			joints.push_back(int(first + j));
+			nodes += ",{\"translation\":[0,0.1,0]";
+			if (j + 1 < params.joints) { nodes += ",\"children\":[" + std::to_string(first + j + 1) + "]"; }
+			nodes += "}";
+		}
+		roots.push_back(int(first));
+
+		std::vector<glm::mat4> inversebinds(params.joints);
+		for (uint32_t j = 0; j < params.joints; j++) { inversebinds[j] = glm::translate(glm::mat4(1.f), glm::vec3(0.f, -0.1f * float(j + 1), 0.f)); }
+		const int ibm = writer.add(inversebinds.data(), inversebinds.size() * sizeof(glm::mat4), params.joints, 5126, "MAT4");
+		skins = ",\"skins\":[{\"inverseBindMatrices\":" + std::to_string(ibm) + ",\"skeleton\":" + std::to_string(first) + ",\"joints\":[" + list(joints) + "]}]";
+		nodes += ",{\"mesh\":1,\"skin\":0}";
+		roots.push_back(int(first + params.joints));
+	}
+
+	// every hierarchy node translates and every joint rotates, two samplers shared by all channels
+	std::string animations;
+	if (params.keyframes) {
+		std::vector<float> times, translations, rotations;
+		for (uint32_t k = 0; k < params.keyframes; k++) {
+			const float t = float(k) / 30.f;
+			const float angle = 0.5f * std::sin(t * 3.f);
+			times.push_back(t);
+			translations.insert(translations.end(), { 0.1f, 0.2f + 0.05f * std::sin(t), 0.f });
+			rotations.insert(rotations.end(), { 0.f, 0.f, std::sin(angle * 0.5f), std::cos(angle * 0.5f) });
+		}
+		const std::string range = ",\"min\":[0],\"max\":[" + std::to_string(times.back()) + "]";
+		const int input = writer.add(times.data(), times.size() * sizeof(float), times.size(), 5126, "SCALAR", range);
+		const int translation = writer.add(translations.data(), translations.size() * sizeof(float), params.keyframes, 5126, "VEC3");
+		const int rotation = writer.add(rotations.data(), rotations.size() * sizeof(float), params.keyframes, 5126, "VEC4");
+
+		std::string channels;
+		for (uint32_t i = 0; i < params.nodes; i++) {
+			channels += std::string(i ? "," : "") + "{\"sampler\":0,\"target\":{\"node\":" + std::to_string(i) + ",\"path\":\"translation\"}}";
+		}
+		for (int joint : joints) {
+			channels += ",{\"sampler\":1,\"target\":{\"node\":" + std::to_string(joint) + ",\"path\":\"rotation\"}}";
+		}
+		animations = ",\"animations\":[{\"name\":\"bench\",\"samplers\":[{\"input\":" + std::to_string(input) + ",\"output\":" + std::to_string(translation)
+			+ "},{\"input\":" + std::to_string(input) + ",\"output\":" + std::to_string(rotation) + "}],\"channels\":[" + channels + "]}]";
+	}
+
+	return "{\"asset\":{\"version\":\"2.0\",\"generator\":\"gltfviewer bench\"},\"scene\":0,\"scenes\":[{\"nodes\":[" + list(roots) + "]}]"
+		",\"nodes\":[" + nodes + "],\"meshes\":[" + meshes + "]" + skins + animations
+		+ ",\"buffers\":[{\"byteLength\":" + std::to_string(writer.buffer.size()) + ",\"uri\":\"data:application/octet-stream;base64," + base64(writer.buffer) + "\"}]"
+		",\"bufferViews\":[" + writer.views + "],\"accessors\":[" + writer.accessors + "]}";
+}
+
+static double now_ms(void)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// two sided Student t quantiles for 95%, the normal quantile past 30 degrees of freedom
+static double t_quantile(size_t dof)
+{
+	static const double T95[30] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+	if (dof == 0) { return 0.0; }
+
+	return dof <= 30 ? T95[dof - 1] : 1.960;
+}
+
+static struct sample_stats statistics(std::vector<double> samples)
+{
+	struct sample_stats stats = {};
+	stats.count = samples.size();
+	if (samples.empty()) { return stats; }
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double sample : samples) { sum += sample; }
+	stats.mean = sum / double(samples.size());
+	double squares = 0.0;
+	for (double sample : samples) { squares += (sample - stats.mean) * (sample - stats.mean); }
+	stats.stddev = samples.size() > 1 ? std::sqrt(squares / double(samples.size() - 1)) : 0.0;
+	const size_t middle = samples.size() / 2;
+	stats.median = samples.size() % 2 ? samples[middle] : 0.5 * (samples[middle - 1] + samples[middle]);
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.ci95 = t_quantile(samples.size() - 1) * stats.stddev / std::sqrt(double(samples.size()));
+
+	return stats;
+}
+
+static bool run_scene(const struct scene_params &params, uint32_t repeats, uint32_t frames, struct scene_results *results)
+{
+	const std::string json = gen_scene(params);
+	results->document = json.size();
+
+	// the first run warms caches and the allocator and is not counted
+	for (uint32_t repeat = 0; repeat <= repeats; repeat++) {
+		double parse, stream;
+		tinygltf::Model model;
+		struct gltf_names names;
+		std::string err, warn;
+		{
+			tinygltf::Model dom;
+			tinygltf::TinyGLTF loader;
+			const size_t base = reset_heap_peak();
+			const double start = now_ms();
+			if (!loader.LoadASCIIFromString(&dom, &err, &warn, json.data(), unsigned(json.size()), "")) {
+				std::cerr << "error: synthetic scene " << params.name << " did not parse: " << err << std::endl;
+				return false;
+			}
+			parse = now_ms() - start;
+			results->parsepeak = heappeak.load() - base;
+		}
+		{
+			const size_t base = reset_heap_peak();
+			const double start = now_ms();
+			if (!read_gltf(reinterpret_cast<const unsigned char*>(json.data()), json.size(), "", &model, &err, &warn, nullptr, nullptr, &names)) {
+				std::cerr << "error: synthetic scene " << params.name << " did not stream: " << err << std::endl;
+				return false;
+			}
+			stream = now_ms() - start;
+			results->streampeak = heappeak.load() - base;
+		}
+		double start;
+
+		gltf::Model *scene = new gltf::Model;
+		scene->load(model, false, &names);
+
+		// one animation step and one pose update per frame, reported per frame, the step only samples keyframes
+		double animation = 0.0;
+		double pose = 0.0;
+		for (uint32_t frame = 0; frame < frames; frame++) {
+			if (!scene->animations.empty()) {
+				const float time = scene->animations[0].end * float(frame) / float(frames);
+				start = now_ms();
+				scene->sampleAnimation(0, time);
+				animation += now_ms() - start;
+			}
+			start = now_ms();
+			scene->updatePose();
+			pose += now_ms() - start;
+		}
+
+		if (repeat > 0) {
+			results->parse.push_back(parse);
+			results->stream.push_back(stream);
+			results->textures.push_back(scene->timings.textures);
+			results->meshes.push_back(scene->timings.meshes);
+			results->animations.push_back(scene->timings.animations);
+			results->skins.push_back(scene->timings.skins);
+			results->import.push_back(scene->timings.total);
+			if (!scene->animations.empty()) { results->animation.push_back(animation / frames); }
+			results->pose.push_back(pose / frames);
+		}
+		delete scene;
+	}
+
+	return true;
+}
+
+// one data URI decoded by tinygltf, by both decoders on one thread and by the reader in parallel slices
+static bool run_base64(size_t bytes, uint32_t repeats, struct base64_results *results)
+{
+	std::vector<unsigned char> data(bytes);
+	uint32_t state = 1;
+	for (unsigned char &byte : data) {
+		state = state * 1664525u + 1013904223u;
+		byte = uint8_t(state >> 24);
+	}
+	const std::string uri = "data:application/octet-stream;base64," + base64(data);
+	const std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[]}],\"buffers\":[{\"byteLength\":" + std::to_string(bytes) + ",\"uri\":\"" + uri + "\"}]}";
+	const char *text = uri.data() + uri.find(',') + 1;
+	const size_t length = uri.size() - size_t(text - uri.data());
+	std::vector<unsigned char> out(bytes);
+
+	for (uint32_t repeat = 0; repeat <= repeats; repeat++) {
+		std::vector<unsigned char> dom;
+		std::string mime;
+		double start = now_ms();
+		const bool tiny = tinygltf::DecodeDataURI(&dom, mime, uri, bytes, true);
+		const double tinyms = now_ms() - start;
+
+		start = now_ms();
+		const bool scalar = base64_decode_scalar(text, length, out.data()) && out == data;
+		const double scalarms = now_ms() - start;
+
+		std::fill(out.begin(), out.end(), 0);
+		start = now_ms();
+		const bool simd = base64_decode(text, length, out.data());
+		const double simdms = now_ms() - start;
+
+		tinygltf::Model model;
+		std::string err, warn;
+		start = now_ms();
+		const bool document = read_gltf(reinterpret_cast<const unsigned char*>(json.data()), json.size(), "", &model, &err, &warn, nullptr, nullptr);
+		const double documentms = now_ms() - start;
+
+		if (!tiny || !scalar || !simd || out != data || !document || model.buffers[0].data != data) {
+			std::cerr << "error: base64 decode of " << bytes << " bytes differs " << err << std::endl;
+			return false;
+		}
+		if (repeat > 0) {
+			results->tinygltf.push_back(tinyms);
+			results->scalar.push_back(scalarms);
+			results->simd.push_back(simdms);
+			results->document.push_back(documentms);
+		}
+	}
+
+	return true;
+}
+
+// every local light against every cluster box, what the binning has to find
+static std::vector<std::vector<uint32_t>> brute_force_clusters(const struct cluster_grid &grid, const glm::mat4 &view, const struct light_clusters &clusters)
+{
+	std::vector<std::vector<uint32_t>> expected(CLUSTER_COUNT);
+	for (uint32_t i = clusters.directional; i < uint32_t(clusters.lights.size()); i++) {
+		const glm::vec4 &position = clusters.lights[i].position;
+		const glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(position), 1.f));
+		for (size_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+			const glm::vec3 d = glm::max(glm::max(grid.mins[cluster] - center, center - grid.maxs[cluster]), glm::vec3(0.f));
+			if (glm::dot(d, d) <= position.w * position.w) { expected[cluster].push_back(i); }
+		}
+	}
+
+	return expected;
+}
+
+static bool run_clusters(uint32_t count, uint32_t repeats, struct cluster_results *results)
+{
+	const float width = 1920.f;
+	const float height = 1080.f;
+	const glm::mat4 project = glm::perspective(glm::radians(90.f), width / height, 0.1f, 800.f);
+	const struct cluster_grid grid = make_cluster_grid(project, width, height, 0.1f, 800.f);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 2.f, 0.f), glm::vec3(0.3f, 1.5f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+
+	// a sun and point and spot lights scattered in front of the camera and a bit behind it
+	uint32_t state = 1;
+	auto random = [&state](float low, float high) {
+		state = state * 1664525u + 1013904223u;
+		return low + (high - low) * float(state >> 8) / float(1 << 24);
+	};
+	std::vector<struct light_data> lights;
+	lights.push_back(make_light(LIGHT_DIRECTIONAL, glm::vec3(0.f), glm::vec3(-0.5f, -1.f, -0.2f), glm::vec3(1.f), 3.f, 0.f, 0.f, 0.f));
+	for (uint32_t i = 0; i < count; i++) {
+		const glm::vec3 position(random(-150.f, 150.f), random(-10.f, 30.f), random(-400.f, 20.f));
+		const glm::vec3 direction(random(-1.f, 1.f), -1.f, random(-1.f, 1.f));
+		lights.push_back(make_light(i % 2 ? LIGHT_SPOT : LIGHT_POINT, position, direction, glm::vec3(1.f), 1.f, random(0.5f, 40.f), 0.3f, 0.6f));
+	}
+
+	for (uint32_t repeat = 0; repeat <= repeats; repeat++) {
+		struct light_clusters clusters;
+		const double start = now_ms();
+		cluster_lights(grid, view, lights, clusters);
+		const double binning = now_ms() - start;
+
+		if (repeat == 0) {
+			const std::vector<std::vector<uint32_t>> expected = brute_force_clusters(grid, view, clusters);
+			size_t mismatches = 0;
+			for (size_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+				const glm::uvec2 range = clusters.ranges[cluster];
+				std::vector<uint32_t> found(clusters.indices.begin() + range.x, clusters.indices.begin() + range.x + range.y);
+				std::sort(found.begin(), found.end());
+				if (found != expected[cluster]) { mismatches++; }
+			}
+			if (clusters.directional != 1 || mismatches > 0) {
+				std::cerr << "error: binning of " << count << " lights differs from the brute force test in " << mismatches << " clusters" << std::endl;
+				return false;
+			}
+			results->pairs = clusters.indices.size();
+		} else {
+			results->binning.push_back(binning);
+		}
+	}
+
+	return true;
+}
+
+static void write_stats(FILE *fp, const char *name, const std::vector<double> &samples, bool last)
+{
+	const struct sample_stats stats = statistics(samples);
+	fprintf(fp, "\t\t\t\t\"%s\": {\"repeats\": %zu, \"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"median_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, \"ci95_ms\": [%.6f, %.6f]}%s\n",
+		name, stats.count, stats.mean, stats.stddev, stats.median, stats.min, stats.max, stats.mean - stats.ci95, stats.mean + stats.ci95, last ? "" : ",");
+}
+
+static void usage(const char *program)
+{
+	printf("usage: %s [options]\n", program);
+	printf("  --repeats N   measured runs per scene after one warm up run (default 10)\n");
+	printf("  --frames N    animation and pose updates per run (default 100)\n");
+	printf("  --scene NAME  only this synthetic scene, may be repeated\n");
+	printf("  --out FILE    JSON results, stdout if not given\n");
+	printf("scenes:");
+	for (const struct scene_params &scene : SCENES) { printf(" %s", scene.name); }
+	printf(" base64 clusters\n");
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t repeats = 10;
+	uint32_t frames = 100;
+	const char *outpath = nullptr;
+	std::vector<std::string> only;
+	for (int i = 1; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (!strcmp(argv[i], "--repeats") && value) {
+			repeats = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--frames") && value) {
+			frames = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--scene") && value) {
+			only.push_back(argv[++i]);
+		} else if (!strcmp(argv[i], "--out") && value) {
+			outpath = argv[++i];
+		} else {
+			usage(argv[0]);
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	std::vector<const struct scene_params*> scenes;
+	for (const struct scene_params &scene : SCENES) {
+		if (only.empty() || std::find(only.begin(), only.end(), scene.name) != only.end()) { scenes.push_back(&scene); }
+	}
+
+	FILE *fp = outpath ? fopen(outpath, "w") : stdout;
+	if (fp == nullptr) {
+		std::cerr << "error: can't write '" << outpath << "'" << std::endl;
+		return 1;
+	}
+
+	int failed = 0;
+	fprintf(fp, "{\n\t\"repeats\": %u,\n\t\"frames\": %u,\n\t\"scenes\": [\n", repeats, frames);
+	for (size_t i = 0; i < scenes.size(); i++) {
+		const struct scene_params &params = *scenes[i];
+		struct scene_results results;
+		if (!run_scene(params, repeats, frames, &results)) { failed++; }
+		std::cerr << "bench: " << params.name << " done" << std::endl;
+
+		fprintf(fp, "\t\t{\n\t\t\t\"name\": \"%s\",\n", params.name);
+		fprintf(fp, "\t\t\t\"params\": {\"nodes\": %u, \"depth\": %u, \"meshes\": %u, \"vertices\": %u, \"joints\": %u, \"keyframes\": %u},\n",
+			params.nodes, params.depth, params.meshes, params.vertices, params.joints, params.keyframes);
+		fprintf(fp, "\t\t\t\"results\": {\n");
+		write_stats(fp, "parse_tinygltf", results.parse, false);
+		write_stats(fp, "parse_stream", results.stream, false);
+		write_stats(fp, "import_textures", results.textures, false);
+		write_stats(fp, "import_meshes", results.meshes, false);
+		write_stats(fp, "import_animations", results.animations, false);
+		write_stats(fp, "import_skins", results.skins, false);
+		write_stats(fp, "import_total", results.import, false);
+		write_stats(fp, "update_animation", results.animation, false);
+		write_stats(fp, "update_pose", results.pose, true);
+		fprintf(fp, "\t\t\t},\n");
+		fprintf(fp, "\t\t\t\"parse_peak_bytes\": {\"document\": %zu, \"tinygltf\": %zu, \"stream\": %zu}\n", results.document, results.parsepeak, results.streampeak);
+		fprintf(fp, "\t\t}%s\n", i + 1 < scenes.size() ? "," : "");
+	}
+	fprintf(fp, "\t]");
+
+	if (only.empty() || std::find(only.begin(), only.end(), "base64") != only.end()) {
+		fprintf(fp, ",\n\t\"base64\": {\n\t\t\"isa\": \"%s\",\n\t\t\"sizes\": [\n", base64_isa());
+		const size_t nsizes = sizeof(BASE64_SIZES) / sizeof(BASE64_SIZES[0]);
+		for (size_t i = 0; i < nsizes; i++) {
+			struct base64_results results;
+			if (!run_base64(BASE64_SIZES[i], repeats, &results)) { failed++; }
+			std::cerr << "bench: base64 " << BASE64_SIZES[i] << " done" << std::endl;
+
+			fprintf(fp, "\t\t\t{\n\t\t\t\t\"bytes\": %zu,\n\t\t\t\t\"results\": {\n", BASE64_SIZES[i]);
+			write_stats(fp, "tinygltf", results.tinygltf, false);
+			write_stats(fp, "scalar", results.scalar, false);
+			write_stats(fp, "simd", results.simd, false);
+			write_stats(fp, "read_gltf", results.document, true);
+			fprintf(fp, "\t\t\t\t}\n\t\t\t}%s\n", i + 1 < nsizes ? "," : "");
+		}
+		fprintf(fp, "\t\t]\n\t}");
+	}
+
+	if (only.empty() || std::find(only.begin(), only.end(), "clusters") != only.end()) {
+		fprintf(fp, ",\n\t\"clusters\": [\n");
+		const size_t ncounts = sizeof(CLUSTER_LIGHTS) / sizeof(CLUSTER_LIGHTS[0]);
+		for (size_t i = 0; i < ncounts; i++) {
+			struct cluster_results results;
+			if (!run_clusters(CLUSTER_LIGHTS[i], repeats, &results)) { failed++; }
+			std::cerr << "bench: clusters " << CLUSTER_LIGHTS[i] << " done" << std::endl;
+
+			fprintf(fp, "\t\t{\n\t\t\t\"lights\": %u,\n\t\t\t\"pairs\": %zu,\n\t\t\t\"results\": {\n", CLUSTER_LIGHTS[i], results.pairs);
+			write_stats(fp, "cluster_lights", results.binning, true);
+			fprintf(fp, "\t\t\t}\n\t\t}%s\n", i + 1 < ncounts ? "," : "");
+		}
+		fprintf(fp, "\t]");
+	}
+	fprintf(fp, "\n}\n");
+	if (outpath) { fclose(fp); }
+
+	return failed;
+}
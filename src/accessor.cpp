@@ -0,0 +1,36 @@
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "external/tiny_gltf.h"
+#include "accessor.hpp"
+
+bool view_accessor(const tinygltf::Model &model, int index, struct accessor_view *view)
+{
+	if (index < 0 || size_t(index) >= model.accessors.size()) { return false; }
+	const tinygltf::Accessor &accessor = model.accessors[index];
+	if (accessor.bufferView < 0) { return false; }
+	const tinygltf::BufferView &bufview = model.bufferViews[accessor.bufferView];
+
+	view->data = model.buffers[bufview.buffer].data.data() + bufview.byteOffset + accessor.byteOffset;
+	view->count = accessor.count;
+	view->componenttype = accessor.componentType;
+	view->componentsize = tinygltf::GetComponentSizeInBytes(uint32_t(accessor.componentType));
+	view->components = tinygltf::GetNumComponentsInType(uint32_t(accessor.type));
+	view->normalized = accessor.normalized;
+	const int stride = accessor.ByteStride(bufview);
+	view->stride = stride > 0 ? size_t(stride) : size_t(view->componentsize * view->components);
+
+	return view->componentsize > 0 && view->components > 0;
+}
+
+void read_accessor(const struct accessor_view &view, std::vector<float> &out)
+{
+	out.resize(view.count * view.components);
+	for (size_t i = 0; i < view.count; i++) {
+		const unsigned char *p = view.data + i * view.stride;
+		for (int c = 0; c < view.components; c++) {
+			out[i * view.components + c] = accessor_component(p + c * view.componentsize, view.componenttype, view.normalized);
+		}
+	}
+}
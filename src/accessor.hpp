@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "external/tiny_gltf.h"
+
+// elements of a glTF accessor in its buffer, read as floats whatever the component type
+// integer components keep their value, normalized ones are scaled to [0, 1] or [-1, 1] (KHR_mesh_quantization)
+struct accessor_view {
+	const unsigned char *data = nullptr; /* first element */
+	size_t stride = 0;
+	size_t count = 0;
+	int componenttype = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	int componentsize = 4;
+	int components = 0;
+	bool normalized = false;
+};
+
+// false if the index is -1 or the accessor has no buffer view
+bool view_accessor(const tinygltf::Model &model, int index, struct accessor_view *view);
+
+// every component of every element, count * components floats
+void read_accessor(const struct accessor_view &view, std::vector<float> &out);
+
+static inline float accessor_component(const unsigned char *p, int componenttype, bool normalized)
+{
+	switch (componenttype) {
+	case TINYGLTF_COMPONENT_TYPE_BYTE: {
+		const int8_t value = int8_t(*p);
+		return normalized ? std::max(float(value) / 127.f, -1.f) : float(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return normalized ? float(*p) / 255.f : float(*p);
+	case TINYGLTF_COMPONENT_TYPE_SHORT: {
+		int16_t value;
+		memcpy(&value, p, sizeof(value));
+		return normalized ? std::max(float(value) / 32767.f, -1.f) : float(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		uint16_t value;
+		memcpy(&value, p, sizeof(value));
+		return normalized ? float(value) / 65535.f : float(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return float(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	}
+
+	return 0.f;
+}
+
+// the first four components of element i, missing ones are 0
+static inline glm::vec4 accessor_element(const struct accessor_view &view, size_t i)
+{
+	glm::vec4 element(0.f);
+	const unsigned char *p = view.data + i * view.stride;
+	const int components = std::min(view.components, 4);
+	if (view.componenttype == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+		memcpy(&element[0], p, components * sizeof(float));
+		return element;
+	}
+	for (int c = 0; c < components; c++) {
+		element[c] = accessor_component(p + c * view.componentsize, view.componenttype, view.normalized);
+	}
+
+	return element;
+}
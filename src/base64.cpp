@@ -0,0 +1,209 @@
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+#include "base64.hpp"
+
+// the build doesn't pass -march, so the vector paths are compiled for their own target and picked at run time
+#ifdef BASE64_X86
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define BASE64_INVALID 0xFF
+
+enum base64_level {
+	BASE64_SCALAR,
+	BASE64_SSSE3,
+	BASE64_AVX2
+};
+
+struct base64_table {
+	uint8_t values[256];
+	base64_table()
+	{
+		const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		memset(values, BASE64_INVALID, sizeof(values));
+		for (uint8_t i = 0; i < 64; i++) { values[uint8_t(alphabet[i])] = i; }
+	}
+};
+
+static const struct base64_table TABLE;
+
+static enum base64_level detect_level(void)
+{
+#ifdef BASE64_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) { return BASE64_AVX2; }
+	if (__builtin_cpu_supports("ssse3")) { return BASE64_SSSE3; }
+#endif
+
+	return BASE64_SCALAR;
+}
+
+static enum base64_level cpu_level(void)
+{
+	static const enum base64_level level = detect_level();
+
+	return level;
+}
+
+// at most two '=' of a padded text
+static size_t unpadded(const char *text, size_t length)
+{
+	if (length == 0 || length % 4) { return length; }
+	if (text[length - 1] == '=') { length--; }
+	if (text[length - 1] == '=') { length--; }
+
+	return length;
+}
+
+size_t base64_decoded_size(const char *text, size_t length)
+{
+	length = unpadded(text, length);
+	if (length % 4 == 1) { return 0; }
+
+	return length / 4 * 3 + (length % 4 ? length % 4 - 1 : 0);
+}
+
+// length without padding
+static bool decode_rest(const unsigned char *text, size_t length, unsigned char *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4) {
+		const uint32_t a = TABLE.values[text[i]], b = TABLE.values[text[i + 1]], c = TABLE.values[text[i + 2]], d = TABLE.values[text[i + 3]];
+		if ((a | b | c | d) & 0xC0) { return false; }
+		const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+		out[0] = uint8_t(bits >> 16);
+		out[1] = uint8_t(bits >> 8);
+		out[2] = uint8_t(bits);
+		out += 3;
+	}
+
+	const size_t rest = length - i;
+	if (rest == 1) { return false; }
+	if (rest > 1) {
+		const uint32_t a = TABLE.values[text[i]], b = TABLE.values[text[i + 1]], c = rest > 2 ? TABLE.values[text[i + 2]] : 0;
+		if ((a | b | c) & 0xC0) { return false; }
+		const uint32_t bits = (a << 18) | (b << 12) | (c << 6);
+		out[0] = uint8_t(bits >> 16);
+		if (rest > 2) { out[1] = uint8_t(bits >> 8); }
+	}
+
+	return true;
+}
+
+#ifdef BASE64_X86
+// sextets of 16 characters, a lane outside the alphabet sets a bit of invalid
+TARGET_SSSE3 static inline __m128i translate_ssse3(__m128i in, uint32_t *invalid)
+{
+	const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+	const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+	const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+	const __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+	const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+
+	__m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+	shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+	shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+	shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));
+	shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+
+	const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+	*invalid |= uint32_t(_mm_movemask_epi8(valid)) ^ 0xFFFF;
+
+	return _mm_add_epi8(in, shift);
+}
+
+// 16 characters to 12 bytes, the store writes 16 so the loop stops while 4 bytes of its own output are left
+TARGET_SSSE3 static size_t decode_ssse3(const char *text, size_t length, unsigned char *out, size_t outsize, uint32_t *invalid)
+{
+	const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t i = 0, o = 0;
+	for (; i + 16 <= length && o + 16 <= outsize; i += 16, o += 12) {
+		const __m128i sextets = translate_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), invalid);
+		const __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140)); /* a * 64 + b */
+		const __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000)); /* ab * 4096 + cd */
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm_shuffle_epi8(triples, order));
+	}
+
+	return i;
+}
+
+TARGET_AVX2 static inline __m256i translate_avx2(__m256i in, uint32_t *invalid)
+{
+	const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+	const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+	const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+	const __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+	const __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+
+	__m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+	shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+	shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+	shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')));
+	shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')));
+
+	const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+	*invalid |= ~uint32_t(_mm256_movemask_epi8(valid));
+
+	return _mm256_add_epi8(in, shift);
+}
+
+// 32 characters to 24 bytes, the 12 bytes of each lane are moved together before the 32 byte store
+TARGET_AVX2 static size_t decode_avx2(const char *text, size_t length, unsigned char *out, size_t outsize, uint32_t *invalid)
+{
+	const __m256i order = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t i = 0, o = 0;
+	for (; i + 32 <= length && o + 32 <= outsize; i += 32, o += 24) {
+		const __m256i sextets = translate_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), invalid);
+		const __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+		const __m256i triples = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+		const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(triples, order), lanes);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + o), packed);
+	}
+
+	return i;
+}
+#endif
+
+bool base64_decode_scalar(const char *text, size_t length, unsigned char *out)
+{
+	length = unpadded(text, length);
+
+	return decode_rest(reinterpret_cast<const unsigned char*>(text), length, out);
+}
+
+bool base64_decode(const char *text, size_t length, unsigned char *out)
+{
+	const size_t outsize = base64_decoded_size(text, length);
+	length = unpadded(text, length);
+	if (length % 4 == 1) { return false; }
+
+	size_t done = 0;
+#ifdef BASE64_X86
+	uint32_t invalid = 0;
+	const enum base64_level level = cpu_level();
+	if (level >= BASE64_AVX2) { done += decode_avx2(text, length, out, outsize, &invalid); }
+	if (level >= BASE64_SSSE3) { done += decode_ssse3(text + done, length - done, out + done / 4 * 3, outsize - done / 4 * 3, &invalid); }
+	if (invalid) { return false; }
+#else
+	(void)outsize;
+#endif
+
+	return decode_rest(reinterpret_cast<const unsigned char*>(text) + done, length - done, out + done / 4 * 3);
+}
+
+const char *base64_isa(void)
+{
+	switch (cpu_level()) {
+	case BASE64_AVX2: return "avx2";
+	case BASE64_SSSE3: return "ssse3";
+	default: return "scalar";
+	}
+}
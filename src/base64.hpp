@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+// bytes the base64 text decodes to, padding is not counted, 0 if the length can't be base64
+size_t base64_decoded_size(const char *text, size_t length);
+
+// decodes into out which holds base64_decoded_size bytes, false on a character outside the alphabet
+// nothing past those bytes is written, so slices of one text can be decoded into one buffer from several threads
+bool base64_decode(const char *text, size_t length, unsigned char *out);
+bool base64_decode_scalar(const char *text, size_t length, unsigned char *out);
+
+// the instruction set base64_decode picked on this CPU
+const char *base64_isa(void);
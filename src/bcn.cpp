@@ -0,0 +1,272 @@
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "dds.hpp"
+#include "bcn.hpp"
+#include "parallel.hpp"
+
+// block rows a parallel_for job compresses, images that are only a few rows high stay on one thread
+#define ROWS_PER_JOB 8
+
+struct bitwriter {
+	unsigned char *out;
+	uint32_t pos = 0;
+
+	void put(uint32_t value, uint32_t nbits)
+	{
+		for (uint32_t i = 0; i < nbits; i++) {
+			out[pos >> 3] |= ((value >> i) & 1) << (pos & 7);
+			pos++;
+		}
+	}
+};
+
+uint32_t bcn_dxgi_format(enum bcn_format format)
+{
+	switch (format) {
+	case BCN_BC4: return DXGI_FORMAT_BC4_UNORM;
+	case BCN_BC5: return DXGI_FORMAT_BC5_UNORM;
+	case BCN_BC7: return DXGI_FORMAT_BC7_UNORM;
+	case BCN_BC7_SRGB: return DXGI_FORMAT_BC7_UNORM_SRGB;
+	}
+
+	return 0;
+}
+
+size_t bcn_block_size(enum bcn_format format)
+{
+	return (format == BCN_BC4) ? 8 : 16;
+}
+
+size_t bcn_image_size(enum bcn_format format, uint32_t width, uint32_t height)
+{
+	return size_t((width + 3) / 4) * size_t((height + 3) / 4) * bcn_block_size(format);
+}
+
+// copy a 4x4 block of pixels, edge pixels are repeated for images smaller than a block
+static void fetch_block(const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, unsigned char block[64])
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		uint32_t sy = std::min(by * 4 + y, height - 1);
+		for (uint32_t x = 0; x < 4; x++) {
+			uint32_t sx = std::min(bx * 4 + x, width - 1);
+			memcpy(&block[(y * 4 + x) * 4], &rgba[(size_t(sy) * width + sx) * 4], 4);
+		}
+	}
+}
+
+static void encode_BC4(const unsigned char block[64], int channel, unsigned char out[8])
+{
+	unsigned char values[16];
+	for (int i = 0; i < 16; i++) { values[i] = block[i * 4 + channel]; }
+
+	uint8_t lo = 255;
+	uint8_t hi = 0;
+#ifdef __SSE2__
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+	__m128i vmin = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+	__m128i vmax = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+	vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+	vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+	vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 2));
+	vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 2));
+	vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 1));
+	vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 1));
+	lo = uint8_t(_mm_cvtsi128_si32(vmin) & 0xff);
+	hi = uint8_t(_mm_cvtsi128_si32(vmax) & 0xff);
+#else
+	for (int i = 0; i < 16; i++) {
+		lo = std::min(lo, values[i]);
+		hi = std::max(hi, values[i]);
+	}
+#endif
+
+	// 8 value mode: red0 > red1, palette runs from red0 to red1 in sevenths
+	out[0] = hi;
+	out[1] = lo;
+
+	uint64_t bits = 0;
+	if (hi > lo) {
+		const int range = hi - lo;
+		for (int i = 0; i < 16; i++) {
+			int step = ((hi - values[i]) * 7 + range / 2) / range;
+			uint64_t index = (step == 0) ? 0 : (step == 7) ? 1 : step + 1;
+			bits |= index << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; i++) { out[2 + i] = (bits >> (8 * i)) & 0xff; }
+}
+
+// quantize an endpoint to 7 bits plus a shared p-bit, picking the p-bit with the lowest error
+static void quantize_endpoint(const float endpoint[4], uint32_t quantized[4], uint32_t *pbit)
+{
+	float besterr = 1e30f;
+	for (uint32_t p = 0; p < 2; p++) {
+		uint32_t q[4];
+		float err = 0.f;
+		for (int c = 0; c < 4; c++) {
+			float v = (endpoint[c] - float(p)) * 0.5f;
+			q[c] = uint32_t(std::min(127.f, std::max(0.f, std::round(v))));
+			float d = float((q[c] << 1) | p) - endpoint[c];
+			err += d * d;
+		}
+		if (err < besterr) {
+			besterr = err;
+			memcpy(quantized, q, sizeof(q));
+			*pbit = p;
+		}
+	}
+}
+
+// mode 6: one subset, RGBA endpoints with p-bits and 4 bit indices
+static void encode_BC7(const unsigned char block[64], unsigned char out[16])
+{
+	alignas(16) float channels[4][16];
+	float mean[4] = { 0.f, 0.f, 0.f, 0.f };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			channels[c][i] = float(block[i * 4 + c]);
+			mean[c] += channels[c][i];
+		}
+	}
+	for (int c = 0; c < 4; c++) { mean[c] /= 16.f; }
+
+	// principal axis of the block colors through power iteration on the covariance
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		float d[4];
+		for (int c = 0; c < 4; c++) { d[c] = channels[c][i] - mean[c]; }
+		for (int r = 0; r < 4; r++) {
+			for (int c = 0; c < 4; c++) { cov[r][c] += d[r] * d[c]; }
+		}
+	}
+	float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4];
+		float largest = 0.f;
+		for (int r = 0; r < 4; r++) {
+			next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2] + cov[r][3] * axis[3];
+			largest = std::max(largest, std::abs(next[r]));
+		}
+		if (largest < 1e-6f) { break; }
+		for (int c = 0; c < 4; c++) { axis[c] = next[c] / largest; }
+	}
+
+	float tmin = 1e30f;
+	float tmax = -1e30f;
+	const float axislen = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+	for (int i = 0; i < 16; i++) {
+		float t = 0.f;
+		for (int c = 0; c < 4; c++) { t += (channels[c][i] - mean[c]) * axis[c]; }
+		t /= axislen;
+		tmin = std::min(tmin, t);
+		tmax = std::max(tmax, t);
+	}
+
+	float endpoints[2][4];
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] = std::min(255.f, std::max(0.f, mean[c] + tmin * axis[c]));
+		endpoints[1][c] = std::min(255.f, std::max(0.f, mean[c] + tmax * axis[c]));
+	}
+
+	uint32_t quantized[2][4];
+	uint32_t pbits[2];
+	quantize_endpoint(endpoints[0], quantized[0], &pbits[0]);
+	quantize_endpoint(endpoints[1], quantized[1], &pbits[1]);
+
+	// project every pixel onto the dequantized endpoint line to pick its index
+	float e0[4];
+	float delta[4];
+	float deltalen = 0.f;
+	for (int c = 0; c < 4; c++) {
+		e0[c] = float((quantized[0][c] << 1) | pbits[0]);
+		delta[c] = float((quantized[1][c] << 1) | pbits[1]) - e0[c];
+		deltalen += delta[c] * delta[c];
+	}
+	const float scale = (deltalen > 0.f) ? 15.f / deltalen : 0.f;
+
+	alignas(16) int32_t indices[16];
+#ifdef __SSE2__
+	for (int i = 0; i < 16; i += 4) {
+		__m128 t = _mm_setzero_ps();
+		for (int c = 0; c < 4; c++) {
+			__m128 d = _mm_sub_ps(_mm_load_ps(&channels[c][i]), _mm_set1_ps(e0[c]));
+			t = _mm_add_ps(t, _mm_mul_ps(d, _mm_set1_ps(delta[c])));
+		}
+		t = _mm_mul_ps(t, _mm_set1_ps(scale));
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(15.f));
+		_mm_store_si128(reinterpret_cast<__m128i*>(&indices[i]), _mm_cvtps_epi32(t));
+	}
+#else
+	for (int i = 0; i < 16; i++) {
+		float t = 0.f;
+		for (int c = 0; c < 4; c++) { t += (channels[c][i] - e0[c]) * delta[c]; }
+		indices[i] = int32_t(std::min(15.f, std::max(0.f, std::round(t * scale))));
+	}
+#endif
+
+	// the most significant bit of the first index is implicit and must be zero
+	if (indices[0] & 8) {
+		std::swap(quantized[0], quantized[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; i++) { indices[i] = 15 - indices[i]; }
+	}
+
+	memset(out, 0, 16);
+	struct bitwriter writer = { out };
+	writer.put(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.put(quantized[0][c], 7);
+		writer.put(quantized[1][c], 7);
+	}
+	writer.put(pbits[0], 1);
+	writer.put(pbits[1], 1);
+	writer.put(indices[0], 3);
+	for (int i = 1; i < 16; i++) { writer.put(indices[i], 4); }
+}
+
+static void compress_rows(enum bcn_format format, const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t firstrow, uint32_t lastrow, unsigned char *out)
+{
+	const uint32_t blocksx = (width + 3) / 4;
+	const size_t blocksize = bcn_block_size(format);
+
+	unsigned char block[64];
+	for (uint32_t by = firstrow; by < lastrow; by++) {
+		for (uint32_t bx = 0; bx < blocksx; bx++) {
+			unsigned char *dst = out + (size_t(by) * blocksx + bx) * blocksize;
+			fetch_block(rgba, width, height, bx, by, block);
+			switch (format) {
+			case BCN_BC4:
+				encode_BC4(block, 0, dst);
+				break;
+			case BCN_BC5:
+				encode_BC4(block, 0, dst);
+				encode_BC4(block, 1, dst + 8);
+				break;
+			case BCN_BC7:
+			case BCN_BC7_SRGB:
+				encode_BC7(block, dst);
+				break;
+			}
+		}
+	}
+}
+
+void bcn_compress(enum bcn_format format, const unsigned char *rgba, uint32_t width, uint32_t height, unsigned char *out)
+{
+	const uint32_t blocksy = (height + 3) / 4;
+
+	/* inside another parallel_for (texture imports, the optimizer) this runs serially on the calling worker */
+	const uint32_t nchunks = (blocksy + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+	parallel_for(nchunks, [&](size_t chunk) {
+		uint32_t first = uint32_t(chunk) * ROWS_PER_JOB;
+		uint32_t last = std::min(blocksy, first + ROWS_PER_JOB);
+		compress_rows(format, rgba, width, height, first, last, out);
+	});
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// block compression formats produced by the encoder
+enum bcn_format {
+	BCN_BC4, // single channel
+	BCN_BC5, // two channels, normal maps
+	BCN_BC7, // RGBA data such as metallic roughness
+	BCN_BC7_SRGB, // RGBA color, same blocks as BC7 but sampled as sRGB
+};
+
+// DXGI format of the DX10 DDS header
+uint32_t bcn_dxgi_format(enum bcn_format format);
+
+// bytes of a single 4x4 block
+size_t bcn_block_size(enum bcn_format format);
+
+// bytes of a compressed image of the given dimensions
+size_t bcn_image_size(enum bcn_format format, uint32_t width, uint32_t height);
+
+// compress RGBA8 pixels into blocks, rows of blocks are split across a parallel_for
+void bcn_compress(enum bcn_format format, const unsigned char *rgba, uint32_t width, uint32_t height, unsigned char *out);
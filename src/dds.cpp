@@ -1,42 +1,200 @@
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
+#include <algorithm>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "dds.hpp"
 
-unsigned char *load_DDS(const char *fpath, struct DDS *header)
+uint32_t DDS_block_size(const struct DDS *header)
 {
-	FILE *fp = fopen(fpath, "rb");
-	if (fp == nullptr) {
+	switch (header->dxt_codec) {
+	case FOURCC_DXT1:
+	case FOURCC_ATI1:
+	case FOURCC_BC4U:
+		return 8;
+	case FOURCC_DXT3:
+	case FOURCC_DXT5:
+	case FOURCC_ATI2:
+	case FOURCC_BC5U:
+		return 16;
+	case FOURCC_DX10:
+		switch (header->dxgi_format) {
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM:
+		case DXGI_FORMAT_BC4_SNORM:
+			return 8;
+		case DXGI_FORMAT_BC2_UNORM:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_UNORM:
+		case DXGI_FORMAT_BC5_SNORM:
+		case DXGI_FORMAT_BC6H_UF16:
+		case DXGI_FORMAT_BC6H_SF16:
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return 16;
+		}
+	}
+
+	return 0;
+}
+
+size_t DDS_level_size(const struct DDS *header, uint32_t level)
+{
+	size_t width = std::max(1u, header->width >> level);
+	size_t height = std::max(1u, header->height >> level);
+
+	return ((width + 3) / 4) * ((height + 3) / 4) * DDS_block_size(header);
+}
+
+size_t DDS_face_size(const struct DDS *header)
+{
+	size_t size = 0;
+	for (uint32_t level = 0; level < header->mip_levels; level++) {
+		size += DDS_level_size(header, level);
+	}
+
+	return size;
+}
+
+bool map_DDS(const char *fpath, struct DDS_file *file)
+{
+	int fd = open(fpath, O_RDONLY);
+	if (fd < 0) {
+		perror(fpath);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < 128) {
+		std::cerr << "error: " << fpath << " not a valid DDS file\n";
+		close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
 		perror(fpath);
-		return nullptr;
+		return false;
 	}
+	/* levels are uploaded front to back */
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	const unsigned char *bytes = static_cast<const unsigned char*>(mapping);
+	struct DDS *header = &file->header;
 
 	/* verify the type of file */
-	fread(header->identifier, 1, 4, fp);
+	memcpy(header->identifier, bytes, 4);
 	if (strncmp(header->identifier, "DDS ", 4) != 0) {
-		std::cerr << "error: " << fpath << "not a valid DDS file\n";
-		fclose(fp);
-		return nullptr;
+		std::cerr << "error: " << fpath << " not a valid DDS file\n";
+		munmap(mapping, st.st_size);
+		return false;
 	}
 
-	/* the header is 128 bytes, 124 after reading the file type */
-	unsigned char header_buf[124];
-	fread(&header_buf, 124, 1, fp);
+	/* the header is 128 bytes, 124 after the file type */
+	const unsigned char *header_buf = bytes + 4;
 	header->height = *(uint32_t*)&(header_buf[8]);
 	header->width = *(uint32_t*)&(header_buf[12]);
 	header->linear_size = *(uint32_t*)&(header_buf[16]);
 	header->mip_levels = *(uint32_t*)&(header_buf[24]);
 	header->dxt_codec = *(uint32_t*)&(header_buf[80]);
 	header->dwcaps2 = *(uint32_t*)&(header_buf[108]);
+	header->dxgi_format = 0;
+	header->array_size = 1;
+	header->cubemap = (header->dwcaps2 & DDSF_CUBEMAP) != 0;
+
+	size_t data_start = 128;
+	if (header->dxt_codec == FOURCC_DX10) {
+		if (size_t(st.st_size) < data_start + 20) {
+			std::cerr << "error: " << fpath << " has a truncated DX10 header\n";
+			munmap(mapping, st.st_size);
+			return false;
+		}
+		const unsigned char *dx10_buf = bytes + data_start;
+		header->dxgi_format = *(uint32_t*)&(dx10_buf[0]);
+		header->cubemap = (*(uint32_t*)&(dx10_buf[8]) & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+		header->array_size = std::max(1u, *(uint32_t*)&(dx10_buf[12]));
+		data_start += 20;
+	}
+
+	/* mip count is zero when the DDSD_MIPMAPCOUNT flag is missing */
+	uint32_t max_levels = 1;
+	while ((std::max(header->width, header->height) >> max_levels) > 0) { max_levels++; }
+	header->mip_levels = std::min(std::max(1u, header->mip_levels), max_levels);
+
+	if (DDS_block_size(header) == 0) {
+		std::cerr << "error: " << fpath << " has an unsupported pixel format\n";
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	/* every level of every face has to be present */
+	const size_t faces = header->cubemap ? 6 : 1;
+	header->data_size = DDS_face_size(header) * faces * header->array_size;
+	if (size_t(st.st_size) - data_start < header->data_size) {
+		std::cerr << "error: " << fpath << " is truncated\n";
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	file->data = bytes + data_start;
+	file->mapping = mapping;
+	file->mapping_size = st.st_size;
+
+	return true;
+}
+
+void unmap_DDS(struct DDS_file *file)
+{
+	if (file->mapping) {
+		munmap(file->mapping, file->mapping_size);
+	}
+	file->mapping = nullptr;
+	file->data = nullptr;
+}
+
+bool write_DDS(const char *fpath, const struct DDS *header, const unsigned char *data)
+{
+	FILE *fp = fopen(fpath, "wb");
+	if (fp == nullptr) {
+		perror(fpath);
+		return false;
+	}
+
+	/* same layout map_DDS reads, flags: caps | height | width | pixel format | mip count | linear size */
+	unsigned char header_buf[124] = {};
+	*(uint32_t*)&(header_buf[0]) = 124;
+	*(uint32_t*)&(header_buf[4]) = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	*(uint32_t*)&(header_buf[8]) = header->height;
+	*(uint32_t*)&(header_buf[12]) = header->width;
+	*(uint32_t*)&(header_buf[16]) = header->linear_size;
+	*(uint32_t*)&(header_buf[24]) = header->mip_levels;
+	*(uint32_t*)&(header_buf[72]) = 32; /* pixel format size */
+	*(uint32_t*)&(header_buf[76]) = 0x4; /* fourcc is set */
+	*(uint32_t*)&(header_buf[80]) = FOURCC_DX10;
+	*(uint32_t*)&(header_buf[104]) = 0x1000 | 0x400000 | 0x8; /* texture | mipmap | complex */
+	*(uint32_t*)&(header_buf[108]) = header->cubemap ? (DDSF_CUBEMAP | DDSF_CUBEMAP_ALL_FACES) : 0;
+
+	unsigned char dx10_buf[20] = {};
+	*(uint32_t*)&(dx10_buf[0]) = header->dxgi_format;
+	*(uint32_t*)&(dx10_buf[4]) = 3; /* 2D texture */
+	*(uint32_t*)&(dx10_buf[8]) = header->cubemap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	*(uint32_t*)&(dx10_buf[12]) = std::max(1u, header->array_size);
 
-	/* now get the actual image data */
-	unsigned char *image;
-	uint32_t len = (header->mip_levels > 1) ? (header->linear_size * 2) : header->linear_size;
-	image = new unsigned char[len];
-	fread(image, 1, len, fp);
+	bool written = fwrite("DDS ", 1, 4, fp) == 4;
+	written = written && fwrite(header_buf, 1, 124, fp) == 124;
+	written = written && fwrite(dx10_buf, 1, 20, fp) == 20;
+	written = written && fwrite(data, 1, header->data_size, fp) == header->data_size;
 
 	fclose(fp);
 
-	return image;
+	return written;
 }
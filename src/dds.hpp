@@ -2,6 +2,29 @@ enum {
 	FOURCC_DXT1 = 0x31545844, 
 	FOURCC_DXT3 = 0x33545844, 
 	FOURCC_DXT5 = 0x35545844,
+	FOURCC_ATI1 = 0x31495441, /* BC4 */
+	FOURCC_ATI2 = 0x32495441, /* BC5 */
+	FOURCC_BC4U = 0x55344342,
+	FOURCC_BC5U = 0x55354342,
+	FOURCC_DX10 = 0x30315844, /* extended header with a DXGI format follows */
+};
+
+// DXGI formats of the DX10 extended header
+enum {
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+	DXGI_FORMAT_BC2_UNORM = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_BC4_SNORM = 81,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC5_SNORM = 84,
+	DXGI_FORMAT_BC6H_UF16 = 95,
+	DXGI_FORMAT_BC6H_SF16 = 96,
+	DXGI_FORMAT_BC7_UNORM = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB = 99,
 };
 
 enum {
@@ -15,6 +38,11 @@ enum {
 	DDSF_CUBEMAP_ALL_FACES = 0x0000FC00,
 };
 
+// misc flag of the DX10 header
+enum {
+	DDS_RESOURCE_MISC_TEXTURECUBE = 0x4,
+};
+
 // DDS header
 struct DDS {
 	char identifier[4]; /* file type */
@@ -24,7 +52,32 @@ struct DDS {
 	uint32_t mip_levels;
 	uint32_t dxt_codec; /* compression type */
 	uint32_t dwcaps2;
+	uint32_t dxgi_format; /* only set if dxt_codec is FOURCC_DX10 */
+	uint32_t array_size; /* number of layers, the six faces of a cubemap count as one */
+	bool cubemap;
+	size_t data_size; /* bytes of image data after the header */
 };
 
-// cubemaps importing isn't supported
-unsigned char *load_DDS(const char *fpath, struct DDS *header);
+// a DDS file mapped into memory, data points at the first mip level of the first face
+struct DDS_file {
+	struct DDS header;
+	const unsigned char *data;
+	void *mapping;
+	size_t mapping_size;
+};
+
+// images are stored layer by layer, each face of a layer holds its full mip chain
+bool map_DDS(const char *fpath, struct DDS_file *file);
+void unmap_DDS(struct DDS_file *file);
+
+// bytes of a 4x4 block, 0 if the format isn't supported
+uint32_t DDS_block_size(const struct DDS *header);
+
+// bytes of a single mip level of one face
+size_t DDS_level_size(const struct DDS *header, uint32_t level);
+
+// bytes of the full mip chain of one face
+size_t DDS_face_size(const struct DDS *header);
+
+// writes a 2D texture or cubemap with a DX10 header, data holds all mip levels
+bool write_DDS(const char *fpath, const struct DDS *header, const unsigned char *data);
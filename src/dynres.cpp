@@ -0,0 +1,179 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "shader.hpp"
+#include "dynres.hpp"
+#include "memory.hpp"
+
+struct dynres_target gen_dynres_target(int width, int height)
+{
+	struct dynres_target target = {};
+	target.width = width;
+	target.height = height;
+	target.enabled = true;
+	target.target = DYNRES_DEFAULT_TARGET;
+	target.sharpness = 0.2f;
+	target.scale = DYNRES_MAX_SCALE;
+
+	glGenTextures(1, &target.color);
+	glBindTexture(GL_TEXTURE_2D, target.color);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &target.depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &target.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "error: dynamic resolution framebuffer incomplete, rendering at native resolution" << std::endl;
+		target.enabled = false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, target.color, texture_storage_size(GL_RGBA8, width, height, 1, 1), GL_RGBA8, "scene target");
+	gpu_memory_track(GPU_MEMORY_RENDERBUFFER, target.depth, texture_storage_size(GL_DEPTH24_STENCIL8, width, height, 1, 1), GL_DEPTH24_STENCIL8, "scene target");
+
+	glGenVertexArrays(1, &target.VAO);
+	glGenQueries(DYNRES_QUERIES, target.queries);
+
+	struct shaderinfo pipeline[] = {
+		{GL_VERTEX_SHADER, "usr/shaders/upscalev.glsl"},
+		{GL_FRAGMENT_SHADER, "usr/shaders/upscalef.glsl"},
+		{GL_NONE, NULL}
+	};
+	target.upscale = new Shader(pipeline);
+
+	return target;
+}
+
+void delete_dynres_target(struct dynres_target *target)
+{
+	delete target->upscale;
+	target->upscale = nullptr;
+	glDeleteQueries(DYNRES_QUERIES, target->queries);
+	glDeleteVertexArrays(1, &target->VAO);
+	glDeleteFramebuffers(1, &target->FBO);
+	gpu_memory_untrack(GPU_MEMORY_RENDERBUFFER, target->depth);
+	gpu_memory_untrack(GPU_MEMORY_TEXTURE, target->color);
+	glDeleteRenderbuffers(1, &target->depth);
+	glDeleteTextures(1, &target->color);
+}
+
+float next_scale(float scale, float gpums, float target)
+{
+	if (gpums <= 0.f || target <= 0.f) { return scale; }
+
+	// the time follows the rendered area, the square root gives the side
+	const float ideal = scale * std::sqrt(target / gpums);
+	// growing right below the target would only shrink again a few frames later
+	if (ideal > scale && gpums > DYNRES_HEADROOM * target) { return scale; }
+
+	// drops quickly when over budget and recovers slowly
+	const float step = glm::clamp(ideal - scale, -0.1f, 0.05f);
+	const float next = std::round((scale + step) * 100.f) / 100.f;
+
+	return glm::clamp(next, DYNRES_MIN_SCALE, DYNRES_MAX_SCALE);
+}
+
+static void scaled_size(const struct dynres_target *target, int *width, int *height)
+{
+	*width = std::max(1, int(float(target->width) * target->scale + 0.5f));
+	*height = std::max(1, int(float(target->height) * target->scale + 0.5f));
+}
+
+// reads a finished query into the moving average, waits for it if block is set
+static bool collect_query(struct dynres_target *target, uint32_t slot, bool block)
+{
+	if (!target->issued[slot]) { return true; }
+
+	GLint available = GL_TRUE;
+	if (!block) { glGetQueryObjectiv(target->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available); }
+	if (!available) { return false; }
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(target->queries[slot], GL_QUERY_RESULT, &elapsed);
+	target->issued[slot] = false;
+
+	const float ms = float(double(elapsed) * 1e-6);
+	target->gpums = target->gpums > 0.f ? glm::mix(target->gpums, ms, 0.2f) : ms;
+
+	return true;
+}
+
+static void update_scale(struct dynres_target *target)
+{
+	// oldest first, the rest stays in flight
+	for (uint32_t i = 0; i < DYNRES_QUERIES; i++) {
+		if (!collect_query(target, (target->next + i) % DYNRES_QUERIES, false)) { break; }
+	}
+
+	target->frames++;
+	if (!target->enabled) {
+		target->scale = DYNRES_MAX_SCALE;
+		return;
+	}
+	if (target->frames < DYNRES_INTERVAL) { return; }
+
+	const float scale = next_scale(target->scale, target->gpums, target->target);
+	if (scale != target->scale) {
+		if (target->log) {
+			printf("dynres: scene %.2f ms, target %.2f ms, scale %.2f -> %.2f\n", target->gpums, target->target, target->scale, scale);
+		}
+		target->scale = scale;
+		target->frames = 0;
+	}
+}
+
+void begin_scene(struct dynres_target *target)
+{
+	collect_query(target, target->next, true);
+
+	int width, height;
+	scaled_size(target, &width, &height);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->FBO);
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glBeginQuery(GL_TIME_ELAPSED, target->queries[target->next]);
+}
+
+void end_scene(struct dynres_target *target)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	target->issued[target->next] = true;
+	target->next = (target->next + 1) % DYNRES_QUERIES;
+
+	int width, height;
+	scaled_size(target, &width, &height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, target->width, target->height);
+	glDisable(GL_DEPTH_TEST);
+	target->upscale->bind();
+	target->upscale->uniform_vec2("region", glm::vec2(float(width) / target->width, float(height) / target->height));
+	target->upscale->uniform_vec2("texel", glm::vec2(1.f / target->width, 1.f / target->height));
+	// sharpening a native image would only add noise
+	target->upscale->uniform_float("sharpness", width < target->width ? target->sharpness : 0.f);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, target->color);
+	glBindVertexArray(target->VAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+
+	update_scale(target);
+}
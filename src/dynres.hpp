@@ -0,0 +1,43 @@
+#pragma once
+
+// the scene renders to a scaled offscreen target that is upscaled to the window, the UI stays at native resolution
+#define DYNRES_MIN_SCALE 0.5f
+#define DYNRES_MAX_SCALE 1.f
+#define DYNRES_DEFAULT_TARGET 14.f /* ms of GPU time for the scene, leaves room for the UI at 60 Hz */
+#define DYNRES_QUERIES 4 /* timer queries in flight, read back a few frames late so they never stall */
+#define DYNRES_INTERVAL 8 /* frames between scale changes so the average settles first */
+#define DYNRES_HEADROOM 0.85f /* the scale only grows while the scene takes less than this part of the target */
+
+class Shader;
+
+struct dynres_target {
+	int width; /* native size, the scene texture is this big */
+	int height;
+	GLuint FBO;
+	GLuint color;
+	GLuint depth;
+	GLuint VAO; /* empty, the upscale draws a fullscreen triangle */
+	Shader *upscale;
+	GLuint queries[DYNRES_QUERIES];
+	bool issued[DYNRES_QUERIES];
+	uint32_t next;
+	// controller state
+	bool enabled;
+	float target;
+	float sharpness;
+	float scale;
+	float gpums; /* moving average of the scene time */
+	uint32_t frames; /* since the last scale change */
+	bool log; /* prints every decision of the controller */
+};
+
+struct dynres_target gen_dynres_target(int width, int height);
+void delete_dynres_target(struct dynres_target *target);
+
+// binds the offscreen target at the current scale and starts timing the scene
+void begin_scene(struct dynres_target *target);
+// stops timing and upscales into the default framebuffer
+void end_scene(struct dynres_target *target);
+
+// next scale from the measured scene time, pixels are assumed to cost the same so time follows the area
+float next_scale(float scale, float gpums, float target);
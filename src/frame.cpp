@@ -0,0 +1,216 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "external/imgui.h"
+#include "external/imgui_impl_opengl3.h"
+
+#include "shader.hpp"
+#include "gltf.h"
+#include "ibl.hpp"
+#include "frame.hpp"
+#include "lightbuffers.hpp"
+#include "profiler.hpp"
+
+void frame_queue::push(struct frame_packet &&packet)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return closed || packets.size() < FRAMES_IN_FLIGHT; });
+	if (closed) { return; }
+	packets.push_back(std::move(packet));
+	changed.notify_all();
+}
+
+bool frame_queue::pop(struct frame_packet &packet)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return closed || !packets.empty(); });
+	if (closed) { return false; }
+	packet = std::move(packets.front());
+	packets.pop_front();
+	changed.notify_all();
+
+	return true;
+}
+
+void frame_queue::flush(void)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return closed || packets.empty(); });
+}
+
+void frame_queue::close(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	closed = true;
+	changed.notify_all();
+}
+
+std::vector<struct frame_packet> frame_queue::drain(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<struct frame_packet> remaining;
+	for (struct frame_packet &packet : packets) { remaining.push_back(std::move(packet)); }
+	packets.clear();
+
+	return remaining;
+}
+
+// ImGui reuses its draw lists next frame, the packet keeps copies
+// they are plain vectors, ImGui allocations would count themselves in the context the simulation is using
+void record_ui(struct frame_packet &packet)
+{
+	ImDrawData *data = ImGui::GetDrawData();
+	packet.ui.clear();
+	for (int i = 0; i < data->CmdListsCount; i++) {
+		const ImDrawList *list = data->CmdLists[i];
+		struct ui_list copy;
+		copy.commands.assign(list->CmdBuffer.begin(), list->CmdBuffer.end());
+		copy.vertices.assign(list->VtxBuffer.begin(), list->VtxBuffer.end());
+		copy.indices.assign(list->IdxBuffer.begin(), list->IdxBuffer.end());
+		packet.ui.push_back(std::move(copy));
+	}
+	packet.uiwidth = data->DisplaySize.x;
+	packet.uiheight = data->DisplaySize.y;
+}
+
+// the draw lists only borrow the packet's buffers and hand them back before they are destroyed, nothing is allocated
+// through ImGui here
+void render_ui(struct frame_packet &packet)
+{
+	std::vector<ImDrawList> lists;
+	std::vector<ImDrawList*> pointers;
+	lists.reserve(packet.ui.size());
+	for (struct ui_list &copy : packet.ui) {
+		lists.emplace_back(nullptr);
+		ImDrawList *list = &lists.back();
+		list->CmdBuffer.Data = copy.commands.data();
+		list->CmdBuffer.Size = list->CmdBuffer.Capacity = int(copy.commands.size());
+		list->VtxBuffer.Data = copy.vertices.data();
+		list->VtxBuffer.Size = list->VtxBuffer.Capacity = int(copy.vertices.size());
+		list->IdxBuffer.Data = copy.indices.data();
+		list->IdxBuffer.Size = list->IdxBuffer.Capacity = int(copy.indices.size());
+		pointers.push_back(list);
+	}
+
+	ImDrawData data;
+	data.Valid = true;
+	data.CmdLists = pointers.data();
+	data.CmdListsCount = int(pointers.size());
+	for (const struct ui_list &copy : packet.ui) {
+		data.TotalVtxCount += int(copy.vertices.size());
+		data.TotalIdxCount += int(copy.indices.size());
+	}
+	data.DisplayPos = ImVec2(0.f, 0.f);
+	data.DisplaySize = ImVec2(packet.uiwidth, packet.uiheight);
+	data.FramebufferScale = ImVec2(1.f, 1.f);
+
+	ImGui_ImplOpenGL3_RenderDrawData(&data);
+
+	for (ImDrawList &list : lists) {
+		list.CmdBuffer.Data = nullptr;
+		list.VtxBuffer.Data = nullptr;
+		list.IdxBuffer.Data = nullptr;
+	}
+}
+
+void render_draws(struct frame_packet &packet)
+{
+	PROFILE_SCOPE("submit");
+	poll_variants();
+
+	// grouped by variant to switch programs as little as possible, blending needs the opaque draws behind it first
+	// and the blended ones back to front
+	const glm::vec3 campos = packet.campos;
+	std::stable_sort(packet.draws.begin(), packet.draws.end(), [campos](const struct draw_t &a, const struct draw_t &b) {
+		const bool ablend = a.features & FEATURE_ALPHA_BLEND;
+		const bool bblend = b.features & FEATURE_ALPHA_BLEND;
+		if (ablend != bblend) { return bblend; }
+		if (ablend) { return glm::dot(a.center - campos, a.center - campos) > glm::dot(b.center - campos, b.center - campos); }
+		return a.features < b.features;
+	});
+
+	upload_clusters(packet.clusters);
+
+	Shader *shader = nullptr;
+	bool blending = false;
+	for (const struct draw_t &draw : packet.draws) {
+		Shader *variant = variant_shader(draw.features);
+		if (variant == nullptr) { continue; }
+		if (variant != shader) {
+			shader = variant;
+			shader->bind();
+			shader->uniform_mat4("project", packet.project);
+			shader->uniform_mat4("view", packet.view);
+			shader->uniform_vec3("campos", packet.campos);
+			shader->uniform_uint("directionalcount", packet.clusters.directional);
+			shader->uniform_vec4("clustergrid", packet.clusters.grid);
+			bind_environment(shader);
+		}
+		if (!blending && (draw.features & FEATURE_ALPHA_BLEND)) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+			blending = true;
+		}
+
+		geometry_bind(&draw.geometry);
+		shader->uniform_mat4("model", draw.model);
+		if (draw.features & FEATURE_SKINNED) {
+			shader->uniform_array_mat4("u_joint_matrix", draw.jointcount, &packet.palettes[draw.palette]);
+		} else {
+			shader->uniform_mat3("normalmatrix", glm::transpose(glm::inverse(glm::mat3(draw.model))));
+		}
+		shader->uniform_vec3("basedcolor", draw.basecolor);
+		shader->uniform_float("basealpha", draw.basealpha);
+		shader->uniform_float("metallicfactor", draw.metallic);
+		shader->uniform_float("roughnessfactor", draw.roughness);
+		shader->uniform_float("alphacutoff", draw.alphacutoff);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, draw.basecolormap.texture);
+		glBindSampler(0, draw.basecolormap.sampler);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, draw.metalroughmap.texture);
+		glBindSampler(1, draw.metalroughmap.sampler);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, draw.normalmap.texture);
+		glBindSampler(2, draw.normalmap.sampler);
+
+		if (draw.indexed == false) {
+			glDrawArrays(GL_TRIANGLES, draw.firstvertex, draw.count);
+		} else {
+			glDrawElementsBaseVertex(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, (GLvoid *)(draw.firstindex*sizeof(GL_UNSIGNED_INT)), draw.firstvertex);
+		}
+	}
+
+	if (blending) {
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+	}
+	// don't let the shared samplers override other textures on these units
+	for (GLuint unit = 0; unit < 3; unit++) { glBindSampler(unit, 0); }
+}
+
+static struct {
+	std::mutex lock;
+	struct render_stats stats = {};
+} published;
+
+void publish_stats(const struct render_stats &stats)
+{
+	std::lock_guard<std::mutex> guard(published.lock);
+	published.stats = stats;
+}
+
+struct render_stats latest_stats(void)
+{
+	std::lock_guard<std::mutex> guard(published.lock);
+	return published.stats;
+}
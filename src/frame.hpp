@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "external/imgui.h"
+
+#include "streaming.hpp"
+#include "variants.hpp"
+#include "lighting.hpp"
+
+// frames the simulation may record ahead of the GL thread
+#define FRAMES_IN_FLIGHT 2
+
+// commands and buffers of one ImGui draw list, copied out of the ImGui context
+struct ui_list {
+	std::vector<ImDrawCmd> commands;
+	std::vector<ImDrawVert> vertices;
+	std::vector<ImDrawIdx> indices;
+};
+
+// one primitive with everything the GL thread needs to draw it
+struct draw_t {
+	struct geometry_t geometry;
+	glm::mat4 model;
+	glm::vec3 center; /* of the primitive bounds in world space, blended draws are sorted by it */
+	uint32_t features; /* shader_feature bits, picks the program */
+	uint32_t palette; /* first joint matrix in the palettes of the frame */
+	uint32_t jointcount;
+	bool indexed;
+	GLint firstvertex;
+	uint32_t firstindex;
+	GLsizei count;
+	glm::vec3 basecolor;
+	float basealpha;
+	float metallic;
+	float roughness;
+	float alphacutoff;
+	gltf::texture_t basecolormap;
+	gltf::texture_t metalroughmap;
+	gltf::texture_t normalmap;
+};
+
+// everything recorded by the simulation for one frame, read only once it is queued
+struct frame_packet {
+	glm::mat4 project;
+	glm::mat4 view;
+	glm::vec3 campos;
+	std::vector<struct draw_t> draws;
+	std::vector<glm::mat4> palettes;
+	// world space lights of the models, binned into clusters before the packet is queued
+	std::vector<struct light_data> lights;
+	struct light_clusters clusters;
+	std::vector<struct mip_request> mips;
+	// GL work of the simulation like loading and unloading models, runs before anything is drawn
+	std::vector<std::function<void()>> tasks;
+	// ImGui draw lists, the GL thread never touches the ImGui context the simulation builds the next frame in
+	std::vector<struct ui_list> ui;
+	float uiwidth;
+	float uiheight;
+	int32_t frame = -1; /* replay frame the packet draws, -1 outside of replays */
+};
+
+// GL side numbers for the debug UI of the simulation
+struct render_stats {
+	struct geometry_stats geometry;
+	struct stream_stats stream;
+	struct variant_stats variants;
+	float msperframe;
+	float resolution; /* scale of the scene target */
+	float scenems; /* GPU time of the scene */
+};
+
+// bounded queue between the simulation and the GL thread
+struct frame_queue {
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<struct frame_packet> packets;
+	bool closed = false;
+
+	// blocks while FRAMES_IN_FLIGHT packets are waiting
+	void push(struct frame_packet &&packet);
+	// blocks until a packet arrives, false once the queue is closed
+	bool pop(struct frame_packet &packet);
+	// blocks until the GL thread took every waiting packet
+	void flush(void);
+	void close(void);
+	// packets the GL thread never got to
+	std::vector<struct frame_packet> drain(void);
+};
+
+void record_ui(struct frame_packet &packet);
+void render_ui(struct frame_packet &packet);
+
+// draws with the shader variant of each draw, opaque ones first and blended ones last
+void render_draws(struct frame_packet &packet);
+
+void publish_stats(const struct render_stats &stats);
+struct render_stats latest_stats(void);
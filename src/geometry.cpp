@@ -0,0 +1,411 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "geometry.hpp"
+#include "memory.hpp"
+
+// free ranges of a block, by offset to merge neighbours and by size for best fit
+struct freelist {
+	std::map<uint32_t, uint32_t> ranges;
+	std::multimap<uint32_t, uint32_t> sizes;
+
+	void insert(uint32_t first, uint32_t count)
+	{
+		ranges[first] = count;
+		sizes.emplace(count, first);
+	}
+
+	void erase(std::map<uint32_t, uint32_t>::iterator range)
+	{
+		auto bysize = sizes.equal_range(range->second);
+		for (auto it = bysize.first; it != bysize.second; ++it) {
+			if (it->second == range->first) {
+				sizes.erase(it);
+				break;
+			}
+		}
+		ranges.erase(range);
+	}
+
+	bool alloc(uint32_t count, uint32_t *first)
+	{
+		auto best = sizes.lower_bound(count);
+		if (best == sizes.end()) { return false; }
+
+		const uint32_t size = best->first;
+		*first = best->second;
+		sizes.erase(best);
+		ranges.erase(*first);
+		if (size > count) { insert(*first + count, size - count); }
+
+		return true;
+	}
+
+	void release(uint32_t first, uint32_t count)
+	{
+		auto next = ranges.lower_bound(first);
+		if (next != ranges.end() && first + count == next->first) {
+			count += next->second;
+			erase(next);
+		}
+		auto prev = ranges.lower_bound(first);
+		if (prev != ranges.begin()) {
+			--prev;
+			if (prev->first + prev->second == first) {
+				first = prev->first;
+				count += prev->second;
+				erase(prev);
+			}
+		}
+		insert(first, count);
+	}
+};
+
+struct block_t {
+	GLuint buffer;
+	uint32_t capacity; /* in elements */
+	uint32_t used;
+	uint32_t allocations;
+	struct freelist free;
+};
+
+struct pool_t {
+	size_t stride;
+	uint32_t blocksize;
+	std::vector<block_t> blocks;
+};
+
+// freed ranges wait for the frames that may still draw from them before they are reused
+struct retired_range {
+	struct pool_t *pool;
+	struct geometry_range range;
+};
+
+struct retire_batch {
+	GLsync fence;
+	std::vector<struct retired_range> ranges;
+};
+
+static struct {
+	bool initialized = false;
+	GLuint VAOs[VERTEX_FORMAT_COUNT] = {};
+	struct pool_t vertices[VERTEX_FORMAT_COUNT];
+	struct pool_t indices;
+	std::vector<struct retired_range> freed; /* since the last geometry_retire */
+	std::deque<struct retire_batch> retired; /* oldest fence first */
+} arena;
+
+size_t vertex_stride(enum vertex_format format)
+{
+	switch (format) {
+	case VERTEX_FORMAT_MESH: return sizeof(struct vertex);
+	case VERTEX_FORMAT_COUNT: break;
+	}
+
+	return 0;
+}
+
+// attribute layout without a buffer, the vertex buffer of a block is attached on bind
+static GLuint gen_format_VAO(enum vertex_format format)
+{
+	GLuint VAO;
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+
+	switch (format) {
+	case VERTEX_FORMAT_MESH:
+		// positions
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, position));
+		// normals
+		glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, normal));
+		// texcoords
+		glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, offsetof(vertex, uv));
+		// joints
+		glVertexAttribIFormat(3, 4, GL_UNSIGNED_INT, offsetof(vertex, joints));
+		// weights
+		glVertexAttribFormat(4, 4, GL_FLOAT, GL_FALSE, offsetof(vertex, weights));
+		for (GLuint attrib = 0; attrib < 5; attrib++) {
+			glVertexAttribBinding(attrib, 0);
+			glEnableVertexAttribArray(attrib);
+		}
+		break;
+	case VERTEX_FORMAT_COUNT:
+		break;
+	}
+
+	glBindVertexArray(0);
+
+	return VAO;
+}
+
+static void init_arena(void)
+{
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+		arena.VAOs[format] = gen_format_VAO(vertex_format(format));
+		arena.vertices[format].stride = vertex_stride(vertex_format(format));
+		arena.vertices[format].blocksize = GEOMETRY_VERTEX_BLOCK;
+	}
+	arena.indices.stride = sizeof(uint32_t);
+	arena.indices.blocksize = GEOMETRY_INDEX_BLOCK;
+
+	arena.initialized = true;
+}
+
+static bool add_block(struct pool_t *pool, uint32_t capacity)
+{
+	block_t block = {};
+	block.capacity = capacity;
+
+	glGenBuffers(1, &block.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, GLsizeiptr(capacity * pool->stride), nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (glGetError() == GL_OUT_OF_MEMORY) {
+		std::cerr << "error: out of memory for a geometry block of " << capacity * pool->stride << " bytes" << std::endl;
+		glDeleteBuffers(1, &block.buffer);
+		return false;
+	}
+
+	gpu_memory_track(GPU_MEMORY_BUFFER, block.buffer, size_t(capacity) * pool->stride, GL_NONE, pool == &arena.indices ? "index block" : "vertex block");
+	block.free.insert(0, capacity);
+	pool->blocks.push_back(std::move(block));
+
+	return true;
+}
+
+static bool pool_alloc(struct pool_t *pool, uint32_t count, struct geometry_range *range)
+{
+	*range = geometry_range{};
+	if (count == 0) { return true; }
+
+	uint32_t first = 0;
+	for (uint32_t i = 0; i < pool->blocks.size(); i++) {
+		if (pool->blocks[i].free.alloc(count, &first)) {
+			range->block = i;
+			break;
+		}
+	}
+
+	if (range->block == GEOMETRY_NO_BLOCK) {
+		/* larger allocations than a block get a block of their own */
+		if (!add_block(pool, std::max(count, pool->blocksize))) { return false; }
+		range->block = uint32_t(pool->blocks.size() - 1);
+		pool->blocks.back().free.alloc(count, &first);
+	}
+
+	block_t &block = pool->blocks[range->block];
+	block.used += count;
+	block.allocations++;
+	range->first = first;
+	range->count = count;
+
+	return true;
+}
+
+static void pool_free(struct pool_t *pool, struct geometry_range *range)
+{
+	if (range->block == GEOMETRY_NO_BLOCK) { return; }
+
+	block_t &block = pool->blocks[range->block];
+	block.free.release(range->first, range->count);
+	block.used -= range->count;
+	block.allocations--;
+
+	*range = geometry_range{};
+}
+
+bool geometry_alloc(enum vertex_format format, uint32_t vertexcount, uint32_t indexcount, struct geometry_t *geometry)
+{
+	if (!arena.initialized) { init_arena(); }
+
+	*geometry = geometry_t{};
+	geometry->format = format;
+	if (!pool_alloc(&arena.vertices[format], vertexcount, &geometry->vertices)) { return false; }
+	if (!pool_alloc(&arena.indices, indexcount, &geometry->indices)) {
+		pool_free(&arena.vertices[format], &geometry->vertices);
+		return false;
+	}
+
+	return true;
+}
+
+void geometry_free(struct geometry_t *geometry)
+{
+	if (!arena.initialized) { return; }
+
+	if (geometry->vertices.block != GEOMETRY_NO_BLOCK) { arena.freed.push_back({ &arena.vertices[geometry->format], geometry->vertices }); }
+	if (geometry->indices.block != GEOMETRY_NO_BLOCK) { arena.freed.push_back({ &arena.indices, geometry->indices }); }
+	geometry->vertices = geometry_range{};
+	geometry->indices = geometry_range{};
+}
+
+void geometry_retire(void)
+{
+	if (!arena.initialized) { return; }
+
+	if (!arena.freed.empty()) {
+		struct retire_batch batch;
+		batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		batch.ranges.swap(arena.freed);
+		arena.retired.push_back(std::move(batch));
+	}
+
+	// fences signal in submission order
+	while (!arena.retired.empty()) {
+		struct retire_batch &batch = arena.retired.front();
+		const GLenum status = glClientWaitSync(batch.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) { break; }
+		for (struct retired_range &retired : batch.ranges) { pool_free(retired.pool, &retired.range); }
+		glDeleteSync(batch.fence);
+		arena.retired.pop_front();
+	}
+}
+
+static void upload_range(const struct pool_t *pool, const struct geometry_range *range, const void *data)
+{
+	if (range->block == GEOMETRY_NO_BLOCK || data == nullptr) { return; }
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool->blocks[range->block].buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(range->first * pool->stride), GLsizeiptr(range->count * pool->stride), data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void geometry_upload(const struct geometry_t *geometry, const void *vertices, const uint32_t *indices)
+{
+	upload_range(&arena.vertices[geometry->format], &geometry->vertices, vertices);
+	upload_range(&arena.indices, &geometry->indices, indices);
+}
+
+static void *map_range(const struct pool_t *pool, const struct geometry_range *range)
+{
+	if (range->block == GEOMETRY_NO_BLOCK) { return nullptr; }
+
+	/* freed ranges are only reused once the GPU is done with them, see geometry_retire */
+	const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool->blocks[range->block].buffer);
+	void *mapping = glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(range->first * pool->stride), GLsizeiptr(range->count * pool->stride), access);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	return mapping;
+}
+
+static void unmap_range(const struct pool_t *pool, const struct geometry_range *range)
+{
+	if (range->block == GEOMETRY_NO_BLOCK) { return; }
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pool->blocks[range->block].buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool geometry_map(const struct geometry_t *geometry, void **vertices, uint32_t **indices)
+{
+	const struct pool_t *pool = &arena.vertices[geometry->format];
+	*vertices = map_range(pool, &geometry->vertices);
+	*indices = static_cast<uint32_t*>(map_range(&arena.indices, &geometry->indices));
+
+	bool mapped = (*vertices || geometry->vertices.count == 0) && (*indices || geometry->indices.count == 0);
+	if (!mapped) {
+		if (*vertices) { unmap_range(pool, &geometry->vertices); }
+		if (*indices) { unmap_range(&arena.indices, &geometry->indices); }
+		*vertices = nullptr;
+		*indices = nullptr;
+	}
+
+	return mapped;
+}
+
+void geometry_unmap(const struct geometry_t *geometry)
+{
+	unmap_range(&arena.vertices[geometry->format], &geometry->vertices);
+	unmap_range(&arena.indices, &geometry->indices);
+}
+
+void geometry_bind(const struct geometry_t *geometry)
+{
+	const struct pool_t &pool = arena.vertices[geometry->format];
+	glBindVertexArray(arena.VAOs[geometry->format]);
+	if (geometry->vertices.block != GEOMETRY_NO_BLOCK) {
+		glBindVertexBuffer(0, pool.blocks[geometry->vertices.block].buffer, 0, GLsizei(pool.stride));
+	}
+	if (geometry->indices.block != GEOMETRY_NO_BLOCK) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indices.blocks[geometry->indices.block].buffer);
+	}
+}
+
+static struct geometry_pool_stats pool_statistics(const struct pool_t *pool)
+{
+	struct geometry_pool_stats stats = {};
+	size_t totalfree = 0;
+	for (const block_t &block : pool->blocks) {
+		stats.blocks++;
+		stats.capacity += block.capacity * pool->stride;
+		stats.used += block.used * pool->stride;
+		stats.allocations += block.allocations;
+		stats.free_ranges += block.free.ranges.size();
+		if (!block.free.sizes.empty()) {
+			stats.largest_free = std::max(stats.largest_free, block.free.sizes.rbegin()->first * pool->stride);
+		}
+		totalfree += (block.capacity - block.used) * pool->stride;
+	}
+	stats.fragmentation = (totalfree > 0) ? 1.f - float(stats.largest_free) / float(totalfree) : 0.f;
+
+	return stats;
+}
+
+struct geometry_stats geometry_statistics(void)
+{
+	struct geometry_stats stats = {};
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+		stats.vertices[format] = pool_statistics(&arena.vertices[format]);
+	}
+	stats.indices = pool_statistics(&arena.indices);
+
+	return stats;
+}
+
+static void print_pool(const char *name, const struct geometry_pool_stats *stats)
+{
+	printf("%-8s %zu blocks, %.1f / %.1f MB used, %zu allocations, %zu free ranges, largest free %.1f MB, fragmentation %.2f\n",
+		name, stats->blocks, double(stats->used) / (1 << 20), double(stats->capacity) / (1 << 20),
+		stats->allocations, stats->free_ranges, double(stats->largest_free) / (1 << 20), stats->fragmentation);
+}
+
+void geometry_report(void)
+{
+	struct geometry_stats stats = geometry_statistics();
+	print_pool("vertices", &stats.vertices[VERTEX_FORMAT_MESH]);
+	print_pool("indices", &stats.indices);
+}
+
+void geometry_shutdown(void)
+{
+	if (!arena.initialized) { return; }
+
+	for (struct retire_batch &batch : arena.retired) { glDeleteSync(batch.fence); }
+	arena.retired.clear();
+	arena.freed.clear();
+
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+		for (block_t &block : arena.vertices[format].blocks) {
+			gpu_memory_untrack(GPU_MEMORY_BUFFER, block.buffer);
+			glDeleteBuffers(1, &block.buffer);
+		}
+		arena.vertices[format].blocks.clear();
+		glDeleteVertexArrays(1, &arena.VAOs[format]);
+	}
+	for (block_t &block : arena.indices.blocks) {
+		gpu_memory_untrack(GPU_MEMORY_BUFFER, block.buffer);
+		glDeleteBuffers(1, &block.buffer);
+	}
+	arena.indices.blocks.clear();
+
+	arena.initialized = false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// vertices of every format live in a few large buffers, a new block is created when all are full
+#define GEOMETRY_VERTEX_BLOCK (1u << 19)
+#define GEOMETRY_INDEX_BLOCK (1u << 23)
+
+#define GEOMETRY_NO_BLOCK 0xffffffffu
+
+struct vertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+	glm::ivec4 joints;
+	glm::vec4 weights;
+};
+
+// every vertex format has one VAO shared by all models
+enum vertex_format {
+	VERTEX_FORMAT_MESH, /* struct vertex */
+	VERTEX_FORMAT_COUNT
+};
+
+// range of elements (vertices or indices) inside one block of a pool
+struct geometry_range {
+	uint32_t block = GEOMETRY_NO_BLOCK;
+	uint32_t first = 0;
+	uint32_t count = 0;
+};
+
+struct geometry_t {
+	enum vertex_format format = VERTEX_FORMAT_MESH;
+	struct geometry_range vertices;
+	struct geometry_range indices;
+};
+
+struct geometry_pool_stats {
+	size_t blocks;
+	size_t capacity; /* in bytes */
+	size_t used;
+	size_t allocations;
+	size_t free_ranges;
+	size_t largest_free;
+	float fragmentation; /* 1 - largest free range / total free */
+};
+
+struct geometry_stats {
+	struct geometry_pool_stats vertices[VERTEX_FORMAT_COUNT];
+	struct geometry_pool_stats indices;
+};
+
+size_t vertex_stride(enum vertex_format format);
+
+// returns false if the GL buffers can't be created, vertex data is left undefined
+bool geometry_alloc(enum vertex_format format, uint32_t vertexcount, uint32_t indexcount, struct geometry_t *geometry);
+// the ranges are reused once the frames submitted before the next geometry_retire are done with them
+void geometry_free(struct geometry_t *geometry);
+// fences the ranges freed since the last call and recycles the ones whose fence signaled, once per frame on the GL thread
+void geometry_retire(void);
+void geometry_upload(const struct geometry_t *geometry, const void *vertices, const uint32_t *indices);
+
+// write-only mapping of both ranges so loaders can decode in place, only for ranges the GPU isn't reading yet
+bool geometry_map(const struct geometry_t *geometry, void **vertices, uint32_t **indices);
+void geometry_unmap(const struct geometry_t *geometry);
+
+// binds the VAO of the format and the buffers of both ranges, draws use the range firsts as base vertex and index offset
+void geometry_bind(const struct geometry_t *geometry);
+
+struct geometry_stats geometry_statistics(void);
+void geometry_report(void);
+void geometry_shutdown(void);
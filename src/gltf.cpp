@@ -3,6 +3,8 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <mutex>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -16,98 +18,219 @@
 
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
+#include "external/tiny_gltf.h"
+/* headers that include tiny_gltf.h again only need its declarations */
+#undef TINYGLTF_IMPLEMENTATION
 
+#include "dds.hpp"
 #include "texture.hpp"
+#include "texcache.hpp"
+#include "ktx.hpp"
+#include "parallel.hpp"
+#include "streaming.hpp"
 #include "shader.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+#include "memory.hpp"
 #include "gltf.h"
+#include "gltfreader.hpp"
+#include "accessor.hpp"
+#include "frame.hpp"
+
+// destination of the decoded vertices and indices of a model, usually a mapping of its geometry ranges
+struct gltf::geometry_writer {
+	vertex *vertices = nullptr;
+	uint32_t *indices = nullptr;
+	uint32_t vertexcount = 0;
+	uint32_t indexcount = 0;
+	// primitives left that read each glTF buffer, the buffer is released when it reaches zero
+	std::vector<uint32_t> bufferuses;
+	tinygltf::Model *model = nullptr;
+	const struct gltf_names *names = nullptr;
+};
 
-#define BUFFER_OFFSET(i) ((char *)NULL + (i))
-
-static GLuint bind_VAO(std::vector<uint32_t> &indexbuffer, std::vector<vertex> &vertexbuffer)
-{
-	GLuint VAO;
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
-
-	GLuint EBO;
-	glGenBuffers(1, &EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t)*indexbuffer.size(), indexbuffer.data(), GL_STATIC_DRAW);
-
-	GLuint VBO;
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex)*vertexbuffer.size(), vertexbuffer.data(), GL_STATIC_DRAW);
-	// positions
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), BUFFER_OFFSET(offsetof(vertex, position)));
-	glEnableVertexAttribArray(0);
-	// normals
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), BUFFER_OFFSET(offsetof(vertex, normal)));
-	glEnableVertexAttribArray(1);
-	// texcoords
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), BUFFER_OFFSET(offsetof(vertex, uv)));
-	glEnableVertexAttribArray(2);
-	// joints
-	glVertexAttribIPointer(3, 4, GL_UNSIGNED_INT, sizeof(vertex), BUFFER_OFFSET(offsetof(vertex, joints)));
-	glEnableVertexAttribArray(3);
-	// weights
-	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), BUFFER_OFFSET(offsetof(vertex, weights)));
-	glEnableVertexAttribArray(4);
-
-	return VAO;
-}
-
-static GLuint load_gltf_image(tinygltf::Image &gltfimage)
-{
-	GLuint texture;
-
-	struct image_t image;
-	image.nchannels = gltfimage.component;
-	image.width = gltfimage.width;
-	image.height = gltfimage.height;
-	image.data = &gltfimage.image[0];
-
-	GLenum format = GL_RGBA;
-	GLenum internalformat = GL_RGB5_A1;
-
-	if (gltfimage.component == 1) {
-		format = GL_RED;
-	} else if (gltfimage.component == 2) {
-		format = GL_RG;
-	} else if (gltfimage.component == 3) {
-		format = GL_RGB;
-	}
-
-	texture = gen_texture(&image, internalformat, format, GL_UNSIGNED_BYTE);
-
-	return texture;
-}
-
-static inline int32_t tinygltfsize(uint32_t ty) 
-{
-	if (ty == TINYGLTF_TYPE_SCALAR) {
-		return 1;
-	} else if (ty == TINYGLTF_TYPE_VEC2) {
-		return 2;
-	} else if (ty == TINYGLTF_TYPE_VEC3) {
-		return 3;
-	} else if (ty == TINYGLTF_TYPE_VEC4) {
-		return 4;
-	} else if (ty == TINYGLTF_TYPE_MAT2) {
-		return 4;
-	} else if (ty == TINYGLTF_TYPE_MAT3) {
-		return 9;
-	} else if (ty == TINYGLTF_TYPE_MAT4) {
-		return 16;
-	} else {
-		// Unknown componenty type
-		return -1;
+static void use_accessor(const tinygltf::Model &model, int index, std::vector<uint32_t> &bufferuses)
+{
+	if (index < 0) { return; }
+	const tinygltf::Accessor &accessor = model.accessors[index];
+	if (accessor.bufferView < 0) { return; }
+	bufferuses[model.bufferViews[accessor.bufferView].buffer]++;
+}
+
+#define SCENE_STORAGE_CACHE 4 /* storages kept for the next models after theirs are deleted */
+
+static struct {
+	std::mutex lock;
+	std::vector<gltf::scene_storage*> storages;
+} recycled;
+
+void gltf::scene_storage::clear(void)
+{
+	nodes.clear();
+	roots.clear();
+	lookup.clear();
+	meshes.clear();
+	primitives.clear();
+	skins.clear();
+	joints.clear();
+	inversebinds.clear();
+	palettes.clear();
+	names.clear();
+}
+
+size_t gltf::scene_storage::bytes(void) const
+{
+	return sizeof(scene_storage) + nodes.capacity() * sizeof(node_t) + (roots.capacity() + lookup.capacity()) * sizeof(uint32_t)
+		+ meshes.capacity() * sizeof(mesh_t) + primitives.capacity() * sizeof(primitive_t) + names.capacity();
+}
+
+// skins are accounted on their own
+static size_t skin_bytes(const gltf::scene_storage *storage)
+{
+	return storage->skins.capacity() * sizeof(gltf::skin_t) + storage->joints.capacity() * sizeof(uint32_t)
+		+ (storage->inversebinds.capacity() + storage->palettes.capacity()) * sizeof(glm::mat4);
+}
+
+// cached storages stay on the scene tag until a model takes them again
+gltf::scene_storage *gltf::acquire_scene_storage(void)
+{
+	std::lock_guard<std::mutex> guard(recycled.lock);
+	if (recycled.storages.empty()) { return new scene_storage; }
+	scene_storage *storage = recycled.storages.back();
+	recycled.storages.pop_back();
+	memory_sub(MEMORY_SCENE, storage->bytes() + skin_bytes(storage));
+
+	return storage;
+}
+
+void gltf::release_scene_storage(scene_storage *storage)
+{
+	if (storage == nullptr) { return; }
+	storage->clear();
+
+	std::lock_guard<std::mutex> guard(recycled.lock);
+	if (recycled.storages.size() >= SCENE_STORAGE_CACHE) {
+		delete storage;
+		return;
+	}
+	recycled.storages.push_back(storage);
+	memory_add(MEMORY_SCENE, storage->bytes() + skin_bytes(storage));
+}
+
+struct scene_counts {
+	uint32_t vertices = 0;
+	uint32_t indices = 0;
+	uint32_t nodes = 0;
+	uint32_t meshes = 0;
+	uint32_t primitives = 0;
+};
+
+// sizes of every mesh instance and node in the scene, and how many primitives read each buffer
+static void count_node(const tinygltf::Model &model, int nodeindex, struct scene_counts *counts, std::vector<uint32_t> &bufferuses)
+{
+	const tinygltf::Node &node = model.nodes[nodeindex];
+	counts->nodes++;
+	for (int child : node.children) { count_node(model, child, counts, bufferuses); }
+
+	if (node.mesh < 0) { return; }
+	counts->meshes++;
+	counts->primitives += uint32_t(model.meshes[node.mesh].primitives.size());
+	for (const tinygltf::Primitive &primitive : model.meshes[node.mesh].primitives) {
+		auto position = primitive.attributes.find("POSITION");
+		if (position != primitive.attributes.end()) { counts->vertices += uint32_t(model.accessors[position->second].count); }
+		if (primitive.indices > -1) { counts->indices += uint32_t(model.accessors[primitive.indices].count); }
+
+		use_accessor(model, primitive.indices, bufferuses);
+		for (const char *attribute : { "POSITION", "NORMAL", "TEXCOORD_0", "JOINTS_0", "WEIGHTS_0" }) {
+			auto found = primitive.attributes.find(attribute);
+			if (found != primitive.attributes.end()) { use_accessor(model, found->second, bufferuses); }
+		}
+	}
+}
+
+// animations and skins are read after the meshes, their buffers have to stay
+static void pin_buffers(const tinygltf::Model &model, std::vector<uint32_t> &bufferuses)
+{
+	for (const tinygltf::Animation &animation : model.animations) {
+		for (const tinygltf::AnimationSampler &sampler : animation.samplers) {
+			use_accessor(model, sampler.input, bufferuses);
+			use_accessor(model, sampler.output, bufferuses);
+		}
+	}
+	for (const tinygltf::Skin &skin : model.skins) { use_accessor(model, skin.inverseBindMatrices, bufferuses); }
+}
+
+static void release_accessor(gltf::geometry_writer &writer, int index)
+{
+	if (index < 0) { return; }
+	const tinygltf::Accessor &accessor = writer.model->accessors[index];
+	if (accessor.bufferView < 0) { return; }
+	const int buffer = writer.model->bufferViews[accessor.bufferView].buffer;
+	if (--writer.bufferuses[buffer] == 0) {
+		std::vector<unsigned char>().swap(writer.model->buffers[buffer].data);
+	}
+}
+
+// keep images encoded during parsing, they are only decoded on a texture cache miss
+bool gltf::keep_encoded_image(tinygltf::Image *image, const int index, std::string *err, std::string *warn, int req_width, int req_height, const unsigned char *bytes, int size, void *user)
+{
+	int width, height, nchannels;
+	struct KTX ktx;
+	if (read_KTX2_header(bytes, size, &ktx)) {
+		width = ktx.width;
+		height = ktx.height;
+		nchannels = 4;
+	} else if (!stbi_info_from_memory(bytes, size, &width, &height, &nchannels)) {
+		if (err) { (*err) += "Unknown image format for image[" + std::to_string(index) + "]\n"; }
+		return false;
+	}
+
+	image->width = width;
+	image->height = height;
+	image->component = nchannels;
+	image->bits = 8;
+	image->pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+
+	return true;
+}
+
+static GLuint load_gltf_image(tinygltf::Image &gltfimage, uint64_t hash, enum bcn_format format)
+{
+	// drivers without BPTC get uncompressed textures with the same CPU filtered mip chain
+	if (!GLEW_ARB_texture_compression_bptc && (format == BCN_BC7 || format == BCN_BC7_SRGB)) {
+		struct image_t image;
+		int width, height, nchannels;
+		image.data = stbi_load_from_memory(gltfimage.image.data(), int(gltfimage.image.size()), &width, &height, &nchannels, 0);
+		if (image.data == nullptr) { return 0; }
+		image.width = width;
+		image.height = height;
+		image.nchannels = nchannels;
+		struct memory_scope decoded(MEMORY_TEXTURES, size_t(width) * height * nchannels);
+		GLuint texture = gen_texture(&image, (format == BCN_BC7_SRGB) ? MIP_SRGB : MIP_LINEAR);
+		stbi_image_free(image.data);
+		return texture;
+	}
+
+	return cached_texture(gltfimage.image.data(), gltfimage.image.size(), hash, format);
+}
+
+static GLuint load_gltf_sampler(const tinygltf::Model &gltfmodel, int index)
+{
+	if (index < 0) {
+		return shared_sampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT);
 	}
+
+	const tinygltf::Sampler &sampler = gltfmodel.samplers[index];
+	GLint minfilter = (sampler.minFilter > -1) ? sampler.minFilter : GL_LINEAR_MIPMAP_LINEAR;
+	GLint magfilter = (sampler.magFilter > -1) ? sampler.magFilter : GL_LINEAR;
+
+	return shared_sampler(minfilter, magfilter, sampler.wrapS, sampler.wrapT);
 }
 
-// fills an index buffer and returns the index count
-static uint32_t load_indices(const tinygltf::Model &model, const tinygltf::Primitive &primitive, std::vector<uint32_t> &indexbuffer)
+// writes the indices of a primitive and returns the index count
+static uint32_t load_indices(const tinygltf::Model &model, const tinygltf::Primitive &primitive, uint32_t *indexbuffer)
 {
 	uint32_t indexcount = 0;
 
@@ -122,125 +245,148 @@ static uint32_t load_indices(const tinygltf::Model &model, const tinygltf::Primi
 	case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
 		const uint32_t *buf = static_cast<const uint32_t*>(data);
 		for (size_t index = 0; index < accessor.count; index++) {
-			indexbuffer.push_back(buf[index]);
+			indexbuffer[index] = buf[index];
 		}
 		break;
 	}
 	case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
 		const uint16_t *buf = static_cast<const uint16_t*>(data);
 		for (size_t index = 0; index < accessor.count; index++) {
-			indexbuffer.push_back(buf[index]);
+			indexbuffer[index] = buf[index];
 		}
 		break;
 	}
 	case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
 		const uint8_t *buf = static_cast<const uint8_t*>(data);
 		for (size_t index = 0; index < accessor.count; index++) {
-			indexbuffer.push_back(buf[index]);
+			indexbuffer[index] = buf[index];
 		}
 		break;
 	}
 	default:
 		std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
+		memset(indexbuffer, 0, accessor.count * sizeof(uint32_t));
 	}
 
 	return indexcount;
 }
 
-void gltf::Model::load_mesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh, gltf::mesh_t *newmesh, std::vector<uint32_t> &indexbuffer, std::vector<vertex> &vertexbuffer)
+// texture maps are only sampled with texture coordinates to sample them at
+static uint32_t material_features(const gltf::material_t &material, bool texcoords)
 {
+	uint32_t features = 0;
+	if (texcoords) {
+		features |= FEATURE_UV;
+		if (material.basecolormap.texture) { features |= FEATURE_BASECOLOR_MAP; }
+		if (material.metalroughmap.texture) { features |= FEATURE_METALROUGH_MAP; }
+		if (material.normalmap.texture) { features |= FEATURE_NORMAL_MAP; }
+	}
+	if (material.alphamode == gltf::material_t::ALPHA_MASK) { features |= FEATURE_ALPHA_MASK; }
+	if (material.alphamode == gltf::material_t::ALPHA_BLEND) { features |= FEATURE_ALPHA_BLEND; }
+
+	return features;
+}
+
+void gltf::Model::load_mesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh, uint32_t meshhandle, geometry_writer &writer)
+{
+	scene->meshes[meshhandle].firstprimitive = uint32_t(scene->primitives.size());
 	for (size_t j = 0; j < mesh.primitives.size(); j++) {
 		const tinygltf::Primitive &primitive = mesh.primitives[j];
-		uint32_t indexstart = static_cast<uint32_t>(indexbuffer.size());
-		uint32_t vertexstart = static_cast<uint32_t>(vertexbuffer.size());
+		uint32_t indexstart = writer.indexcount;
+		uint32_t vertexstart = writer.vertexcount;
 		uint32_t indexcount = 0;
 		uint32_t vertexcount = 0;
 		bool skinned = false;
 		bool indexed = primitive.indices > -1;
 
 		// Indices
-		if (indexed) { indexcount = load_indices(model, primitive, indexbuffer); }
-
-		// import vertex data
-		const float *bufferpos = nullptr;
-		const float *buffernormals = nullptr;
-		const float *buffertexcoords = nullptr;
-		const uint16_t *bufferjoints = nullptr;
-		const float *bufferweights = nullptr;
+		if (indexed) { indexcount = load_indices(model, primitive, writer.indices + indexstart); }
 
-		int posbytestride = 0;
-		int normbytestride = 0;
-		int uvbytestride = 0;
-		int jointbytestride = 0;
-		int weightbytestride = 0;
+		// import vertex data, attributes may be quantized (KHR_mesh_quantization)
+		struct accessor_view positions, normals, texcoords, joints, weights;
+		auto attribute = [&](const char *name, struct accessor_view *view) {
+			auto found = primitive.attributes.find(name);
+			return found != primitive.attributes.end() && view_accessor(model, found->second, view);
+		};
 
 		// Position attribute is required
 		assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-		const tinygltf::Accessor &posaccess = model.accessors[primitive.attributes.find("POSITION")->second];
-		const tinygltf::BufferView &posview = model.bufferViews[posaccess.bufferView];
-		bufferpos = reinterpret_cast<const float *>(&(model.buffers[posview.buffer].data[posaccess.byteOffset + posview.byteOffset]));
-		vertexcount = static_cast<uint32_t>(posaccess.count);
-		posbytestride = posaccess.ByteStride(posview) ? (posaccess.ByteStride(posview) / sizeof(float)) : tinygltfsize(TINYGLTF_TYPE_VEC3);
-
-
-		if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-			const tinygltf::Accessor &normaccess = model.accessors[primitive.attributes.find("NORMAL")->second];
-			const tinygltf::BufferView &normview = model.bufferViews[normaccess.bufferView];
-			buffernormals = reinterpret_cast<const float *>(&(model.buffers[normview.buffer].data[normaccess.byteOffset + normview.byteOffset]));
-			normbytestride = normaccess.ByteStride(normview) ? (normaccess.ByteStride(normview) / sizeof(float)) : tinygltfsize(TINYGLTF_TYPE_VEC3);
-		}
-
-		if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-			const tinygltf::Accessor &uvaccess = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-			const tinygltf::BufferView &uvview = model.bufferViews[uvaccess.bufferView];
-			buffertexcoords = reinterpret_cast<const float *>(&(model.buffers[uvview.buffer].data[uvaccess.byteOffset + uvview.byteOffset]));
-			uvbytestride = uvaccess.ByteStride(uvview) ? (uvaccess.ByteStride(uvview) / sizeof(float)) : tinygltfsize(TINYGLTF_TYPE_VEC2);
+		attribute("POSITION", &positions);
+		vertexcount = static_cast<uint32_t>(positions.count);
+		const bool hasnormals = attribute("NORMAL", &normals);
+		const bool hastexcoords = attribute("TEXCOORD_0", &texcoords);
+		const bool hasjoints = attribute("JOINTS_0", &joints);
+		const bool hasweights = attribute("WEIGHTS_0", &weights);
+
+		skinned = (hasjoints && hasweights);
+
+		glm::vec3 bmin(std::numeric_limits<float>::max());
+		glm::vec3 bmax(-std::numeric_limits<float>::max());
+		for (size_t v = 0; v < positions.count; v++) {
+			vertex vert{};
+			vert.position = glm::vec3(accessor_element(positions, v));
+			bmin = glm::min(bmin, vert.position);
+			bmax = glm::max(bmax, vert.position);
+			vert.normal = glm::normalize(hasnormals ? glm::vec3(accessor_element(normals, v)) : glm::vec3(0.0f));
+			vert.uv = hastexcoords ? glm::vec2(accessor_element(texcoords, v)) : glm::vec2(0.0f);
+
+			vert.joints = skinned ? glm::ivec4(accessor_element(joints, v)) : glm::ivec4(0.0f);
+			vert.weights = skinned ? accessor_element(weights, v) : glm::vec4(0.0f);
+			// Fix for all zero weights
+			if (glm::length(vert.weights) == 0.0f) { vert.weights = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f); }
+			writer.vertices[vertexstart + v] = vert;
 		}
 
-		// Joints
-		if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-			const tinygltf::Accessor &jointaccess = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-			const tinygltf::BufferView &jointview = model.bufferViews[jointaccess.bufferView];
-			bufferjoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointview.buffer].data[jointaccess.byteOffset + jointview.byteOffset]));
-			jointbytestride = jointaccess.ByteStride(jointview) ? (jointaccess.ByteStride(jointview) / sizeof(bufferjoints[0])) : tinygltfsize(TINYGLTF_TYPE_VEC4);
+		gltf::primitive_t newprimitive{};
+		newprimitive.firstindex = indexstart;
+		newprimitive.indexcount = indexcount;
+		newprimitive.firstvertex = vertexstart;
+		newprimitive.vertexcount = vertexcount;
+		newprimitive.indexed = indexcount > 0;
+		newprimitive.material = primitive.material > -1 ? uint32_t(primitive.material) : uint32_t(materials.size() - 1);
+		if (vertexcount > 0) {
+			newprimitive.center = 0.5f * (bmin + bmax);
+			newprimitive.radius = 0.5f * glm::length(bmax - bmin);
 		}
 
-		if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-			const tinygltf::Accessor &weightaccess = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-			const tinygltf::BufferView &weightview = model.bufferViews[weightaccess.bufferView];
-			bufferweights = reinterpret_cast<const float *>(&(model.buffers[weightview.buffer].data[weightaccess.byteOffset + weightview.byteOffset]));
-			weightbytestride = weightaccess.ByteStride(weightview) ? (weightaccess.ByteStride(weightview) / sizeof(float)) : tinygltfsize(TINYGLTF_TYPE_VEC4);
-		}
+		newprimitive.features = material_features(materials[newprimitive.material], hastexcoords);
+		if (skinned) { newprimitive.features |= FEATURE_SKINNED; }
 
-		skinned = (bufferjoints && bufferweights);
+		scene->primitives.push_back(newprimitive);
+		scene->meshes[meshhandle].primitivecount++;
 
-		for (size_t v = 0; v < posaccess.count; v++) {
-			vertex vert{};
-			vert.position = glm::make_vec3(&bufferpos[v * posbytestride]);
-			vert.normal = glm::normalize(glm::vec3(buffernormals ? glm::make_vec3(&buffernormals[v * normbytestride]) : glm::vec3(0.0f)));
-			vert.uv = buffertexcoords ? glm::make_vec2(&buffertexcoords[v * uvbytestride]) : glm::vec2(0.0f);
+		writer.vertexcount += vertexcount;
+		writer.indexcount += indexcount;
 
-			vert.joints = skinned ? glm::ivec4(glm::make_vec4(&bufferjoints[v * jointbytestride])) : glm::ivec4(0.0f);
-			vert.weights = skinned ? glm::make_vec4(&bufferweights[v * weightbytestride]) : glm::vec4(0.0f);
-			// Fix for all zero weights
-			if (glm::length(vert.weights) == 0.0f) { vert.weights = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f); }
-			vertexbuffer.push_back(vert);
+		release_accessor(writer, primitive.indices);
+		for (const char *attribute : { "POSITION", "NORMAL", "TEXCOORD_0", "JOINTS_0", "WEIGHTS_0" }) {
+			auto found = primitive.attributes.find(attribute);
+			if (found != primitive.attributes.end()) { release_accessor(writer, found->second); }
 		}
-
-		gltf::primitive_t *newPrimitive = new struct primitive_t(indexstart, indexcount, vertexstart, vertexcount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-
-		newmesh->primitives.push_back(newPrimitive);
 	}
 }
 
-void gltf::Model::load_node(gltf::node_t *parent, const tinygltf::Node &node, uint32_t nodeindex, const tinygltf::Model &model, std::vector<uint32_t> &indexbuffer, std::vector<vertex> &vertexbuffer)
+// nodes are appended before their children, so a single pass in storage order sees every parent first
+void gltf::Model::load_node(uint32_t parent, const tinygltf::Node &node, uint32_t nodeindex, const tinygltf::Model &model, geometry_writer &writer)
 {
-	gltf::node_t *newnode = new gltf::node_t{};
+	const uint32_t handle = uint32_t(scene->nodes.size());
+	scene->nodes.emplace_back();
+	gltf::node_t *newnode = &scene->nodes[handle];
 	newnode->index = nodeindex;
 	newnode->parent = parent;
-	newnode->name = node.name;
+	scene->lookup[nodeindex] = handle;
+	if (writer.names) {
+		newnode->name = writer.names->nodes[nodeindex];
+	} else {
+		newnode->name = uint32_t(scene->names.size());
+		scene->names.append(node.name.c_str(), node.name.size() + 1);
+	}
 	newnode->skinIndex = node.skin;
+	auto punctual = node.extensions.find("KHR_lights_punctual");
+	if (punctual != node.extensions.end() && punctual->second.Has("light")) {
+		newnode->light = int32_t(punctual->second.Get("light").GetNumberAsInt());
+		if (newnode->light >= int32_t(lights.size())) { newnode->light = -1; }
+	}
 	newnode->matrix = glm::mat4(1.0f);
 
 	// get local node matrix
@@ -263,28 +409,19 @@ void gltf::Model::load_node(gltf::node_t *parent, const tinygltf::Node &node, ui
 		newnode->matrix = glm::make_mat4x4(node.matrix.data());
 	};
 
-	// Node with children
-	if (node.children.size() > 0) {
-		for (size_t i = 0; i < node.children.size(); i++) {
-			load_node(newnode, model.nodes[node.children[i]], node.children[i], model, indexbuffer, vertexbuffer);
-		}
-	}
-
 	// Node contains mesh data
 	if (node.mesh > -1) {
-		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		mesh_t *newmesh = new mesh_t(newnode->matrix);
-		load_mesh(model, mesh, newmesh, indexbuffer, vertexbuffer);
-		newnode->mesh = newmesh;
+		newnode->mesh = uint32_t(scene->meshes.size());
+		scene->meshes.emplace_back();
+		load_mesh(model, model.meshes[node.mesh], newnode->mesh, writer);
 	}
 
-	if (parent) {
-		parent->children.push_back(newnode);
-	} else {
-		nodes.push_back(newnode);
-	}
+	if (parent == SCENE_NO_HANDLE) { scene->roots.push_back(handle); }
 
-	linearNodes.push_back(newnode);
+	// Node with children
+	for (int child : node.children) {
+		load_node(handle, model.nodes[child], uint32_t(child), model, writer);
+	}
 }
 
 void gltf::Model::load_animations(tinygltf::Model &gltfModel)
@@ -304,16 +441,12 @@ void gltf::Model::load_animations(tinygltf::Model &gltfModel)
 
 			// Read sampler input time values
 			{
-				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
-				const tinygltf::BufferView &bufview = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufview.buffer];
-
-				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-				const void *data = &buffer.data[accessor.byteOffset + bufview.byteOffset];
-				const float *buf = static_cast<const float*>(data);
-				for (size_t index = 0; index < accessor.count; index++) {
-					sampler.inputs.push_back(buf[index]);
+				struct accessor_view inputs;
+				if (view_accessor(gltfModel, samp.input, &inputs)) {
+					assert(inputs.componenttype == TINYGLTF_COMPONENT_TYPE_FLOAT);
+					for (size_t index = 0; index < inputs.count; index++) {
+						sampler.inputs.push_back(accessor_element(inputs, index).x);
+					}
 				}
 
 				for (auto input : sampler.inputs) {
@@ -322,35 +455,15 @@ void gltf::Model::load_animations(tinygltf::Model &gltfModel)
 				}
 			}
 
-			// Read sampler output T/R/S values
+			// Read sampler output T/R/S values, rotations may be normalized integers
 			{
-				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
-				const tinygltf::BufferView &bufview = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufview.buffer];
-
-				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-				const void *data = &buffer.data[accessor.byteOffset + bufview.byteOffset];
-
-				switch (accessor.type) {
-				case TINYGLTF_TYPE_VEC3: {
-					const glm::vec3 *buf = static_cast<const glm::vec3*>(data);
-					for (size_t index = 0; index < accessor.count; index++) {
-						sampler.outputs.push_back(glm::vec4(buf[index], 0.0f));
-					}
-					break;
-				}
-				case TINYGLTF_TYPE_VEC4: {
-					const glm::vec4 *buf = static_cast<const glm::vec4*>(data);
-					for (size_t index = 0; index < accessor.count; index++) {
-						sampler.outputs.push_back(buf[index]);
+				struct accessor_view outputs;
+				if (view_accessor(gltfModel, samp.output, &outputs) && (outputs.components == 3 || outputs.components == 4)) {
+					for (size_t index = 0; index < outputs.count; index++) {
+						sampler.outputs.push_back(accessor_element(outputs, index));
 					}
-					break;
-				}
-				default: {
+				} else {
 					std::cout << "unknown type" << std::endl;
-					break;
-				}
 				}
 			}
 
@@ -372,7 +485,7 @@ void gltf::Model::load_animations(tinygltf::Model &gltfModel)
 			}
 			channel.samplerindex = source.sampler;
 			channel.target = nodefrom(source.target_node);
-			if (!channel.target) { continue; }
+			if (channel.target == SCENE_NO_HANDLE) { continue; }
 
 			animation.channels.push_back(channel);
 		}
@@ -381,45 +494,169 @@ void gltf::Model::load_animations(tinygltf::Model &gltfModel)
 	}
 }
 
-void gltf::Model::load_skins(tinygltf::Model &gltfModel)
+void gltf::Model::load_skins(tinygltf::Model &gltfModel, const struct gltf_names *names)
 {
 	for (tinygltf::Skin &source : gltfModel.skins) {
-		gltf::skin_t *newskin = new skin_t{};
-		newskin->name = source.name;
+		gltf::skin_t newskin{};
+		if (names) {
+			newskin.name = names->skins[scene->skins.size()];
+		} else {
+			newskin.name = uint32_t(scene->names.size());
+			scene->names.append(source.name.c_str(), source.name.size() + 1);
+		}
 
 		// Find skeleton root node
 		if (source.skeleton > -1) {
-			newskin->skeletonRoot = nodefrom(source.skeleton);
+			newskin.skeleton = nodefrom(source.skeleton);
 		}
 
-		// Find joint nodes
-		for (int jointindex : source.joints) {
-			node_t *node = nodefrom(jointindex);
-			if (node) {
-				newskin->joints.push_back(nodefrom(jointindex));
-			}
-		}
-
-		// Get inverse bind matrices from buffer
+		// inverse bind matrices from the buffer, identity if there are none
+		const glm::mat4 *inversebinds = nullptr;
+		size_t inversebindcount = 0;
 		if (source.inverseBindMatrices > -1) {
 			const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
 			const tinygltf::BufferView &bufview = gltfModel.bufferViews[accessor.bufferView];
 			const tinygltf::Buffer &buffer = gltfModel.buffers[bufview.buffer];
-			newskin->inversebinds.resize(accessor.count);
-			memcpy(newskin->inversebinds.data(), &buffer.data[accessor.byteOffset + bufview.byteOffset], accessor.count * sizeof(glm::mat4));
+			inversebinds = reinterpret_cast<const glm::mat4*>(&buffer.data[accessor.byteOffset + bufview.byteOffset]);
+			inversebindcount = accessor.count;
+		}
+
+		// joints outside the scene keep their slot so JOINTS_0 indices stay aligned
+		// they are bound to the skeleton root, or the first joint there is, with an identity inverse bind
+		uint32_t placeholder = newskin.skeleton;
+		for (size_t i = 0; i < source.joints.size() && placeholder == SCENE_NO_HANDLE; i++) { placeholder = nodefrom(source.joints[i]); }
+
+		// Find joint nodes
+		newskin.firstjoint = uint32_t(scene->joints.size());
+		for (size_t i = 0; i < source.joints.size() && placeholder != SCENE_NO_HANDLE; i++) {
+			const uint32_t joint = nodefrom(source.joints[i]);
+			glm::mat4 inversebind(1.f);
+			if (joint != SCENE_NO_HANDLE && i < inversebindcount) { memcpy(&inversebind, &inversebinds[i], sizeof(glm::mat4)); }
+			scene->joints.push_back(joint != SCENE_NO_HANDLE ? joint : placeholder);
+			scene->inversebinds.push_back(inversebind);
 		}
+		newskin.jointcount = uint32_t(scene->joints.size()) - newskin.firstjoint;
+
+		scene->skins.push_back(newskin);
+	}
+}
+
+// KTX2_TEXTURE_EXTENSION points at a KTX2 image, the regular source is its fallback
+// KHR_texture_basisu textures use their regular source, there is no Basis Universal transcoder
+int gltf::texture_source(const tinygltf::Texture &texture)
+{
+	auto ktx = texture.extensions.find(KTX2_TEXTURE_EXTENSION);
+	if (ktx != texture.extensions.end() && ktx->second.Has("source")) {
+		return static_cast<int>(ktx->second.Get("source").GetNumberAsInt());
+	}
 
-		skins.push_back(newskin);
+	return texture.source;
+}
+
+// how each texture is used decides its block compression format
+// base color and emissive are sRGB, everything else is linear data
+void gltf::texture_formats(const tinygltf::Model &gltfmodel, std::vector<enum bcn_format> &formats)
+{
+	enum { USAGE_SRGB = 1, USAGE_DATA = 2, USAGE_NORMAL = 4, USAGE_OCCLUSION = 8 };
+	std::vector<int> usage(gltfmodel.textures.size(), 0);
+	for (const tinygltf::Material &mat : gltfmodel.materials) {
+		if (mat.normalTexture.index > -1) { usage[mat.normalTexture.index] |= USAGE_NORMAL; }
+		if (mat.occlusionTexture.index > -1) { usage[mat.occlusionTexture.index] |= USAGE_OCCLUSION; }
+		if (mat.emissiveTexture.index > -1) { usage[mat.emissiveTexture.index] |= USAGE_SRGB; }
+		if (mat.pbrMetallicRoughness.baseColorTexture.index > -1) { usage[mat.pbrMetallicRoughness.baseColorTexture.index] |= USAGE_SRGB; }
+		if (mat.pbrMetallicRoughness.metallicRoughnessTexture.index > -1) { usage[mat.pbrMetallicRoughness.metallicRoughnessTexture.index] |= USAGE_DATA; }
+	}
+
+	formats.assign(gltfmodel.textures.size(), BCN_BC7);
+	for (size_t i = 0; i < gltfmodel.textures.size(); i++) {
+		const int source = texture_source(gltfmodel.textures[i]);
+		const bool grey = source > -1 && gltfmodel.images[source].component == 1;
+		// BC4 samples as red, grey color textures stay BC7 and metallic roughness reads green and blue
+		if (usage[i] == USAGE_NORMAL) {
+			formats[i] = BCN_BC5;
+		} else if (usage[i] & USAGE_SRGB) {
+			formats[i] = BCN_BC7_SRGB;
+		} else if (usage[i] == USAGE_OCCLUSION || (grey && !(usage[i] & USAGE_DATA))) {
+			formats[i] = BCN_BC4;
+		}
 	}
 }
 
 void gltf::Model::load_textures(tinygltf::Model &gltfmodel)
 {
-	for (tinygltf::Texture &tex : gltfmodel.textures) {
-		tinygltf::Image image = gltfmodel.images[tex.source];
-		GLuint texture;
-		texture = load_gltf_image(image);
-		textures.push_back(texture);
+	std::vector<enum bcn_format> formats;
+	texture_formats(gltfmodel, formats);
+
+	// one upload per distinct image and format, textures often share an image
+	struct upload_t {
+		int source;
+		enum bcn_format format;
+		uint64_t hash = 0;
+		bool ktx = false;
+		bool transcoded = false;
+		struct DDS header;
+		std::vector<unsigned char> blocks;
+		GLuint texture = 0;
+	};
+	std::vector<upload_t> uploads;
+	std::map<std::pair<int, int>, size_t> lookup;
+	auto upload_index = [&](int source, enum bcn_format format) -> size_t {
+		auto key = std::make_pair(source, int(format));
+		auto found = lookup.find(key);
+		if (found != lookup.end()) { return found->second; }
+		uploads.push_back(upload_t{source, format});
+		lookup[key] = uploads.size() - 1;
+		return uploads.size() - 1;
+	};
+
+	std::vector<size_t> texture_uploads;
+	for (size_t i = 0; i < gltfmodel.textures.size(); i++) {
+		texture_uploads.push_back(upload_index(texture_source(gltfmodel.textures[i]), formats[i]));
+	}
+
+	// hash images and transcode KTX2 images in parallel, uploads stay on this thread
+	auto prepare = [&](upload_t &upload) {
+		if (upload.source < 0) { return; }
+		const tinygltf::Image &image = gltfmodel.images[upload.source];
+		upload.hash = hash_bytes(image.image.data(), image.image.size());
+		upload.ktx = is_KTX2(image.image.data(), image.image.size());
+		if (upload.ktx && find_texture(upload.hash, upload.format) == 0) {
+			upload.transcoded = transcode_KTX2(image.image.data(), image.image.size(), upload.format, &upload.header, upload.blocks);
+		}
+	};
+	auto upload = [&](upload_t &upload) {
+		if (upload.source < 0) { return; }
+		upload.texture = find_texture(upload.hash, upload.format);
+		if (upload.texture) { return; }
+		if (upload.transcoded) {
+			upload.texture = gen_DDS_texture(&upload.header, upload.blocks.data());
+		} else if (!upload.ktx) {
+			upload.texture = load_gltf_image(gltfmodel.images[upload.source], upload.hash, upload.format);
+		}
+		if (upload.texture) { register_texture(upload.hash, upload.format, upload.texture); }
+		std::vector<unsigned char>().swap(upload.blocks);
+	};
+
+	parallel_for(uploads.size(), [&](size_t i) { prepare(uploads[i]); });
+	for (upload_t &entry : uploads) { upload(entry); }
+
+	for (size_t i = 0; i < gltfmodel.textures.size(); i++) {
+		const tinygltf::Texture &tex = gltfmodel.textures[i];
+		GLuint texture = uploads[texture_uploads[i]].texture;
+		// KTX2 textures that failed to transcode fall back to their regular source
+		if (texture == 0 && tex.source > -1 && tex.source != texture_source(tex)) {
+			size_t fallback = upload_index(tex.source, formats[i]);
+			if (uploads[fallback].texture == 0) {
+				prepare(uploads[fallback]);
+				upload(uploads[fallback]);
+			}
+			texture = uploads[fallback].texture;
+		}
+
+		texture_t newtexture;
+		newtexture.texture = texture;
+		newtexture.sampler = load_gltf_sampler(gltfmodel, tex.sampler);
+		textures.push_back(newtexture);
 	}
 }
 
@@ -442,6 +679,7 @@ void gltf::Model::load_materials(tinygltf::Model &gltfmodel)
 		}
 		if (mat.values.find("baseColorFactor") != mat.values.end()) {
 			material.basecolor = glm::make_vec4(mat.values["baseColorFactor"].ColorFactor().data());
+			material.basealpha = material.basecolor.a;
 		}
 		if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end()) {
 			material.normalmap = textures[mat.additionalValues["normalTexture"].TextureIndex()];
@@ -452,6 +690,12 @@ void gltf::Model::load_materials(tinygltf::Model &gltfmodel)
 		if (mat.additionalValues.find("occlusionTexture") != mat.additionalValues.end()) {
 			material.occlusionmap = textures[mat.additionalValues["occlusionTexture"].TextureIndex()];
 		}
+		if (mat.alphaMode == "MASK") {
+			material.alphamode = material_t::ALPHA_MASK;
+			material.alphacutoff = static_cast<float>(mat.alphaCutoff);
+		} else if (mat.alphaMode == "BLEND") {
+			material.alphamode = material_t::ALPHA_BLEND;
+		}
 
 		materials.push_back(material);
 	}
@@ -459,66 +703,227 @@ void gltf::Model::load_materials(tinygltf::Model &gltfmodel)
 	materials.push_back(material_t{});
 }
 
-void gltf::Model::importf(std::string fpath)
+void gltf::Model::load_lights(const tinygltf::Model &gltfmodel)
 {
+	for (const tinygltf::Light &light : gltfmodel.lights) {
+		gltf::light_t newlight;
+		if (light.type == "directional") {
+			newlight.type = LIGHT_DIRECTIONAL;
+		} else if (light.type == "spot") {
+			newlight.type = LIGHT_SPOT;
+		}
+		if (light.color.size() == 3) { newlight.color = glm::make_vec3(light.color.data()); }
+		newlight.intensity = static_cast<float>(light.intensity);
+		newlight.range = static_cast<float>(light.range);
+		newlight.innercone = static_cast<float>(light.spot.innerConeAngle);
+		newlight.outercone = static_cast<float>(light.spot.outerConeAngle);
+		lights.push_back(newlight);
+	}
+}
+
+gltf::Model::~Model()
+{
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) { memory_sub(memory_tag(tag), accounted[tag]); }
+	geometry_free(&geometry);
+	release_scene_storage(scene);
+}
+
+bool gltf::Model::importf(std::string fpath)
+{
+	PROFILE_SCOPE("import");
 	tinygltf::Model model;
-	tinygltf::TinyGLTF loader;
+	struct gltf_names names;
 	std::string err;
 	std::string warn;
-
-	bool binary = false;
-	size_t extpos = fpath.rfind('.', fpath.length());
-	if (extpos != std::string::npos) {
-		binary = (fpath.substr(extpos + 1, fpath.length() - extpos) == "glb");
-	} else {
-		std::cerr << "Could not open glTF file: " << err << std::endl;
-		return;
+	// the process peak isn't reset, the import has its own peak only where it raises it
+	const size_t rssbefore = current_rss();
+	const size_t peakbefore = peak_rss();
+
+	bool ret;
+	{
+		PROFILE_SCOPE("parse");
+		ret = read_gltf_file(fpath, &model, &err, &warn, keep_encoded_image, nullptr, &names);
 	}
 
-	bool ret = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, fpath.c_str()) : loader.LoadASCIIFromFile(&model, &err, &warn, fpath.c_str());
-
-	std::vector<uint32_t> indexbuffer;
-	std::vector<vertex> vertexbuffer;
-
-
 	if (!warn.empty()) { printf("Warn: %s\n", warn.c_str()); }
 	if (!err.empty()) { printf("Err: %s\n", err.c_str()); }
 
 	if (!ret) { 
 		std::cerr << "Could not load glTF file: " << err << std::endl;
-		return;
+		return false;
 	}
 
-	load_textures(model);
+	size_t document = 0;
+	for (const tinygltf::Buffer &buffer : model.buffers) { document += buffer.data.size(); }
+	for (const tinygltf::Image &image : model.images) { document += image.image.size(); }
+	memory_add(MEMORY_GLTF, document);
+	const bool loaded = load(model, true, &names);
+	memory_sub(MEMORY_GLTF, document);
+	memory_record_import({ fpath, document, rssbefore, peakbefore, peak_rss(), current_rss() });
+
+	return loaded;
+}
+
+static double elapsed_ms(int64_t since)
+{
+	return double(profile_now() - since) * 1e-6;
+}
+
+bool gltf::Model::load(tinygltf::Model &model, bool gpu, const struct gltf_names *names)
+{
+	const int64_t start = profile_now();
+	int64_t phase = start;
+	if (gpu) {
+		PROFILE_SCOPE("textures");
+		load_textures(model);
+	} else {
+		textures.assign(model.textures.size(), texture_t{});
+	}
+	timings.textures = elapsed_ms(phase);
 	load_materials(model);
-	const tinygltf::Scene &scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
-	for (size_t i = 0; i < scene.nodes.size(); i++) {
-		const tinygltf::Node node = model.nodes[scene.nodes[i]];
-		load_node(nullptr, node, scene.nodes[i], model, indexbuffer, vertexbuffer);
+	load_lights(model);
+	// textures are uploaded, the encoded images aren't needed anymore
+	for (tinygltf::Image &image : model.images) { std::vector<unsigned char>().swap(image.image); }
+
+	const tinygltf::Scene &gltfscene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
+
+	// size the geometry ranges up front so the meshes decode straight into the mapped buffers
+	geometry_writer writer;
+	writer.model = &model;
+	writer.names = names;
+	writer.bufferuses.resize(model.buffers.size(), 0);
+	struct scene_counts counts;
+	for (int root : gltfscene.nodes) { count_node(model, root, &counts, writer.bufferuses); }
+	pin_buffers(model, writer.bufferuses);
+	const uint32_t vertexcount = counts.vertices;
+	const uint32_t indexcount = counts.indices;
+
+	// one allocation per array at most, none when recycled storage is large enough
+	if (scene == nullptr) { scene = acquire_scene_storage(); }
+	scene->clear();
+	if (names) { scene->names.assign(names->pool); }
+	scene->nodes.reserve(counts.nodes);
+	scene->roots.reserve(gltfscene.nodes.size());
+	scene->lookup.assign(model.nodes.size(), SCENE_NO_HANDLE);
+	scene->meshes.reserve(counts.meshes);
+	scene->primitives.reserve(counts.primitives);
+	size_t jointcount = 0;
+	for (const tinygltf::Skin &skin : model.skins) { jointcount += skin.joints.size(); }
+	scene->skins.reserve(model.skins.size());
+	scene->joints.reserve(jointcount);
+	scene->inversebinds.reserve(jointcount);
+
+	phase = profile_now();
+	bool allocated = gpu && geometry_alloc(VERTEX_FORMAT_MESH, vertexcount, indexcount, &geometry);
+	if (gpu && !allocated) {
+		std::cerr << "error: no room for " << vertexcount << " vertices in the geometry buffers" << std::endl;
+	}
+	void *mapping = nullptr;
+	bool mapped = allocated && geometry_map(&geometry, &mapping, &writer.indices);
+	// staging copy if the buffers can't be mapped
+	std::vector<vertex> vertexbuffer;
+	std::vector<uint32_t> indexbuffer;
+	if (mapped) {
+		writer.vertices = static_cast<vertex*>(mapping);
+	} else {
+		vertexbuffer.resize(vertexcount);
+		indexbuffer.resize(indexcount);
+		writer.vertices = vertexbuffer.data();
+		writer.indices = indexbuffer.data();
 	}
+	struct memory_scope staging(MEMORY_GEOMETRY, vertexbuffer.size() * sizeof(vertex) + indexbuffer.size() * sizeof(uint32_t));
 
-	VAO = bind_VAO(indexbuffer, vertexbuffer);
+	{
+		PROFILE_SCOPE("meshes");
+		for (size_t i = 0; i < gltfscene.nodes.size(); i++) {
+			const tinygltf::Node &node = model.nodes[gltfscene.nodes[i]];
+			load_node(SCENE_NO_HANDLE, node, gltfscene.nodes[i], model, writer);
+		}
+	}
+
+	if (mapped) {
+		geometry_unmap(&geometry);
+	} else if (allocated) {
+		geometry_upload(&geometry, vertexbuffer.data(), indexbuffer.data());
+	}
+	timings.meshes = elapsed_ms(phase);
 
+	phase = profile_now();
 	if (model.animations.size() > 0) { load_animations(model); }
-	load_skins(model);
+	timings.animations = elapsed_ms(phase);
+	phase = profile_now();
+	load_skins(model, names);
+
+	// Assign skins, each skinned mesh gets its own range of joint matrices
+	uint32_t palettesize = 0;
+	for (node_t &node : scene->nodes) {
+		if (node.skinIndex < 0 || size_t(node.skinIndex) >= scene->skins.size()) { continue; }
+		node.skin = uint32_t(node.skinIndex);
+		if (node.mesh == SCENE_NO_HANDLE) { continue; }
+		mesh_t &mesh = scene->meshes[node.mesh];
+		mesh.palette = palettesize;
+		mesh.jointcount = std::min(scene->skins[node.skin].jointcount, MAX_NUM_JOINTS);
+		palettesize += mesh.jointcount;
+	}
+	scene->palettes.assign(palettesize, glm::mat4(1.f));
+	// Initial pose
+	updatePose();
+	timings.skins = elapsed_ms(phase);
+	timings.total = elapsed_ms(start);
+	account_memory();
+
+	if (!gpu) { return true; }
+
+	// start compiling the shader variants now, they are usually linked by the first frame that draws the model
+	for (const node_t &node : scene->nodes) {
+		if (node.mesh == SCENE_NO_HANDLE) { continue; }
+		const mesh_t &mesh = scene->meshes[node.mesh];
+		for (uint32_t i = 0; i < mesh.primitivecount; i++) {
+			const uint32_t features = scene->primitives[mesh.firstprimitive + i].features;
+			request_variant(mesh.jointcount > 0 ? features : features & ~uint32_t(FEATURE_SKINNED));
+		}
+	}
+
+	return true;
+}
+
+// what the model keeps on the heap once it is loaded
+void gltf::Model::account_memory(void)
+{
+	size_t bytes[MEMORY_TAG_COUNT] = {};
+	bytes[MEMORY_SCENE] = scene->bytes();
+	bytes[MEMORY_ANIMATION] = animations.capacity() * sizeof(animation_t);
+	for (const animation_t &animation : animations) {
+		bytes[MEMORY_ANIMATION] += animation.name.capacity() + animation.channels.capacity() * sizeof(animchannel_t) + animation.samplers.capacity() * sizeof(animsampler_t);
+		for (const animsampler_t &sampler : animation.samplers) {
+			bytes[MEMORY_ANIMATION] += sampler.inputs.capacity() * sizeof(float) + sampler.outputs.capacity() * sizeof(glm::vec4);
+		}
+	}
+	bytes[MEMORY_SKINS] = skin_bytes(scene);
+	bytes[MEMORY_MATERIALS] = materials.capacity() * sizeof(material_t) + textures.capacity() * sizeof(texture_t) + lights.capacity() * sizeof(light_t);
 
-	for (auto node : linearNodes) {
-		// Assign skins
-		if (node->skinIndex > -1) { node->skin = skins[node->skinIndex]; }
-		// Initial pose
-		if (node->mesh) { node->update(); }
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		memory_sub(memory_tag(tag), accounted[tag]);
+		memory_add(memory_tag(tag), bytes[tag]);
+		accounted[tag] = bytes[tag];
 	}
 }
 
 void gltf::Model::updateAnimation(uint32_t index, float time)
 {
+	if (sampleAnimation(index, time)) { updatePose(); }
+}
+
+bool gltf::Model::sampleAnimation(uint32_t index, float time)
+{
+	PROFILE_SCOPE("animation");
 	if (animations.empty()) {
 		std::cout << ".glTF does not contain animation." << std::endl;
-		return;
+		return false;
 	}
 	if (index > static_cast<uint32_t>(animations.size()) - 1) {
 		std::cout << "No animation with index " << index << std::endl;
-		return;
+		return false;
 	}
 	animation_t &animation = animations[index];
 
@@ -534,12 +939,12 @@ void gltf::Model::updateAnimation(uint32_t index, float time)
 					switch (channel.path) {
 					case gltf::animchannel_t::pathtype::TRANSLATION: {
 					glm::vec4 trans = glm::mix(sampler.outputs[i], sampler.outputs[i + 1], u);
-					channel.target->translation = glm::vec3(trans);
+					scene->nodes[channel.target].translation = glm::vec3(trans);
 					break;
 					}
 					case gltf::animchannel_t::pathtype::SCALE: {
 					glm::vec4 trans = glm::mix(sampler.outputs[i], sampler.outputs[i + 1], u);
-					channel.target->scale = glm::vec3(trans);
+					scene->nodes[channel.target].scale = glm::vec3(trans);
 					break;
 					}
 					case gltf::animchannel_t::pathtype::ROTATION: {
@@ -553,7 +958,7 @@ void gltf::Model::updateAnimation(uint32_t index, float time)
 					q2.y = sampler.outputs[i + 1].y;
 					q2.z = sampler.outputs[i + 1].z;
 					q2.w = sampler.outputs[i + 1].w;
-					channel.target->rotation = glm::normalize(glm::slerp(q1, q2, u));
+					scene->nodes[channel.target].rotation = glm::normalize(glm::slerp(q1, q2, u));
 					break;
 					}
 					}
@@ -563,40 +968,128 @@ void gltf::Model::updateAnimation(uint32_t index, float time)
 		}
 	}
 
-	if (updated) {
-		for (auto &node : nodes) { node->update(); }
+	return updated;
+}
+
+void gltf::Model::updatePose(void)
+{
+	PROFILE_SCOPE("transforms");
+	// parents are stored first, their world matrices are always ready
+	for (node_t &node : scene->nodes) {
+		node.world = node.parent == SCENE_NO_HANDLE ? node.localMatrix() : scene->nodes[node.parent].world * node.localMatrix();
+	}
+
+	for (const node_t &node : scene->nodes) {
+		if (node.mesh == SCENE_NO_HANDLE || node.skin == SCENE_NO_HANDLE) { continue; }
+		const mesh_t &mesh = scene->meshes[node.mesh];
+		const skin_t &skin = scene->skins[node.skin];
+		const glm::mat4 inverse = glm::inverse(node.world);
+		for (uint32_t i = 0; i < mesh.jointcount; i++) {
+			const uint32_t joint = skin.firstjoint + i;
+			scene->palettes[mesh.palette + i] = inverse * scene->nodes[scene->joints[joint]].world * scene->inversebinds[joint];
+		}
 	}
 }
 
-void gltf::Model::display(Shader *shader, float scale)
+// copy the draws of the current pose into the packet of this frame
+void gltf::Model::record(struct frame_packet &packet, float scale)
 {
-	glBindVertexArray(VAO);
+	PROFILE_SCOPE("record");
+	if (geometry.vertices.block == GEOMETRY_NO_BLOCK) { return; }
+
+	glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scale));
+	for (const node_t &node : scene->nodes) {
+		if (node.light > -1) {
+			// lights shine down their local -Z axis
+			const light_t &light = lights[node.light];
+			const glm::mat4 m = S * node.world;
+			const glm::vec3 direction = glm::mat3(m) * glm::vec3(0.f, 0.f, -1.f);
+			const float range = light.range > 0.f ? light.range * scale : 0.f;
+			packet.lights.push_back(make_light(light.type, glm::vec3(m[3]), direction, light.color, light.intensity, range, light.innercone, light.outercone));
+		}
+		if (node.mesh == SCENE_NO_HANDLE) { continue; }
+		const mesh_t &mesh = scene->meshes[node.mesh];
+		const glm::mat4 m = S * node.world;
+		const uint32_t palette = uint32_t(packet.palettes.size());
+		const uint32_t jointcount = mesh.jointcount;
+		packet.palettes.insert(packet.palettes.end(), scene->palettes.begin() + mesh.palette, scene->palettes.begin() + mesh.palette + jointcount);
+		for (uint32_t i = 0; i < mesh.primitivecount; i++) {
+			const primitive_t *prim = &scene->primitives[mesh.firstprimitive + i];
+			const material_t &material = materials[prim->material];
+			struct draw_t draw;
+			draw.geometry = geometry;
+			draw.model = m;
+			draw.center = glm::vec3(m * glm::vec4(prim->center, 1.f));
+			draw.features = jointcount > 0 ? prim->features : prim->features & ~uint32_t(FEATURE_SKINNED);
+			draw.palette = palette;
+			draw.jointcount = jointcount;
+			draw.indexed = prim->indexed;
+			draw.firstvertex = GLint(geometry.vertices.first + prim->firstvertex);
+			draw.firstindex = geometry.indices.first + prim->firstindex;
+			draw.count = GLsizei(prim->indexed ? prim->indexcount : prim->vertexcount);
+			draw.basecolor = material.basecolor;
+			draw.basealpha = material.basealpha;
+			draw.metallic = material.metallicf;
+			draw.roughness = material.roughnessf;
+			draw.alphacutoff = material.alphacutoff;
+			draw.basecolormap = material.basecolormap;
+			draw.metalroughmap = material.metalroughmap;
+			draw.normalmap = material.normalmap;
+			packet.draws.push_back(draw);
+		}
+	}
+}
 
-	shader->uniform_bool("skinned", !skins.empty());
+void gltf::Model::bounds(glm::vec3 *center, float *radius)
+{
+	glm::vec3 bmin(std::numeric_limits<float>::max());
+	glm::vec3 bmax(-std::numeric_limits<float>::max());
+	for (const node_t &node : scene->nodes) {
+		if (node.mesh == SCENE_NO_HANDLE) { continue; }
+		const mesh_t &mesh = scene->meshes[node.mesh];
+		glm::mat4 m = node.world;
+		float maxscale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+		for (uint32_t i = 0; i < mesh.primitivecount; i++) {
+			const primitive_t *prim = &scene->primitives[mesh.firstprimitive + i];
+			glm::vec3 c = glm::vec3(m * glm::vec4(prim->center, 1.f));
+			bmin = glm::min(bmin, c - glm::vec3(prim->radius * maxscale));
+			bmax = glm::max(bmax, c + glm::vec3(prim->radius * maxscale));
+		}
+	}
 
-	for (gltf::node_t *node : linearNodes) {
-		if (node->mesh) {
-			glm::mat4 m = node->getMatrix();
-			glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scale));
-			shader->uniform_mat4("model", S * m);
-			shader->uniform_array_mat4("u_joint_matrix", node->mesh->uniformblock.jointcount, node->mesh->uniformblock.jointMatrix); 
-			for (const gltf::primitive_t *prim : node->mesh->primitives) {
-				shader->uniform_vec3("basedcolor", prim->material.basecolor);
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, prim->material.basecolormap);
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, prim->material.metalroughmap);
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, prim->material.normalmap);
+	if (bmin.x > bmax.x) {
+		*center = glm::vec3(0.f);
+		*radius = 1.f;
+		return;
+	}
+	*center = 0.5f * (bmin + bmax);
+	*radius = std::max(0.5f * glm::length(bmax - bmin), 1e-3f);
+}
 
-				if (prim->indexed == false) {
-					glDrawArrays(GL_TRIANGLES, prim->firstvertex, prim->vertexcount);
-				} else {
-					glDrawElementsBaseVertex(GL_TRIANGLES, prim->indexcount, GL_UNSIGNED_INT, (GLvoid *)((prim->firstindex)*sizeof(GL_UNSIGNED_INT)), prim->firstvertex);
-				/* TODO use primitive restart */
-				}
+// mip levels each visible primitive needs, handed to the texture streamer on the GL thread
+void gltf::Model::request_mips(const glm::mat4 &project, const glm::mat4 &view, float scale, float viewheight, std::vector<struct mip_request> &requests)
+{
+	PROFILE_SCOPE("mip requests");
+	glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scale));
+	for (const node_t &node : scene->nodes) {
+		if (node.mesh == SCENE_NO_HANDLE) { continue; }
+		const mesh_t &mesh = scene->meshes[node.mesh];
+		glm::mat4 modelview = view * S * node.world;
+		float maxscale = std::max(glm::length(glm::vec3(modelview[0])), std::max(glm::length(glm::vec3(modelview[1])), glm::length(glm::vec3(modelview[2]))));
+		for (uint32_t i = 0; i < mesh.primitivecount; i++) {
+			const primitive_t *prim = &scene->primitives[mesh.firstprimitive + i];
+			glm::vec3 center = glm::vec3(modelview * glm::vec4(prim->center, 1.f));
+			float radius = prim->radius * maxscale;
+			float depth = -center.z;
+			/* behind the camera */
+			if (depth < -radius) { continue; }
+			/* projected diameter in pixels, full detail when the camera is inside the bounds */
+			float pixels = (depth > radius) ? radius * project[1][1] / depth * viewheight : std::numeric_limits<float>::max();
+
+			const material_t &mat = materials[prim->material];
+			for (const texture_t *map : { &mat.basecolormap, &mat.metalroughmap, &mat.normalmap, &mat.occlusionmap, &mat.emissivemap }) {
+				if (map->texture) { requests.push_back(mip_request{ map->texture, pixels }); }
 			}
 		}
 	}
 }
-
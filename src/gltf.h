@@ -1,53 +1,74 @@
 #pragma once
 
 #include "external/tiny_gltf.h"
+#include "geometry.hpp"
+#include "lighting.hpp"
+#include "bcn.hpp"
+#include "memory.hpp"
 
 #define MAX_NUM_JOINTS 128u
 
-struct vertex {
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 uv;
-	glm::ivec4 joints;
-	glm::vec4 weights;
-};
+struct frame_packet;
+struct mip_request;
+struct gltf_names;
 
 namespace gltf {
 
 struct node_t;
+struct geometry_writer;
+
+// GL texture and sampler objects are shared, several textures can point at the same ones
+struct texture_t {
+	GLuint texture = 0;
+	GLuint sampler = 0;
+};
 
 struct material_t {
+	enum alphamode_t { ALPHA_OPAQUE, ALPHA_MASK, ALPHA_BLEND };
 	float metallicf = 1.0f;
 	float roughnessf = 1.0f;
 	glm::vec4 basecolor = glm::vec4(0.0f);
-	GLuint basecolormap = 0;
-	GLuint metalroughmap = 0;
-	GLuint normalmap = 0;
-	GLuint occlusionmap = 0;
-	GLuint emissivemap = 0;
+	float basealpha = 1.0f;
+	alphamode_t alphamode = ALPHA_OPAQUE;
+	float alphacutoff = 0.5f;
+	texture_t basecolormap;
+	texture_t metalroughmap;
+	texture_t normalmap;
+	texture_t occlusionmap;
+	texture_t emissivemap;
+};
+
+// KHR_lights_punctual, placed by the nodes that point at it
+struct light_t {
+	enum light_type type = LIGHT_POINT;
+	glm::vec3 color{1.f};
+	float intensity = 1.f;
+	float range = 0.f; /* unlimited */
+	float innercone = 0.f;
+	float outercone = 0.7853981634f;
 };
 
+// scene objects refer to each other by their index in the storage of the model
+#define SCENE_NO_HANDLE 0xffffffffu
+
 struct primitive_t {
 	uint32_t firstindex;
 	uint32_t indexcount;
 	uint32_t firstvertex;
 	uint32_t vertexcount;
 	bool indexed;
-	material_t &material;
-
-	primitive_t(uint32_t frstindex, uint32_t indexcnt, uint32_t frstvert, uint32_t vertcnt, material_t &material) : material(material) {
-		firstindex = frstindex;
-		indexcount = indexcnt;
-		firstvertex = frstvert;
-		vertexcount = vertcnt;
-		indexed = indexcnt > 0;
-	};
+	uint32_t material; /* in the materials of the model, the last one is the default */
+	// shader_feature bits of its variant
+	uint32_t features = 0;
+	// bounding sphere in mesh space, sizes the primitive on screen for texture streaming
+	glm::vec3 center{0.f};
+	float radius = 0.f;
 };
 
 struct animchannel_t {
 	enum pathtype { TRANSLATION, ROTATION, SCALE };
 	pathtype path;
-	node_t *target;
+	uint32_t target; /* node */
 	uint32_t samplerindex;
 };
 
@@ -66,126 +87,125 @@ struct animation_t {
 	float end = std::numeric_limits<float>::min();
 };
 
+// one instance of a glTF mesh, its primitives are a range of the primitive storage
 struct mesh_t {
-	std::vector<primitive_t*> primitives;
-
-	struct uniformblock {
-	glm::mat4 matrix;
-	glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
-	float jointcount{ 0 };
-	} uniformblock;
-
-	mesh_t(glm::mat4 matrix) {
-		this->uniformblock.matrix = matrix;
-	};
-	~mesh_t() {
-		for (primitive_t *p : primitives) { delete p; }
-	};
+	uint32_t firstprimitive = 0;
+	uint32_t primitivecount = 0;
+	// joint matrices of the skinned pose, a range of the palette storage
+	uint32_t palette = 0;
+	uint32_t jointcount = 0;
 };
 
+// joints and inverse bind matrices are ranges of the joint storage
 struct skin_t {
-	std::string name;
-	node_t *skeletonRoot = nullptr;
-	std::vector<glm::mat4> inversebinds;
-	std::vector<node_t*> joints;
+	uint32_t name; /* offset in the name storage */
+	uint32_t skeleton = SCENE_NO_HANDLE;
+	uint32_t firstjoint = 0;
+	uint32_t jointcount = 0;
 };
 
 struct node_t {
-	node_t *parent;
-	uint32_t index;
-	std::vector<node_t*> children;
-	glm::mat4 matrix{1.f};
-	std::string name;
-	mesh_t *mesh;
-	skin_t *skin;
+	uint32_t parent = SCENE_NO_HANDLE;
+	uint32_t index; /* glTF node */
+	uint32_t name; /* offset in the name storage */
+	uint32_t mesh = SCENE_NO_HANDLE;
+	uint32_t skin = SCENE_NO_HANDLE;
 	int32_t skinIndex = -1;
+	int32_t light = -1;
+	glm::mat4 matrix{1.f};
 	glm::vec3 translation{};
 	glm::vec3 scale{ 1.0f };
 	glm::quat rotation{};
+	glm::mat4 world{1.f}; /* of the current pose */
 
-	glm::mat4 localMatrix() {
+	glm::mat4 localMatrix() const {
 		return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
 	}
+};
 
-	glm::mat4 getMatrix() {
-		glm::mat4 m = localMatrix();
-		gltf::node_t *p = parent;
-		while (p) {
-			m = p->localMatrix() * m;
-			p = p->parent;
-		}
-		return m;
-	}
-
-	void update() {
-		if (mesh) {
-			glm::mat4 m = getMatrix();
-			if (skin) {
-			mesh->uniformblock.matrix = m;
-			glm::mat4 inverseTransform = glm::inverse(m);
-			size_t numJoints = std::min((uint32_t)skin->joints.size(), MAX_NUM_JOINTS);
-			for (size_t i = 0; i < numJoints; i++) {
-			gltf::node_t *jointNode = skin->joints[i];
-			glm::mat4 jointMat = jointNode->getMatrix() * skin->inversebinds[i];
-			jointMat = inverseTransform * jointMat;
-			mesh->uniformblock.jointMatrix[i] = jointMat;
-			}
-			mesh->uniformblock.jointcount = (float)numJoints;
-			}
-		}
-
-		for (auto& child : children) {
-			child->update();
-		}
-	}
-
-	~node_t() {
-		if (mesh) {
-			delete mesh;
-		}
-		for (auto &child : children) { delete child; }
-	}
+// every scene object of a model in a few flat arrays, sized once per import and recycled between models
+struct scene_storage {
+	std::vector<node_t> nodes; /* parents always come before their children */
+	std::vector<uint32_t> roots;
+	std::vector<uint32_t> lookup; /* node of each glTF node, SCENE_NO_HANDLE outside the scene */
+	std::vector<mesh_t> meshes;
+	std::vector<primitive_t> primitives;
+	std::vector<skin_t> skins; /* in glTF order */
+	std::vector<uint32_t> joints; /* nodes */
+	std::vector<glm::mat4> inversebinds; /* one per joint */
+	std::vector<glm::mat4> palettes;
+	std::string names; /* NUL terminated */
+
+	// drops the objects and keeps the capacity, nothing in here has a destructor to run
+	void clear(void);
+	size_t bytes(void) const;
+};
 
+// storage of a deleted model if there is one, so loading after unloading doesn't allocate
+struct scene_storage *acquire_scene_storage(void);
+void release_scene_storage(struct scene_storage *storage);
+
+// image loader of read_gltf that keeps images encoded and only reads their size and channels
+bool keep_encoded_image(tinygltf::Image *image, const int index, std::string *err, std::string *warn, int req_width, int req_height, const unsigned char *bytes, int size, void *user);
+
+// image a texture samples, the KTX2_TEXTURE_EXTENSION source if there is one
+int texture_source(const tinygltf::Texture &texture);
+// block compression format of each texture, from how the materials use it
+void texture_formats(const tinygltf::Model &gltfmodel, std::vector<enum bcn_format> &formats);
+
+// milliseconds spent in each phase of the last import
+struct import_timings {
+	double textures;
+	double meshes; /* decoding vertices and indices, including the upload */
+	double animations;
+	double skins;
+	double total;
 };
 
 class Model {
 public:
-	void importf(std::string fpath);
+	Model() = default;
+	Model(const Model&) = delete;
+	Model &operator=(const Model&) = delete;
+	~Model();
+	bool importf(std::string fpath);
+	// everything after parsing, without gpu nothing touches GL and the geometry only goes to memory
+	// names pooled by the reader replace the ones in the model
+	bool load(tinygltf::Model &model, bool gpu = true, const struct gltf_names *names = nullptr);
+	// samples the animation and updates the pose if a node moved
 	void updateAnimation(uint32_t index, float time);
-	void display(Shader *shader, float scale);
+	// only the keyframe sampling, true if a node transform changed
+	bool sampleAnimation(uint32_t index, float time);
+	// propagates the node transforms and rebuilds the joint palettes
+	void updatePose(void);
+	void record(struct frame_packet &packet, float scale);
+	// bounding sphere of the current pose
+	void bounds(glm::vec3 *center, float *radius);
+	void request_mips(const glm::mat4 &project, const glm::mat4 &view, float scale, float viewheight, std::vector<struct mip_request> &requests);
 	std::vector<animation_t> animations;
+	struct import_timings timings = {};
 private:
-	GLuint VAO = 0;
-	std::vector<node_t*> nodes;
-	std::vector<node_t*> linearNodes;
-	std::vector<skin_t*> skins;
-	std::vector<GLuint> textures;
+	// vertex and index ranges in the shared geometry arena, primitive offsets are relative to them
+	geometry_t geometry;
+	struct scene_storage *scene = nullptr;
+	std::vector<texture_t> textures;
 	std::vector<material_t> materials;
+	std::vector<light_t> lights;
+	// heap bytes reported to each memory tag, taken back when the model is deleted
+	size_t accounted[MEMORY_TAG_COUNT] = {};
 private:
 	void load_textures(tinygltf::Model &gltfmodel);
 	void load_materials(tinygltf::Model &gltfmodel);
-	void load_node(gltf::node_t *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<uint32_t> &indexBuffer, std::vector<vertex> &vertexBuffer);
+	void load_lights(const tinygltf::Model &gltfmodel);
+	void load_node(uint32_t parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, geometry_writer &writer);
 	void load_animations(tinygltf::Model &gltfModel);
-	void load_skins(tinygltf::Model &gltfModel);
-	void load_mesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh, gltf::mesh_t *newmesh, std::vector<uint32_t> &indexbuffer, std::vector<vertex> &vertexbuffer);
+	void load_skins(tinygltf::Model &gltfModel, const struct gltf_names *names);
+	void load_mesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh, uint32_t meshhandle, geometry_writer &writer);
+	void account_memory(void);
 private:
-	node_t *findnode(node_t *parent, uint32_t index) {
-		node_t* found = nullptr;
-		if (parent->index == index) { return parent; }
-		for (auto &child : parent->children) {
-			found = findnode(child, index);
-			if (found) { break; }
-		}
-		return found;
-	}
-
-	node_t *nodefrom(uint32_t index) {
-		node_t *found = nullptr;
-		for (auto &node : nodes) {
-			found = findnode(node, index);
-			if (found) { break; }
-		}
-		return found;
+	// node created for a glTF node, SCENE_NO_HANDLE if the scene doesn't use it
+	uint32_t nodefrom(uint32_t index) {
+		return index < scene->lookup.size() ? scene->lookup[index] : SCENE_NO_HANDLE;
 	}
 };
 
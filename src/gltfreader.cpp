@@ -0,0 +1,1406 @@
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "external/tiny_gltf.h"
+
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "base64.hpp"
+#include "meshcodec.hpp"
+#include "ktx.hpp"
+#include "gltfreader.hpp"
+
+#define GLB_MAGIC 0x46546C67 /* "glTF" */
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+#define JSON_MAX_DEPTH 256 /* glTF nests a few levels, anything deeper is a broken file */
+#define BASE64_SLICE (1 << 20) /* characters of a data URI decoded by one task, a multiple of 4 */
+#define KEY_MAX_LENGTH 32 /* longer keys are none the reader knows */
+
+// the object or array the parser is in, decides what the values of its keys are read into
+enum scope {
+	SCOPE_ROOT,
+	SCOPE_LIST, /* array of objects, each one a new element */
+	SCOPE_NUMBERS,
+	SCOPE_INTEGERS,
+	SCOPE_EXTENSIONS,
+	SCOPE_LIGHTS_PUNCTUAL,
+	SCOPE_LIGHT,
+	SCOPE_SPOT,
+	SCOPE_SCENE,
+	SCOPE_NODE,
+	SCOPE_NODE_EXTENSIONS,
+	SCOPE_NODE_LIGHT,
+	SCOPE_MESH,
+	SCOPE_PRIMITIVE,
+	SCOPE_ATTRIBUTES,
+	SCOPE_PRIMITIVE_EXTENSIONS,
+	SCOPE_DRACO,
+	SCOPE_DRACO_ATTRIBUTES,
+	SCOPE_ACCESSOR,
+	SCOPE_BUFFER_VIEW,
+	SCOPE_BUFFER_VIEW_EXTENSIONS,
+	SCOPE_MESHOPT,
+	SCOPE_BUFFER,
+	SCOPE_BUFFER_EXTENSIONS,
+	SCOPE_MESHOPT_BUFFER,
+	SCOPE_MATERIAL,
+	SCOPE_PBR,
+	SCOPE_TEXTURE_INFO,
+	SCOPE_TEXTURE,
+	SCOPE_TEXTURE_EXTENSIONS,
+	SCOPE_KTX2,
+	SCOPE_IMAGE,
+	SCOPE_SAMPLER,
+	SCOPE_SKIN,
+	SCOPE_ANIMATION,
+	SCOPE_ANIMATION_SAMPLER,
+	SCOPE_CHANNEL,
+	SCOPE_CHANNEL_TARGET
+};
+
+enum key {
+	KEY_UNKNOWN,
+	KEY_SCENE, KEY_SCENES, KEY_NODES, KEY_MESHES, KEY_ACCESSORS, KEY_BUFFER_VIEWS, KEY_BUFFERS,
+	KEY_MATERIALS, KEY_TEXTURES, KEY_IMAGES, KEY_SAMPLERS, KEY_SKINS, KEY_ANIMATIONS, KEY_EXTENSIONS,
+	KEY_NAME, KEY_CHILDREN, KEY_MESH, KEY_SKIN, KEY_MATRIX, KEY_TRANSLATION, KEY_ROTATION, KEY_SCALE,
+	KEY_LIGHTS_PUNCTUAL, KEY_LIGHT, KEY_LIGHTS, KEY_TYPE, KEY_COLOR, KEY_INTENSITY, KEY_RANGE, KEY_SPOT,
+	KEY_INNER_CONE_ANGLE, KEY_OUTER_CONE_ANGLE,
+	KEY_PRIMITIVES, KEY_ATTRIBUTES, KEY_INDICES, KEY_MATERIAL, KEY_MODE,
+	KEY_BUFFER_VIEW, KEY_BYTE_OFFSET, KEY_COMPONENT_TYPE, KEY_COUNT, KEY_NORMALIZED, KEY_MIN, KEY_MAX,
+	KEY_BUFFER, KEY_BYTE_LENGTH, KEY_BYTE_STRIDE, KEY_TARGET, KEY_URI, KEY_MIME_TYPE,
+	KEY_PBR, KEY_BASE_COLOR_FACTOR, KEY_BASE_COLOR_TEXTURE, KEY_METALLIC_FACTOR, KEY_ROUGHNESS_FACTOR,
+	KEY_METALLIC_ROUGHNESS_TEXTURE, KEY_NORMAL_TEXTURE, KEY_OCCLUSION_TEXTURE, KEY_EMISSIVE_TEXTURE,
+	KEY_EMISSIVE_FACTOR, KEY_ALPHA_MODE, KEY_ALPHA_CUTOFF, KEY_DOUBLE_SIDED, KEY_INDEX, KEY_TEX_COORD, KEY_STRENGTH,
+	KEY_SOURCE, KEY_SAMPLER, KEY_KTX2, KEY_MAG_FILTER, KEY_MIN_FILTER, KEY_WRAP_S, KEY_WRAP_T,
+	KEY_INVERSE_BIND_MATRICES, KEY_SKELETON, KEY_JOINTS, KEY_CHANNELS, KEY_INPUT, KEY_OUTPUT,
+	KEY_INTERPOLATION, KEY_NODE, KEY_PATH, KEY_MESHOPT, KEY_FILTER, KEY_FALLBACK, KEY_DRACO
+};
+
+struct key_name {
+	std::string_view name;
+	enum key key;
+};
+
+static const struct key_name KEYS[] = {
+	{ "scene", KEY_SCENE }, { "scenes", KEY_SCENES }, { "nodes", KEY_NODES }, { "meshes", KEY_MESHES },
+	{ "accessors", KEY_ACCESSORS }, { "bufferViews", KEY_BUFFER_VIEWS }, { "buffers", KEY_BUFFERS },
+	{ "materials", KEY_MATERIALS }, { "textures", KEY_TEXTURES }, { "images", KEY_IMAGES },
+	{ "samplers", KEY_SAMPLERS }, { "skins", KEY_SKINS }, { "animations", KEY_ANIMATIONS },
+	{ "extensions", KEY_EXTENSIONS }, { "name", KEY_NAME }, { "children", KEY_CHILDREN }, { "mesh", KEY_MESH },
+	{ "skin", KEY_SKIN }, { "matrix", KEY_MATRIX }, { "translation", KEY_TRANSLATION }, { "rotation", KEY_ROTATION },
+	{ "scale", KEY_SCALE }, { "KHR_lights_punctual", KEY_LIGHTS_PUNCTUAL }, { "light", KEY_LIGHT },
+	{ "lights", KEY_LIGHTS }, { "type", KEY_TYPE }, { "color", KEY_COLOR }, { "intensity", KEY_INTENSITY },
+	{ "range", KEY_RANGE }, { "spot", KEY_SPOT }, { "innerConeAngle", KEY_INNER_CONE_ANGLE },
+	{ "outerConeAngle", KEY_OUTER_CONE_ANGLE }, { "primitives", KEY_PRIMITIVES }, { "attributes", KEY_ATTRIBUTES },
+	{ "indices", KEY_INDICES }, { "material", KEY_MATERIAL }, { "mode", KEY_MODE }, { "bufferView", KEY_BUFFER_VIEW },
+	{ "byteOffset", KEY_BYTE_OFFSET }, { "componentType", KEY_COMPONENT_TYPE }, { "count", KEY_COUNT },
+	{ "normalized", KEY_NORMALIZED }, { "min", KEY_MIN }, { "max", KEY_MAX }, { "buffer", KEY_BUFFER },
+	{ "byteLength", KEY_BYTE_LENGTH }, { "byteStride", KEY_BYTE_STRIDE }, { "target", KEY_TARGET },
+	{ "uri", KEY_URI }, { "mimeType", KEY_MIME_TYPE }, { "pbrMetallicRoughness", KEY_PBR },
+	{ "baseColorFactor", KEY_BASE_COLOR_FACTOR }, { "baseColorTexture", KEY_BASE_COLOR_TEXTURE },
+	{ "metallicFactor", KEY_METALLIC_FACTOR }, { "roughnessFactor", KEY_ROUGHNESS_FACTOR },
+	{ "metallicRoughnessTexture", KEY_METALLIC_ROUGHNESS_TEXTURE }, { "normalTexture", KEY_NORMAL_TEXTURE },
+	{ "occlusionTexture", KEY_OCCLUSION_TEXTURE }, { "emissiveTexture", KEY_EMISSIVE_TEXTURE },
+	{ "emissiveFactor", KEY_EMISSIVE_FACTOR }, { "alphaMode", KEY_ALPHA_MODE }, { "alphaCutoff", KEY_ALPHA_CUTOFF },
+	{ "doubleSided", KEY_DOUBLE_SIDED }, { "index", KEY_INDEX }, { "texCoord", KEY_TEX_COORD },
+	{ "strength", KEY_STRENGTH }, { "source", KEY_SOURCE }, { "sampler", KEY_SAMPLER },
+	{ KTX2_TEXTURE_EXTENSION, KEY_KTX2 }, { "magFilter", KEY_MAG_FILTER }, { "minFilter", KEY_MIN_FILTER },
+	{ "wrapS", KEY_WRAP_S }, { "wrapT", KEY_WRAP_T }, { "inverseBindMatrices", KEY_INVERSE_BIND_MATRICES },
+	{ "skeleton", KEY_SKELETON }, { "joints", KEY_JOINTS }, { "channels", KEY_CHANNELS }, { "input", KEY_INPUT },
+	{ "output", KEY_OUTPUT }, { "interpolation", KEY_INTERPOLATION }, { "node", KEY_NODE }, { "path", KEY_PATH },
+	{ "EXT_meshopt_compression", KEY_MESHOPT }, { "filter", KEY_FILTER }, { "fallback", KEY_FALLBACK },
+	{ "KHR_draco_mesh_compression", KEY_DRACO }
+};
+
+// the keys split by length, a key is only compared with the few names as long as it, nothing is hashed or copied
+static enum key find_key(std::string_view name)
+{
+	static const std::vector<std::vector<struct key_name>> lengths = [] {
+		std::vector<std::vector<struct key_name>> table(KEY_MAX_LENGTH + 1);
+		for (const struct key_name &entry : KEYS) { table[entry.name.size()].push_back(entry); }
+		return table;
+	}();
+	if (name.size() > KEY_MAX_LENGTH) { return KEY_UNKNOWN; }
+	for (const struct key_name &entry : lengths[name.size()]) {
+		if (entry.name == name) { return entry.key; }
+	}
+
+	return KEY_UNKNOWN;
+}
+
+struct reader_frame {
+	enum scope scope;
+	enum key key; /* whose value comes next */
+	enum scope element; /* of a list */
+	enum key slot; /* texture of a texture info */
+	std::vector<double> *numbers;
+	std::vector<int> *integers;
+};
+
+// a buffer view whose data is coded into another buffer, the view itself names where the decoded data goes
+struct meshopt_view {
+	int view;
+	int buffer;
+	size_t byteoffset;
+	size_t bytelength;
+	size_t stride;
+	size_t count;
+	enum meshopt_mode mode;
+	enum meshopt_filter filter;
+};
+
+// a primitive whose indices and listed attributes are all in one Draco mesh
+struct draco_primitive {
+	int mesh;
+	int primitive;
+	int view;
+	std::vector<std::pair<std::string, int>> attributes; /* glTF attribute and the Draco id it comes from */
+};
+
+static int accessor_type(std::string_view type)
+{
+	if (type == "SCALAR") { return TINYGLTF_TYPE_SCALAR; }
+	if (type == "VEC2") { return TINYGLTF_TYPE_VEC2; }
+	if (type == "VEC3") { return TINYGLTF_TYPE_VEC3; }
+	if (type == "VEC4") { return TINYGLTF_TYPE_VEC4; }
+	if (type == "MAT2") { return TINYGLTF_TYPE_MAT2; }
+	if (type == "MAT3") { return TINYGLTF_TYPE_MAT3; }
+	if (type == "MAT4") { return TINYGLTF_TYPE_MAT4; }
+
+	return -1;
+}
+
+// the legacy parameter maps the material import reads
+static tinygltf::Parameter &texture_parameter(tinygltf::Material &material, enum key slot)
+{
+	switch (slot) {
+	case KEY_BASE_COLOR_TEXTURE: return material.values["baseColorTexture"];
+	case KEY_METALLIC_ROUGHNESS_TEXTURE: return material.values["metallicRoughnessTexture"];
+	case KEY_NORMAL_TEXTURE: return material.additionalValues["normalTexture"];
+	case KEY_OCCLUSION_TEXTURE: return material.additionalValues["occlusionTexture"];
+	default: return material.additionalValues["emissiveTexture"];
+	}
+}
+
+static int texture_index(const tinygltf::ParameterMap &values, const char *name)
+{
+	auto found = values.find(name);
+	return found != values.end() ? found->second.TextureIndex() : -1;
+}
+
+// offset of the name appended to the pool
+static uint32_t pool_name(struct gltf_names *names, std::string_view name)
+{
+	const uint32_t offset = uint32_t(names->pool.size());
+	names->pool.append(name.data(), name.size());
+	names->pool += '\0';
+
+	return offset;
+}
+
+// receives the tokens of the JSON parser, nothing is kept but what goes into the model
+struct gltf_handler {
+	tinygltf::Model *model;
+	std::string *err;
+	std::vector<struct reader_frame> stack;
+	uint32_t skipped = 0; /* depth inside a value nobody reads */
+	std::string attribute; /* key inside the attributes of a primitive */
+	std::vector<size_t> bytelengths; /* of each buffer */
+	std::vector<bool> fallbacks; /* buffers that only stand in for meshopt compressed views */
+	std::vector<struct meshopt_view> meshopt;
+	std::vector<struct draco_primitive> draco;
+	struct gltf_names *names; /* node and skin names go here instead of the model if set */
+
+	tinygltf::Node &node(void) { return model->nodes.back(); }
+	tinygltf::Primitive &primitive(void) { return model->meshes.back().primitives.back(); }
+	tinygltf::Material &material(void) { return model->materials.back(); }
+	tinygltf::Texture &texture(void) { return model->textures.back(); }
+	tinygltf::Animation &animation(void) { return model->animations.back(); }
+	tinygltf::Light &light(void) { return model->lights.back(); }
+
+	void push(enum scope scope)
+	{
+		stack.push_back({ scope, KEY_UNKNOWN, SCOPE_ROOT, KEY_UNKNOWN, nullptr, nullptr });
+	}
+
+	bool fail(const char *message)
+	{
+		*err += message;
+		*err += "\n";
+		return false;
+	}
+
+	bool number(double value);
+	bool string(std::string_view value);
+	bool boolean(bool value);
+	bool start_object(void);
+	bool start_array(void);
+	bool end_object(void);
+
+	bool key(std::string_view name)
+	{
+		if (skipped > 0) { return true; }
+		struct reader_frame &frame = stack.back();
+		frame.key = find_key(name);
+		if (frame.scope == SCOPE_ATTRIBUTES || frame.scope == SCOPE_DRACO_ATTRIBUTES) { attribute = name; }
+		return true;
+	}
+
+	bool end_array(void)
+	{
+		if (skipped > 0) { skipped--; } else { stack.pop_back(); }
+		return true;
+	}
+};
+
+// indices and sizes are JSON numbers, casting one that doesn't fit is undefined
+static inline bool fits_int(double value)
+{
+	return value >= double(INT_MIN) && value <= double(INT_MAX);
+}
+
+// below 2^53 every integer is exact
+static inline bool fits_size(double value)
+{
+	return value >= 0.0 && value < std::min(9007199254740992.0, double(SIZE_MAX));
+}
+
+bool gltf_handler::number(double value)
+{
+	if (skipped > 0) { return true; }
+	if (stack.empty()) { return fail("glTF document is not an object"); }
+
+	const struct reader_frame &frame = stack.back();
+	/* only read by the keys that hold an index or a size, checked once the value is stored */
+	bool overflow = false;
+	auto index = [&]() -> int {
+		overflow |= !fits_int(value);
+		return overflow ? -1 : int(value);
+	};
+	auto size = [&]() -> size_t {
+		overflow |= !fits_size(value);
+		return overflow ? 0 : size_t(value);
+	};
+	switch (frame.scope) {
+	case SCOPE_NUMBERS: frame.numbers->push_back(value); break;
+	case SCOPE_INTEGERS: frame.integers->push_back(index()); break;
+	case SCOPE_ROOT:
+		if (frame.key == KEY_SCENE) { model->defaultScene = index(); }
+		break;
+	case SCOPE_NODE:
+		if (frame.key == KEY_MESH) { node().mesh = index(); }
+		if (frame.key == KEY_SKIN) { node().skin = index(); }
+		break;
+	case SCOPE_NODE_LIGHT:
+		if (frame.key == KEY_LIGHT) {
+			node().extensions["KHR_lights_punctual"] = tinygltf::Value(tinygltf::Value::Object{ { "light", tinygltf::Value(index()) } });
+		}
+		break;
+	case SCOPE_PRIMITIVE:
+		if (frame.key == KEY_INDICES) { primitive().indices = index(); }
+		if (frame.key == KEY_MATERIAL) { primitive().material = index(); }
+		if (frame.key == KEY_MODE) { primitive().mode = index(); }
+		break;
+	case SCOPE_ATTRIBUTES: primitive().attributes[attribute] = index(); break;
+	case SCOPE_DRACO:
+		if (frame.key == KEY_BUFFER_VIEW) { draco.back().view = index(); }
+		break;
+	case SCOPE_DRACO_ATTRIBUTES: draco.back().attributes.emplace_back(attribute, index()); break;
+	case SCOPE_ACCESSOR: {
+		tinygltf::Accessor &accessor = model->accessors.back();
+		if (frame.key == KEY_BUFFER_VIEW) { accessor.bufferView = index(); }
+		if (frame.key == KEY_BYTE_OFFSET) { accessor.byteOffset = size(); }
+		if (frame.key == KEY_COMPONENT_TYPE) { accessor.componentType = index(); }
+		if (frame.key == KEY_COUNT) { accessor.count = size(); }
+		break;
+	}
+	case SCOPE_BUFFER_VIEW: {
+		tinygltf::BufferView &view = model->bufferViews.back();
+		if (frame.key == KEY_BUFFER) { view.buffer = index(); }
+		if (frame.key == KEY_BYTE_OFFSET) { view.byteOffset = size(); }
+		if (frame.key == KEY_BYTE_LENGTH) { view.byteLength = size(); }
+		if (frame.key == KEY_BYTE_STRIDE) { view.byteStride = size(); }
+		if (frame.key == KEY_TARGET) { view.target = index(); }
+		break;
+	}
+	case SCOPE_MESHOPT: {
+		struct meshopt_view &view = meshopt.back();
+		if (frame.key == KEY_BUFFER) { view.buffer = index(); }
+		if (frame.key == KEY_BYTE_OFFSET) { view.byteoffset = size(); }
+		if (frame.key == KEY_BYTE_LENGTH) { view.bytelength = size(); }
+		if (frame.key == KEY_BYTE_STRIDE) { view.stride = size(); }
+		if (frame.key == KEY_COUNT) { view.count = size(); }
+		break;
+	}
+	case SCOPE_BUFFER:
+		if (frame.key == KEY_BYTE_LENGTH) { bytelengths.back() = size(); }
+		break;
+	case SCOPE_MATERIAL:
+		if (frame.key == KEY_ALPHA_CUTOFF) { material().alphaCutoff = value; }
+		break;
+	case SCOPE_PBR:
+		if (frame.key == KEY_METALLIC_FACTOR || frame.key == KEY_ROUGHNESS_FACTOR) {
+			tinygltf::Parameter &factor = material().values[frame.key == KEY_METALLIC_FACTOR ? "metallicFactor" : "roughnessFactor"];
+			factor.number_value = value;
+			factor.has_number_value = true;
+		}
+		break;
+	case SCOPE_TEXTURE_INFO: {
+		tinygltf::Parameter &parameter = texture_parameter(material(), frame.slot);
+		if (frame.key == KEY_INDEX) { parameter.json_double_value["index"] = value; }
+		if (frame.key == KEY_TEX_COORD) { parameter.json_double_value["texCoord"] = value; }
+		if (frame.key == KEY_SCALE) { parameter.json_double_value["scale"] = value; }
+		if (frame.key == KEY_STRENGTH) { parameter.json_double_value["strength"] = value; }
+		break;
+	}
+	case SCOPE_TEXTURE:
+		if (frame.key == KEY_SOURCE) { texture().source = index(); }
+		if (frame.key == KEY_SAMPLER) { texture().sampler = index(); }
+		break;
+	case SCOPE_KTX2:
+		if (frame.key == KEY_SOURCE) {
+			texture().extensions[KTX2_TEXTURE_EXTENSION] = tinygltf::Value(tinygltf::Value::Object{ { "source", tinygltf::Value(index()) } });
+		}
+		break;
+	case SCOPE_IMAGE:
+		if (frame.key == KEY_BUFFER_VIEW) { model->images.back().bufferView = index(); }
+		break;
+	case SCOPE_SAMPLER: {
+		tinygltf::Sampler &sampler = model->samplers.back();
+		if (frame.key == KEY_MAG_FILTER) { sampler.magFilter = index(); }
+		if (frame.key == KEY_MIN_FILTER) { sampler.minFilter = index(); }
+		if (frame.key == KEY_WRAP_S) { sampler.wrapS = index(); }
+		if (frame.key == KEY_WRAP_T) { sampler.wrapT = index(); }
+		break;
+	}
+	case SCOPE_SKIN:
+		if (frame.key == KEY_INVERSE_BIND_MATRICES) { model->skins.back().inverseBindMatrices = index(); }
+		if (frame.key == KEY_SKELETON) { model->skins.back().skeleton = index(); }
+		break;
+	case SCOPE_ANIMATION_SAMPLER:
+		if (frame.key == KEY_INPUT) { animation().samplers.back().input = index(); }
+		if (frame.key == KEY_OUTPUT) { animation().samplers.back().output = index(); }
+		break;
+	case SCOPE_CHANNEL:
+		if (frame.key == KEY_SAMPLER) { animation().channels.back().sampler = index(); }
+		break;
+	case SCOPE_CHANNEL_TARGET:
+		if (frame.key == KEY_NODE) { animation().channels.back().target_node = index(); }
+		break;
+	case SCOPE_LIGHT:
+		if (frame.key == KEY_INTENSITY) { light().intensity = value; }
+		if (frame.key == KEY_RANGE) { light().range = value; }
+		break;
+	case SCOPE_SPOT:
+		if (frame.key == KEY_INNER_CONE_ANGLE) { light().spot.innerConeAngle = value; }
+		if (frame.key == KEY_OUTER_CONE_ANGLE) { light().spot.outerConeAngle = value; }
+		break;
+	default: break;
+	}
+
+	if (overflow) { return fail("glTF index or size out of range"); }
+
+	return true;
+}
+
+bool gltf_handler::string(std::string_view value)
+{
+	if (skipped > 0) { return true; }
+	if (stack.empty()) { return fail("glTF document is not an object"); }
+
+	const struct reader_frame &frame = stack.back();
+	if (frame.key == KEY_NAME) {
+		switch (frame.scope) {
+		case SCOPE_SCENE: model->scenes.back().name = value; break;
+		case SCOPE_NODE:
+			if (names) {
+				names->nodes.back() = pool_name(names, value);
+			} else {
+				node().name = value;
+			}
+			break;
+		case SCOPE_MESH: model->meshes.back().name = value; break;
+		case SCOPE_ACCESSOR: model->accessors.back().name = value; break;
+		case SCOPE_BUFFER_VIEW: model->bufferViews.back().name = value; break;
+		case SCOPE_BUFFER: model->buffers.back().name = value; break;
+		case SCOPE_MATERIAL: material().name = value; break;
+		case SCOPE_TEXTURE: texture().name = value; break;
+		case SCOPE_IMAGE: model->images.back().name = value; break;
+		case SCOPE_SAMPLER: model->samplers.back().name = value; break;
+		case SCOPE_SKIN:
+			if (names) {
+				names->skins.back() = pool_name(names, value);
+			} else {
+				model->skins.back().name = value;
+			}
+			break;
+		case SCOPE_ANIMATION: animation().name = value; break;
+		case SCOPE_LIGHT: light().name = value; break;
+		default: break;
+		}
+		return true;
+	}
+
+	switch (frame.scope) {
+	case SCOPE_ACCESSOR:
+		if (frame.key == KEY_TYPE) { model->accessors.back().type = accessor_type(value); }
+		break;
+	case SCOPE_BUFFER:
+		if (frame.key == KEY_URI) { model->buffers.back().uri = value; }
+		break;
+	case SCOPE_MESHOPT:
+		if (frame.key == KEY_MODE) {
+			if (value == "ATTRIBUTES") {
+				meshopt.back().mode = MESHOPT_ATTRIBUTES;
+			} else if (value == "TRIANGLES") {
+				meshopt.back().mode = MESHOPT_TRIANGLES;
+			} else if (value == "INDICES") {
+				meshopt.back().mode = MESHOPT_INDICES;
+			} else {
+				return fail("unknown EXT_meshopt_compression mode");
+			}
+		}
+		if (frame.key == KEY_FILTER) {
+			if (value == "NONE") {
+				meshopt.back().filter = MESHOPT_FILTER_NONE;
+			} else if (value == "OCTAHEDRAL") {
+				meshopt.back().filter = MESHOPT_FILTER_OCTAHEDRAL;
+			} else if (value == "QUATERNION") {
+				meshopt.back().filter = MESHOPT_FILTER_QUATERNION;
+			} else if (value == "EXPONENTIAL") {
+				meshopt.back().filter = MESHOPT_FILTER_EXPONENTIAL;
+			} else {
+				return fail("unknown EXT_meshopt_compression filter");
+			}
+		}
+		break;
+	case SCOPE_IMAGE:
+		if (frame.key == KEY_URI) { model->images.back().uri = value; }
+		if (frame.key == KEY_MIME_TYPE) { model->images.back().mimeType = value; }
+		break;
+	case SCOPE_MATERIAL:
+		if (frame.key == KEY_ALPHA_MODE) { material().alphaMode = value; }
+		break;
+	case SCOPE_ANIMATION_SAMPLER:
+		if (frame.key == KEY_INTERPOLATION) { animation().samplers.back().interpolation = value; }
+		break;
+	case SCOPE_CHANNEL_TARGET:
+		if (frame.key == KEY_PATH) { animation().channels.back().target_path = value; }
+		break;
+	case SCOPE_LIGHT:
+		if (frame.key == KEY_TYPE) { light().type = value; }
+		break;
+	default: break;
+	}
+
+	return true;
+}
+
+bool gltf_handler::boolean(bool value)
+{
+	if (skipped > 0) { return true; }
+	if (stack.empty()) { return fail("glTF document is not an object"); }
+
+	const struct reader_frame &frame = stack.back();
+	if (frame.scope == SCOPE_ACCESSOR && frame.key == KEY_NORMALIZED) { model->accessors.back().normalized = value; }
+	if (frame.scope == SCOPE_MATERIAL && frame.key == KEY_DOUBLE_SIDED) { material().doubleSided = value; }
+	if (frame.scope == SCOPE_MESHOPT_BUFFER && frame.key == KEY_FALLBACK) { fallbacks.back() = value; }
+
+	return true;
+}
+
+bool gltf_handler::start_object(void)
+{
+	if (skipped > 0) {
+		skipped++;
+		return true;
+	}
+	if (stack.empty()) {
+		push(SCOPE_ROOT);
+		return true;
+	}
+
+	const struct reader_frame frame = stack.back();
+	enum scope scope = SCOPE_LIST;
+	switch (frame.scope) {
+	case SCOPE_LIST:
+		// a new element of the list
+		switch (frame.element) {
+		case SCOPE_SCENE: model->scenes.emplace_back(); break;
+		case SCOPE_NODE:
+			model->nodes.emplace_back();
+			if (names) { names->nodes.push_back(0); }
+			break;
+		case SCOPE_MESH: model->meshes.emplace_back(); break;
+		case SCOPE_PRIMITIVE:
+			model->meshes.back().primitives.emplace_back();
+			primitive().mode = TINYGLTF_MODE_TRIANGLES;
+			break;
+		case SCOPE_ACCESSOR: model->accessors.emplace_back(); break;
+		case SCOPE_BUFFER_VIEW: model->bufferViews.emplace_back(); break;
+		case SCOPE_BUFFER:
+			model->buffers.emplace_back();
+			bytelengths.push_back(0);
+			fallbacks.push_back(false);
+			break;
+		case SCOPE_MATERIAL:
+			model->materials.emplace_back();
+			material().emissiveFactor = { 0.0, 0.0, 0.0 };
+			break;
+		case SCOPE_TEXTURE: model->textures.emplace_back(); break;
+		case SCOPE_IMAGE: model->images.emplace_back(); break;
+		case SCOPE_SAMPLER: model->samplers.emplace_back(); break;
+		case SCOPE_SKIN:
+			model->skins.emplace_back();
+			if (names) { names->skins.push_back(0); }
+			break;
+		case SCOPE_ANIMATION: model->animations.emplace_back(); break;
+		case SCOPE_ANIMATION_SAMPLER: animation().samplers.emplace_back(); break;
+		case SCOPE_CHANNEL: animation().channels.emplace_back(); break;
+		case SCOPE_LIGHT: model->lights.emplace_back(); break;
+		default: break;
+		}
+		push(frame.element);
+		return true;
+	case SCOPE_ROOT:
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_EXTENSIONS; }
+		break;
+	case SCOPE_EXTENSIONS:
+		if (frame.key == KEY_LIGHTS_PUNCTUAL) { scope = SCOPE_LIGHTS_PUNCTUAL; }
+		break;
+	case SCOPE_LIGHT:
+		if (frame.key == KEY_SPOT) { scope = SCOPE_SPOT; }
+		break;
+	case SCOPE_NODE:
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_NODE_EXTENSIONS; }
+		break;
+	case SCOPE_NODE_EXTENSIONS:
+		if (frame.key == KEY_LIGHTS_PUNCTUAL) { scope = SCOPE_NODE_LIGHT; }
+		break;
+	case SCOPE_PRIMITIVE:
+		if (frame.key == KEY_ATTRIBUTES) { scope = SCOPE_ATTRIBUTES; }
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_PRIMITIVE_EXTENSIONS; }
+		break;
+	case SCOPE_PRIMITIVE_EXTENSIONS:
+		if (frame.key == KEY_DRACO) {
+			scope = SCOPE_DRACO;
+			draco.push_back({ int(model->meshes.size()) - 1, int(model->meshes.back().primitives.size()) - 1, -1, {} });
+		}
+		break;
+	case SCOPE_DRACO:
+		if (frame.key == KEY_ATTRIBUTES) { scope = SCOPE_DRACO_ATTRIBUTES; }
+		break;
+	case SCOPE_BUFFER_VIEW:
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_BUFFER_VIEW_EXTENSIONS; }
+		break;
+	case SCOPE_BUFFER_VIEW_EXTENSIONS:
+		if (frame.key == KEY_MESHOPT) {
+			scope = SCOPE_MESHOPT;
+			meshopt.push_back({ int(model->bufferViews.size()) - 1, -1, 0, 0, 0, 0, MESHOPT_ATTRIBUTES, MESHOPT_FILTER_NONE });
+		}
+		break;
+	case SCOPE_BUFFER:
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_BUFFER_EXTENSIONS; }
+		break;
+	case SCOPE_BUFFER_EXTENSIONS:
+		if (frame.key == KEY_MESHOPT) { scope = SCOPE_MESHOPT_BUFFER; }
+		break;
+	case SCOPE_MATERIAL:
+		if (frame.key == KEY_PBR) { scope = SCOPE_PBR; }
+		if (frame.key == KEY_NORMAL_TEXTURE || frame.key == KEY_OCCLUSION_TEXTURE || frame.key == KEY_EMISSIVE_TEXTURE) { scope = SCOPE_TEXTURE_INFO; }
+		break;
+	case SCOPE_PBR:
+		if (frame.key == KEY_BASE_COLOR_TEXTURE || frame.key == KEY_METALLIC_ROUGHNESS_TEXTURE) { scope = SCOPE_TEXTURE_INFO; }
+		break;
+	case SCOPE_TEXTURE:
+		if (frame.key == KEY_EXTENSIONS) { scope = SCOPE_TEXTURE_EXTENSIONS; }
+		break;
+	case SCOPE_TEXTURE_EXTENSIONS:
+		if (frame.key == KEY_KTX2) { scope = SCOPE_KTX2; }
+		break;
+	case SCOPE_CHANNEL:
+		if (frame.key == KEY_TARGET) { scope = SCOPE_CHANNEL_TARGET; }
+		break;
+	default: break;
+	}
+
+	if (scope == SCOPE_LIST) {
+		skipped++;
+		return true;
+	}
+	push(scope);
+	if (scope == SCOPE_TEXTURE_INFO) {
+		// the parameter exists as soon as the texture is mentioned, like tinygltf has it
+		stack.back().slot = frame.key;
+		texture_parameter(material(), frame.key);
+	}
+
+	return true;
+}
+
+bool gltf_handler::start_array(void)
+{
+	if (skipped > 0) {
+		skipped++;
+		return true;
+	}
+	if (stack.empty()) { return fail("glTF document is not an object"); }
+
+	const struct reader_frame frame = stack.back();
+	enum scope element = SCOPE_ROOT;
+	std::vector<double> *numbers = nullptr;
+	std::vector<int> *integers = nullptr;
+	switch (frame.scope) {
+	case SCOPE_ROOT:
+		switch (frame.key) {
+		case KEY_SCENES: element = SCOPE_SCENE; break;
+		case KEY_NODES: element = SCOPE_NODE; break;
+		case KEY_MESHES: element = SCOPE_MESH; break;
+		case KEY_ACCESSORS: element = SCOPE_ACCESSOR; break;
+		case KEY_BUFFER_VIEWS: element = SCOPE_BUFFER_VIEW; break;
+		case KEY_BUFFERS: element = SCOPE_BUFFER; break;
+		case KEY_MATERIALS: element = SCOPE_MATERIAL; break;
+		case KEY_TEXTURES: element = SCOPE_TEXTURE; break;
+		case KEY_IMAGES: element = SCOPE_IMAGE; break;
+		case KEY_SAMPLERS: element = SCOPE_SAMPLER; break;
+		case KEY_SKINS: element = SCOPE_SKIN; break;
+		case KEY_ANIMATIONS: element = SCOPE_ANIMATION; break;
+		default: break;
+		}
+		break;
+	case SCOPE_LIGHTS_PUNCTUAL:
+		if (frame.key == KEY_LIGHTS) { element = SCOPE_LIGHT; }
+		break;
+	case SCOPE_LIGHT:
+		if (frame.key == KEY_COLOR) { numbers = &light().color; }
+		break;
+	case SCOPE_SCENE:
+		if (frame.key == KEY_NODES) { integers = &model->scenes.back().nodes; }
+		break;
+	case SCOPE_NODE:
+		if (frame.key == KEY_CHILDREN) { integers = &node().children; }
+		if (frame.key == KEY_MATRIX) { numbers = &node().matrix; }
+		if (frame.key == KEY_TRANSLATION) { numbers = &node().translation; }
+		if (frame.key == KEY_ROTATION) { numbers = &node().rotation; }
+		if (frame.key == KEY_SCALE) { numbers = &node().scale; }
+		break;
+	case SCOPE_MESH:
+		if (frame.key == KEY_PRIMITIVES) { element = SCOPE_PRIMITIVE; }
+		break;
+	case SCOPE_ACCESSOR:
+		if (frame.key == KEY_MIN) { numbers = &model->accessors.back().minValues; }
+		if (frame.key == KEY_MAX) { numbers = &model->accessors.back().maxValues; }
+		break;
+	case SCOPE_MATERIAL:
+		if (frame.key == KEY_EMISSIVE_FACTOR) { numbers = &material().emissiveFactor; }
+		break;
+	case SCOPE_PBR:
+		if (frame.key == KEY_BASE_COLOR_FACTOR) { numbers = &material().values["baseColorFactor"].number_array; }
+		break;
+	case SCOPE_SKIN:
+		if (frame.key == KEY_JOINTS) { integers = &model->skins.back().joints; }
+		break;
+	case SCOPE_ANIMATION:
+		if (frame.key == KEY_SAMPLERS) { element = SCOPE_ANIMATION_SAMPLER; }
+		if (frame.key == KEY_CHANNELS) { element = SCOPE_CHANNEL; }
+		break;
+	default: break;
+	}
+
+	if (element != SCOPE_ROOT) {
+		push(SCOPE_LIST);
+		stack.back().element = element;
+	} else if (numbers) {
+		numbers->clear();
+		push(SCOPE_NUMBERS);
+		stack.back().numbers = numbers;
+	} else if (integers) {
+		integers->clear();
+		push(SCOPE_INTEGERS);
+		stack.back().integers = integers;
+	} else {
+		skipped++;
+	}
+
+	return true;
+}
+
+bool gltf_handler::end_object(void)
+{
+	if (skipped > 0) {
+		skipped--;
+		return true;
+	}
+
+	// the material structs follow the parameters, both are read by the importer
+	if (stack.back().scope == SCOPE_MATERIAL) {
+		tinygltf::Material &mat = material();
+		auto basecolor = mat.values.find("baseColorFactor");
+		if (basecolor != mat.values.end() && basecolor->second.number_array.size() < 3) { mat.values.erase(basecolor); }
+		basecolor = mat.values.find("baseColorFactor");
+		if (basecolor != mat.values.end()) {
+			mat.pbrMetallicRoughness.baseColorFactor = basecolor->second.number_array;
+			mat.pbrMetallicRoughness.baseColorFactor.resize(4, 1.0);
+		}
+		auto metallic = mat.values.find("metallicFactor");
+		if (metallic != mat.values.end()) { mat.pbrMetallicRoughness.metallicFactor = metallic->second.number_value; }
+		auto roughness = mat.values.find("roughnessFactor");
+		if (roughness != mat.values.end()) { mat.pbrMetallicRoughness.roughnessFactor = roughness->second.number_value; }
+		mat.pbrMetallicRoughness.baseColorTexture.index = texture_index(mat.values, "baseColorTexture");
+		mat.pbrMetallicRoughness.metallicRoughnessTexture.index = texture_index(mat.values, "metallicRoughnessTexture");
+		mat.normalTexture.index = texture_index(mat.additionalValues, "normalTexture");
+		mat.occlusionTexture.index = texture_index(mat.additionalValues, "occlusionTexture");
+		mat.emissiveTexture.index = texture_index(mat.additionalValues, "emissiveTexture");
+	}
+	stack.pop_back();
+
+	return true;
+}
+
+// the JSON text in one pass, strings without escapes and numbers are read in place, the others reuse one buffer
+struct json_cursor {
+	const char *at;
+	const char *end;
+	std::string text; /* unescaped copy of the last string that needed one */
+	std::string_view view; /* the last string or key, into the document or text */
+};
+
+static inline void skip_space(struct json_cursor *cursor)
+{
+	while (cursor->at < cursor->end && (*cursor->at == ' ' || *cursor->at == '\n' || *cursor->at == '\r' || *cursor->at == '\t')) { cursor->at++; }
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') { return c - '0'; }
+	if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+	if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+
+	return -1;
+}
+
+static bool read_hex4(struct json_cursor *cursor, uint32_t *code)
+{
+	if (cursor->end - cursor->at < 4) { return false; }
+	*code = 0;
+	for (int i = 0; i < 4; i++) {
+		const int digit = hex_digit(*cursor->at++);
+		if (digit < 0) { return false; }
+		*code = (*code << 4) | uint32_t(digit);
+	}
+
+	return true;
+}
+
+static void append_utf8(std::string &out, uint32_t code)
+{
+	if (code < 0x80) {
+		out += char(code);
+	} else if (code < 0x800) {
+		out += char(0xC0 | (code >> 6));
+		out += char(0x80 | (code & 0x3F));
+	} else if (code < 0x10000) {
+		out += char(0xE0 | (code >> 12));
+		out += char(0x80 | ((code >> 6) & 0x3F));
+		out += char(0x80 | (code & 0x3F));
+	} else {
+		out += char(0xF0 | (code >> 18));
+		out += char(0x80 | ((code >> 12) & 0x3F));
+		out += char(0x80 | ((code >> 6) & 0x3F));
+		out += char(0x80 | (code & 0x3F));
+	}
+}
+
+// the cursor is on the opening quote
+static bool read_string(struct json_cursor *cursor)
+{
+	cursor->text.clear();
+	cursor->at++;
+	const char *begin = cursor->at;
+	while (cursor->at < cursor->end) {
+		// runs without escapes are copied at once, data URIs are megabytes of them
+		const char *run = cursor->at;
+		while (cursor->at < cursor->end && *cursor->at != '"' && *cursor->at != '\\') { cursor->at++; }
+		if (cursor->at >= cursor->end) { return false; }
+		// nearly every string, keys included, has no escape and isn't copied at all
+		if (run == begin && *cursor->at == '"') {
+			cursor->view = std::string_view(begin, size_t(cursor->at - begin));
+			cursor->at++;
+			return true;
+		}
+		cursor->text.append(run, size_t(cursor->at - run));
+		if (*cursor->at++ == '"') {
+			cursor->view = cursor->text;
+			return true;
+		}
+
+		if (cursor->at >= cursor->end) { return false; }
+		const char escape = *cursor->at++;
+		switch (escape) {
+		case '"': cursor->text += '"'; break;
+		case '\\': cursor->text += '\\'; break;
+		case '/': cursor->text += '/'; break;
+		case 'b': cursor->text += '\b'; break;
+		case 'f': cursor->text += '\f'; break;
+		case 'n': cursor->text += '\n'; break;
+		case 'r': cursor->text += '\r'; break;
+		case 't': cursor->text += '\t'; break;
+		case 'u': {
+			uint32_t code;
+			if (!read_hex4(cursor, &code)) { return false; }
+			// surrogate pairs
+			if (code >= 0xD800 && code < 0xDC00) {
+				uint32_t low;
+				if (cursor->end - cursor->at < 6 || cursor->at[0] != '\\' || cursor->at[1] != 'u') { return false; }
+				cursor->at += 2;
+				if (!read_hex4(cursor, &low) || low < 0xDC00 || low > 0xDFFF) { return false; }
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			}
+			append_utf8(cursor->text, code);
+			break;
+		}
+		default: return false;
+		}
+	}
+
+	return false;
+}
+
+// integers are summed up directly, everything else goes through strtod on a terminated copy
+static bool read_number(struct json_cursor *cursor, double *value)
+{
+	const char *start = cursor->at;
+	const bool negative = cursor->at < cursor->end && *cursor->at == '-';
+	if (negative) { cursor->at++; }
+	uint64_t integer = 0;
+	const char *digits = cursor->at;
+	while (cursor->at < cursor->end && *cursor->at >= '0' && *cursor->at <= '9' && cursor->at - digits < 18) {
+		integer = integer * 10 + uint64_t(*cursor->at++ - '0');
+	}
+	if (cursor->at == digits) { return false; }
+	const bool simple = cursor->at >= cursor->end || (*cursor->at != '.' && *cursor->at != 'e' && *cursor->at != 'E' && (*cursor->at < '0' || *cursor->at > '9'));
+	if (simple) {
+		*value = negative ? -double(integer) : double(integer);
+		return true;
+	}
+
+	while (cursor->at < cursor->end && ((*cursor->at >= '0' && *cursor->at <= '9') || *cursor->at == '.' || *cursor->at == 'e' || *cursor->at == 'E' || *cursor->at == '+' || *cursor->at == '-')) { cursor->at++; }
+	char copy[64];
+	const size_t length = size_t(cursor->at - start);
+	if (length >= sizeof(copy)) { return false; }
+	memcpy(copy, start, length);
+	copy[length] = '\0';
+	char *parsed;
+	*value = strtod(copy, &parsed);
+
+	return parsed == copy + length;
+}
+
+static bool read_literal(struct json_cursor *cursor, const char *literal)
+{
+	const size_t length = strlen(literal);
+	if (size_t(cursor->end - cursor->at) < length || memcmp(cursor->at, literal, length) != 0) { return false; }
+	cursor->at += length;
+
+	return true;
+}
+
+static bool read_value(struct json_cursor *cursor, struct gltf_handler *handler, uint32_t depth)
+{
+	skip_space(cursor);
+	if (cursor->at >= cursor->end || depth > JSON_MAX_DEPTH) { return false; }
+
+	switch (*cursor->at) {
+	case '{':
+		cursor->at++;
+		if (!handler->start_object()) { return false; }
+		skip_space(cursor);
+		if (cursor->at < cursor->end && *cursor->at == '}') {
+			cursor->at++;
+			return handler->end_object();
+		}
+		while (true) {
+			skip_space(cursor);
+			if (cursor->at >= cursor->end || *cursor->at != '"' || !read_string(cursor) || !handler->key(cursor->view)) { return false; }
+			skip_space(cursor);
+			if (cursor->at >= cursor->end || *cursor->at++ != ':') { return false; }
+			if (!read_value(cursor, handler, depth + 1)) { return false; }
+			skip_space(cursor);
+			if (cursor->at >= cursor->end) { return false; }
+			const char next = *cursor->at++;
+			if (next == '}') { return handler->end_object(); }
+			if (next != ',') { return false; }
+		}
+	case '[':
+		cursor->at++;
+		if (!handler->start_array()) { return false; }
+		skip_space(cursor);
+		if (cursor->at < cursor->end && *cursor->at == ']') {
+			cursor->at++;
+			return handler->end_array();
+		}
+		while (true) {
+			if (!read_value(cursor, handler, depth + 1)) { return false; }
+			skip_space(cursor);
+			if (cursor->at >= cursor->end) { return false; }
+			const char next = *cursor->at++;
+			if (next == ']') { return handler->end_array(); }
+			if (next != ',') { return false; }
+		}
+	case '"':
+		return read_string(cursor) && handler->string(cursor->view);
+	case 't':
+		return read_literal(cursor, "true") && handler->boolean(true);
+	case 'f':
+		return read_literal(cursor, "false") && handler->boolean(false);
+	case 'n':
+		return read_literal(cursor, "null");
+	default: {
+		double value;
+		return read_number(cursor, &value) && handler->number(value);
+	}
+	}
+}
+
+static bool read_file(const std::string &fpath, std::vector<unsigned char> &out)
+{
+	std::ifstream file(fpath, std::ios::binary | std::ios::ate);
+	if (!file) { return false; }
+	const std::streamsize size = file.tellg();
+	file.seekg(0);
+	out.resize(size_t(size));
+
+	return bool(file.read(reinterpret_cast<char*>(out.data()), size));
+}
+
+// file a relative URI points at, escapes like %20 are decoded as in tinygltf
+static std::string uri_path(const std::string &basedir, const std::string &uri)
+{
+	std::string path;
+	for (size_t i = 0; i < uri.size(); i++) {
+		if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2])) {
+			path += char(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+			i += 2;
+		} else {
+			path += uri[i];
+		}
+	}
+
+	return basedir.empty() ? path : basedir + "/" + path;
+}
+
+// the base64 text of a "data:[mime];base64," URI, false for any other URI
+static bool data_uri_payload(const std::string &uri, const char **text, size_t *length)
+{
+	if (uri.compare(0, 5, "data:") != 0) { return false; }
+	const size_t comma = uri.find(',');
+	if (comma == std::string::npos || comma < 12 || uri.compare(comma - 7, 7, ";base64") != 0) { return false; }
+	*text = uri.data() + comma + 1;
+	*length = uri.size() - comma - 1;
+
+	return true;
+}
+
+// part of a data URI and where its bytes go, source counts the buffers first and then the images
+struct base64_slice {
+	const char *text;
+	size_t length;
+	unsigned char *out;
+	size_t bytes;
+	size_t source;
+	bool decoded;
+};
+
+// every slice but the last is a whole number of quads, so its bytes end where the next slice starts
+static void add_slices(std::vector<struct base64_slice> &slices, const char *text, size_t length, unsigned char *out, size_t bytes, size_t source)
+{
+	for (size_t offset = 0; offset < length; offset += BASE64_SLICE) {
+		const size_t size = std::min(size_t(BASE64_SLICE), length - offset);
+		const size_t done = offset / 4 * 3;
+		slices.push_back({ text + offset, size, out + done, offset + size < length ? size / 4 * 3 : bytes - done, source, false });
+	}
+}
+
+static bool in_range(int index, size_t count)
+{
+	return index >= 0 && size_t(index) < count;
+}
+
+// the importer follows the indices without checking them
+static bool check_references(const tinygltf::Model &model, std::string *err)
+{
+	const size_t accessors = model.accessors.size();
+	for (const tinygltf::BufferView &view : model.bufferViews) {
+		if (!in_range(view.buffer, model.buffers.size()) || view.byteOffset + view.byteLength > model.buffers[view.buffer].data.size()) {
+			*err += "buffer view outside of its buffer\n";
+			return false;
+		}
+	}
+	for (const tinygltf::Accessor &accessor : model.accessors) {
+		if (accessor.bufferView < 0) { continue; }
+		const int size = tinygltf::GetComponentSizeInBytes(uint32_t(accessor.componentType)) * tinygltf::GetNumComponentsInType(uint32_t(accessor.type));
+		if (!in_range(accessor.bufferView, model.bufferViews.size()) || size <= 0) {
+			*err += "accessor with an unknown buffer view or type\n";
+			return false;
+		}
+		const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+		const size_t stride = view.byteStride ? view.byteStride : size_t(size);
+		if (accessor.count > 0 && accessor.byteOffset + stride * (accessor.count - 1) + size_t(size) > view.byteLength) {
+			*err += "accessor outside of its buffer view\n";
+			return false;
+		}
+	}
+	for (const tinygltf::Mesh &mesh : model.meshes) {
+		for (const tinygltf::Primitive &primitive : mesh.primitives) {
+			bool valid = (primitive.indices < 0 || in_range(primitive.indices, accessors)) && (primitive.material < 0 || in_range(primitive.material, model.materials.size()));
+			for (const auto &attribute : primitive.attributes) { valid &= in_range(attribute.second, accessors); }
+			if (!valid) {
+				*err += "primitive with an unknown accessor or material\n";
+				return false;
+			}
+		}
+	}
+	for (const tinygltf::Node &node : model.nodes) {
+		bool valid = (node.mesh < 0 || in_range(node.mesh, model.meshes.size())) && (node.skin < 0 || in_range(node.skin, model.skins.size()));
+		for (int child : node.children) { valid &= in_range(child, model.nodes.size()); }
+		if (!valid) {
+			*err += "node with an unknown child, mesh or skin\n";
+			return false;
+		}
+	}
+	for (const tinygltf::Scene &scene : model.scenes) {
+		for (int root : scene.nodes) {
+			if (!in_range(root, model.nodes.size())) {
+				*err += "scene with an unknown node\n";
+				return false;
+			}
+		}
+	}
+	for (const tinygltf::Skin &skin : model.skins) {
+		if (skin.inverseBindMatrices >= 0 && !in_range(skin.inverseBindMatrices, accessors)) {
+			*err += "skin with an unknown accessor\n";
+			return false;
+		}
+	}
+	for (const tinygltf::Animation &animation : model.animations) {
+		for (const tinygltf::AnimationSampler &sampler : animation.samplers) {
+			if (!in_range(sampler.input, accessors) || !in_range(sampler.output, accessors)) {
+				*err += "animation sampler with an unknown accessor\n";
+				return false;
+			}
+		}
+		for (const tinygltf::AnimationChannel &channel : animation.channels) {
+			if (!in_range(channel.sampler, animation.samplers.size())) {
+				*err += "animation channel with an unknown sampler\n";
+				return false;
+			}
+		}
+	}
+	for (const tinygltf::Texture &texture : model.textures) {
+		if ((texture.source >= 0 && !in_range(texture.source, model.images.size())) || (texture.sampler >= 0 && !in_range(texture.sampler, model.samplers.size()))) {
+			*err += "texture with an unknown image or sampler\n";
+			return false;
+		}
+	}
+	for (const tinygltf::Material &material : model.materials) {
+		for (const tinygltf::ParameterMap *values : { &material.values, &material.additionalValues }) {
+			for (const auto &value : *values) {
+				const int index = value.second.TextureIndex();
+				if (value.second.json_double_value.count("index") && !in_range(index, model.textures.size())) {
+					*err += "material with an unknown texture\n";
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// the views decode in parallel into their fallback buffer, where the accessors already point, unless the fallback has data of its own
+static bool decode_meshopt(tinygltf::Model *model, const std::vector<struct meshopt_view> &views, const std::vector<bool> &placeholders, std::string *err)
+{
+	const size_t nbuffers = model->buffers.size();
+	std::vector<char> decoded(views.size(), 0);
+	parallel_for(views.size(), [&](size_t i) {
+		const struct meshopt_view &compressed = views[i];
+		const tinygltf::BufferView &view = model->bufferViews[compressed.view];
+		if (!in_range(view.buffer, nbuffers) || !in_range(compressed.buffer, nbuffers) || placeholders[compressed.buffer]) { return; }
+		if (!placeholders[view.buffer]) {
+			decoded[i] = 1;
+			return;
+		}
+		const std::vector<unsigned char> &source = model->buffers[compressed.buffer].data;
+		std::vector<unsigned char> &target = model->buffers[view.buffer].data;
+		const size_t bytes = compressed.count * compressed.stride;
+		if (compressed.byteoffset + compressed.bytelength > source.size() || bytes > view.byteLength || view.byteOffset + bytes > target.size()) { return; }
+		decoded[i] = meshopt_decode(source.data() + compressed.byteoffset, compressed.bytelength, compressed.count, compressed.stride, compressed.mode, compressed.filter, target.data() + view.byteOffset);
+	});
+	for (size_t i = 0; i < views.size(); i++) {
+		if (!decoded[i]) {
+			*err += "can't decode EXT_meshopt_compression buffer view " + std::to_string(views[i].view) + "\n";
+			return false;
+		}
+	}
+
+	// the compressed buffers are done with unless a plain view points into them
+	std::vector<bool> referenced(nbuffers, false);
+	for (const tinygltf::BufferView &view : model->bufferViews) {
+		if (in_range(view.buffer, nbuffers)) { referenced[view.buffer] = true; }
+	}
+	for (const struct meshopt_view &compressed : views) {
+		if (!referenced[compressed.buffer]) { std::vector<unsigned char>().swap(model->buffers[compressed.buffer].data); }
+	}
+
+	return true;
+}
+
+// a decoded Draco mesh waiting to be moved into the model
+struct draco_mesh {
+	std::vector<unsigned char> indices;
+	std::vector<struct draco_attribute> attributes;
+	std::vector<int> accessors; /* one per attribute */
+	uint32_t vertices = 0;
+	std::string err;
+	bool decoded = false;
+};
+
+// the primitives decode in parallel, every stream then becomes a buffer of its own and the accessors are pointed at it
+static bool decode_draco(tinygltf::Model *model, const std::vector<struct draco_primitive> &primitives, std::string *err)
+{
+	std::vector<struct draco_mesh> meshes(primitives.size());
+	parallel_for(primitives.size(), [&](size_t i) {
+		const struct draco_primitive &compressed = primitives[i];
+		const tinygltf::Primitive &primitive = model->meshes[compressed.mesh].primitives[compressed.primitive];
+		struct draco_mesh &mesh = meshes[i];
+		if (!in_range(compressed.view, model->bufferViews.size())) {
+			mesh.err = "unknown buffer view";
+			return;
+		}
+		const tinygltf::BufferView &view = model->bufferViews[compressed.view];
+		if (!in_range(view.buffer, model->buffers.size()) || view.byteOffset + view.byteLength > model->buffers[view.buffer].data.size()) {
+			mesh.err = "buffer view outside of its buffer";
+			return;
+		}
+		for (const auto &entry : compressed.attributes) {
+			auto found = primitive.attributes.find(entry.first);
+			if (found == primitive.attributes.end() || !in_range(found->second, model->accessors.size())) {
+				mesh.err = "no accessor for " + entry.first;
+				return;
+			}
+			const tinygltf::Accessor &accessor = model->accessors[found->second];
+			mesh.attributes.push_back({ entry.second, accessor.componentType, tinygltf::GetNumComponentsInType(uint32_t(accessor.type)), {} });
+			mesh.accessors.push_back(found->second);
+		}
+		const int indextype = in_range(primitive.indices, model->accessors.size()) ? model->accessors[primitive.indices].componentType : 0;
+		mesh.decoded = draco_decode(model->buffers[view.buffer].data.data() + view.byteOffset, view.byteLength, indextype, &mesh.indices, mesh.attributes, &mesh.vertices, &mesh.err);
+	});
+
+	auto attach = [model](int accessor, std::vector<unsigned char> &data, size_t count) {
+		model->buffers.emplace_back();
+		model->buffers.back().data.swap(data);
+		tinygltf::BufferView view;
+		view.buffer = int(model->buffers.size()) - 1;
+		view.byteLength = model->buffers.back().data.size();
+		model->bufferViews.push_back(view);
+		tinygltf::Accessor &target = model->accessors[accessor];
+		target.bufferView = int(model->bufferViews.size()) - 1;
+		target.byteOffset = 0;
+		target.count = count;
+	};
+	for (size_t i = 0; i < primitives.size(); i++) {
+		struct draco_mesh &mesh = meshes[i];
+		if (!mesh.decoded) {
+			*err += "can't decode KHR_draco_mesh_compression primitive " + std::to_string(primitives[i].primitive) + " of mesh " + std::to_string(primitives[i].mesh) + ": " + mesh.err + "\n";
+			return false;
+		}
+		const tinygltf::Primitive &primitive = model->meshes[primitives[i].mesh].primitives[primitives[i].primitive];
+		if (!mesh.indices.empty()) {
+			const int indexsize = tinygltf::GetComponentSizeInBytes(uint32_t(model->accessors[primitive.indices].componentType));
+			attach(primitive.indices, mesh.indices, mesh.indices.size() / size_t(indexsize));
+		}
+		for (size_t k = 0; k < mesh.attributes.size(); k++) { attach(mesh.accessors[k], mesh.attributes[k].data, mesh.vertices); }
+	}
+
+	return true;
+}
+
+bool read_gltf(const unsigned char *bytes, size_t size, const std::string &basedir, tinygltf::Model *model, std::string *err, std::string *warn, tinygltf::LoadImageDataFunction loadimage, void *user, struct gltf_names *names)
+{
+	// a GLB container holds the JSON and the first buffer
+	const unsigned char *text = bytes;
+	size_t textsize = size;
+	const unsigned char *bin = nullptr;
+	size_t binsize = 0;
+	uint32_t header[5];
+	if (size >= sizeof(header) && (memcpy(header, bytes, sizeof(header)), header[0] == GLB_MAGIC)) {
+		if (header[1] != 2 || header[2] > size || header[4] != GLB_CHUNK_JSON || size_t(header[3]) + 20 > header[2]) {
+			*err += "malformed GLB header\n";
+			return false;
+		}
+		text = bytes + 20;
+		textsize = header[3];
+		const size_t next = (20 + size_t(header[3]) + 3) & ~size_t(3);
+		uint32_t chunk[2];
+		if (next + sizeof(chunk) <= header[2] && (memcpy(chunk, bytes + next, sizeof(chunk)), chunk[1] == GLB_CHUNK_BIN) && next + 8 + chunk[0] <= header[2]) {
+			bin = bytes + next + 8;
+			binsize = chunk[0];
+		}
+	}
+
+	*model = tinygltf::Model();
+	struct gltf_handler handler;
+	handler.model = model;
+	handler.err = err;
+	handler.names = names;
+	if (names) {
+		// offset 0 is the empty name of everything without one
+		names->pool.assign(1, '\0');
+		names->nodes.clear();
+		names->skins.clear();
+	}
+	struct json_cursor cursor;
+	cursor.at = reinterpret_cast<const char*>(text);
+	cursor.end = cursor.at + textsize;
+	skip_space(&cursor);
+	if (cursor.at >= cursor.end || *cursor.at != '{') {
+		*err += "glTF document is not an object\n";
+		return false;
+	}
+	const bool parsed = read_value(&cursor, &handler, 0);
+	skip_space(&cursor);
+	if (!parsed || cursor.at != cursor.end) {
+		if (err->empty()) { *err += "JSON syntax error at byte " + std::to_string(cursor.at - reinterpret_cast<const char*>(text)) + "\n"; }
+		return false;
+	}
+	if (model->scenes.empty()) {
+		*err += "glTF document without a scene\n";
+		return false;
+	}
+	if (model->defaultScene >= int(model->scenes.size())) { model->defaultScene = 0; }
+
+	// files and the GLB chunk are read here, data URIs are sized and sliced to be decoded below
+	const size_t nbuffers = model->buffers.size();
+	std::vector<struct base64_slice> slices;
+	std::vector<bool> placeholders(nbuffers, false);
+	for (size_t i = 0; i < nbuffers; i++) {
+		tinygltf::Buffer &buffer = model->buffers[i];
+		const size_t bytelength = handler.bytelengths[i];
+		const char *base64;
+		size_t base64size;
+		if (buffer.uri.empty() && handler.fallbacks[i]) {
+			// filled by decoding the meshopt views that point into it
+			buffer.data.resize(bytelength);
+			placeholders[i] = true;
+		} else if (buffer.uri.empty() && i == 0 && bin != nullptr && binsize >= bytelength) {
+			buffer.data.assign(bin, bin + bytelength);
+		} else if (data_uri_payload(buffer.uri, &base64, &base64size)) {
+			buffer.data.resize(base64_decoded_size(base64, base64size));
+			add_slices(slices, base64, base64size, buffer.data.data(), buffer.data.size(), i);
+		} else if (buffer.uri.empty() || !read_file(uri_path(basedir, buffer.uri), buffer.data)) {
+			*err += "can't read buffer " + std::to_string(i) + " '" + buffer.uri.substr(0, 64) + "'\n";
+			return false;
+		}
+		if (buffer.data.size() < bytelength) {
+			*err += "buffer " + std::to_string(i) + " is shorter than its byteLength\n";
+			return false;
+		}
+	}
+	std::vector<std::vector<unsigned char>> encoded(model->images.size());
+	for (size_t i = 0; i < model->images.size(); i++) {
+		const char *base64;
+		size_t base64size;
+		if (model->images[i].bufferView < 0 && data_uri_payload(model->images[i].uri, &base64, &base64size)) {
+			encoded[i].resize(base64_decoded_size(base64, base64size));
+			add_slices(slices, base64, base64size, encoded[i].data(), encoded[i].size(), nbuffers + i);
+		}
+	}
+
+	// every core decodes straight into the buffers, a big buffer is split as well as many small ones
+	parallel_for(slices.size(), [&](size_t i) {
+		struct base64_slice &slice = slices[i];
+		slice.decoded = base64_decoded_size(slice.text, slice.length) == slice.bytes && base64_decode(slice.text, slice.length, slice.out);
+	});
+	std::vector<bool> undecoded(nbuffers + model->images.size(), false);
+	for (const struct base64_slice &slice : slices) {
+		if (!slice.decoded) { undecoded[slice.source] = true; }
+	}
+	for (size_t i = 0; i < nbuffers; i++) {
+		if (undecoded[i]) {
+			*err += "buffer " + std::to_string(i) + " isn't valid base64\n";
+			return false;
+		}
+	}
+	// the data URIs are in the data now, their text can be half of the document
+	for (const struct base64_slice &slice : slices) {
+		std::string &uri = slice.source < nbuffers ? model->buffers[slice.source].uri : model->images[slice.source - nbuffers].uri;
+		if (!uri.empty() && !undecoded[slice.source]) { std::string().swap(uri); }
+	}
+
+	if (!decode_meshopt(model, handler.meshopt, placeholders, err) || !decode_draco(model, handler.draco, err)) { return false; }
+	if (!check_references(*model, err)) { return false; }
+
+	for (size_t i = 0; i < model->images.size(); i++) {
+		tinygltf::Image &image = model->images[i];
+		const unsigned char *data = nullptr;
+		size_t datasize = 0;
+		if (image.bufferView >= 0) {
+			if (!in_range(image.bufferView, model->bufferViews.size())) {
+				*err += "image with an unknown buffer view\n";
+				return false;
+			}
+			const tinygltf::BufferView &view = model->bufferViews[image.bufferView];
+			data = model->buffers[view.buffer].data.data() + view.byteOffset;
+			datasize = view.byteLength;
+		} else if (image.uri.empty() && !encoded[i].empty() && !undecoded[nbuffers + i]) {
+			data = encoded[i].data();
+			datasize = encoded[i].size();
+		} else if (!undecoded[nbuffers + i] && read_file(uri_path(basedir, image.uri), encoded[i])) {
+			data = encoded[i].data();
+			datasize = encoded[i].size();
+		} else {
+			*warn += "can't read image " + std::to_string(i) + " '" + image.uri.substr(0, 64) + "'\n";
+			continue;
+		}
+
+		if (loadimage == nullptr && data == encoded[i].data()) {
+			image.image.swap(encoded[i]);
+			image.as_is = true;
+		} else if (loadimage == nullptr) {
+			image.image.assign(data, data + datasize);
+			image.as_is = true;
+		} else if (!loadimage(&image, int(i), err, warn, 0, 0, data, int(datasize), user)) {
+			return false;
+		}
+		std::vector<unsigned char>().swap(encoded[i]);
+	}
+
+	return true;
+}
+
+bool read_gltf_file(const std::string &fpath, tinygltf::Model *model, std::string *err, std::string *warn, tinygltf::LoadImageDataFunction loadimage, void *user, struct gltf_names *names)
+{
+	std::vector<unsigned char> bytes;
+	if (!read_file(fpath, bytes)) {
+		*err += "can't read " + fpath + "\n";
+		return false;
+	}
+	struct memory_scope document(MEMORY_GLTF, bytes.size());
+
+	const size_t slash = fpath.find_last_of("/\\");
+	const std::string basedir = slash == std::string::npos ? "" : fpath.substr(0, slash);
+
+	return read_gltf(bytes.data(), bytes.size(), basedir, model, err, warn, loadimage, user, names);
+}
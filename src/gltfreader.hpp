@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// node and skin names back to back in one buffer instead of a string each, the names in the model stay empty
+struct gltf_names {
+	std::string pool; /* NUL terminated, offset 0 is the empty name */
+	std::vector<uint32_t> nodes; /* offset of the name of each node */
+	std::vector<uint32_t> skins;
+};
+
+// glTF and GLB documents read with the streaming JSON parser, the model is filled as the tokens arrive without a DOM in between
+// covers what the importer reads: scenes, nodes, meshes, accessors, buffers, materials, textures, images, samplers,
+// skins, animations and KHR_lights_punctual, everything else (cameras, morph targets, sparse accessors, extras) is skipped
+bool read_gltf(const unsigned char *bytes, size_t size, const std::string &basedir, tinygltf::Model *model, std::string *err, std::string *warn, tinygltf::LoadImageDataFunction loadimage, void *user, struct gltf_names *names = nullptr);
+bool read_gltf_file(const std::string &fpath, tinygltf::Model *model, std::string *err, std::string *warn, tinygltf::LoadImageDataFunction loadimage, void *user, struct gltf_names *names = nullptr);
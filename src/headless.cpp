@@ -0,0 +1,486 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "external/stb_image_write.h"
+
+#include "shader.hpp"
+#include "texcache.hpp"
+#include "variants.hpp"
+#include "lighting.hpp"
+#include "lightbuffers.hpp"
+#include "ibl.hpp"
+#include "gltf.h"
+#include "frame.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "memory.hpp"
+#include "headless.hpp"
+
+// readbacks in flight so the GPU renders the next image while the last one is copied
+#define READBACK_SLOTS 2
+
+struct png_job {
+	std::string path;
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+};
+
+// PNG encoding is the slowest step, it runs on every other core
+static struct {
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<struct png_job> jobs;
+	std::vector<std::thread> workers;
+	size_t maxjobs = 0;
+	bool running = false;
+	size_t failed = 0;
+} writer;
+
+static void write_pngs(void)
+{
+	while (true) {
+		struct png_job job;
+		{
+			std::unique_lock<std::mutex> guard(writer.lock);
+			writer.changed.wait(guard, [] { return !writer.running || !writer.jobs.empty(); });
+			if (writer.jobs.empty()) { return; }
+			job = std::move(writer.jobs.front());
+			writer.jobs.pop_front();
+			writer.changed.notify_all();
+		}
+
+		if (stbi_write_png(job.path.c_str(), job.width, job.height, 4, job.pixels.data(), job.width * 4) == 0) {
+			std::lock_guard<std::mutex> guard(writer.lock);
+			std::cerr << "error: could not write " << job.path << std::endl;
+			writer.failed++;
+		}
+	}
+}
+
+static void start_writers(void)
+{
+	const unsigned nthreads = std::max(1u, std::thread::hardware_concurrency() - 1);
+	writer.maxjobs = 2 * nthreads;
+	writer.running = true;
+	for (unsigned i = 0; i < nthreads; i++) { writer.workers.emplace_back(write_pngs); }
+}
+
+// blocks while enough images wait for encoding to keep memory bounded
+static void queue_png(struct png_job &&job)
+{
+	std::unique_lock<std::mutex> guard(writer.lock);
+	writer.changed.wait(guard, [] { return writer.jobs.size() < writer.maxjobs; });
+	writer.jobs.push_back(std::move(job));
+	writer.changed.notify_all();
+}
+
+static void stop_writers(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(writer.lock);
+		writer.running = false;
+	}
+	writer.changed.notify_all();
+	for (std::thread &worker : writer.workers) { worker.join(); }
+	writer.workers.clear();
+}
+
+// surfaceless context on the default EGL device, works on Mesa's llvmpipe without a display server
+static bool init_EGL(EGLDisplay *display, EGLContext *context)
+{
+	EGLDisplay dpy = EGL_NO_DISPLAY;
+	auto getplatformdisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getplatformdisplay) {
+		dpy = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (dpy == EGL_NO_DISPLAY) { dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY); }
+
+	EGLint major, minor;
+	if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor)) {
+		std::cerr << "error: could not initialize EGL: " << std::hex << eglGetError() << std::dec << std::endl;
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cerr << "error: EGL has no desktop OpenGL" << std::endl;
+		eglTerminate(dpy);
+		return false;
+	}
+
+	/* surfaceless platforms might not have any config, contexts don't need one with EGL_KHR_no_config_context */
+	const EGLint configattribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	EGLint count = 0;
+	if (!eglChooseConfig(dpy, configattribs, &config, 1, &count) || count == 0) { config = EGL_NO_CONFIG_KHR; }
+
+	const EGLint contextattribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, contextattribs);
+	if (ctx == EGL_NO_CONTEXT || !eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+		std::cerr << "error: could not create a surfaceless OpenGL 4.3 context: " << std::hex << eglGetError() << std::dec << std::endl;
+		if (ctx != EGL_NO_CONTEXT) { eglDestroyContext(dpy, ctx); }
+		eglTerminate(dpy);
+		return false;
+	}
+
+	*display = dpy;
+	*context = ctx;
+
+	return true;
+}
+
+// EGL context with the GL entry points loaded
+static bool init_headless_GL(EGLDisplay *display, EGLContext *context)
+{
+	if (!init_EGL(display, context)) { return false; }
+
+	/* GLEW looks for a GLX display after loading the entry points, there is none here */
+	glewExperimental = GL_TRUE;
+	GLenum glewerror = glewInit();
+	if (glewerror != GLEW_OK && glewerror != GLEW_ERROR_NO_GLX_DISPLAY) {
+		std::cerr << "error: unable to init glew" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static void shutdown_headless_GL(EGLDisplay display, EGLContext context)
+{
+	variants_shutdown();
+	lighting_shutdown();
+	environment_shutdown();
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+}
+
+struct offscreen_target {
+	GLuint FBO;
+	GLuint color;
+	GLuint depth;
+	GLuint PBOs[READBACK_SLOTS];
+};
+
+static struct offscreen_target gen_offscreen_target(int width, int height)
+{
+	struct offscreen_target target;
+	glGenRenderbuffers(1, &target.color);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &target.depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &target.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "error: offscreen framebuffer is incomplete" << std::endl;
+	}
+
+	glGenBuffers(READBACK_SLOTS, target.PBOs);
+	for (GLuint PBO : target.PBOs) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+		glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(width) * height * 4, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	gpu_memory_track(GPU_MEMORY_RENDERBUFFER, target.color, texture_storage_size(GL_RGBA8, width, height, 1, 1), GL_RGBA8, "offscreen target");
+	gpu_memory_track(GPU_MEMORY_RENDERBUFFER, target.depth, texture_storage_size(GL_DEPTH_COMPONENT24, width, height, 1, 1), GL_DEPTH_COMPONENT24, "offscreen target");
+	for (GLuint PBO : target.PBOs) { gpu_memory_track(GPU_MEMORY_BUFFER, PBO, size_t(width) * height * 4, GL_NONE, "readback"); }
+
+	return target;
+}
+
+static void delete_offscreen_target(struct offscreen_target *target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gpu_memory_untrack(GPU_MEMORY_RENDERBUFFER, target->color);
+	gpu_memory_untrack(GPU_MEMORY_RENDERBUFFER, target->depth);
+	for (GLuint PBO : target->PBOs) { gpu_memory_untrack(GPU_MEMORY_BUFFER, PBO); }
+	glDeleteFramebuffers(1, &target->FBO);
+	glDeleteRenderbuffers(1, &target->color);
+	glDeleteRenderbuffers(1, &target->depth);
+	glDeleteBuffers(READBACK_SLOTS, target->PBOs);
+}
+
+struct readback {
+	bool busy = false;
+	std::string path;
+};
+
+// waits for a readback and hands the image to the PNG writers, GL rows are bottom to top
+static void finish_readback(const struct offscreen_target *target, uint32_t slot, struct readback *read, int width, int height)
+{
+	if (!read->busy) { return; }
+
+	struct png_job job;
+	job.path = std::move(read->path);
+	job.width = width;
+	job.height = height;
+	job.pixels.resize(size_t(width) * height * 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, target->PBOs[slot]);
+	const unsigned char *pixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(job.pixels.size()), GL_MAP_READ_BIT));
+	if (pixels) {
+		const size_t rowsize = size_t(width) * 4;
+		for (int y = 0; y < height; y++) {
+			memcpy(job.pixels.data() + size_t(y) * rowsize, pixels + size_t(height - 1 - y) * rowsize, rowsize);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	read->busy = false;
+
+	if (pixels) {
+		queue_png(std::move(job));
+	} else {
+		std::cerr << "error: could not read back " << job.path << std::endl;
+	}
+}
+
+// image names of every file, inputs with the same name (a.gltf and a.glb, or a.gltf in two directories) are numbered
+static std::vector<std::string> image_stems(const std::vector<std::string> &files)
+{
+	std::vector<std::string> stems;
+	std::map<std::string, std::string> taken;
+	for (const std::string &file : files) {
+		const std::string wanted = std::filesystem::path(file).stem().string();
+		std::string stem = wanted;
+		for (int n = 1; taken.count(stem); n++) { stem = wanted + "-" + std::to_string(n); }
+		if (stem != wanted) {
+			std::cerr << "warning: " << file << " and " << taken[wanted] << " have the same name, writing " << stem << " images" << std::endl;
+		}
+		taken[stem] = file;
+		stems.push_back(stem);
+	}
+
+	return stems;
+}
+
+static std::string image_path(const struct headless_options *options, const std::string &stem, int view, size_t time)
+{
+	char suffix[64];
+	if (options->times.size() > 1) {
+		snprintf(suffix, sizeof(suffix), "_%03d_%03zu.png", view, time);
+	} else if (options->views > 1) {
+		snprintf(suffix, sizeof(suffix), "_%03d.png", view);
+	} else {
+		snprintf(suffix, sizeof(suffix), ".png");
+	}
+
+	return (std::filesystem::path(options->outdir) / (stem + suffix)).string();
+}
+
+int run_headless(const struct headless_options *options, const std::vector<std::string> &files)
+{
+	if (files.empty()) {
+		std::cerr << "error: no glTF files to render" << std::endl;
+		return 1;
+	}
+
+	EGLDisplay display;
+	EGLContext context;
+	if (!init_headless_GL(&display, &context)) { return int(files.size()); }
+
+	std::error_code error;
+	std::filesystem::create_directories(options->outdir, error);
+
+	// shader variants, samplers, the environment and the texture cache are shared by every file
+	if (!variants_init("usr/shaders/basev.glsl", "usr/shaders/pbr.glsl")) {
+		std::cerr << "error: the fallback shader variants did not link" << std::endl;
+	}
+	if (!load_environment(DEFAULT_ENVIRONMENT)) {
+		std::cerr << "error: no environment lighting" << std::endl;
+	}
+	const float aspect = float(options->width) / float(options->height);
+	const float fov = glm::radians(45.f);
+
+	struct offscreen_target target = gen_offscreen_target(options->width, options->height);
+	glViewport(0, 0, options->width, options->height);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glEnable(GL_DEPTH_TEST);
+
+	start_writers();
+
+	const std::vector<float> times = options->times.empty() ? std::vector<float>{ 0.f } : options->times;
+	const std::vector<std::string> stems = image_stems(files);
+	struct readback reads[READBACK_SLOTS];
+	uint32_t slot = 0;
+	size_t images = 0;
+	int failed = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t f = 0; f < files.size(); f++) {
+		const std::string &file = files[f];
+		gltf::Model *model = new gltf::Model;
+		if (model->importf(file) == false) {
+			failed++;
+			delete model;
+			continue;
+		}
+		finish_variants();
+
+		for (size_t t = 0; t < times.size(); t++) {
+			if (model->animations.empty() == false) { model->updateAnimation(0, times[t]); }
+
+			glm::vec3 center;
+			float radius;
+			model->bounds(&center, &radius);
+			const float distance = 1.1f * radius / std::sin(0.5f * fov);
+			const float near = 0.01f * distance;
+			const float far = distance + 2.f * radius;
+			const glm::mat4 project = glm::perspective(fov, aspect, near, far);
+			const struct cluster_grid grid = make_cluster_grid(project, float(options->width), float(options->height), near, far);
+
+			for (int view = 0; view < options->views; view++) {
+				const float yaw = glm::radians(360.f * float(view) / float(options->views));
+				const float pitch = glm::radians(options->pitch);
+				const glm::vec3 eye = center + distance * glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+
+				struct frame_packet packet;
+				packet.project = project;
+				packet.view = glm::lookAt(eye, center, glm::vec3(0.f, 1.f, 0.f));
+				packet.campos = eye;
+				model->record(packet, 1.f);
+				cluster_lights(grid, packet.view, packet.lights, packet.clusters);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				render_draws(packet);
+
+				/* the image the slot held from two renders ago has to be copied out before the slot is reused */
+				finish_readback(&target, slot, &reads[slot], options->width, options->height);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, target.PBOs[slot]);
+				glReadPixels(0, 0, options->width, options->height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				reads[slot].busy = true;
+				reads[slot].path = image_path(options, stems[f], view, t);
+				slot = (slot + 1) % READBACK_SLOTS;
+				images++;
+			}
+		}
+
+		/* the GPU is done with the model once its readbacks are */
+		for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+			finish_readback(&target, (slot + i) % READBACK_SLOTS, &reads[(slot + i) % READBACK_SLOTS], options->width, options->height);
+		}
+		/* textures stay registered, later files that share images with this one reuse them */
+		delete model;
+		geometry_retire();
+	}
+
+	stop_writers();
+	clear_textures();
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%zu images from %zu files in %.2f s, %.1f images per second\n", images, files.size(), seconds, double(images) / std::max(seconds, 1e-6));
+
+	delete_offscreen_target(&target);
+	shutdown_headless_GL(display, context);
+
+	return failed + int(writer.failed);
+}
+
+bool run_headless_replay(const struct replay_options *options, const struct capture *capture, std::vector<struct frame_metrics> &metrics)
+{
+	EGLDisplay display;
+	EGLContext context;
+	if (!init_headless_GL(&display, &context)) { return false; }
+
+	if (!variants_init("usr/shaders/basev.glsl", "usr/shaders/pbr.glsl")) {
+		std::cerr << "error: the fallback shader variants did not link" << std::endl;
+	}
+	if (!load_environment(DEFAULT_ENVIRONMENT)) {
+		std::cerr << "error: no environment lighting" << std::endl;
+	}
+	const float aspect = float(options->width) / float(options->height);
+	const glm::mat4 project = glm::perspective(capture->fovy, aspect, capture->near, capture->far);
+	const struct cluster_grid grid = make_cluster_grid(project, float(options->width), float(options->height), capture->near, capture->far);
+
+	struct offscreen_target target = gen_offscreen_target(options->width, options->height);
+	glViewport(0, 0, options->width, options->height);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glEnable(GL_DEPTH_TEST);
+
+	bool loaded = true;
+	std::vector<gltf::Model*> models;
+	for (const std::string &file : capture->files) {
+		gltf::Model *model = new gltf::Model;
+		if (model->importf(file) == false) {
+			loaded = false;
+			delete model;
+			continue;
+		}
+		models.push_back(model);
+	}
+	// every variant has to be ready before the first measured frame
+	finish_variants();
+
+	struct replay_timer timer = gen_replay_timer();
+	const uint32_t frames = replay_frames(capture, options->step);
+	metrics.assign(frames, {});
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		const int64_t start = profile_now();
+		const struct capture_sample sample = sample_capture(capture, float(frame) * options->step);
+		for (gltf::Model *model : models) {
+			if (model->animations.empty()) { continue; }
+			const size_t current = std::min(size_t(std::max(sample.animation, 0)), model->animations.size() - 1);
+			const float end = model->animations[current].end;
+			model->updateAnimation(current, end > 0.f ? std::fmod(sample.timeline, end) : 0.f);
+		}
+
+		struct frame_packet packet;
+		packet.project = project;
+		packet.view = glm::lookAt(sample.eye, sample.target, sample.up);
+		packet.campos = sample.eye;
+		for (gltf::Model *model : models) { model->record(packet, sample.scale); }
+		cluster_lights(grid, packet.view, packet.lights, packet.clusters);
+		const int64_t submit = profile_now();
+		metrics[frame].cpums = float(double(submit - start) * 1e-6);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		begin_replay_timer(&timer, frame, metrics);
+		render_draws(packet);
+		end_replay_timer(&timer);
+		metrics[frame].glms = float(double(profile_now() - submit) * 1e-6);
+		count_draws(packet, &metrics[frame]);
+	}
+	finish_replay_timer(&timer, metrics);
+	delete_replay_timer(&timer);
+
+	for (gltf::Model *model : models) { delete model; }
+	clear_textures();
+	delete_offscreen_target(&target);
+	shutdown_headless_GL(display, context);
+
+	return loaded;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct replay_options;
+struct capture;
+struct frame_metrics;
+
+struct headless_options {
+	int width = 512;
+	int height = 512;
+	int views = 1; /* camera poses spread around the model */
+	float pitch = 20.f; /* camera elevation in degrees */
+	std::vector<float> times; /* animation times, the bind pose if empty */
+	std::string outdir = ".";
+};
+
+// renders every file offscreen without a window and writes PNGs to outdir, returns the number of failed files
+int run_headless(const struct headless_options *options, const std::vector<std::string> &files);
+
+// replays a capture offscreen at the size of the options, one entry per frame in metrics
+bool run_headless_replay(const struct replay_options *options, const struct capture *capture, std::vector<struct frame_metrics> &metrics);
@@ -0,0 +1,497 @@
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "external/stb_image.h"
+
+#include "texcache.hpp"
+#include "parallel.hpp"
+#include "shader.hpp"
+#include "ibl.hpp"
+#include "memory.hpp"
+
+static const char IBLCACHE_MAGIC[4] = { 'I', 'B', 'L', 'C' };
+
+static const float PI = 3.14159265358979f;
+
+const char *DEFAULT_ENVIRONMENT[6] = {
+	"media/textures/skybox/dust_ft.tga",
+	"media/textures/skybox/dust_bk.tga",
+	"media/textures/skybox/dust_up.tga",
+	"media/textures/skybox/dust_dn.tga",
+	"media/textures/skybox/dust_rt.tga",
+	"media/textures/skybox/dust_lf.tga",
+};
+
+// linear RGB float faces of one level of the source cubemap
+struct cube_level {
+	uint32_t size;
+	std::vector<float> texels;
+};
+
+static struct {
+	GLuint prefiltered = 0;
+	GLuint brdflut = 0;
+	float maxlod = 0.f;
+	glm::vec3 irradiance[9];
+} environment;
+
+// GL cubemap addressing, s and t in [0, 1] with t = 0 at the first row of a face
+static glm::vec3 face_direction(int face, float s, float t)
+{
+	const float sc = 2.f * s - 1.f;
+	const float tc = 2.f * t - 1.f;
+	switch (face) {
+	case 0: return glm::vec3(1.f, -tc, -sc);
+	case 1: return glm::vec3(-1.f, -tc, sc);
+	case 2: return glm::vec3(sc, 1.f, tc);
+	case 3: return glm::vec3(sc, -1.f, -tc);
+	case 4: return glm::vec3(sc, -tc, 1.f);
+	default: return glm::vec3(-sc, -tc, -1.f);
+	}
+}
+
+static int direction_face(glm::vec3 d, float *s, float *t)
+{
+	const glm::vec3 a = glm::abs(d);
+	int face;
+	float ma, sc, tc;
+	if (a.x >= a.y && a.x >= a.z) {
+		face = d.x > 0.f ? 0 : 1;
+		ma = a.x;
+		sc = d.x > 0.f ? -d.z : d.z;
+		tc = -d.y;
+	} else if (a.y >= a.z) {
+		face = d.y > 0.f ? 2 : 3;
+		ma = a.y;
+		sc = d.x;
+		tc = d.y > 0.f ? d.z : -d.z;
+	} else {
+		face = d.z > 0.f ? 4 : 5;
+		ma = a.z;
+		sc = d.z > 0.f ? d.x : -d.x;
+		tc = -d.y;
+	}
+	*s = 0.5f * (sc / ma + 1.f);
+	*t = 0.5f * (tc / ma + 1.f);
+
+	return face;
+}
+
+// bilinear inside the face, edges are clamped instead of filtered across faces
+static glm::vec3 sample_level(const struct cube_level &level, glm::vec3 direction)
+{
+	float s, t;
+	const int face = direction_face(direction, &s, &t);
+	const float x = glm::clamp(s * level.size - 0.5f, 0.f, float(level.size - 1));
+	const float y = glm::clamp(t * level.size - 0.5f, 0.f, float(level.size - 1));
+	const uint32_t x0 = uint32_t(x), y0 = uint32_t(y);
+	const uint32_t x1 = std::min(x0 + 1, level.size - 1), y1 = std::min(y0 + 1, level.size - 1);
+	const float fx = x - x0, fy = y - y0;
+
+	const float *texels = &level.texels[size_t(face) * level.size * level.size * 3];
+	auto texel = [&](uint32_t tx, uint32_t ty) { return glm::make_vec3(&texels[(size_t(ty) * level.size + tx) * 3]); };
+
+	return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), fx), glm::mix(texel(x0, y1), texel(x1, y1), fx), fy);
+}
+
+static glm::vec3 sample_lod(const std::vector<struct cube_level> &chain, glm::vec3 direction, float lod)
+{
+	lod = glm::clamp(lod, 0.f, float(chain.size() - 1));
+	const size_t lower = size_t(lod);
+	const size_t upper = std::min(lower + 1, chain.size() - 1);
+
+	return glm::mix(sample_level(chain[lower], direction), sample_level(chain[upper], direction), lod - float(lower));
+}
+
+static glm::vec2 hammersley(uint32_t i, uint32_t count)
+{
+	uint32_t bits = i;
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+	return glm::vec2(float(i) / float(count), float(bits) * 2.3283064365386963e-10f);
+}
+
+// half vector around n distributed by GGX with alpha = roughness squared
+static glm::vec3 importance_sample_GGX(glm::vec2 xi, glm::vec3 n, float alpha)
+{
+	const float phi = 2.f * PI * xi.x;
+	const float costheta = std::sqrt((1.f - xi.y) / (1.f + (alpha * alpha - 1.f) * xi.y));
+	const float sintheta = std::sqrt(1.f - costheta * costheta);
+
+	const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(1.f, 0.f, 0.f);
+	const glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+	const glm::vec3 bitangent = glm::cross(n, tangent);
+
+	return glm::normalize(tangent * (sintheta * std::cos(phi)) + bitangent * (sintheta * std::sin(phi)) + n * costheta);
+}
+
+static float distribution_GGX(float NdotH, float alpha)
+{
+	const float a2 = alpha * alpha;
+	const float f = NdotH * NdotH * (a2 - 1.f) + 1.f;
+
+	return a2 / (PI * f * f);
+}
+
+// one texel of a prefiltered level, view and normal are taken as the reflection direction
+// samples read coarser source levels the less likely they are (filtered importance sampling)
+static glm::vec3 prefilter_texel(const std::vector<struct cube_level> &chain, glm::vec3 n, float roughness)
+{
+	const float alpha = roughness * roughness;
+	const float texelangle = 4.f * PI / (6.f * float(chain[0].size) * float(chain[0].size));
+
+	glm::vec3 color(0.f);
+	float weight = 0.f;
+	for (uint32_t i = 0; i < IBL_SAMPLES; i++) {
+		const glm::vec3 h = importance_sample_GGX(hammersley(i, IBL_SAMPLES), n, alpha);
+		const float NdotH = glm::dot(n, h);
+		const glm::vec3 l = 2.f * NdotH * h - n;
+		const float NdotL = glm::dot(n, l);
+		if (NdotL <= 0.f) { continue; }
+
+		const float pdf = distribution_GGX(NdotH, alpha) * 0.25f;
+		const float sampleangle = 1.f / (float(IBL_SAMPLES) * pdf + 1e-4f);
+		const float lod = 0.5f * std::log2(sampleangle / texelangle) + 1.f;
+		color += sample_lod(chain, l, lod) * NdotL;
+		weight += NdotL;
+	}
+
+	return weight > 0.f ? color / weight : color;
+}
+
+static float geometry_schlick_GGX(float NdotV, float roughness)
+{
+	const float k = roughness * roughness * 0.5f;
+
+	return NdotV / (NdotV * (1.f - k) + k);
+}
+
+static void integrate_BRDF(uint32_t row, uint32_t size, float *dst)
+{
+	const float roughness = (float(row) + 0.5f) / float(size);
+	const float alpha = roughness * roughness;
+	const glm::vec3 n(0.f, 0.f, 1.f);
+	for (uint32_t column = 0; column < size; column++) {
+		const float NdotV = (float(column) + 0.5f) / float(size);
+		const glm::vec3 v(std::sqrt(1.f - NdotV * NdotV), 0.f, NdotV);
+		float scale = 0.f;
+		float bias = 0.f;
+		for (uint32_t i = 0; i < IBL_LUT_SAMPLES; i++) {
+			const glm::vec3 h = importance_sample_GGX(hammersley(i, IBL_LUT_SAMPLES), n, alpha);
+			const glm::vec3 l = 2.f * glm::dot(v, h) * h - v;
+			const float NdotL = std::max(l.z, 0.f);
+			const float NdotH = std::max(h.z, 0.f);
+			const float VdotH = std::max(glm::dot(v, h), 0.f);
+			if (NdotL <= 0.f) { continue; }
+
+			const float G = geometry_schlick_GGX(NdotV, roughness) * geometry_schlick_GGX(NdotL, roughness);
+			const float visibility = G * VdotH / (NdotH * NdotV);
+			const float fresnel = std::pow(1.f - VdotH, 5.f);
+			scale += (1.f - fresnel) * visibility;
+			bias += fresnel * visibility;
+		}
+		dst[column * 2 + 0] = scale / IBL_LUT_SAMPLES;
+		dst[column * 2 + 1] = bias / IBL_LUT_SAMPLES;
+	}
+}
+
+static float texel_area(float x, float y)
+{
+	return std::atan2(x * y, std::sqrt(x * x + y * y + 1.f));
+}
+
+// projects the radiance on the first 9 SH bands and convolves it with the cosine lobe
+static void project_irradiance(const struct cube_level &level, glm::vec3 irradiance[9])
+{
+	glm::vec3 faces[6][9] = {};
+	parallel_for(6, [&](size_t face) {
+		const float texel = 2.f / level.size;
+		for (uint32_t y = 0; y < level.size; y++) {
+			for (uint32_t x = 0; x < level.size; x++) {
+				const float u = (x + 0.5f) * texel - 1.f;
+				const float v = (y + 0.5f) * texel - 1.f;
+				const float weight = texel_area(u - 0.5f * texel, v - 0.5f * texel) - texel_area(u - 0.5f * texel, v + 0.5f * texel)
+					- texel_area(u + 0.5f * texel, v - 0.5f * texel) + texel_area(u + 0.5f * texel, v + 0.5f * texel);
+				const glm::vec3 d = glm::normalize(face_direction(int(face), (x + 0.5f) / level.size, (y + 0.5f) / level.size));
+				const glm::vec3 radiance = weight * glm::make_vec3(&level.texels[((face * level.size + y) * level.size + x) * 3]);
+				const float basis[9] = {
+					0.282095f,
+					0.488603f * d.y, 0.488603f * d.z, 0.488603f * d.x,
+					1.092548f * d.x * d.y, 1.092548f * d.y * d.z, 0.315392f * (3.f * d.z * d.z - 1.f), 1.092548f * d.x * d.z, 0.546274f * (d.x * d.x - d.y * d.y)
+				};
+				for (int i = 0; i < 9; i++) { faces[face][i] += radiance * basis[i]; }
+			}
+		}
+	});
+
+	// cosine lobe convolution (pi, 2pi/3, pi/4 per band) over pi for the lambert term
+	const float bands[9] = { 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (int i = 0; i < 9; i++) {
+		irradiance[i] = glm::vec3(0.f);
+		for (int face = 0; face < 6; face++) { irradiance[i] += faces[face][i]; }
+		irradiance[i] *= bands[i];
+	}
+}
+
+static bool read_file(const char *fpath, std::vector<unsigned char> &data)
+{
+	std::ifstream file(fpath, std::ios::binary);
+	if (!file) {
+		std::cerr << "error: to open file '" << fpath << "'" << std::endl;
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	return true;
+}
+
+static std::string cache_path(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ibl", (unsigned long long)key);
+
+	return std::string(IBLCACHE_DIR) + name;
+}
+
+static bool read_cache(uint64_t key, struct environment_bake *bake)
+{
+	FILE *fp = fopen(cache_path(key).c_str(), "rb");
+	if (fp == nullptr) { return false; }
+
+	char magic[4];
+	uint32_t header[3] = {};
+	bool valid = fread(magic, 1, 4, fp) == 4 && memcmp(magic, IBLCACHE_MAGIC, 4) == 0;
+	valid = valid && fread(header, sizeof(header), 1, fp) == 1;
+	valid = valid && header[0] == IBL_SIZE && header[1] == IBL_LEVELS && header[2] == IBL_LUT_SIZE;
+	valid = valid && fread(bake->irradiance, sizeof(bake->irradiance), 1, fp) == 1;
+	if (valid) {
+		bake->size = IBL_SIZE;
+		bake->levels = IBL_LEVELS;
+		bake->lutsize = IBL_LUT_SIZE;
+		bake->prefiltered.resize(IBL_LEVELS);
+		for (uint32_t level = 0; level < IBL_LEVELS && valid; level++) {
+			const size_t size = IBL_SIZE >> level;
+			bake->prefiltered[level].resize(6 * size * size * 3);
+			valid = fread(bake->prefiltered[level].data(), sizeof(float), bake->prefiltered[level].size(), fp) == bake->prefiltered[level].size();
+		}
+		bake->brdflut.resize(IBL_LUT_SIZE * IBL_LUT_SIZE * 2);
+		valid = valid && fread(bake->brdflut.data(), sizeof(float), bake->brdflut.size(), fp) == bake->brdflut.size();
+	}
+	fclose(fp);
+
+	return valid;
+}
+
+static void write_cache(uint64_t key, const struct environment_bake *bake)
+{
+	std::error_code error;
+	std::filesystem::create_directories(IBLCACHE_DIR, error);
+	const std::string path = cache_path(key);
+	const std::string tmppath = path + ".tmp";
+
+	FILE *fp = fopen(tmppath.c_str(), "wb");
+	if (fp == nullptr) { return; }
+	const uint32_t header[3] = { bake->size, bake->levels, bake->lutsize };
+	bool written = fwrite(IBLCACHE_MAGIC, 1, 4, fp) == 4;
+	written = written && fwrite(header, sizeof(header), 1, fp) == 1;
+	written = written && fwrite(bake->irradiance, sizeof(bake->irradiance), 1, fp) == 1;
+	for (const std::vector<float> &level : bake->prefiltered) {
+		written = written && fwrite(level.data(), sizeof(float), level.size(), fp) == level.size();
+	}
+	written = written && fwrite(bake->brdflut.data(), sizeof(float), bake->brdflut.size(), fp) == bake->brdflut.size();
+	fclose(fp);
+
+	if (written) {
+		std::filesystem::rename(tmppath, path, error);
+	} else {
+		std::filesystem::remove(tmppath, error);
+	}
+}
+
+// linear float faces with a box filtered chain down to 1x1
+static bool decode_faces(const std::vector<unsigned char> encoded[6], std::vector<struct cube_level> &chain)
+{
+	float linear[256];
+	for (int i = 0; i < 256; i++) { linear[i] = std::pow(i / 255.f, 2.2f); }
+
+	struct cube_level base;
+	base.size = 0;
+	for (int face = 0; face < 6; face++) {
+		int width, height, nchannels;
+		unsigned char *image = stbi_load_from_memory(encoded[face].data(), int(encoded[face].size()), &width, &height, &nchannels, 3);
+		if (image == nullptr || width != height || (face > 0 && uint32_t(width) != base.size)) {
+			std::cerr << "error: environment faces have to be square images of the same size" << std::endl;
+			stbi_image_free(image);
+			return false;
+		}
+		if (face == 0) {
+			base.size = uint32_t(width);
+			base.texels.resize(6 * size_t(width) * width * 3);
+		}
+		float *dst = &base.texels[size_t(face) * width * width * 3];
+		for (size_t i = 0; i < size_t(width) * width * 3; i++) { dst[i] = linear[image[i]]; }
+		stbi_image_free(image);
+	}
+
+	chain.push_back(std::move(base));
+	while (chain.back().size > 1) {
+		const struct cube_level &src = chain.back();
+		struct cube_level dst;
+		dst.size = src.size / 2;
+		dst.texels.resize(6 * size_t(dst.size) * dst.size * 3);
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t y = 0; y < dst.size; y++) {
+				for (uint32_t x = 0; x < dst.size; x++) {
+					for (uint32_t c = 0; c < 3; c++) {
+						auto at = [&](uint32_t sx, uint32_t sy) { return src.texels[((size_t(face) * src.size + sy) * src.size + sx) * 3 + c]; };
+						dst.texels[((size_t(face) * dst.size + y) * dst.size + x) * 3 + c] = 0.25f * (at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1));
+					}
+				}
+			}
+		}
+		chain.push_back(std::move(dst));
+	}
+
+	return true;
+}
+
+bool bake_environment(const char *faces[6], struct environment_bake *bake)
+{
+	// the key covers the encoded faces and everything that changes the result
+	std::vector<unsigned char> encoded[6];
+	std::string keydata = "IBL " + std::to_string(IBL_SIZE) + " " + std::to_string(IBL_LEVELS) + " " + std::to_string(IBL_SAMPLES) + " " + std::to_string(IBL_LUT_SIZE) + " " + std::to_string(IBL_LUT_SAMPLES) + "\n";
+	for (int face = 0; face < 6; face++) {
+		if (!read_file(faces[face], encoded[face])) { return false; }
+		keydata += std::to_string(hash_bytes(encoded[face].data(), encoded[face].size())) + "\n";
+	}
+	const uint64_t key = hash_bytes(reinterpret_cast<const unsigned char*>(keydata.data()), keydata.size());
+
+	if (read_cache(key, bake)) { return true; }
+
+	std::vector<struct cube_level> chain;
+	if (!decode_faces(encoded, chain)) { return false; }
+
+	bake->size = IBL_SIZE;
+	bake->levels = IBL_LEVELS;
+	bake->lutsize = IBL_LUT_SIZE;
+	bake->prefiltered.assign(IBL_LEVELS, std::vector<float>());
+	for (uint32_t level = 0; level < IBL_LEVELS; level++) {
+		const size_t size = IBL_SIZE >> level;
+		bake->prefiltered[level].resize(6 * size * size * 3);
+	}
+
+	// every row of every face of every level is a job, roughness 0 just resamples the source
+	struct row_job { uint32_t level, face, row; };
+	std::vector<struct row_job> jobs;
+	for (uint32_t level = 0; level < IBL_LEVELS; level++) {
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t row = 0; row < (IBL_SIZE >> level); row++) { jobs.push_back({ level, face, row }); }
+		}
+	}
+	parallel_for(jobs.size(), [&](size_t i) {
+		const struct row_job &job = jobs[i];
+		const uint32_t size = IBL_SIZE >> job.level;
+		const float roughness = float(job.level) / float(IBL_LEVELS - 1);
+		float *dst = &bake->prefiltered[job.level][((size_t(job.face) * size + job.row) * size) * 3];
+		for (uint32_t x = 0; x < size; x++) {
+			const glm::vec3 n = glm::normalize(face_direction(int(job.face), (x + 0.5f) / size, (job.row + 0.5f) / size));
+			const float sourcelod = std::log2(float(chain[0].size) / float(size));
+			const glm::vec3 color = job.level == 0 ? sample_lod(chain, n, sourcelod) : prefilter_texel(chain, n, roughness);
+			dst[x * 3 + 0] = color.r;
+			dst[x * 3 + 1] = color.g;
+			dst[x * 3 + 2] = color.b;
+		}
+	});
+
+	// a 32x32 level is plenty for 9 coefficients
+	size_t shlevel = 0;
+	while (shlevel + 1 < chain.size() && chain[shlevel].size > 32) { shlevel++; }
+	project_irradiance(chain[shlevel], bake->irradiance);
+
+	bake->brdflut.resize(IBL_LUT_SIZE * IBL_LUT_SIZE * 2);
+	parallel_for(IBL_LUT_SIZE, [&](size_t row) {
+		integrate_BRDF(uint32_t(row), IBL_LUT_SIZE, &bake->brdflut[row * IBL_LUT_SIZE * 2]);
+	});
+
+	write_cache(key, bake);
+
+	return true;
+}
+
+bool load_environment(const char *faces[6])
+{
+	struct environment_bake bake;
+	if (!bake_environment(faces, &bake)) { return false; }
+
+	environment_shutdown();
+
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	glGenTextures(1, &environment.prefiltered);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, environment.prefiltered);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, bake.levels, GL_RGB16F, bake.size, bake.size);
+	for (uint32_t level = 0; level < bake.levels; level++) {
+		const uint32_t size = bake.size >> level;
+		for (uint32_t face = 0; face < 6; face++) {
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGB, GL_FLOAT, &bake.prefiltered[level][size_t(face) * size * size * 3]);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, environment.prefiltered, texture_storage_size(GL_RGB16F, bake.size, bake.size, bake.levels, 6), GL_RGB16F, "prefiltered environment");
+
+	glGenTextures(1, &environment.brdflut);
+	glBindTexture(GL_TEXTURE_2D, environment.brdflut);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, bake.lutsize, bake.lutsize);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bake.lutsize, bake.lutsize, GL_RG, GL_FLOAT, bake.brdflut.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, environment.brdflut, texture_storage_size(GL_RG16F, bake.lutsize, bake.lutsize, 1, 1), GL_RG16F, "BRDF LUT");
+
+	environment.maxlod = float(bake.levels - 1);
+	for (int i = 0; i < 9; i++) { environment.irradiance[i] = bake.irradiance[i]; }
+
+	return true;
+}
+
+void bind_environment(Shader *shader)
+{
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, environment.prefiltered);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, environment.brdflut);
+	shader->uniform_float("prefilteredlod", environment.maxlod);
+	shader->uniform_array_vec3("irradiance", 9, environment.irradiance);
+}
+
+void environment_shutdown(void)
+{
+	gpu_memory_untrack(GPU_MEMORY_TEXTURE, environment.prefiltered);
+	gpu_memory_untrack(GPU_MEMORY_TEXTURE, environment.brdflut);
+	glDeleteTextures(1, &environment.prefiltered);
+	glDeleteTextures(1, &environment.brdflut);
+	environment.prefiltered = 0;
+	environment.brdflut = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// baked environments are kept here, keyed by the face images and the bake settings
+#define IBLCACHE_DIR "cache/ibl/"
+
+#define IBL_SIZE 128u /* faces of the first prefiltered level */
+#define IBL_LEVELS 6 /* roughness 0 to 1 in even steps, down to 4x4 faces */
+#define IBL_SAMPLES 64 /* GGX samples per prefiltered texel */
+#define IBL_LUT_SIZE 128u
+#define IBL_LUT_SAMPLES 256
+
+class Shader;
+
+// the skybox faces in cubemap order (+X, -X, +Y, -Y, +Z, -Z)
+extern const char *DEFAULT_ENVIRONMENT[6];
+
+struct environment_bake {
+	uint32_t size;
+	uint32_t levels;
+	std::vector<std::vector<float>> prefiltered; /* RGB of the six faces for every level */
+	glm::vec3 irradiance[9]; /* spherical harmonics of the irradiance, divided by pi for the lambert term */
+	uint32_t lutsize;
+	std::vector<float> brdflut; /* split sum scale and bias of F0, NdotV along rows and roughness down columns */
+};
+
+// precomputes the lighting of a cubemap on the CPU, from the cache when it was baked before
+bool bake_environment(const char *faces[6], struct environment_bake *bake);
+
+// bakes and uploads the environment every draw is lit by, false if the faces can't be read
+bool load_environment(const char *faces[6]);
+// binds the prefiltered cubemap and LUT to units 3 and 4, sets the irradiance of the shader
+void bind_environment(Shader *shader);
+void environment_shutdown(void);
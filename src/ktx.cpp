@@ -0,0 +1,313 @@
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <zstd.h>
+
+#include "dds.hpp"
+#include "ktx.hpp"
+
+#define KTX_HEADER_SIZE 80
+#define KTX_LEVEL_INDEX_SIZE 24
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// data format descriptor values
+enum {
+	KHR_DF_MODEL_BC4 = 131,
+	KHR_DF_MODEL_BC5 = 132,
+	KHR_DF_MODEL_BC7 = 134,
+	KHR_DF_MODEL_ETC1S = 163,
+	KHR_DF_MODEL_UASTC = 166,
+	KHR_DF_PRIMARIES_BT709 = 1,
+	KHR_DF_TRANSFER_LINEAR = 1,
+	KHR_DF_TRANSFER_SRGB = 2,
+};
+
+// Vulkan formats of block compressed payloads and their DXGI counterparts
+static const struct {
+	uint32_t vk_format;
+	uint32_t dxgi_format;
+} BLOCK_FORMATS[] = {
+	{ 131, DXGI_FORMAT_BC1_UNORM }, { 132, DXGI_FORMAT_BC1_UNORM_SRGB },
+	{ 133, DXGI_FORMAT_BC1_UNORM }, { 134, DXGI_FORMAT_BC1_UNORM_SRGB },
+	{ 135, DXGI_FORMAT_BC2_UNORM }, { 136, DXGI_FORMAT_BC2_UNORM_SRGB },
+	{ 137, DXGI_FORMAT_BC3_UNORM }, { 138, DXGI_FORMAT_BC3_UNORM_SRGB },
+	{ 139, DXGI_FORMAT_BC4_UNORM }, { 140, DXGI_FORMAT_BC4_SNORM },
+	{ 141, DXGI_FORMAT_BC5_UNORM }, { 142, DXGI_FORMAT_BC5_SNORM },
+	{ 143, DXGI_FORMAT_BC6H_UF16 }, { 144, DXGI_FORMAT_BC6H_SF16 },
+	{ 145, DXGI_FORMAT_BC7_UNORM }, { 146, DXGI_FORMAT_BC7_UNORM_SRGB },
+};
+
+static inline uint32_t read_u32(const unsigned char *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t read_u64(const unsigned char *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline void write_u32(unsigned char *p, uint32_t value)
+{
+	memcpy(p, &value, sizeof(value));
+}
+
+static inline void write_u64(unsigned char *p, uint64_t value)
+{
+	memcpy(p, &value, sizeof(value));
+}
+
+static uint32_t block_dxgi_format(uint32_t vk_format)
+{
+	for (const auto &entry : BLOCK_FORMATS) {
+		if (entry.vk_format == vk_format) { return entry.dxgi_format; }
+	}
+
+	return 0;
+}
+
+// channels of the 8 bit per channel formats that get block compressed on load
+static uint32_t uncompressed_channels(uint32_t vk_format)
+{
+	switch (vk_format) {
+	case 9: case 15: return 1; /* R8 */
+	case 16: case 22: return 2; /* R8G8 */
+	case 23: case 29: return 3; /* R8G8B8 */
+	case 37: case 43: return 4; /* R8G8B8A8 */
+	}
+
+	return 0;
+}
+
+bool is_KTX2(const unsigned char *data, size_t len)
+{
+	return len >= sizeof(KTX2_IDENTIFIER) && memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+bool read_KTX2_header(const unsigned char *data, size_t len, struct KTX *header)
+{
+	if (!is_KTX2(data, len) || len < KTX_HEADER_SIZE) { return false; }
+
+	header->vk_format = read_u32(data + 12);
+	header->width = read_u32(data + 20);
+	header->height = read_u32(data + 24);
+	uint32_t depth = read_u32(data + 28);
+	header->layers = std::max(1u, read_u32(data + 32));
+	header->faces = read_u32(data + 36);
+	header->levels = std::max(1u, read_u32(data + 40));
+	header->supercompression = read_u32(data + 44);
+
+	/* volume textures aren't supported */
+	if (depth > 1 || (header->faces != 1 && header->faces != 6)) { return false; }
+	if (KTX_HEADER_SIZE + size_t(header->levels) * KTX_LEVEL_INDEX_SIZE > len) { return false; }
+
+	/* the color model of the first descriptor block tells Basis payloads apart */
+	const uint32_t dfd_offset = read_u32(data + 48);
+	const uint32_t dfd_length = read_u32(data + 52);
+	header->color_model = 0;
+	header->srgb = false;
+	if (dfd_length >= 16 && size_t(dfd_offset) + dfd_length <= len) {
+		const unsigned char *block = data + dfd_offset + 4;
+		header->color_model = block[8];
+		header->srgb = (block[10] == KHR_DF_TRANSFER_SRGB);
+	}
+
+	return true;
+}
+
+// expand 1 to 3 channel pixels to the RGBA input of the block encoder
+static void expand_RGBA(const unsigned char *src, uint32_t channels, size_t count, unsigned char *dst)
+{
+	for (size_t i = 0; i < count; i++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			dst[i * 4 + c] = (c < channels) ? src[i * channels + c] : ((c == 3) ? 255 : 0);
+		}
+	}
+}
+
+bool transcode_KTX2(const unsigned char *data, size_t len, enum bcn_format format, struct DDS *header, std::vector<unsigned char> &blocks)
+{
+	struct KTX ktx;
+	if (!read_KTX2_header(data, len, &ktx)) {
+		std::cerr << "error: not a supported KTX2 file" << std::endl;
+		return false;
+	}
+
+	/* there is no Basis Universal transcoder, such textures use their regular glTF source */
+	if (ktx.supercompression == KTX_SUPERCOMPRESSION_BASISLZ || ktx.color_model == KHR_DF_MODEL_ETC1S || ktx.color_model == KHR_DF_MODEL_UASTC) {
+		std::cerr << "error: Basis Universal (ETC1S, UASTC) KTX2 payloads aren't supported, only BCn and 8 bit ones" << std::endl;
+		return false;
+	}
+	/* glTF textures are sampled as 2D textures */
+	if (ktx.layers > 1 || ktx.faces != 1) {
+		std::cerr << "error: KTX2 arrays and cubemaps can't be glTF textures" << std::endl;
+		return false;
+	}
+	if (ktx.supercompression != KTX_SUPERCOMPRESSION_NONE && ktx.supercompression != KTX_SUPERCOMPRESSION_ZSTD) {
+		std::cerr << "error: unknown KTX2 supercompression scheme " << ktx.supercompression << std::endl;
+		return false;
+	}
+
+	const uint32_t dxgi_format = block_dxgi_format(ktx.vk_format);
+	const uint32_t channels = uncompressed_channels(ktx.vk_format);
+	if (dxgi_format == 0 && channels == 0) {
+		std::cerr << "error: unsupported KTX2 format " << ktx.vk_format << std::endl;
+		return false;
+	}
+
+	*header = {};
+	header->width = ktx.width;
+	header->height = ktx.height;
+	header->mip_levels = ktx.levels;
+	header->dxt_codec = FOURCC_DX10;
+	header->dxgi_format = dxgi_format ? dxgi_format : bcn_dxgi_format(format);
+	header->array_size = ktx.layers;
+	header->cubemap = (ktx.faces == 6);
+	header->linear_size = uint32_t(DDS_level_size(header, 0));
+
+	/* KTX2 stores all images of a level together, DDS all levels of an image */
+	const size_t images = size_t(ktx.layers) * ktx.faces;
+	const size_t face_size = DDS_face_size(header);
+	blocks.resize(face_size * images);
+	header->data_size = blocks.size();
+
+	std::vector<unsigned char> inflated;
+	std::vector<unsigned char> rgba;
+	size_t level_offset = 0;
+	for (uint32_t level = 0; level < ktx.levels; level++) {
+		const unsigned char *entry = data + KTX_HEADER_SIZE + size_t(level) * KTX_LEVEL_INDEX_SIZE;
+		const uint64_t offset = read_u64(entry);
+		uint64_t length = read_u64(entry + 8);
+		const uint64_t uncompressed = read_u64(entry + 16);
+		if (offset > len || length > len - offset) {
+			std::cerr << "error: KTX2 level " << level << " is truncated" << std::endl;
+			return false;
+		}
+
+		const unsigned char *src = data + offset;
+		if (ktx.supercompression == KTX_SUPERCOMPRESSION_ZSTD) {
+			inflated.resize(uncompressed);
+			size_t size = ZSTD_decompress(inflated.data(), inflated.size(), src, length);
+			if (ZSTD_isError(size)) {
+				std::cerr << "error: KTX2 level " << level << ": " << ZSTD_getErrorName(size) << std::endl;
+				return false;
+			}
+			src = inflated.data();
+			length = size;
+		}
+
+		const uint32_t width = std::max(1u, ktx.width >> level);
+		const uint32_t height = std::max(1u, ktx.height >> level);
+		const size_t level_size = DDS_level_size(header, level);
+		const size_t image_size = dxgi_format ? level_size : size_t(width) * height * channels;
+		if (image_size * images > length) {
+			std::cerr << "error: KTX2 level " << level << " is truncated" << std::endl;
+			return false;
+		}
+
+		for (size_t image = 0; image < images; image++) {
+			unsigned char *dst = blocks.data() + image * face_size + level_offset;
+			const unsigned char *pixels = src + image * image_size;
+			if (dxgi_format) {
+				memcpy(dst, pixels, level_size);
+			} else {
+				rgba.resize(size_t(width) * height * 4);
+				expand_RGBA(pixels, channels, size_t(width) * height, rgba.data());
+				bcn_compress(format, rgba.data(), width, height, dst);
+			}
+		}
+
+		level_offset += level_size;
+	}
+
+	return true;
+}
+
+// Vulkan format and descriptor color model of the encoder formats
+static void block_format(enum bcn_format format, uint32_t *vk_format, uint8_t *color_model)
+{
+	switch (format) {
+	case BCN_BC4: *vk_format = 139; *color_model = KHR_DF_MODEL_BC4; break;
+	case BCN_BC5: *vk_format = 141; *color_model = KHR_DF_MODEL_BC5; break;
+	case BCN_BC7: *vk_format = 145; *color_model = KHR_DF_MODEL_BC7; break;
+	case BCN_BC7_SRGB: *vk_format = 146; *color_model = KHR_DF_MODEL_BC7; break;
+	}
+}
+
+bool pack_KTX2(enum bcn_format format, uint32_t width, uint32_t height, uint32_t levels, const unsigned char *blocks, int zstdlevel, std::vector<unsigned char> &out)
+{
+	uint32_t vk_format = 0;
+	uint8_t color_model = 0;
+	block_format(format, &vk_format, &color_model);
+
+	/* a basic descriptor block with one 16 byte sample per channel, BC5 has red and green */
+	const uint32_t samples = (format == BCN_BC5) ? 2 : 1;
+	const uint32_t block_size = 24 + 16 * samples;
+	const size_t dfd_offset = KTX_HEADER_SIZE + size_t(levels) * KTX_LEVEL_INDEX_SIZE;
+	const uint32_t dfd_length = 4 + block_size;
+
+	out.assign(dfd_offset + dfd_length, 0);
+	unsigned char *header = out.data();
+	memcpy(header, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	write_u32(header + 12, vk_format);
+	write_u32(header + 16, 1); /* type size of block compressed formats */
+	write_u32(header + 20, width);
+	write_u32(header + 24, height);
+	write_u32(header + 36, 1); /* faces */
+	write_u32(header + 40, levels);
+	write_u32(header + 44, KTX_SUPERCOMPRESSION_ZSTD);
+	write_u32(header + 48, uint32_t(dfd_offset));
+	write_u32(header + 52, dfd_length);
+
+	unsigned char *dfd = out.data() + dfd_offset;
+	write_u32(dfd, dfd_length);
+	dfd[8] = 2; /* descriptor version */
+	dfd[10] = uint8_t(block_size);
+	dfd[12] = color_model;
+	dfd[13] = KHR_DF_PRIMARIES_BT709;
+	dfd[14] = (format == BCN_BC7_SRGB) ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR;
+	dfd[16] = 3; /* 4x4 texel blocks */
+	dfd[17] = 3;
+	/* bytesPlane stays 0 for supercompressed data */
+	const uint8_t bits = (format == BCN_BC7 || format == BCN_BC7_SRGB) ? 127 : 63;
+	for (uint32_t sample = 0; sample < samples; sample++) {
+		unsigned char *entry = dfd + 28 + 16 * sample;
+		entry[0] = uint8_t(sample * 64); /* bit offset */
+		entry[2] = bits;
+		entry[3] = uint8_t(sample); /* red, then green */
+		write_u32(entry + 12, 0xFFFFFFFF);
+	}
+
+	/* levels are stored smallest first, each one compressed on its own */
+	std::vector<size_t> offsets(levels + 1, 0);
+	for (uint32_t level = 0; level < levels; level++) {
+		offsets[level + 1] = offsets[level] + bcn_image_size(format, std::max(1u, width >> level), std::max(1u, height >> level));
+	}
+	for (uint32_t level = levels; level-- > 0;) {
+		const size_t size = offsets[level + 1] - offsets[level];
+		const size_t start = out.size();
+		out.resize(start + ZSTD_compressBound(size));
+		const size_t packed = ZSTD_compress(out.data() + start, out.size() - start, blocks + offsets[level], size, zstdlevel);
+		if (ZSTD_isError(packed)) {
+			std::cerr << "error: KTX2 level " << level << ": " << ZSTD_getErrorName(packed) << std::endl;
+			return false;
+		}
+		out.resize(start + packed);
+
+		unsigned char *entry = out.data() + KTX_HEADER_SIZE + size_t(level) * KTX_LEVEL_INDEX_SIZE;
+		write_u64(entry, start);
+		write_u64(entry + 8, packed);
+		write_u64(entry + 16, size);
+	}
+
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "bcn.hpp"
+
+// private glTF texture extension whose source is a KTX2 image with a BCn or 8 bit payload
+// KHR_texture_basisu only allows Basis Universal payloads, which aren't transcoded, so it isn't read
+#define KTX2_TEXTURE_EXTENSION "GLTFVIEWER_texture_ktx2"
+
+// KTX2 supercompression schemes
+enum {
+	KTX_SUPERCOMPRESSION_NONE = 0,
+	KTX_SUPERCOMPRESSION_BASISLZ = 1,
+	KTX_SUPERCOMPRESSION_ZSTD = 2,
+};
+
+struct KTX {
+	uint32_t vk_format; /* VK_FORMAT_UNDEFINED for Basis Universal payloads */
+	uint32_t width;
+	uint32_t height;
+	uint32_t layers;
+	uint32_t faces;
+	uint32_t levels;
+	uint32_t supercompression;
+	uint32_t color_model; /* from the data format descriptor */
+	bool srgb;
+};
+
+bool is_KTX2(const unsigned char *data, size_t len);
+
+bool read_KTX2_header(const unsigned char *data, size_t len, struct KTX *header);
+
+// transcodes a KTX2 file into block compressed levels in DDS layout, ready for gen_DDS_texture
+// uncompressed payloads are block compressed to format, Basis Universal payloads, arrays and cubemaps aren't supported
+bool transcode_KTX2(const unsigned char *data, size_t len, enum bcn_format format, struct DDS *header, std::vector<unsigned char> &blocks);
+
+// KTX2 file of levels block compressed by compress_chain, every level is zstd supercompressed
+// this is not a Basis Universal payload, glTF files point at it through KTX2_TEXTURE_EXTENSION
+bool pack_KTX2(enum bcn_format format, uint32_t width, uint32_t height, uint32_t levels, const unsigned char *blocks, int zstdlevel, std::vector<unsigned char> &out);
@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+#include "lighting.hpp"
+#include "lightbuffers.hpp"
+#include "memory.hpp"
+
+static struct {
+	GLuint lights = 0;
+	GLuint ranges = 0;
+	GLuint indices = 0;
+} buffers;
+
+static void upload_buffer(GLuint *buffer, GLuint binding, const void *data, size_t size, const char *label)
+{
+	if (*buffer == 0) { glGenBuffers(1, buffer); }
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+	// a fresh store each frame, the draws of the last frame may still read the old one
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, size_t(16)), nullptr, GL_STREAM_DRAW);
+	gpu_memory_track(GPU_MEMORY_BUFFER, *buffer, std::max(size, size_t(16)), GL_NONE, label);
+	if (size > 0) { glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data); }
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, *buffer);
+}
+
+void upload_clusters(const struct light_clusters &clusters)
+{
+	upload_buffer(&buffers.lights, 0, clusters.lights.data(), clusters.lights.size() * sizeof(struct light_data), "lights");
+	upload_buffer(&buffers.ranges, 1, clusters.ranges.data(), clusters.ranges.size() * sizeof(glm::uvec2), "light clusters");
+	upload_buffer(&buffers.indices, 2, clusters.indices.data(), clusters.indices.size() * sizeof(uint32_t), "light indices");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void lighting_shutdown(void)
+{
+	for (GLuint buffer : { buffers.lights, buffers.ranges, buffers.indices }) { gpu_memory_untrack(GPU_MEMORY_BUFFER, buffer); }
+	glDeleteBuffers(1, &buffers.lights);
+	glDeleteBuffers(1, &buffers.ranges);
+	glDeleteBuffers(1, &buffers.indices);
+	buffers.lights = buffers.ranges = buffers.indices = 0;
+}
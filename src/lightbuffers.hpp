@@ -0,0 +1,7 @@
+#pragma once
+
+struct light_clusters;
+
+// GL thread, binds the lights, ranges and indices to shader storage bindings 0, 1 and 2
+void upload_clusters(const struct light_clusters &clusters);
+void lighting_shutdown(void);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "parallel.hpp"
+#include "lighting.hpp"
+#include "profiler.hpp"
+
+// the lights that reach one depth slice in view space, structure of arrays padded to a multiple of 4
+struct slice_lights {
+	std::vector<float> x, y, z, r;
+	std::vector<uint32_t> index;
+};
+
+struct light_data make_light(enum light_type type, glm::vec3 position, glm::vec3 direction, glm::vec3 color, float intensity, float range, float innercone, float outercone)
+{
+	struct light_data light = {};
+	// glTF lights without a range are only cut off once they are too dim to matter
+	if (type != LIGHT_DIRECTIONAL && range <= 0.f) {
+		const float brightest = std::max(color.r, std::max(color.g, color.b)) * intensity;
+		range = std::sqrt(std::max(brightest, 0.f) / LIGHT_CUTOFF);
+	}
+	light.position = glm::vec4(position, range);
+	light.color = glm::vec4(color * intensity, float(type));
+	const float scale = 1.f / std::max(0.001f, std::cos(innercone) - std::cos(outercone));
+	light.direction = glm::vec4(glm::normalize(direction), scale);
+	light.spot = glm::vec4(-std::cos(outercone) * scale, 0.f, 0.f, 0.f);
+
+	return light;
+}
+
+struct cluster_grid make_cluster_grid(const glm::mat4 &project, float width, float height, float near, float far)
+{
+	struct cluster_grid grid;
+	grid.near = near;
+	grid.far = far;
+	grid.width = width;
+	grid.height = height;
+	grid.mins.resize(CLUSTER_COUNT);
+	grid.maxs.resize(CLUSTER_COUNT);
+
+	// view space directions through the tile corners, scaled to the slice planes below
+	const glm::mat4 unproject = glm::inverse(project);
+	std::vector<glm::vec3> rays((CLUSTER_X + 1) * (CLUSTER_Y + 1));
+	for (int y = 0; y <= CLUSTER_Y; y++) {
+		for (int x = 0; x <= CLUSTER_X; x++) {
+			const glm::vec2 ndc = glm::vec2(float(x) / CLUSTER_X, float(y) / CLUSTER_Y) * 2.f - 1.f;
+			glm::vec4 point = unproject * glm::vec4(ndc, 0.5f, 1.f);
+			glm::vec3 ray = glm::vec3(point) / point.w;
+			rays[y * (CLUSTER_X + 1) + x] = ray / -ray.z;
+		}
+	}
+
+	for (int z = 0; z < CLUSTER_Z; z++) {
+		const float front = near * std::pow(far / near, float(z) / CLUSTER_Z);
+		const float back = near * std::pow(far / near, float(z + 1) / CLUSTER_Z);
+		for (int y = 0; y < CLUSTER_Y; y++) {
+			for (int x = 0; x < CLUSTER_X; x++) {
+				glm::vec3 bmin(FLT_MAX);
+				glm::vec3 bmax(-FLT_MAX);
+				for (int corner = 0; corner < 4; corner++) {
+					const glm::vec3 &ray = rays[(y + corner / 2) * (CLUSTER_X + 1) + x + corner % 2];
+					for (float depth : { front, back }) {
+						bmin = glm::min(bmin, ray * depth);
+						bmax = glm::max(bmax, ray * depth);
+					}
+				}
+				const size_t cluster = x + CLUSTER_X * (y + CLUSTER_Y * z);
+				grid.mins[cluster] = bmin;
+				grid.maxs[cluster] = bmax;
+			}
+		}
+	}
+
+	return grid;
+}
+
+// appends the lights whose spheres touch the box
+static void test_cluster(const struct slice_lights &slice, glm::vec3 bmin, glm::vec3 bmax, std::vector<uint32_t> &indices)
+{
+#if defined(__SSE2__)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 minx = _mm_set1_ps(bmin.x), miny = _mm_set1_ps(bmin.y), minz = _mm_set1_ps(bmin.z);
+	const __m128 maxx = _mm_set1_ps(bmax.x), maxy = _mm_set1_ps(bmax.y), maxz = _mm_set1_ps(bmax.z);
+	for (size_t i = 0; i < slice.index.size(); i += 4) {
+		const __m128 x = _mm_loadu_ps(&slice.x[i]);
+		const __m128 y = _mm_loadu_ps(&slice.y[i]);
+		const __m128 z = _mm_loadu_ps(&slice.z[i]);
+		const __m128 r = _mm_loadu_ps(&slice.r[i]);
+		const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minx, x), _mm_sub_ps(x, maxx)), zero);
+		const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(miny, y), _mm_sub_ps(y, maxy)), zero);
+		const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minz, z), _mm_sub_ps(z, maxz)), zero);
+		const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		int mask = _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)));
+		while (mask) {
+			indices.push_back(slice.index[i + __builtin_ctz(mask)]);
+			mask &= mask - 1;
+		}
+	}
+#else
+	for (size_t i = 0; i < slice.index.size(); i++) {
+		const glm::vec3 center(slice.x[i], slice.y[i], slice.z[i]);
+		const glm::vec3 d = glm::max(glm::max(bmin - center, center - bmax), glm::vec3(0.f));
+		if (glm::dot(d, d) <= slice.r[i] * slice.r[i]) { indices.push_back(slice.index[i]); }
+	}
+#endif
+}
+
+void cluster_lights(const struct cluster_grid &grid, const glm::mat4 &view, const std::vector<struct light_data> &lights, struct light_clusters &clusters)
+{
+	PROFILE_SCOPE("light clustering");
+	clusters.lights.clear();
+	clusters.ranges.assign(CLUSTER_COUNT, glm::uvec2(0));
+	clusters.indices.clear();
+	clusters.maxcount = 0;
+
+	const float depthscale = CLUSTER_Z / std::log(grid.far / grid.near);
+	clusters.grid = glm::vec4(grid.width / CLUSTER_X, grid.height / CLUSTER_Y, depthscale, -depthscale * std::log(grid.near));
+
+	for (const struct light_data &light : lights) {
+		if (int(light.color.w) == LIGHT_DIRECTIONAL) { clusters.lights.push_back(light); }
+	}
+	if (lights.empty()) {
+		clusters.lights.push_back(make_light(LIGHT_DIRECTIONAL, glm::vec3(0.f), glm::vec3(-0.7399f, -0.6428f, -0.1983f), glm::vec3(1.f, 0.9f, 0.8f), 3.4f, 0.f, 0.f, 0.f));
+	}
+	clusters.directional = uint32_t(clusters.lights.size());
+
+	// view space spheres of the local lights
+	std::vector<glm::vec4> spheres;
+	for (const struct light_data &light : lights) {
+		if (int(light.color.w) == LIGHT_DIRECTIONAL) { continue; }
+		spheres.push_back(glm::vec4(glm::vec3(view * glm::vec4(glm::vec3(light.position), 1.f)), light.position.w));
+		clusters.lights.push_back(light);
+	}
+
+	// slices are binned independently, then joined in order
+	std::vector<std::vector<glm::uvec2>> sliceranges(CLUSTER_Z);
+	std::vector<std::vector<uint32_t>> sliceindices(CLUSTER_Z);
+	auto bin_slice = [&](size_t z) {
+		const float front = grid.near * std::pow(grid.far / grid.near, float(z) / CLUSTER_Z);
+		const float back = grid.near * std::pow(grid.far / grid.near, float(z + 1) / CLUSTER_Z);
+		struct slice_lights slice;
+		for (size_t i = 0; i < spheres.size(); i++) {
+			const glm::vec4 &sphere = spheres[i];
+			if (-sphere.z + sphere.w < front || -sphere.z - sphere.w > back) { continue; }
+			slice.x.push_back(sphere.x);
+			slice.y.push_back(sphere.y);
+			slice.z.push_back(sphere.z);
+			slice.r.push_back(sphere.w);
+			slice.index.push_back(clusters.directional + uint32_t(i));
+		}
+		// padding that never touches a cluster
+		while (slice.index.size() % 4) {
+			slice.x.push_back(1e18f);
+			slice.y.push_back(1e18f);
+			slice.z.push_back(1e18f);
+			slice.r.push_back(0.f);
+			slice.index.push_back(0);
+		}
+
+		std::vector<glm::uvec2> &ranges = sliceranges[z];
+		std::vector<uint32_t> &indices = sliceindices[z];
+		ranges.resize(CLUSTER_X * CLUSTER_Y);
+		for (size_t tile = 0; tile < ranges.size(); tile++) {
+			const size_t cluster = tile + z * CLUSTER_X * CLUSTER_Y;
+			const uint32_t first = uint32_t(indices.size());
+			if (slice.index.empty() == false) { test_cluster(slice, grid.mins[cluster], grid.maxs[cluster], indices); }
+			ranges[tile] = glm::uvec2(first, uint32_t(indices.size()) - first);
+		}
+	};
+
+	if (spheres.size() < CLUSTER_PARALLEL_LIGHTS) {
+		for (size_t z = 0; z < CLUSTER_Z; z++) { bin_slice(z); }
+	} else {
+		parallel_for(CLUSTER_Z, bin_slice);
+	}
+
+	for (size_t z = 0; z < CLUSTER_Z; z++) {
+		const uint32_t offset = uint32_t(clusters.indices.size());
+		for (size_t tile = 0; tile < sliceranges[z].size(); tile++) {
+			const glm::uvec2 range = sliceranges[z][tile];
+			clusters.ranges[tile + z * CLUSTER_X * CLUSTER_Y] = glm::uvec2(offset + range.x, range.y);
+			clusters.maxcount = std::max(clusters.maxcount, range.y);
+		}
+		clusters.indices.insert(clusters.indices.end(), sliceindices[z].begin(), sliceindices[z].end());
+	}
+}
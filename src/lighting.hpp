@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// view frustum grid the point and spot lights are binned into, 16:9 tiles and exponential depth slices
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// below this many lights the slices are binned on the calling thread
+#define CLUSTER_PARALLEL_LIGHTS 128
+
+// lights without a range end where their intensity drops below this
+#define LIGHT_CUTOFF 0.01f
+
+enum light_type {
+	LIGHT_DIRECTIONAL,
+	LIGHT_POINT,
+	LIGHT_SPOT
+};
+
+// one light as the shader reads it, std430 layout
+struct light_data {
+	glm::vec4 position; /* world space, w is the range */
+	glm::vec4 color; /* premultiplied by the intensity, w is the light_type */
+	glm::vec4 direction; /* the light points along it, w is the spot angle scale */
+	glm::vec4 spot; /* x is the spot angle offset */
+};
+
+// view space bounds of every cluster, only changes with the projection
+struct cluster_grid {
+	float near;
+	float far;
+	float width; /* viewport in pixels */
+	float height;
+	std::vector<glm::vec3> mins;
+	std::vector<glm::vec3> maxs;
+};
+
+// lights of one frame and the lights of each cluster
+struct light_clusters {
+	std::vector<struct light_data> lights; /* directional lights first, they reach every cluster */
+	uint32_t directional = 0;
+	std::vector<glm::uvec2> ranges; /* offset and count into indices for every cluster */
+	std::vector<uint32_t> indices;
+	glm::vec4 grid; /* tile width and height in pixels, depth slice scale and bias */
+	uint32_t maxcount = 0; /* most lights in a single cluster */
+};
+
+struct light_data make_light(enum light_type type, glm::vec3 position, glm::vec3 direction, glm::vec3 color, float intensity, float range, float innercone, float outercone);
+
+struct cluster_grid make_cluster_grid(const glm::mat4 &project, float width, float height, float near, float far);
+
+// bins the world space lights into the grid seen from view, touches no GL state, the upload is in lightbuffers.hpp
+// without any lights a default sun is added so unlit scenes stay visible
+void cluster_lights(const struct cluster_grid &grid, const glm::mat4 &view, const std::vector<struct light_data> &lights, struct light_clusters &clusters);
@@ -1,4 +1,13 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -16,8 +25,22 @@
 #include "shader.hpp"
 #include "camera.hpp"
 #include "texture.hpp"
+#include "streaming.hpp"
+#include "geometry.hpp"
+#include "progcache.hpp"
+#include "variants.hpp"
+#include "lighting.hpp"
+#include "lightbuffers.hpp"
+#include "ibl.hpp"
+#include "dynres.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "memory.hpp"
 
 #include "gltf.h"
+#include "frame.hpp"
+#include "headless.hpp"
+#include "optimize.hpp"
 
 #define WINWIDTH 1920
 #define WINHEIGHT 1080
@@ -81,28 +104,6 @@ struct mesh make_cubemap(void)
 	return m;
 }
 
-Shader base_shader(void)
-{
-	struct shaderinfo pipeline[] = {
-		{GL_VERTEX_SHADER, "usr/shaders/basev.glsl"},
-		{GL_FRAGMENT_SHADER, "usr/shaders/pbr.glsl"},
-		{GL_NONE, NULL}
-	};
-
-	Shader shader(pipeline);
-
-	shader.bind();
-
-	const float aspect = (float)WINWIDTH/(float)WINHEIGHT;
-	glm::mat4 project = glm::perspective(glm::radians(90.f), aspect, 0.1f, 800.f);
-	shader.uniform_mat4("project", project);
-
-	glm::mat4 model = glm::mat4(1.f);
-	shader.uniform_mat4("model", model);
-
-	return shader;
-}
-
 Shader skybox_shader(void)
 {
 	struct shaderinfo pipeline[] = {
@@ -136,36 +137,198 @@ static inline void start_imguiframe(SDL_Window *window)
 	ImGui::NewFrame();
 }
 
-void render_loop(SDL_Window *window, std::string fpath)
+// models are imported on the GL thread, the simulation only touches them once they are ready
+struct scene_model {
+	gltf::Model *model;
+	std::string name;
+	std::atomic<bool> ready{false};
+};
+
+static struct scene_model *load_model(const std::string &fpath, std::vector<std::function<void()>> &tasks)
 {
-	gltf::Model testmodel;
-	testmodel.importf(fpath);
-
-	const char *CUBEMAP_TEXTURES[6] = {
-	"media/textures/skybox/dust_ft.tga",
-	"media/textures/skybox/dust_bk.tga",
-	"media/textures/skybox/dust_up.tga",
-	"media/textures/skybox/dust_dn.tga",
-	"media/textures/skybox/dust_rt.tga",
-	"media/textures/skybox/dust_lf.tga",
-	};
-	GLuint cubemap = load_TGA_cubemap(CUBEMAP_TEXTURES);
+	struct scene_model *entry = new scene_model;
+	entry->model = new gltf::Model;
+	entry->name = fpath;
+	tasks.push_back([entry] {
+		entry->model->importf(entry->name);
+		entry->ready = true;
+	});
+
+	return entry;
+}
+
+// GL objects only the GL thread uses once it runs
+struct gl_scene {
+	SDL_Window *window;
+	SDL_GLContext context;
+	Shader *skybox;
+	struct mesh cube;
+	GLuint cubemap;
+	struct dynres_target *dynres;
+	struct replay_session *session;
+};
+
+// runs the GL work and draws of every packet the simulation queues
+static void render_thread(struct gl_scene *scene, struct frame_queue *queue)
+{
+	SDL_GL_MakeCurrent(scene->window, scene->context);
+	profile_thread("GL");
+
+	const bool replaying = scene->session->mode == SESSION_REPLAY;
+	struct replay_timer timer;
+	if (replaying) { timer = gen_replay_timer(); }
+
+	struct frame_packet packet;
+	Uint32 lastticks = SDL_GetTicks();
+	while (queue->pop(packet)) {
+		PROFILE_SCOPE("GL frame");
+		const int64_t framestart = profile_now();
+		gpu_profile_frame();
+		{
+			PROFILE_SCOPE("tasks");
+			for (auto &task : packet.tasks) { task(); }
+		}
+
+		{
+			PROFILE_SCOPE("streaming");
+			for (const struct mip_request &request : packet.mips) { stream_request(request.texture, request.pixels); }
+			stream_update();
+		}
+
+		PROFILE_GPU("frame");
+		begin_scene(scene->dynres);
+
+		// the cluster tiles were sized for the native resolution
+		packet.clusters.grid.x *= scene->dynres->scale;
+		packet.clusters.grid.y *= scene->dynres->scale;
+		{
+			PROFILE_GPU("scene");
+			if (packet.frame >= 0) { begin_replay_timer(&timer, packet.frame, scene->session->metrics); }
+			render_draws(packet);
+			if (packet.frame >= 0) { end_replay_timer(&timer); }
+		}
+
+		glDepthFunc(GL_LEQUAL);
+		scene->skybox->bind();
+		scene->skybox->uniform_mat4("view", packet.view);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, scene->cubemap);
+		display_skybox(scene->cube);
+		glDepthFunc(GL_LESS);
+
+		{
+			PROFILE_GPU("upscale");
+			end_scene(scene->dynres);
+		}
+
+		{
+			PROFILE_GPU("ui");
+			render_ui(packet);
+		}
+
+		// the swap may wait for vsync, it is not part of the submission
+		if (packet.frame >= 0) {
+			struct frame_metrics *metrics = &scene->session->metrics[packet.frame];
+			metrics->glms = float(double(profile_now() - framestart) * 1e-6);
+			count_draws(packet, metrics);
+		}
+
+		{
+			PROFILE_SCOPE("swap");
+			SDL_GL_SwapWindow(scene->window);
+		}
+		geometry_retire();
+
+		struct render_stats stats;
+		stats.geometry = geometry_statistics();
+		stats.stream = stream_statistics();
+		stats.variants = variant_statistics();
+		stats.resolution = scene->dynres->scale;
+		stats.scenems = scene->dynres->gpums;
+		Uint32 ticks = SDL_GetTicks();
+		stats.msperframe = float(ticks - lastticks);
+		lastticks = ticks;
+		publish_stats(stats);
+	}
+
+	if (replaying) {
+		finish_replay_timer(&timer, scene->session->metrics);
+		delete_replay_timer(&timer);
+	}
+	gpu_profile_shutdown();
+	SDL_GL_MakeCurrent(scene->window, nullptr);
+}
+
+// the session records the camera and timeline of every frame, or replays a recording at a fixed step and measures it
+void render_loop(SDL_Window *window, SDL_GLContext glcontext, const std::vector<std::string> &fpaths, struct replay_session *session)
+{
+	// cached textures are streamed in from their lowest mip levels
+	stream_init(STREAM_DEFAULT_BUDGET);
+
+	// the pre-compressed cubemap uploads without decoding, the TGA faces are a fallback
+	GLuint cubemap = load_DDS_texture("media/textures/skybox/dust.dds");
+	if (cubemap == 0) { cubemap = load_TGA_cubemap(DEFAULT_ENVIRONMENT); }
+	// the skybox also lights the scene, only the first run bakes it
+	if (!load_environment(DEFAULT_ENVIRONMENT)) {
+		std::cerr << "error: no environment lighting" << std::endl;
+	}
 
 	struct mesh cube = make_cubemap();
 	Shader skybox = skybox_shader();
-	Shader shader = base_shader();
+	// every material draws with a variant of these sources that only has the features it uses
+	if (!variants_init("usr/shaders/basev.glsl", "usr/shaders/pbr.glsl")) {
+		std::cerr << "error: the fallback shader variants did not link" << std::endl;
+	}
 	Camera cam(glm::vec3(10.0, 10.0, 10.0));
 
+	// ImGui frames are built on this thread, its GL objects have to exist before the context moves
+	ImGui_ImplOpenGL3_CreateDeviceObjects();
+
+	// every model shares the same geometry buffers and can be unloaded at runtime
+	std::vector<std::function<void()>> tasks;
+	std::vector<struct scene_model*> models;
+	for (const std::string &fpath : fpaths) { models.push_back(load_model(fpath, tasks)); }
+	static char loadpath[256] = "";
+
+	// the GL thread owns the context from here on
+	struct dynres_target dynres = gen_dynres_target(WINWIDTH, WINHEIGHT);
+	struct gl_scene scene = { window, glcontext, &skybox, cube, cubemap, &dynres, session };
+	struct frame_queue queue;
+	SDL_GL_MakeCurrent(window, nullptr);
+	std::thread renderer(render_thread, &scene, &queue);
+
 	SDL_Event event;
 	bool running = true;
 	float start = 0.f;
 	float end = 0.f;
 	static float timer = 0.f;
 	static float scale = 1.f;
-	unsigned long frames = 0;
-	unsigned int msperframe = 0;
+	float msperframe = 0.f;
+	static int budget = STREAM_DEFAULT_BUDGET >> 20;
 
+	const float aspect = (float)WINWIDTH/(float)WINHEIGHT;
+	const glm::mat4 project = glm::perspective(glm::radians(90.f), aspect, 0.1f, 800.f);
+	const struct cluster_grid grid = make_cluster_grid(project, float(WINWIDTH), float(WINHEIGHT), 0.1f, 800.f);
+
+	struct capture *capture = &session->capture;
+	if (session->mode == SESSION_RECORD) {
+		capture->files = fpaths;
+		capture->fovy = glm::radians(90.f);
+		capture->near = 0.1f;
+		capture->far = 800.f;
+		capture->samples.clear();
+	}
+	// replayed frames are counted once every model is loaded
+	const uint32_t replayframes = session->mode == SESSION_REPLAY ? replay_frames(capture, session->step) : 0;
+	int32_t replayframe = -1;
+	bool warming = false;
+	std::atomic<bool> warmed(false);
+	float recordtime = 0.f;
+
+	profile_thread("simulation");
 	while (running == true) {
+		PROFILE_SCOPE("frame");
+		const int64_t framestart = profile_now();
 	// input and time measuring
 		start = 0.001f * SDL_GetTicks();
 		const float delta = start - end;
@@ -180,63 +343,211 @@ void render_loop(SDL_Window *window, std::string fpath)
 		}
 
 	// update states
-		cam.update(delta);
-
 		static int item_current = 0;
-		timer += delta;
-		if (testmodel.animations.empty() == false) {
-			if (timer > testmodel.animations[item_current].end) { timer -= testmodel.animations[item_current].end; }
-			testmodel.updateAnimation(item_current, timer);
+		struct frame_packet packet;
+		if (session->mode == SESSION_REPLAY) {
+			if (!warming && std::all_of(models.begin(), models.end(), [](const struct scene_model *entry) { return entry->ready.load(); })) {
+				// variants compiling in the background and a changing resolution would make every run different
+				struct dynres_target *target = &dynres;
+				std::atomic<bool> *done = &warmed;
+				tasks.push_back([target, done] {
+					finish_variants();
+					target->enabled = false;
+					target->scale = DYNRES_MAX_SCALE;
+					done->store(true);
+				});
+				warming = true;
+			}
+			// the GL thread ran the warm up before any later packet, so shader compilation isn't measured
+			if (replayframe < 0 && warmed.load()) {
+				session->metrics.assign(replayframes, {});
+				replayframe = 0;
+			}
+			const struct capture_sample sample = sample_capture(capture, std::max(replayframe, 0) * session->step);
+			cam.center = sample.eye;
+			cam.up = sample.up;
+			item_current = sample.animation;
+			timer = sample.timeline;
+			scale = sample.scale;
+			packet.view = glm::lookAt(sample.eye, sample.target, sample.up);
+			packet.frame = replayframe;
+		} else {
+			cam.update(delta);
+			timer += delta;
+			packet.view = cam.view();
 		}
 
-	// rendering
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glm::mat4 view = cam.view();
-		shader.uniform_mat4("view", view);
-		shader.uniform_vec3("campos", cam.center);
+		for (struct scene_model *entry : models) {
+			gltf::Model *model = entry->model;
+			if (entry->ready && model->animations.empty() == false) {
+				const size_t current = std::min(size_t(item_current), model->animations.size() - 1);
+				if (session->mode == SESSION_REPLAY) {
+					const float end = model->animations[current].end;
+					model->updateAnimation(current, end > 0.f ? std::fmod(timer, end) : 0.f);
+					continue;
+				}
+				if (timer > model->animations[current].end) { timer -= model->animations[current].end; }
+				model->updateAnimation(current, timer);
+			}
+		}
 
-		shader.bind();
-		testmodel.display(&shader, scale);
+		if (session->mode == SESSION_RECORD) {
+			recordtime += delta;
+			struct capture_sample sample;
+			sample.time = recordtime;
+			sample.eye = cam.center;
+			sample.target = glm::vec3(0.f, 1.f, 0.f);
+			sample.up = cam.up;
+			sample.animation = item_current;
+			sample.timeline = timer;
+			sample.scale = scale;
+			capture->samples.push_back(sample);
+		}
 
-		glDepthFunc(GL_LEQUAL);
-		skybox.bind();
-		skybox.uniform_mat4("view", view);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
-		display_skybox(cube);
-		glDepthFunc(GL_LESS);
+	// record the frame for the GL thread
+		struct render_stats stats = latest_stats();
+		// textures are sampled at the scene resolution, not the window's, nothing is published before the first frame
+		const float viewheight = float(WINHEIGHT) * (stats.resolution > 0.f ? stats.resolution : 1.f);
+		packet.project = project;
+		packet.campos = cam.center;
+		for (struct scene_model *entry : models) {
+			if (entry->ready == false) { continue; }
+			entry->model->record(packet, scale);
+			entry->model->request_mips(project, packet.view, scale, viewheight, packet.mips);
+		}
+		cluster_lights(grid, packet.view, packet.lights, packet.clusters);
 
 	// debug UI
 		start_imguiframe(window);
 
 		ImGui::Begin("Debug");
-		ImGui::SetWindowSize(ImVec2(400, 200));
-		ImGui::Text("%d ms per frame", msperframe);
+		ImGui::SetWindowSize(ImVec2(500, 400));
+		ImGui::Text("%.2f ms per frame, %.0f ms on the GL thread", msperframe, stats.msperframe);
 		ImGui::Text("camera distance: %.2f", cam.eye.x);
 		ImGui::SliderFloat("model scale", &scale, 0.1f, 10.0f);
 
-		if (testmodel.animations.size() > 0) {
+		if (models.empty() == false && models[0]->ready && models[0]->model->animations.size() > 0) {
+			gltf::Model *first = models[0]->model;
 			std::vector<const char*> charitems;
-			for (size_t i = 0; i < testmodel.animations.size(); i++) {
-				charitems.push_back(testmodel.animations[i].name.c_str());
+			for (size_t i = 0; i < first->animations.size(); i++) {
+				charitems.push_back(first->animations[i].name.c_str());
 			}
 			ImGui::Combo("animation select", &item_current, &charitems[0], charitems.size());
 		}
 
+		ImGui::InputText("glTF file", loadpath, sizeof(loadpath));
+		ImGui::SameLine();
+		if (ImGui::Button("Load") && loadpath[0] != '\0') {
+			models.push_back(load_model(loadpath, tasks));
+			/* a replay loads everything up front, unloads are not recorded */
+			if (session->mode == SESSION_RECORD) { capture->files.push_back(loadpath); }
+		}
+		for (size_t i = 0; i < models.size(); i++) {
+			ImGui::PushID(int(i));
+			if (ImGui::Button("Unload")) {
+				/* queued frames may still draw it, the GL thread deletes it after them */
+				struct scene_model *entry = models[i];
+				tasks.push_back([entry] {
+					delete entry->model;
+					delete entry;
+				});
+				models.erase(models.begin() + i);
+				ImGui::PopID();
+				break;
+			}
+			ImGui::SameLine();
+			ImGui::Text("%s%s", models[i]->name.c_str(), models[i]->ready ? "" : " (loading)");
+			ImGui::PopID();
+		}
+
+		const struct geometry_pool_stats &vertstats = stats.geometry.vertices[VERTEX_FORMAT_MESH];
+		ImGui::Text("vertices: %.1f / %.1f MB in %zu blocks, fragmentation %.2f", double(vertstats.used) / (1 << 20), double(vertstats.capacity) / (1 << 20), vertstats.blocks, vertstats.fragmentation);
+		ImGui::Text("indices: %.1f / %.1f MB in %zu blocks, fragmentation %.2f", double(stats.geometry.indices.used) / (1 << 20), double(stats.geometry.indices.capacity) / (1 << 20), stats.geometry.indices.blocks, stats.geometry.indices.fragmentation);
+		if (ImGui::Button("Geometry report")) { tasks.push_back(geometry_report); }
+
+		struct program_cache_stats programs = program_cache_statistics();
+		ImGui::Text("program cache: %zu hits, %zu misses, %zu rejected, %zu stored", programs.hits, programs.misses, programs.rejected, programs.stores);
+		ImGui::Text("lights: %zu, at most %u in a cluster, %zu cluster entries", packet.clusters.lights.size(), packet.clusters.maxcount, packet.clusters.indices.size());
+		ImGui::Text("shader variants: %zu ready, %zu compiling, %zu failed%s", stats.variants.ready, stats.variants.pending, stats.variants.failed, stats.variants.parallel ? " (parallel)" : "");
+
+		static bool dynamic = true;
+		static bool logdynres = false;
+		static float targetms = DYNRES_DEFAULT_TARGET;
+		static float sharpness = 0.2f;
+		ImGui::Text("scene: %.2f ms on the GPU at %.0f%% resolution", stats.scenems, 100.f * stats.resolution);
+		bool changed = ImGui::Checkbox("dynamic resolution", &dynamic);
+		ImGui::SameLine();
+		changed |= ImGui::Checkbox("log", &logdynres);
+		changed |= ImGui::SliderFloat("scene target (ms)", &targetms, 4.f, 33.f);
+		changed |= ImGui::SliderFloat("sharpness", &sharpness, 0.f, 1.f);
+		if (changed) {
+			struct dynres_target *target = &dynres;
+			const bool enabled = dynamic, log = logdynres;
+			const float ms = targetms, sharpen = sharpness;
+			tasks.push_back([target, enabled, log, ms, sharpen] {
+				target->enabled = enabled;
+				target->log = log;
+				target->target = ms;
+				target->sharpness = sharpen;
+			});
+		}
+
+		if (stream_enabled()) {
+			if (ImGui::SliderInt("texture budget (MB)", &budget, 16, 2048)) {
+				const size_t bytes = size_t(budget) << 20;
+				tasks.push_back([bytes] { stream_set_budget(bytes); });
+			}
+			ImGui::Text("textures: %.1f MB resident, %zu streamed, %zu pending, %zu evictions", double(stats.stream.resident) / (1 << 20), stats.stream.textures, stats.stream.pending, stats.stream.evictions);
+		}
+
 		if (ImGui::Button("Exit")) { running = false; }
 
 		ImGui::End();
 
-		// Render dear imgui into screen
+		profiler_window();
+		memory_window();
+
 		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		record_ui(packet);
+
+		packet.tasks = std::move(tasks);
+		tasks.clear();
+		if (packet.frame >= 0) { session->metrics[packet.frame].cpums = float(double(profile_now() - framestart) * 1e-6); }
+		// blocks while the GL thread is FRAMES_IN_FLIGHT frames behind
+		{
+			PROFILE_SCOPE("queue wait");
+			queue.push(std::move(packet));
+		}
+
+		if (replayframe >= 0 && uint32_t(++replayframe) >= replayframes) {
+			/* the last frames have to be drawn before their metrics are complete */
+			queue.flush();
+			running = false;
+		}
 
-		SDL_GL_SwapWindow(window);
 		end = start;
-		frames++;
-  		if (frames > 100) { msperframe = (unsigned int)(delta*1000); frames = 0; }
+		// smoothed instead of sampled, the profiler has the per frame detail
+		msperframe = msperframe > 0.f ? glm::mix(msperframe, delta * 1000.f, 0.05f) : delta * 1000.f;
+	}
+
+	queue.close();
+	renderer.join();
+	SDL_GL_MakeCurrent(window, glcontext);
+
+	// finish the loads and unloads of frames that were never drawn
+	for (struct frame_packet &packet : queue.drain()) {
+		for (auto &task : packet.tasks) { task(); }
+	}
+	for (struct scene_model *entry : models) {
+		delete entry->model;
+		delete entry;
 	}
+	delete_dynres_target(&dynres);
+	variants_shutdown();
+	lighting_shutdown();
+	environment_shutdown();
+	geometry_shutdown();
+	stream_shutdown();
 }
 
 void init_imgui(SDL_Window *window, SDL_GLContext glcontext)
@@ -254,8 +565,160 @@ void init_imgui(SDL_Window *window, SDL_GLContext glcontext)
 	ImGui_ImplOpenGL3_Init("#version 430");
 }
 
+static void usage(const char *program)
+{
+	std::cerr << "usage: " << program << " [--record capture.json] [file.gltf|file.glb ...]\n";
+	std::cerr << "       " << program << " --headless [--size WxH] [--views N] [--pitch degrees] [--time seconds ...] [--out dir] file ...\n";
+	std::cerr << "       " << program << " --replay capture.json [--headless] [--size WxH] [--step seconds] [--results file.json] [--baseline file.json] [--tolerance fraction]\n";
+	std::cerr << "       " << program << " --optimize [--out dir] [--report file.json] [--budget MB] [--fps N] [--tolerance error] [--keep-images] [--no-quantize] file|dir ...\n";
+}
+
+// options after --headless, anything else is a file
+static bool parse_headless(int argc, char *argv[], struct headless_options *options, std::vector<std::string> &files)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasvalue = i + 1 < argc;
+		if (arg == "--headless") {
+			continue;
+		} else if (arg == "--size" && hasvalue) {
+			if (sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2 || options->width <= 0 || options->height <= 0) { return false; }
+		} else if (arg == "--views" && hasvalue) {
+			options->views = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--pitch" && hasvalue) {
+			options->pitch = float(atof(argv[++i]));
+		} else if (arg == "--time" && hasvalue) {
+			options->times.push_back(float(atof(argv[++i])));
+		} else if (arg == "--out" && hasvalue) {
+			options->outdir = argv[++i];
+		} else if (arg.compare(0, 2, "--") == 0) {
+			return false;
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	return true;
+}
+
+// options after --optimize, anything else is a file or a directory of them
+static bool parse_optimize(int argc, char *argv[], struct optimize_options *options, std::vector<std::string> &paths)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasvalue = i + 1 < argc;
+		if (arg == "--optimize") {
+			continue;
+		} else if (arg == "--out" && hasvalue) {
+			options->outdir = argv[++i];
+		} else if (arg == "--report" && hasvalue) {
+			options->report = argv[++i];
+		} else if (arg == "--budget" && hasvalue) {
+			const int megabytes = atoi(argv[++i]);
+			if (megabytes <= 0) { return false; }
+			options->budget = size_t(megabytes) << 20;
+		} else if (arg == "--fps" && hasvalue) {
+			options->fps = float(atof(argv[++i]));
+			if (options->fps <= 0.f) { return false; }
+		} else if (arg == "--tolerance" && hasvalue) {
+			options->tolerance = std::max(0.f, float(atof(argv[++i])));
+		} else if (arg == "--keep-images") {
+			options->textures = false;
+		} else if (arg == "--no-quantize") {
+			options->quantize = false;
+		} else if (arg.compare(0, 2, "--") == 0) {
+			return false;
+		} else {
+			paths.push_back(arg);
+		}
+	}
+
+	return true;
+}
+
+// options after --replay, the models come from the capture
+static bool parse_replay(int argc, char *argv[], struct replay_options *options)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasvalue = i + 1 < argc;
+		if (arg == "--replay" && hasvalue) {
+			options->capture = argv[++i];
+		} else if (arg == "--headless") {
+			options->headless = true;
+		} else if (arg == "--size" && hasvalue) {
+			if (sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2 || options->width <= 0 || options->height <= 0) { return false; }
+		} else if (arg == "--step" && hasvalue) {
+			options->step = float(atof(argv[++i]));
+			if (options->step <= 0.f) { return false; }
+		} else if (arg == "--results" && hasvalue) {
+			options->results = argv[++i];
+		} else if (arg == "--baseline" && hasvalue) {
+			options->baseline = argv[++i];
+		} else if (arg == "--tolerance" && hasvalue) {
+			options->tolerance = float(atof(argv[++i]));
+		} else {
+			return false;
+		}
+	}
+
+	return !options->capture.empty();
+}
+
 int main(int argc, char *argv[])
 {
+	struct replay_session session;
+	struct replay_options replay;
+	std::string recordpath;
+	std::vector<std::string> fpaths;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0) {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (strcmp(argv[i], "--optimize") == 0) {
+			struct optimize_options options;
+			std::vector<std::string> paths;
+			if (!parse_optimize(argc, argv, &options, paths) || paths.empty()) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			exit(run_optimize(&options, paths) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (strcmp(argv[i], "--replay") == 0) {
+			if (!parse_replay(argc, argv, &replay)) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			if (!load_capture(replay.capture, &session.capture)) { exit(EXIT_FAILURE); }
+			if (replay.headless) {
+				const bool replayed = run_headless_replay(&replay, &session.capture, session.metrics);
+				exit(replayed && report_replay(&replay, session.metrics) ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+			session.mode = SESSION_REPLAY;
+			session.step = replay.step;
+			fpaths = session.capture.files;
+			break;
+		}
+	}
+	for (int i = 1; i < argc && session.mode != SESSION_REPLAY; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			session.mode = SESSION_RECORD;
+			recordpath = argv[++i];
+			continue;
+		}
+		fpaths.push_back(argv[i]);
+		if (strcmp(argv[i], "--headless") == 0) {
+			struct headless_options options;
+			std::vector<std::string> files;
+			if (!parse_headless(argc, argv, &options, files) || files.empty()) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			exit(run_headless(&options, files) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
 	SDL_Init(SDL_INIT_VIDEO);
 	SDL_Window *window = SDL_CreateWindow("glTF viewer", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINWIDTH, WINHEIGHT, SDL_WINDOW_OPENGL);
 
@@ -275,7 +738,7 @@ int main(int argc, char *argv[])
 
 	init_imgui(window, glcontext);
 
-	render_loop(window, argv[1]);
+	render_loop(window, glcontext, fpaths, &session);
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplSDL2_Shutdown();
@@ -284,5 +747,8 @@ int main(int argc, char *argv[])
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
+	if (session.mode == SESSION_RECORD && !save_capture(recordpath, &session.capture)) { exit(EXIT_FAILURE); }
+	if (session.mode == SESSION_REPLAY && !report_replay(&replay, session.metrics)) { exit(EXIT_FAILURE); }
+
 	exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,364 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "external/imgui.h"
+#include "external/json.hpp"
+
+#include "memory.hpp"
+
+using json = nlohmann::json;
+
+#define MB(bytes) (double(bytes) / (1 << 20))
+#define RSS_INTERVAL 0.25 /* seconds between the /proc reads of the memory window */
+
+static const char *TAG_NAMES[MEMORY_TAG_COUNT] = {
+	"glTF documents",
+	"scene graph",
+	"animation",
+	"skins",
+	"materials",
+	"geometry staging",
+	"texture decoding",
+	"texture streaming"
+};
+
+struct gpu_object {
+	size_t bytes;
+	GLenum format;
+	const char *label;
+};
+
+static struct {
+	std::atomic<size_t> current[MEMORY_TAG_COUNT];
+	std::atomic<size_t> peak[MEMORY_TAG_COUNT];
+
+	std::mutex lock;
+	std::map<std::pair<int, GLuint>, struct gpu_object> objects;
+	std::vector<struct import_memory> imports;
+} accounting;
+
+void memory_add(enum memory_tag tag, size_t bytes)
+{
+	const size_t now = accounting.current[tag].fetch_add(bytes) + bytes;
+	size_t peak = accounting.peak[tag].load();
+	while (now > peak && !accounting.peak[tag].compare_exchange_weak(peak, now));
+}
+
+void memory_sub(enum memory_tag tag, size_t bytes)
+{
+	accounting.current[tag].fetch_sub(bytes);
+}
+
+void gpu_memory_track(enum gpu_memory_kind kind, GLuint name, size_t bytes, GLenum format, const char *label)
+{
+	if (name == 0) { return; }
+
+	std::lock_guard<std::mutex> guard(accounting.lock);
+	accounting.objects[std::make_pair(int(kind), name)] = { bytes, format, label };
+}
+
+void gpu_memory_untrack(enum gpu_memory_kind kind, GLuint name)
+{
+	std::lock_guard<std::mutex> guard(accounting.lock);
+	accounting.objects.erase(std::make_pair(int(kind), name));
+}
+
+// bytes per 4x4 block of the compressed formats, bytes per pixel of the others
+static size_t format_bytes(GLenum format, bool *compressed)
+{
+	*compressed = true;
+	switch (format) {
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+	case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		return 8;
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_RG_RGTC2:
+	case GL_COMPRESSED_SIGNED_RG_RGTC2:
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+	case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+	case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+		return 16;
+	}
+
+	*compressed = false;
+	switch (format) {
+	case GL_R8: return 1;
+	case GL_RG8: return 2;
+	case GL_R16F: return 2;
+	/* drivers pad three channels to four */
+	case GL_RGB:
+	case GL_RGB8:
+	case GL_SRGB8:
+	case GL_RGBA:
+	case GL_RGBA8:
+	case GL_SRGB8_ALPHA8:
+	case GL_RG16F:
+	case GL_R32F:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH_COMPONENT32F:
+		return 4;
+	case GL_RGB16F:
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGB32F:
+	case GL_RGBA32F:
+		return 16;
+	}
+
+	return 4;
+}
+
+size_t texture_storage_size(GLenum format, uint32_t width, uint32_t height, uint32_t levels, uint32_t layers)
+{
+	bool compressed;
+	const size_t bytes = format_bytes(format, &compressed);
+	size_t total = 0;
+	for (uint32_t level = 0; level < std::max(levels, 1u); level++) {
+		const size_t w = std::max(1u, width >> level);
+		const size_t h = std::max(1u, height >> level);
+		total += compressed ? ((w + 3) / 4) * ((h + 3) / 4) * bytes : w * h * bytes;
+	}
+
+	return total * std::max(layers, 1u);
+}
+
+const char *gl_format_name(GLenum format)
+{
+	switch (format) {
+	case GL_NONE: return "-";
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return "BC1";
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: return "BC2";
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+	case GL_COMPRESSED_RED_RGTC1: return "BC4";
+	case GL_COMPRESSED_RG_RGTC2: return "BC5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return "BC7";
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: return "BC7 sRGB";
+	case GL_R8: return "R8";
+	case GL_RG8: return "RG8";
+	case GL_RGB: case GL_RGB8: return "RGB8";
+	case GL_SRGB8: return "SRGB8";
+	case GL_RGBA: case GL_RGBA8: return "RGBA8";
+	case GL_SRGB8_ALPHA8: return "SRGB8_A8";
+	case GL_RG16F: return "RG16F";
+	case GL_RGB16F: return "RGB16F";
+	case GL_RGBA16F: return "RGBA16F";
+	case GL_DEPTH_COMPONENT24: return "D24";
+	case GL_DEPTH24_STENCIL8: return "D24S8";
+	}
+
+	return "other";
+}
+
+const char *memory_tag_name(enum memory_tag tag)
+{
+	return TAG_NAMES[tag];
+}
+
+// a "Vm...: N kB" line of /proc/self/status
+static size_t proc_status(const char *field)
+{
+	FILE *fp = fopen("/proc/self/status", "r");
+	if (fp == nullptr) { return 0; }
+
+	char line[256];
+	size_t kb = 0;
+	const size_t len = strlen(field);
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, field, len) == 0 && line[len] == ':') {
+			sscanf(line + len + 1, "%zu", &kb);
+			break;
+		}
+	}
+	fclose(fp);
+
+	return kb * 1024;
+}
+
+size_t current_rss(void)
+{
+	return proc_status("VmRSS");
+}
+
+size_t peak_rss(void)
+{
+	return proc_status("VmHWM");
+}
+
+bool reset_peak_rss(void)
+{
+	/* 5 resets the high water mark, since Linux 4.0 */
+	FILE *fp = fopen("/proc/self/clear_refs", "w");
+	if (fp == nullptr) { return false; }
+	const bool written = fputs("5", fp) >= 0;
+
+	return fclose(fp) == 0 && written;
+}
+
+void memory_record_import(const struct import_memory &import)
+{
+	std::lock_guard<std::mutex> guard(accounting.lock);
+	accounting.imports.push_back(import);
+}
+
+struct memory_report memory_snapshot(bool rss)
+{
+	struct memory_report report = {};
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		report.cpu[tag].current = accounting.current[tag].load();
+		report.cpu[tag].peak = accounting.peak[tag].load();
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(accounting.lock);
+		std::map<std::pair<const char*, GLenum>, struct gpu_memory_group> groups;
+		for (const auto &entry : accounting.objects) {
+			const struct gpu_object &object = entry.second;
+			struct gpu_memory_group &group = groups[std::make_pair(object.label, object.format)];
+			group.label = object.label;
+			group.format = object.format;
+			group.count++;
+			group.bytes += object.bytes;
+			report.gputotal += object.bytes;
+		}
+		for (const auto &entry : groups) { report.gpu.push_back(entry.second); }
+		report.imports = accounting.imports;
+	}
+	std::sort(report.gpu.begin(), report.gpu.end(), [](const struct gpu_memory_group &a, const struct gpu_memory_group &b) {
+		return a.bytes > b.bytes;
+	});
+
+	if (rss) {
+		report.rss = current_rss();
+		report.peakrss = peak_rss();
+	}
+
+	return report;
+}
+
+bool export_memory_report(const char *fpath)
+{
+	const struct memory_report report = memory_snapshot();
+
+	json cpu = json::object();
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		cpu[TAG_NAMES[tag]] = { { "current", report.cpu[tag].current }, { "peak", report.cpu[tag].peak } };
+	}
+	json gpu = json::array();
+	for (const struct gpu_memory_group &group : report.gpu) {
+		gpu.push_back({ { "label", group.label }, { "format", gl_format_name(group.format) }, { "objects", group.count }, { "bytes", group.bytes } });
+	}
+	json imports = json::array();
+	for (const struct import_memory &import : report.imports) {
+		imports.push_back({
+			{ "file", import.name },
+			{ "document", import.document },
+			{ "rss_before", import.rssbefore },
+			{ "peak_rss_before", import.peakbefore },
+			{ "peak_rss", import.peakrss },
+			{ "rss_after", import.rssafter }
+		});
+	}
+	const json root = {
+		{ "cpu", cpu },
+		{ "gpu", gpu },
+		{ "gpu_total", report.gputotal },
+		{ "rss", report.rss },
+		{ "peak_rss", report.peakrss },
+		{ "imports", imports }
+	};
+
+	std::ofstream file(fpath);
+	if (!file) {
+		std::cerr << "error: can't write memory report " << fpath << std::endl;
+		return false;
+	}
+	file << root.dump(1, '\t') << std::endl;
+
+	return bool(file);
+}
+
+void memory_window(void)
+{
+	static char reportpath[256] = MEMORY_REPORT_PATH;
+	struct memory_report report = memory_snapshot(false);
+	// /proc is read a few times a second, not every frame
+	static size_t rss = 0;
+	static size_t peakrss = 0;
+	static double sampled = -RSS_INTERVAL;
+	if (ImGui::GetTime() - sampled >= RSS_INTERVAL) {
+		rss = current_rss();
+		peakrss = peak_rss();
+		sampled = ImGui::GetTime();
+	}
+	report.rss = rss;
+	report.peakrss = peakrss;
+
+	ImGui::Begin("Memory");
+	ImGui::Text("resident: %.1f MB, peak %.1f MB", MB(report.rss), MB(report.peakrss));
+	ImGui::SameLine();
+	if (ImGui::Button("Reset peak")) {
+		if (reset_peak_rss()) {
+			sampled = -RSS_INTERVAL;
+		} else {
+			std::cerr << "error: the kernel doesn't allow resetting the peak resident set" << std::endl;
+		}
+	}
+	ImGui::InputText("report file", reportpath, sizeof(reportpath));
+	ImGui::SameLine();
+	if (ImGui::Button("Dump")) { export_memory_report(reportpath); }
+
+	if (ImGui::CollapsingHeader("CPU", ImGuiTreeNodeFlags_DefaultOpen)) {
+		ImGui::Columns(3, "cpu");
+		ImGui::Text("subsystem"); ImGui::NextColumn();
+		ImGui::Text("MB"); ImGui::NextColumn();
+		ImGui::Text("peak MB"); ImGui::NextColumn();
+		for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+			ImGui::Text("%s", TAG_NAMES[tag]); ImGui::NextColumn();
+			ImGui::Text("%.2f", MB(report.cpu[tag].current)); ImGui::NextColumn();
+			ImGui::Text("%.2f", MB(report.cpu[tag].peak)); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	if (ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen)) {
+		ImGui::Text("%.1f MB tracked", MB(report.gputotal));
+		ImGui::Columns(4, "gpu");
+		ImGui::Text("objects"); ImGui::NextColumn();
+		ImGui::Text("format"); ImGui::NextColumn();
+		ImGui::Text("count"); ImGui::NextColumn();
+		ImGui::Text("MB"); ImGui::NextColumn();
+		for (const struct gpu_memory_group &group : report.gpu) {
+			ImGui::Text("%s", group.label); ImGui::NextColumn();
+			ImGui::Text("%s", gl_format_name(group.format)); ImGui::NextColumn();
+			ImGui::Text("%zu", group.count); ImGui::NextColumn();
+			ImGui::Text("%.2f", MB(group.bytes)); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	if (ImGui::CollapsingHeader("Imports")) {
+		for (const struct import_memory &import : report.imports) {
+			if (import.peakrss > import.peakbefore) {
+				ImGui::Text("%s: document %.1f MB, RSS %.1f -> peak %.1f -> %.1f MB", import.name.c_str(), MB(import.document), MB(import.rssbefore), MB(import.peakrss), MB(import.rssafter));
+			} else {
+				ImGui::Text("%s: document %.1f MB, RSS %.1f -> %.1f MB, peak below the earlier %.1f MB", import.name.c_str(), MB(import.document), MB(import.rssbefore), MB(import.rssafter), MB(import.peakbefore));
+			}
+		}
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define MEMORY_REPORT_PATH "memory.json"
+
+// subsystems the CPU heap is accounted to, the bytes are reported by the owners, allocations aren't hooked
+enum memory_tag {
+	MEMORY_GLTF, /* parsed tinygltf documents while they are imported */
+	MEMORY_SCENE, /* nodes, meshes and primitives */
+	MEMORY_ANIMATION, /* keyframes and channels */
+	MEMORY_SKINS,
+	MEMORY_MATERIALS, /* materials, lights and texture references */
+	MEMORY_GEOMETRY, /* vertices and indices staged on the CPU */
+	MEMORY_TEXTURES, /* decoded images and mip chains waiting for upload */
+	MEMORY_STREAMING, /* levels read from disk and waiting for upload */
+	MEMORY_TAG_COUNT
+};
+
+void memory_add(enum memory_tag tag, size_t bytes);
+void memory_sub(enum memory_tag tag, size_t bytes);
+
+// accounts a temporary buffer for as long as it lives
+struct memory_scope {
+	enum memory_tag tag;
+	size_t bytes;
+	memory_scope(enum memory_tag scopetag, size_t scopebytes) : tag(scopetag), bytes(scopebytes) { memory_add(tag, bytes); }
+	~memory_scope() { memory_sub(tag, bytes); }
+};
+
+enum gpu_memory_kind {
+	GPU_MEMORY_BUFFER,
+	GPU_MEMORY_TEXTURE,
+	GPU_MEMORY_RENDERBUFFER
+};
+
+// GL objects with their size, tracking the same object again replaces its entry, labels have to be string literals
+void gpu_memory_track(enum gpu_memory_kind kind, GLuint name, size_t bytes, GLenum format, const char *label);
+void gpu_memory_untrack(enum gpu_memory_kind kind, GLuint name);
+
+// bytes of a texture with every level of levels, layers counts array layers and cube faces
+size_t texture_storage_size(GLenum format, uint32_t width, uint32_t height, uint32_t levels, uint32_t layers);
+
+// resident set of the process from /proc, 0 where it isn't available
+size_t current_rss(void);
+size_t peak_rss(void);
+// restarts the peak so it covers what follows, false if the kernel doesn't allow it, only done on request
+bool reset_peak_rss(void);
+
+struct import_memory {
+	std::string name;
+	size_t document; /* bytes of the parsed glTF buffers and images */
+	size_t rssbefore;
+	size_t peakbefore; /* of the process before the import, the peak isn't reset for it */
+	size_t peakrss; /* the import's own peak if above peakbefore, else it stayed below that */
+	size_t rssafter;
+};
+
+void memory_record_import(const struct import_memory &import);
+
+struct memory_tag_stats {
+	size_t current;
+	size_t peak;
+};
+
+struct gpu_memory_group {
+	const char *label;
+	GLenum format;
+	size_t count;
+	size_t bytes;
+};
+
+struct memory_report {
+	struct memory_tag_stats cpu[MEMORY_TAG_COUNT];
+	std::vector<struct gpu_memory_group> gpu; /* by label and format, largest first */
+	size_t gputotal;
+	size_t rss;
+	size_t peakrss;
+	std::vector<struct import_memory> imports;
+};
+
+const char *memory_tag_name(enum memory_tag tag);
+const char *gl_format_name(GLenum format);
+
+// safe from any thread, without rss the /proc values are left 0
+struct memory_report memory_snapshot(bool rss = true);
+bool export_memory_report(const char *fpath);
+
+void memory_window(void);
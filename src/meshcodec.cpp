@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#ifdef DRACO_DECODER
+#include <draco/compression/decode.h>
+#include <draco/core/decoder_buffer.h>
+#endif
+
+#include "meshcodec.hpp"
+
+// the meshoptimizer codecs as EXT_meshopt_compression specifies them: vertex codec version 0, index codec versions 0 and 1
+#define VERTEX_HEADER 0xA0
+#define INDEX_HEADER 0xE0
+#define SEQUENCE_HEADER 0xD0
+
+#define VERTEX_BLOCK_BYTES 8192
+#define VERTEX_BLOCK_MAX 256
+#define BYTE_GROUP 16
+#define BYTE_GROUP_LIMIT 24 /* bytes one group reads at most, checked once per group */
+#define VERTEX_TAIL 32
+
+static inline uint8_t unzigzag8(uint8_t v)
+{
+	return uint8_t(-(v & 1)) ^ (v >> 1);
+}
+
+static inline uint32_t unzigzag32(uint32_t v)
+{
+	return (v >> 1) ^ (0u - (v & 1));
+}
+
+// 16 deltas stored with 0, 2, 4 or 8 bits each, all ones in 2 or 4 bits escapes to a literal byte after the packed bits
+static const unsigned char *decode_byte_group(const unsigned char *data, unsigned char *out, int bitslog2)
+{
+	switch (bitslog2) {
+	case 0:
+		memset(out, 0, BYTE_GROUP);
+		return data;
+	case 1:
+	case 2: {
+		const int bits = bitslog2 == 1 ? 2 : 4;
+		const unsigned int escape = (1u << bits) - 1;
+		const unsigned char *literal = data + BYTE_GROUP * bits / 8;
+		for (int i = 0; i < BYTE_GROUP; i++) {
+			const unsigned int shift = 8 - bits - (i * bits) % 8;
+			const unsigned int code = (data[i * bits / 8] >> shift) & escape;
+			out[i] = code == escape ? *literal++ : uint8_t(code);
+		}
+		return literal;
+	}
+	default:
+		memcpy(out, data, BYTE_GROUP);
+		return data + BYTE_GROUP;
+	}
+}
+
+static const unsigned char *decode_bytes(const unsigned char *data, const unsigned char *end, unsigned char *out, size_t count)
+{
+	// two bits of header per group, the groups rounded up to whole header bytes
+	const unsigned char *header = data;
+	const size_t headersize = (count / BYTE_GROUP + 3) / 4;
+	if (size_t(end - data) < headersize) { return nullptr; }
+	data += headersize;
+
+	for (size_t i = 0; i < count; i += BYTE_GROUP) {
+		if (size_t(end - data) < BYTE_GROUP_LIMIT) { return nullptr; }
+		const size_t group = i / BYTE_GROUP;
+		data = decode_byte_group(data, out + i, (header[group / 4] >> ((group % 4) * 2)) & 3);
+	}
+
+	return data;
+}
+
+// every byte of the vertex is a stream of deltas to the same byte of the previous vertex
+static const unsigned char *decode_vertex_block(const unsigned char *data, const unsigned char *end, unsigned char *out, size_t count, size_t stride, unsigned char last[VERTEX_BLOCK_MAX])
+{
+	unsigned char deltas[VERTEX_BLOCK_MAX];
+	const size_t aligned = (count + BYTE_GROUP - 1) & ~size_t(BYTE_GROUP - 1);
+	for (size_t k = 0; k < stride; k++) {
+		data = decode_bytes(data, end, deltas, aligned);
+		if (data == nullptr) { return nullptr; }
+		unsigned char previous = last[k];
+		for (size_t i = 0; i < count; i++) {
+			previous = uint8_t(unzigzag8(deltas[i]) + previous);
+			out[i * stride + k] = previous;
+		}
+		last[k] = previous;
+	}
+
+	return data;
+}
+
+static bool decode_vertices(const unsigned char *data, size_t size, size_t count, size_t stride, unsigned char *out)
+{
+	if (stride == 0 || stride > VERTEX_BLOCK_MAX || stride % 4) { return false; }
+	if (size < 1 + stride || (data[0] & 0xF0) != VERTEX_HEADER || (data[0] & 0x0F) != 0) { return false; }
+	const unsigned char *end = data + size;
+	data++;
+
+	// the first vertex is predicted from the last bytes of the stream
+	unsigned char last[VERTEX_BLOCK_MAX];
+	memcpy(last, end - stride, stride);
+
+	const size_t blocksize = std::min(size_t(VERTEX_BLOCK_MAX), (VERTEX_BLOCK_BYTES / stride) & ~size_t(BYTE_GROUP - 1));
+	for (size_t offset = 0; offset < count; offset += blocksize) {
+		data = decode_vertex_block(data, end, out + offset * stride, std::min(blocksize, count - offset), stride, last);
+		if (data == nullptr) { return false; }
+	}
+
+	return size_t(end - data) == std::max(stride, size_t(VERTEX_TAIL));
+}
+
+static inline uint32_t decode_vbyte(const unsigned char *&data)
+{
+	const unsigned char lead = *data++;
+	if (lead < 128) { return lead; }
+
+	uint32_t result = lead & 127;
+	uint32_t shift = 7;
+	for (int i = 0; i < 4; i++) {
+		const unsigned char group = *data++;
+		result |= uint32_t(group & 127) << shift;
+		shift += 7;
+		if (group < 128) { break; }
+	}
+
+	return result;
+}
+
+static inline void write_index(unsigned char *out, size_t i, size_t stride, uint32_t index)
+{
+	if (stride == 2) {
+		const uint16_t value = uint16_t(index);
+		memcpy(out + i * 2, &value, 2);
+	} else {
+		memcpy(out + i * 4, &index, 4);
+	}
+}
+
+struct index_fifos {
+	uint32_t edges[16][2];
+	uint32_t vertices[16];
+	size_t edgeoffset;
+	size_t vertexoffset;
+};
+
+static inline void push_edge(struct index_fifos *fifos, uint32_t a, uint32_t b)
+{
+	fifos->edges[fifos->edgeoffset][0] = a;
+	fifos->edges[fifos->edgeoffset][1] = b;
+	fifos->edgeoffset = (fifos->edgeoffset + 1) & 15;
+}
+
+static inline void push_vertex(struct index_fifos *fifos, uint32_t v, bool cond = true)
+{
+	fifos->vertices[fifos->vertexoffset] = v;
+	fifos->vertexoffset = (fifos->vertexoffset + cond) & 15;
+}
+
+// triangles coded against a fifo of recent edges and vertices, new vertices count up from next, the rest are deltas to last
+static bool decode_triangles(const unsigned char *data, size_t size, size_t count, size_t stride, unsigned char *out)
+{
+	if ((stride != 2 && stride != 4) || count % 3) { return false; }
+	// header, one code per triangle and the 16 byte table of auxiliary codes
+	if (size < 1 + count / 3 + 16 || (data[0] & 0xF0) != INDEX_HEADER || (data[0] & 0x0F) > 1) { return false; }
+
+	struct index_fifos fifos;
+	memset(&fifos, 0xFF, sizeof(fifos.edges) + sizeof(fifos.vertices));
+	fifos.edgeoffset = 0;
+	fifos.vertexoffset = 0;
+	uint32_t next = 0, last = 0;
+	/* version 1 codes one off deltas to last in 13 and 14 */
+	const int fecmax = (data[0] & 0x0F) >= 1 ? 13 : 15;
+
+	const unsigned char *code = data + 1;
+	const unsigned char *extra = code + count / 3;
+	const unsigned char *safeend = data + size - 16;
+	const unsigned char *table = safeend;
+	for (size_t i = 0; i < count; i += 3) {
+		// a triangle reads at most 16 bytes, the table behind the end makes that safe to do unchecked
+		if (extra > safeend) { return false; }
+
+		const unsigned char codetri = *code++;
+		uint32_t a, b, c;
+		if (codetri < 0xF0) {
+			const uint32_t *edge = fifos.edges[(fifos.edgeoffset - 1 - (codetri >> 4)) & 15];
+			a = edge[0];
+			b = edge[1];
+			const int fec = codetri & 15;
+			if (fec < fecmax) {
+				c = fec == 0 ? next : fifos.vertices[(fifos.vertexoffset - 1 - fec) & 15];
+				next += fec == 0;
+				push_vertex(&fifos, c, fec == 0);
+			} else {
+				last = c = fec != 15 ? last + (fec - (fec ^ 3)) : last + unzigzag32(decode_vbyte(extra));
+				push_vertex(&fifos, c);
+			}
+			push_edge(&fifos, c, b);
+			push_edge(&fifos, a, c);
+		} else if (codetri < 0xFE) {
+			const unsigned char codeaux = table[codetri & 15];
+			const int feb = codeaux >> 4;
+			const int fec = codeaux & 15;
+			a = next++;
+			b = feb == 0 ? next : fifos.vertices[(fifos.vertexoffset - feb) & 15];
+			next += feb == 0;
+			c = fec == 0 ? next : fifos.vertices[(fifos.vertexoffset - fec) & 15];
+			next += fec == 0;
+			push_vertex(&fifos, a);
+			push_vertex(&fifos, b, feb == 0);
+			push_vertex(&fifos, c, fec == 0);
+			push_edge(&fifos, b, a);
+			push_edge(&fifos, c, b);
+			push_edge(&fifos, a, c);
+		} else {
+			const unsigned char codeaux = *extra++;
+			const int fea = codetri == 0xFE ? 0 : 15;
+			const int feb = codeaux >> 4;
+			const int fec = codeaux & 15;
+			if (codeaux == 0) { next = 0; }
+			a = fea == 0 ? next++ : 0;
+			b = feb == 0 ? next++ : fifos.vertices[(fifos.vertexoffset - feb) & 15];
+			c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexoffset - fec) & 15];
+			if (fea == 15) { last = a = last + unzigzag32(decode_vbyte(extra)); }
+			if (feb == 15) { last = b = last + unzigzag32(decode_vbyte(extra)); }
+			if (fec == 15) { last = c = last + unzigzag32(decode_vbyte(extra)); }
+			push_vertex(&fifos, a);
+			push_vertex(&fifos, b, feb == 0 || feb == 15);
+			push_vertex(&fifos, c, fec == 0 || fec == 15);
+			push_edge(&fifos, b, a);
+			push_edge(&fifos, c, b);
+			push_edge(&fifos, a, c);
+		}
+		write_index(out, i, stride, a);
+		write_index(out, i + 1, stride, b);
+		write_index(out, i + 2, stride, c);
+	}
+
+	return extra == safeend;
+}
+
+// indices of any topology as deltas to one of two running baselines
+static bool decode_sequence(const unsigned char *data, size_t size, size_t count, size_t stride, unsigned char *out)
+{
+	if (stride != 2 && stride != 4) { return false; }
+	if (size < 1 + count + 4 || (data[0] & 0xF0) != SEQUENCE_HEADER || (data[0] & 0x0F) > 1) { return false; }
+
+	const unsigned char *safeend = data + size - 4;
+	data++;
+	uint32_t last[2] = { 0, 0 };
+	for (size_t i = 0; i < count; i++) {
+		// at most 5 bytes per index, the 4 byte tail covers the rest
+		if (data >= safeend) { return false; }
+		uint32_t v = decode_vbyte(data);
+		const uint32_t baseline = v & 1;
+		v >>= 1;
+		last[baseline] += unzigzag32(v);
+		write_index(out, i, stride, last[baseline]);
+	}
+
+	return data == safeend;
+}
+
+static inline int round_signed(float v)
+{
+	return int(v + (v >= 0.f ? 0.5f : -0.5f));
+}
+
+// x and y on the octahedron, z holds the length the components are scaled back to
+template <typename T>
+static void filter_octahedral(T *data, size_t count)
+{
+	const float scale = float((1 << (sizeof(T) * 8 - 1)) - 1);
+	for (size_t i = 0; i < count; i++) {
+		float x = float(data[i * 4 + 0]);
+		float y = float(data[i * 4 + 1]);
+		const float z = float(data[i * 4 + 2]) - fabsf(x) - fabsf(y);
+		// the lower half of the octahedron is folded over the diagonals
+		const float t = z >= 0.f ? 0.f : z;
+		x += x >= 0.f ? t : -t;
+		y += y >= 0.f ? t : -t;
+		const float s = scale / sqrtf(x * x + y * y + z * z);
+		data[i * 4 + 0] = T(round_signed(x * s));
+		data[i * 4 + 1] = T(round_signed(y * s));
+		data[i * 4 + 2] = T(round_signed(z * s));
+	}
+}
+
+// three components scaled by 1 / sqrt(2), the largest one is left out and its index is in the low bits of w
+static void filter_quaternion(int16_t *data, size_t count)
+{
+	const float scale = 1.f / sqrtf(2.f);
+	for (size_t i = 0; i < count; i++) {
+		int16_t *q = data + i * 4;
+		const float s = scale / float(q[3] | 3);
+		const float x = float(q[0]) * s;
+		const float y = float(q[1]) * s;
+		const float z = float(q[2]) * s;
+		const float ww = 1.f - x * x - y * y - z * z;
+		const float w = sqrtf(ww >= 0.f ? ww : 0.f);
+		const int largest = q[3] & 3;
+		q[(largest + 1) & 3] = int16_t(round_signed(x * 32767.f));
+		q[(largest + 2) & 3] = int16_t(round_signed(y * 32767.f));
+		q[(largest + 3) & 3] = int16_t(round_signed(z * 32767.f));
+		q[largest] = int16_t(round_signed(w * 32767.f));
+	}
+}
+
+// 24 bit mantissa and 8 bit exponent to a float
+static void filter_exponential(uint32_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const int32_t mantissa = int32_t(data[i] << 8) >> 8;
+		const int32_t exponent = int32_t(data[i]) >> 24;
+		const float value = ldexpf(float(mantissa), exponent);
+		memcpy(&data[i], &value, 4);
+	}
+}
+
+bool meshopt_decode(const unsigned char *data, size_t size, size_t count, size_t stride, enum meshopt_mode mode, enum meshopt_filter filter, unsigned char *out)
+{
+	bool decoded = false;
+	switch (mode) {
+	case MESHOPT_ATTRIBUTES: decoded = decode_vertices(data, size, count, stride, out); break;
+	case MESHOPT_TRIANGLES: decoded = decode_triangles(data, size, count, stride, out); break;
+	case MESHOPT_INDICES: decoded = decode_sequence(data, size, count, stride, out); break;
+	}
+	if (!decoded) { return false; }
+
+	// filters only apply to attributes and are decoded in place
+	switch (filter) {
+	case MESHOPT_FILTER_NONE: return true;
+	case MESHOPT_FILTER_OCTAHEDRAL:
+		if (mode != MESHOPT_ATTRIBUTES || (stride != 4 && stride != 8)) { return false; }
+		if (stride == 4) {
+			filter_octahedral(reinterpret_cast<int8_t*>(out), count);
+		} else {
+			filter_octahedral(reinterpret_cast<int16_t*>(out), count);
+		}
+		return true;
+	case MESHOPT_FILTER_QUATERNION:
+		if (mode != MESHOPT_ATTRIBUTES || stride != 8) { return false; }
+		filter_quaternion(reinterpret_cast<int16_t*>(out), count);
+		return true;
+	case MESHOPT_FILTER_EXPONENTIAL:
+		if (mode != MESHOPT_ATTRIBUTES) { return false; }
+		filter_exponential(reinterpret_cast<uint32_t*>(out), count * (stride / 4));
+		return true;
+	}
+
+	return false;
+}
+
+#ifdef DRACO_DECODER
+template <typename T>
+static bool convert_attribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute, int components, std::vector<unsigned char> &out)
+{
+	out.resize(size_t(mesh.num_points()) * components * sizeof(T));
+	T values[16] = {};
+	for (draco::PointIndex i(0); i < mesh.num_points(); ++i) {
+		if (!attribute.ConvertValue<T>(attribute.mapped_index(i), int8_t(components), values)) { return false; }
+		memcpy(out.data() + size_t(i.value()) * components * sizeof(T), values, components * sizeof(T));
+	}
+
+	return true;
+}
+
+static bool convert_attribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute, int componenttype, int components, std::vector<unsigned char> &out)
+{
+	if (components < 1 || components > 16) { return false; }
+
+	switch (componenttype) {
+	case GL_BYTE: return convert_attribute<int8_t>(mesh, attribute, components, out);
+	case GL_UNSIGNED_BYTE: return convert_attribute<uint8_t>(mesh, attribute, components, out);
+	case GL_SHORT: return convert_attribute<int16_t>(mesh, attribute, components, out);
+	case GL_UNSIGNED_SHORT: return convert_attribute<uint16_t>(mesh, attribute, components, out);
+	case GL_UNSIGNED_INT: return convert_attribute<uint32_t>(mesh, attribute, components, out);
+	case GL_FLOAT: return convert_attribute<float>(mesh, attribute, components, out);
+	}
+
+	return false;
+}
+#endif
+
+bool draco_decode(const unsigned char *data, size_t size, int indextype, std::vector<unsigned char> *indices, std::vector<struct draco_attribute> &attributes, uint32_t *vertices, std::string *err)
+{
+#ifdef DRACO_DECODER
+	draco::DecoderBuffer buffer;
+	buffer.Init(reinterpret_cast<const char*>(data), size);
+	draco::Decoder decoder;
+	auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+	if (!decoded.ok()) {
+		*err += "Draco: " + decoded.status().error_msg_string() + "\n";
+		return false;
+	}
+	const std::unique_ptr<draco::Mesh> &mesh = decoded.value();
+	*vertices = mesh->num_points();
+
+	if (indextype != 0) {
+		const size_t indexsize = indextype == GL_UNSIGNED_INT ? 4 : indextype == GL_UNSIGNED_SHORT ? 2 : 1;
+		indices->resize(size_t(mesh->num_faces()) * 3 * indexsize);
+		for (draco::FaceIndex f(0); f < mesh->num_faces(); ++f) {
+			const draco::Mesh::Face &face = mesh->face(f);
+			for (int corner = 0; corner < 3; corner++) {
+				const uint32_t index = face[corner].value();
+				unsigned char *out = indices->data() + (size_t(f.value()) * 3 + corner) * indexsize;
+				if (indexsize == 4) {
+					memcpy(out, &index, 4);
+				} else if (indexsize == 2) {
+					const uint16_t value = uint16_t(index);
+					memcpy(out, &value, 2);
+				} else {
+					*out = uint8_t(index);
+				}
+			}
+		}
+	}
+
+	for (struct draco_attribute &attribute : attributes) {
+		const draco::PointAttribute *source = mesh->GetAttributeByUniqueId(uint32_t(attribute.id));
+		if (source == nullptr || !convert_attribute(*mesh, *source, attribute.componenttype, attribute.components, attribute.data)) {
+			*err += "Draco: attribute " + std::to_string(attribute.id) + " can't be decoded\n";
+			return false;
+		}
+	}
+
+	return true;
+#else
+	(void)data; (void)size; (void)indextype; (void)indices; (void)attributes; (void)vertices;
+	*err += "KHR_draco_mesh_compression needs a build with the Draco decoder\n";
+	return false;
+#endif
+}
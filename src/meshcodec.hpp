@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// EXT_meshopt_compression, how a compressed buffer view is coded and filtered
+enum meshopt_mode {
+	MESHOPT_ATTRIBUTES,
+	MESHOPT_TRIANGLES,
+	MESHOPT_INDICES
+};
+
+enum meshopt_filter {
+	MESHOPT_FILTER_NONE,
+	MESHOPT_FILTER_OCTAHEDRAL,
+	MESHOPT_FILTER_QUATERNION,
+	MESHOPT_FILTER_EXPONENTIAL
+};
+
+// decodes count elements of stride bytes into out, false if the data is malformed or the stride doesn't suit the mode
+bool meshopt_decode(const unsigned char *data, size_t size, size_t count, size_t stride, enum meshopt_mode mode, enum meshopt_filter filter, unsigned char *out);
+
+// KHR_draco_mesh_compression, one accessor of the primitive filled from the Draco attribute with its id
+struct draco_attribute {
+	int id;
+	int componenttype;
+	int components;
+	std::vector<unsigned char> data; /* tightly packed, one element per decoded vertex */
+};
+
+// indextype is the component type of the index accessor, 0 for a primitive without indices
+// false with err set if the mesh is malformed or the build has no Draco decoder
+bool draco_decode(const unsigned char *data, size_t size, int indextype, std::vector<unsigned char> *indices, std::vector<struct draco_attribute> &attributes, uint32_t *vertices, std::string *err);
@@ -0,0 +1,175 @@
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "parallel.hpp"
+#include "mipmap.hpp"
+
+// destination rows handed to a thread at once
+#define ROWS_PER_TASK 16
+// resolution of the linear to sRGB table
+#define SRGB_ENCODE_STEPS 4096
+
+// separable [1 3 3 1] taps around each pair of source texels
+static const float TAP_WEIGHTS[4] = { 0.125f, 0.375f, 0.375f, 0.125f };
+
+struct srgb_tables {
+	float decode[256];
+	unsigned char encode[SRGB_ENCODE_STEPS + 1];
+
+	srgb_tables()
+	{
+		for (int i = 0; i < 256; i++) {
+			float c = float(i) / 255.f;
+			decode[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i <= SRGB_ENCODE_STEPS; i++) {
+			float c = float(i) / float(SRGB_ENCODE_STEPS);
+			float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+			encode[i] = (unsigned char)(std::min(255.f, s * 255.f + 0.5f));
+		}
+	}
+};
+
+static const struct srgb_tables &srgb(void)
+{
+	static const struct srgb_tables tables;
+	return tables;
+}
+
+uint32_t mip_count(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	while ((std::max(width, height) >> levels) > 0) { levels++; }
+
+	return levels;
+}
+
+// texel as four floats in the space it is filtered in
+static inline void load_texel(const unsigned char *texel, uint32_t nchannels, enum mip_filter filter, float out[4])
+{
+	for (uint32_t c = 0; c < 4; c++) {
+		if (c >= nchannels) {
+			out[c] = 0.f;
+		} else if (filter == MIP_SRGB && c < 3) {
+			out[c] = srgb().decode[texel[c]];
+		} else if (filter == MIP_NORMAL && c < 3) {
+			out[c] = float(texel[c]) * (2.f / 255.f) - 1.f;
+		} else {
+			out[c] = float(texel[c]) * (1.f / 255.f);
+		}
+	}
+}
+
+static inline void store_texel(float in[4], uint32_t nchannels, enum mip_filter filter, unsigned char *texel)
+{
+	if (filter == MIP_NORMAL) {
+		float len = std::sqrt(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+		if (len > 0.f) {
+			for (int c = 0; c < 3; c++) { in[c] /= len; }
+		}
+	}
+
+	for (uint32_t c = 0; c < nchannels; c++) {
+		float v = in[c];
+		if (filter == MIP_SRGB && c < 3) {
+			v = std::min(1.f, std::max(0.f, v));
+			texel[c] = srgb().encode[int(v * SRGB_ENCODE_STEPS + 0.5f)];
+		} else if (filter == MIP_NORMAL && c < 3) {
+			texel[c] = (unsigned char)(std::min(255.f, std::max(0.f, (v * 0.5f + 0.5f) * 255.f + 0.5f)));
+		} else {
+			texel[c] = (unsigned char)(std::min(255.f, std::max(0.f, v * 255.f + 0.5f)));
+		}
+	}
+}
+
+// weighted sum of four texel rows or columns, every texel is four floats
+static inline void accumulate(const float *taps[4], float out[4])
+{
+#ifdef __SSE2__
+	__m128 sum = _mm_mul_ps(_mm_loadu_ps(taps[0]), _mm_set1_ps(TAP_WEIGHTS[0]));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps[1]), _mm_set1_ps(TAP_WEIGHTS[1])));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps[2]), _mm_set1_ps(TAP_WEIGHTS[2])));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps[3]), _mm_set1_ps(TAP_WEIGHTS[3])));
+	_mm_storeu_ps(out, sum);
+#else
+	for (int c = 0; c < 4; c++) {
+		out[c] = taps[0][c] * TAP_WEIGHTS[0] + taps[1][c] * TAP_WEIGHTS[1] + taps[2][c] * TAP_WEIGHTS[2] + taps[3][c] * TAP_WEIGHTS[3];
+	}
+#endif
+}
+
+static void downsample_rows(const unsigned char *src, uint32_t width, uint32_t height, uint32_t nchannels, enum mip_filter filter, unsigned char *dst, uint32_t firstrow, uint32_t lastrow)
+{
+	const uint32_t dstwidth = std::max(1u, width / 2);
+
+	std::vector<float> rows[4];
+	std::vector<float> column(size_t(width) * 4);
+	for (auto &row : rows) { row.resize(size_t(width) * 4); }
+
+	for (uint32_t y = firstrow; y < lastrow; y++) {
+		// decode the four source rows under this destination row
+		for (int k = 0; k < 4; k++) {
+			int sy = std::min(std::max(int(2 * y) - 1 + k, 0), int(height) - 1);
+			const unsigned char *srcrow = src + size_t(sy) * width * nchannels;
+			for (uint32_t x = 0; x < width; x++) {
+				load_texel(srcrow + size_t(x) * nchannels, nchannels, filter, &rows[k][size_t(x) * 4]);
+			}
+		}
+
+		// vertical pass
+		for (uint32_t x = 0; x < width; x++) {
+			const float *taps[4] = { &rows[0][x * 4], &rows[1][x * 4], &rows[2][x * 4], &rows[3][x * 4] };
+			accumulate(taps, &column[size_t(x) * 4]);
+		}
+
+		// horizontal pass
+		unsigned char *dstrow = dst + size_t(y) * dstwidth * nchannels;
+		for (uint32_t x = 0; x < dstwidth; x++) {
+			const float *taps[4];
+			for (int k = 0; k < 4; k++) {
+				int sx = std::min(std::max(int(2 * x) - 1 + k, 0), int(width) - 1);
+				taps[k] = &column[size_t(sx) * 4];
+			}
+			float texel[4];
+			accumulate(taps, texel);
+			store_texel(texel, nchannels, filter, dstrow + size_t(x) * nchannels);
+		}
+	}
+}
+
+void downsample(const unsigned char *src, uint32_t width, uint32_t height, uint32_t nchannels, enum mip_filter filter, unsigned char *dst)
+{
+	const uint32_t dstheight = std::max(1u, height / 2);
+	const uint32_t tasks = (dstheight + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+
+	parallel_for(tasks, [&](size_t task) {
+		uint32_t first = uint32_t(task) * ROWS_PER_TASK;
+		uint32_t last = std::min(dstheight, first + ROWS_PER_TASK);
+		downsample_rows(src, width, height, nchannels, filter, dst, first, last);
+	});
+}
+
+std::vector<std::vector<unsigned char>> gen_mipchain(const unsigned char *image, uint32_t width, uint32_t height, uint32_t nchannels, enum mip_filter filter)
+{
+	std::vector<std::vector<unsigned char>> levels;
+	levels.emplace_back(image, image + size_t(width) * height * nchannels);
+
+	while (width > 1 || height > 1) {
+		const uint32_t dstwidth = std::max(1u, width / 2);
+		const uint32_t dstheight = std::max(1u, height / 2);
+		std::vector<unsigned char> next(size_t(dstwidth) * dstheight * nchannels);
+		downsample(levels.back().data(), width, height, nchannels, filter, next.data());
+		levels.push_back(std::move(next));
+		width = dstwidth;
+		height = dstheight;
+	}
+
+	return levels;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+// how texels are averaged when building a mip level
+enum mip_filter {
+	MIP_LINEAR, // data maps, channels are averaged as they are
+	MIP_SRGB, // color maps, RGB is averaged in linear space
+	MIP_NORMAL, // normal maps, XYZ is renormalized after averaging
+};
+
+// levels of a full chain down to 1x1
+uint32_t mip_count(uint32_t width, uint32_t height);
+
+// halves an image of 8 bit channels with a separable [1 3 3 1] filter, rows are split across threads
+void downsample(const unsigned char *src, uint32_t width, uint32_t height, uint32_t nchannels, enum mip_filter filter, unsigned char *dst);
+
+// full mip chain, the first level is a copy of the image
+std::vector<std::vector<unsigned char>> gen_mipchain(const unsigned char *image, uint32_t width, uint32_t height, uint32_t nchannels, enum mip_filter filter);
@@ -0,0 +1,1257 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "external/stb_image.h"
+#include "external/json.hpp"
+
+#include "texcache.hpp"
+#include "ktx.hpp"
+#include "parallel.hpp"
+#include "vcache.hpp"
+#include "gltf.h"
+#include "gltfreader.hpp"
+#include "accessor.hpp"
+#include "optimize.hpp"
+
+using json = nlohmann::json;
+
+#define MB(bytes) (double(bytes) / (1 << 20))
+#define OPTIMIZE_ALIGN 4 /* buffer views start on a component boundary */
+#define OPTIMIZE_FILE_FACTOR 3 /* parsed input, rebuilt model and written output per input byte */
+#define OPTIMIZE_IMAGE_FACTOR 3 /* decoded pixels, their mip chain and its blocks per RGBA8 byte */
+#define OPTIMIZE_ZSTD_LEVEL 12
+#define STEP_EPSILON 1e-3f /* seconds before a STEP key that the previous value is held */
+
+// bytes the files in flight may hold together, a file is let through on its own even if it needs more
+// decoded images are reserved on top of their file, one is always let through so a full budget can't deadlock
+struct memory_budget {
+	std::mutex lock;
+	std::condition_variable released;
+	size_t limit = 0;
+	size_t used = 0;
+	uint32_t images = 0;
+};
+
+static void reserve(struct memory_budget *budget, size_t bytes, bool image)
+{
+	std::unique_lock<std::mutex> guard(budget->lock);
+	budget->released.wait(guard, [&] {
+		return budget->used + bytes <= budget->limit || (image ? budget->images == 0 : budget->used == 0);
+	});
+	budget->used += bytes;
+	if (image) { budget->images++; }
+}
+
+static void release(struct memory_budget *budget, size_t bytes, bool image)
+{
+	{
+		std::lock_guard<std::mutex> guard(budget->lock);
+		budget->used -= bytes;
+		if (image) { budget->images--; }
+	}
+	budget->released.notify_all();
+}
+
+// size and estimated draw cost of a model as the importer sees it
+struct asset_stats {
+	size_t bytes = 0; /* the file with its external buffers and images */
+	size_t geometry = 0; /* vertex and index data */
+	size_t images = 0; /* encoded image data */
+	size_t animation = 0; /* keyframe data */
+	uint32_t draws = 0; /* primitive instances in the default scene, one draw call each */
+	uint64_t triangles = 0;
+	uint64_t vertices = 0; /* decoded by the importer, every instance of a mesh decodes it again */
+	uint64_t shaded = 0; /* vertex shader runs with a VCACHE_SIMULATED entry FIFO cache */
+	uint32_t meshes = 0;
+	uint32_t textures = 0;
+	double parse = 0.0; /* ms to read the file */
+};
+
+struct optimize_job {
+	std::filesystem::path input;
+	std::filesystem::path output;
+	size_t bytes; /* of the file and the resources it names */
+};
+
+struct file_result {
+	bool ok = false;
+	std::string error;
+	struct asset_stats before;
+	struct asset_stats after;
+	double ms = 0.0;
+};
+
+struct primitive_cost {
+	uint64_t triangles = 0;
+	uint64_t vertices = 0;
+	uint64_t shaded = 0;
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+static void read_indices(const struct accessor_view &view, std::vector<uint32_t> &out)
+{
+	out.resize(view.count);
+	for (size_t i = 0; i < view.count; i++) {
+		const unsigned char *p = view.data + i * view.stride;
+		if (view.componenttype == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+			memcpy(&out[i], p, sizeof(uint32_t));
+		} else if (view.componenttype == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+			uint16_t index;
+			memcpy(&index, p, sizeof(index));
+			out[i] = index;
+		} else {
+			out[i] = *p;
+		}
+	}
+}
+
+static struct primitive_cost measure_primitive(const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+	struct primitive_cost cost;
+	struct accessor_view positions, indices;
+	auto position = primitive.attributes.find("POSITION");
+	if (position == primitive.attributes.end() || !view_accessor(model, position->second, &positions)) { return cost; }
+
+	cost.vertices = positions.count;
+	size_t count = positions.count;
+	if (view_accessor(model, primitive.indices, &indices)) {
+		std::vector<uint32_t> list;
+		read_indices(indices, list);
+		count = list.size();
+		cost.shaded = simulate_vertex_cache(list.data(), count, uint32_t(positions.count), VCACHE_SIMULATED);
+	} else {
+		cost.shaded = positions.count;
+	}
+
+	if (primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+		cost.triangles = count / 3;
+	} else if (primitive.mode == TINYGLTF_MODE_TRIANGLE_STRIP || primitive.mode == TINYGLTF_MODE_TRIANGLE_FAN) {
+		cost.triangles = count > 2 ? count - 2 : 0;
+	}
+
+	return cost;
+}
+
+// every mesh instance is a draw per primitive, as the importer loads them
+static void measure_node(const tinygltf::Model &model, int index, const std::vector<std::vector<struct primitive_cost>> &costs, struct asset_stats *stats)
+{
+	const tinygltf::Node &node = model.nodes[index];
+	for (int child : node.children) { measure_node(model, child, costs, stats); }
+	if (node.mesh < 0) { return; }
+
+	for (const struct primitive_cost &cost : costs[node.mesh]) {
+		stats->draws++;
+		stats->triangles += cost.triangles;
+		stats->vertices += cost.vertices;
+		stats->shaded += cost.shaded;
+	}
+}
+
+static void measure_model(const tinygltf::Model &model, struct asset_stats *stats)
+{
+	std::vector<std::vector<struct primitive_cost>> costs(model.meshes.size());
+	for (size_t i = 0; i < model.meshes.size(); i++) {
+		for (const tinygltf::Primitive &primitive : model.meshes[i].primitives) { costs[i].push_back(measure_primitive(model, primitive)); }
+	}
+	if (!model.scenes.empty()) {
+		const tinygltf::Scene &scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
+		for (int root : scene.nodes) { measure_node(model, root, costs, stats); }
+	}
+
+	// buffer views counted once, by their first user
+	enum { USE_NONE, USE_GEOMETRY, USE_ANIMATION };
+	std::vector<int> uses(model.bufferViews.size(), USE_NONE);
+	auto use = [&](int accessor, int kind) {
+		if (accessor < 0) { return; }
+		const int view = model.accessors[accessor].bufferView;
+		if (view > -1 && uses[view] == USE_NONE) { uses[view] = kind; }
+	};
+	for (const tinygltf::Mesh &mesh : model.meshes) {
+		for (const tinygltf::Primitive &primitive : mesh.primitives) {
+			use(primitive.indices, USE_GEOMETRY);
+			for (const auto &attribute : primitive.attributes) { use(attribute.second, USE_GEOMETRY); }
+		}
+	}
+	for (const tinygltf::Animation &animation : model.animations) {
+		for (const tinygltf::AnimationSampler &sampler : animation.samplers) {
+			use(sampler.input, USE_ANIMATION);
+			use(sampler.output, USE_ANIMATION);
+		}
+	}
+	for (size_t i = 0; i < uses.size(); i++) {
+		if (uses[i] == USE_GEOMETRY) { stats->geometry += model.bufferViews[i].byteLength; }
+		if (uses[i] == USE_ANIMATION) { stats->animation += model.bufferViews[i].byteLength; }
+	}
+	for (const tinygltf::Image &image : model.images) { stats->images += image.image.size(); }
+
+	stats->meshes = uint32_t(model.meshes.size());
+	stats->textures = uint32_t(model.textures.size());
+}
+
+// the optimized model with its single buffer, accessors with the same contents are written once
+struct glb_builder {
+	tinygltf::Model model;
+	std::unordered_map<uint64_t, std::vector<int>> accessors; /* content hash to the accessors with that hash */
+	std::map<std::string, int> meshes; /* primitives of a mesh to the mesh */
+	std::map<std::vector<int>, int> samplers;
+	bool quantized = false; /* KHR_mesh_quantization attributes were written */
+	bool ktx2 = false; /* textures point at KTX2 images through KTX2_TEXTURE_EXTENSION */
+	bool fallbacks = true; /* every KTX2 texture has a regular source too */
+};
+
+struct accessor_desc {
+	int type;
+	int componenttype;
+	bool normalized;
+	size_t count;
+	size_t stride; /* element bytes including padding */
+	int target;
+};
+
+static int add_view(struct glb_builder &builder, const unsigned char *data, size_t size, size_t stride, int target)
+{
+	std::vector<unsigned char> &bin = builder.model.buffers[0].data;
+	const size_t offset = (bin.size() + OPTIMIZE_ALIGN - 1) / OPTIMIZE_ALIGN * OPTIMIZE_ALIGN;
+	bin.resize(offset + size, 0);
+	memcpy(bin.data() + offset, data, size);
+
+	tinygltf::BufferView view;
+	view.buffer = 0;
+	view.byteOffset = offset;
+	view.byteLength = size;
+	view.byteStride = stride;
+	view.target = target;
+	builder.model.bufferViews.push_back(view);
+
+	return int(builder.model.bufferViews.size()) - 1;
+}
+
+static int add_accessor(struct glb_builder &builder, const std::vector<unsigned char> &data, const struct accessor_desc &desc, const std::vector<double> &min = {}, const std::vector<double> &max = {})
+{
+	const size_t element = size_t(tinygltf::GetComponentSizeInBytes(uint32_t(desc.componenttype))) * tinygltf::GetNumComponentsInType(uint32_t(desc.type));
+	const size_t stride = desc.stride > element ? desc.stride : 0;
+	const uint64_t hash = hash_bytes(data.data(), data.size()) ^ (uint64_t(desc.type) << 48) ^ (uint64_t(desc.componenttype) << 32) ^ uint64_t(desc.target);
+
+	std::vector<int> &candidates = builder.accessors[hash];
+	for (int index : candidates) {
+		const tinygltf::Accessor &accessor = builder.model.accessors[index];
+		const tinygltf::BufferView &view = builder.model.bufferViews[accessor.bufferView];
+		if (accessor.type != desc.type || accessor.componentType != desc.componenttype || accessor.normalized != desc.normalized) { continue; }
+		if (accessor.count != desc.count || view.byteStride != stride || view.target != desc.target || view.byteLength != data.size()) { continue; }
+		if (memcmp(builder.model.buffers[0].data.data() + view.byteOffset, data.data(), data.size()) == 0) { return index; }
+	}
+
+	tinygltf::Accessor accessor;
+	accessor.bufferView = add_view(builder, data.data(), data.size(), stride, desc.target);
+	accessor.byteOffset = 0;
+	accessor.componentType = desc.componenttype;
+	accessor.normalized = desc.normalized;
+	accessor.count = desc.count;
+	accessor.type = desc.type;
+	accessor.minValues = min;
+	accessor.maxValues = max;
+	builder.model.accessors.push_back(accessor);
+	candidates.push_back(int(builder.model.accessors.size()) - 1);
+
+	return candidates.back();
+}
+
+// the elements of an accessor packed without stride, same type
+static int copy_accessor(struct glb_builder &builder, const tinygltf::Model &model, int index)
+{
+	struct accessor_view view;
+	if (!view_accessor(model, index, &view)) { return -1; }
+	const size_t size = size_t(view.componentsize) * view.components;
+	std::vector<unsigned char> data(view.count * size);
+	for (size_t i = 0; i < view.count; i++) { memcpy(data.data() + i * size, view.data + i * view.stride, size); }
+
+	const tinygltf::Accessor &accessor = model.accessors[index];
+	const struct accessor_desc desc = { accessor.type, accessor.componentType, accessor.normalized, view.count, size, 0 };
+
+	return add_accessor(builder, data, desc, accessor.minValues, accessor.maxValues);
+}
+
+static int accessor_type(int components)
+{
+	switch (components) {
+	case 1: return TINYGLTF_TYPE_SCALAR;
+	case 2: return TINYGLTF_TYPE_VEC2;
+	case 3: return TINYGLTF_TYPE_VEC3;
+	case 16: return TINYGLTF_TYPE_MAT4;
+	}
+
+	return TINYGLTF_TYPE_VEC4;
+}
+
+// components scaled and rounded to integers of componenttype, elements padded to stride bytes
+static std::vector<unsigned char> pack_integers(const std::vector<float> &values, int components, size_t count, int componenttype, size_t stride, float scale)
+{
+	std::vector<unsigned char> data(count * stride, 0);
+	const size_t size = size_t(tinygltf::GetComponentSizeInBytes(uint32_t(componenttype)));
+	float low = 0.f, high = 255.f;
+	if (componenttype == TINYGLTF_COMPONENT_TYPE_BYTE) { low = -127.f; high = 127.f; }
+	if (componenttype == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) { high = 65535.f; }
+
+	for (size_t i = 0; i < count; i++) {
+		for (int c = 0; c < components; c++) {
+			const float value = std::min(std::max(std::round(values[i * components + c] * scale), low), high);
+			unsigned char *p = data.data() + i * stride + c * size;
+			if (componenttype == TINYGLTF_COMPONENT_TYPE_BYTE) {
+				const int8_t q = int8_t(value);
+				memcpy(p, &q, size);
+			} else if (componenttype == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+				const uint16_t q = uint16_t(value);
+				memcpy(p, &q, size);
+			} else {
+				*p = uint8_t(value);
+			}
+		}
+	}
+
+	return data;
+}
+
+static std::vector<unsigned char> pack_floats(const std::vector<float> &values)
+{
+	std::vector<unsigned char> data(values.size() * sizeof(float));
+	memcpy(data.data(), values.data(), data.size());
+
+	return data;
+}
+
+// one vertex attribute of a primitive, unpacked to floats
+struct vertex_stream {
+	std::string name;
+	int components;
+	std::vector<float> values;
+};
+
+// a primitive in memory, or several of a mesh merged into one
+struct mesh_part {
+	int material;
+	int mode;
+	uint32_t vertexcount = 0;
+	std::vector<struct vertex_stream> streams; /* sorted by name */
+	std::vector<uint32_t> indices;
+	std::map<std::string, int> sources; /* accessors the vertices came from, empty once parts with others were merged in */
+};
+
+static bool read_part(const tinygltf::Model &model, const tinygltf::Primitive &primitive, struct mesh_part *part)
+{
+	part->material = primitive.material;
+	part->mode = primitive.mode;
+	part->sources = primitive.attributes;
+	for (const auto &attribute : primitive.attributes) {
+		struct accessor_view view;
+		if (!view_accessor(model, attribute.second, &view)) { return false; }
+		if (!part->streams.empty() && view.count != part->vertexcount) { return false; }
+		part->vertexcount = uint32_t(view.count);
+		part->streams.push_back(vertex_stream{ attribute.first, view.components, {} });
+		read_accessor(view, part->streams.back().values);
+	}
+
+	struct accessor_view view;
+	if (view_accessor(model, primitive.indices, &view)) {
+		read_indices(view, part->indices);
+	} else {
+		part->indices.resize(part->vertexcount);
+		for (uint32_t i = 0; i < part->vertexcount; i++) { part->indices[i] = i; }
+	}
+	for (uint32_t index : part->indices) {
+		if (index >= part->vertexcount) { return false; }
+	}
+
+	return !part->streams.empty();
+}
+
+// primitives of a mesh with the same material, list mode and attributes become one draw
+static bool mergeable(const struct mesh_part &a, const struct mesh_part &b)
+{
+	if (a.material != b.material || a.mode != b.mode || a.streams.size() != b.streams.size()) { return false; }
+	if (a.mode != TINYGLTF_MODE_POINTS && a.mode != TINYGLTF_MODE_LINE && a.mode != TINYGLTF_MODE_TRIANGLES) { return false; }
+	for (size_t i = 0; i < a.streams.size(); i++) {
+		if (a.streams[i].name != b.streams[i].name || a.streams[i].components != b.streams[i].components) { return false; }
+	}
+
+	return true;
+}
+
+static void merge_part(struct mesh_part &into, const struct mesh_part &from)
+{
+	// primitives indexing the same vertices only add their triangles
+	if (!into.sources.empty() && into.sources == from.sources) {
+		into.indices.insert(into.indices.end(), from.indices.begin(), from.indices.end());
+		return;
+	}
+
+	into.sources.clear();
+	for (size_t i = 0; i < into.streams.size(); i++) {
+		into.streams[i].values.insert(into.streams[i].values.end(), from.streams[i].values.begin(), from.streams[i].values.end());
+	}
+	for (uint32_t index : from.indices) { into.indices.push_back(index + into.vertexcount); }
+	into.vertexcount += from.vertexcount;
+}
+
+// triangles in vertex cache order, then vertices in the order they are first fetched, unused ones are dropped
+static void reorder_part(struct mesh_part &part)
+{
+	if (part.mode == TINYGLTF_MODE_TRIANGLES) { optimize_vertex_cache(part.indices.data(), part.indices.size(), part.vertexcount); }
+
+	std::vector<uint32_t> remap;
+	const uint32_t used = optimize_vertex_fetch(part.indices.data(), part.indices.size(), part.vertexcount, remap);
+	for (struct vertex_stream &stream : part.streams) {
+		std::vector<float> values(size_t(used) * stream.components);
+		for (uint32_t v = 0; v < part.vertexcount; v++) {
+			if (remap[v] == VCACHE_UNUSED) { continue; }
+			memcpy(&values[size_t(remap[v]) * stream.components], &stream.values[size_t(v) * stream.components], stream.components * sizeof(float));
+		}
+		stream.values.swap(values);
+	}
+	part.vertexcount = used;
+}
+
+static int write_indices(struct glb_builder &builder, const std::vector<uint32_t> &indices, uint32_t vertexcount)
+{
+	struct accessor_desc desc = { TINYGLTF_TYPE_SCALAR, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, false, indices.size(), 4, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER };
+	std::vector<unsigned char> data;
+	if (vertexcount <= 0xFFFF) {
+		desc.componenttype = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+		desc.stride = 2;
+		std::vector<uint16_t> narrow(indices.begin(), indices.end());
+		data.resize(narrow.size() * sizeof(uint16_t));
+		memcpy(data.data(), narrow.data(), data.size());
+	} else {
+		data.resize(indices.size() * sizeof(uint32_t));
+		memcpy(data.data(), indices.data(), data.size());
+	}
+
+	return add_accessor(builder, data, desc);
+}
+
+static bool within(const std::vector<float> &values, float low, float high)
+{
+	for (float value : values) {
+		if (!(value >= low && value <= high)) { return false; }
+	}
+
+	return true;
+}
+
+static bool prefixed(const std::string &name, const char *prefix)
+{
+	return name.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// normals and tangents to 8 bit, texture coordinates and colors to 16 bit, joints and weights to bytes
+static int write_stream(struct glb_builder &builder, const struct vertex_stream &stream, uint32_t count, bool quantize)
+{
+	const int components = stream.components;
+	struct accessor_desc desc = { accessor_type(components), TINYGLTF_COMPONENT_TYPE_FLOAT, false, count, size_t(components) * 4, TINYGLTF_TARGET_ARRAY_BUFFER };
+
+	if (prefixed(stream.name, "JOINTS_") && components == 4) {
+		/* joint indices are never floats */
+		const bool small = quantize && within(stream.values, 0.f, 255.f);
+		desc.componenttype = small ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE : TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+		desc.stride = small ? 4 : 8;
+		return add_accessor(builder, pack_integers(stream.values, components, count, desc.componenttype, desc.stride, 1.f), desc);
+	}
+
+	if (quantize) {
+		if (((stream.name == "NORMAL" && components == 3) || (stream.name == "TANGENT" && components == 4)) && within(stream.values, -1.f, 1.f)) {
+			desc.componenttype = TINYGLTF_COMPONENT_TYPE_BYTE;
+			desc.normalized = true;
+			desc.stride = 4;
+			builder.quantized = true;
+			return add_accessor(builder, pack_integers(stream.values, components, count, desc.componenttype, desc.stride, 127.f), desc);
+		}
+		if ((prefixed(stream.name, "TEXCOORD_") || prefixed(stream.name, "COLOR_")) && components >= 2 && within(stream.values, 0.f, 1.f)) {
+			desc.componenttype = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+			desc.normalized = true;
+			desc.stride = (components == 2) ? 4 : 8;
+			return add_accessor(builder, pack_integers(stream.values, components, count, desc.componenttype, desc.stride, 65535.f), desc);
+		}
+		if (prefixed(stream.name, "WEIGHTS_") && components == 4 && within(stream.values, 0.f, 1.f)) {
+			desc.componenttype = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+			desc.normalized = true;
+			desc.stride = 4;
+			std::vector<unsigned char> data = pack_integers(stream.values, components, count, desc.componenttype, desc.stride, 255.f);
+			/* rounding error goes to the largest weight so the weights still add up to one */
+			for (uint32_t v = 0; v < count; v++) {
+				unsigned char *weights = &data[size_t(v) * 4];
+				const int sum = weights[0] + weights[1] + weights[2] + weights[3];
+				if (sum == 0) { continue; }
+				unsigned char *largest = std::max_element(weights, weights + 4);
+				*largest = uint8_t(std::min(std::max(int(*largest) + 255 - sum, 0), 255));
+			}
+			return add_accessor(builder, data, desc);
+		}
+	}
+
+	std::vector<double> min, max;
+	if (stream.name == "POSITION") {
+		min.assign(components, std::numeric_limits<double>::max());
+		max.assign(components, -std::numeric_limits<double>::max());
+		for (uint32_t v = 0; v < count; v++) {
+			for (int c = 0; c < components; c++) {
+				min[c] = std::min(min[c], double(stream.values[size_t(v) * components + c]));
+				max[c] = std::max(max[c], double(stream.values[size_t(v) * components + c]));
+			}
+		}
+	}
+
+	return add_accessor(builder, pack_floats(stream.values), desc, min, max);
+}
+
+static std::string primitive_key(const tinygltf::Primitive &primitive)
+{
+	std::string key = std::to_string(primitive.material) + "/" + std::to_string(primitive.mode) + "/" + std::to_string(primitive.indices);
+	for (const auto &attribute : primitive.attributes) { key += "/" + attribute.first + "=" + std::to_string(attribute.second); }
+
+	return key + ";";
+}
+
+static int build_mesh(struct glb_builder &builder, const tinygltf::Model &model, const tinygltf::Mesh &mesh, bool quantize, std::string *err)
+{
+	std::vector<struct mesh_part> parts;
+	for (const tinygltf::Primitive &primitive : mesh.primitives) {
+		struct mesh_part part;
+		if (!read_part(model, primitive, &part)) {
+			*err = "mesh \"" + mesh.name + "\" has a primitive without readable vertices";
+			return -1;
+		}
+		auto same = std::find_if(parts.begin(), parts.end(), [&](const struct mesh_part &other) { return mergeable(other, part); });
+		if (same != parts.end()) {
+			merge_part(*same, part);
+		} else {
+			parts.push_back(std::move(part));
+		}
+	}
+
+	tinygltf::Mesh out;
+	out.name = mesh.name;
+	std::string key;
+	for (struct mesh_part &part : parts) {
+		reorder_part(part);
+		if (part.vertexcount == 0) { continue; }
+		tinygltf::Primitive primitive;
+		primitive.material = part.material;
+		primitive.mode = part.mode;
+		primitive.indices = write_indices(builder, part.indices, part.vertexcount);
+		for (const struct vertex_stream &stream : part.streams) {
+			primitive.attributes[stream.name] = write_stream(builder, stream, part.vertexcount, quantize);
+		}
+		key += primitive_key(primitive);
+		out.primitives.push_back(primitive);
+	}
+
+	// meshes that came out the same share their accessors, and now the mesh as well
+	auto found = builder.meshes.find(key);
+	if (found != builder.meshes.end()) { return found->second; }
+	builder.model.meshes.push_back(out);
+	builder.meshes[key] = int(builder.model.meshes.size()) - 1;
+
+	return builder.meshes[key];
+}
+
+// keyframes of one channel, values hold components floats per key
+struct keyframes {
+	std::vector<float> times;
+	std::vector<float> values;
+	int components;
+};
+
+static void normalize(float *q)
+{
+	const float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (length > 0.f) {
+		for (int c = 0; c < 4; c++) { q[c] /= length; }
+	}
+}
+
+// linear for vectors, shortest path slerp for rotations like the importer plays them
+static void interpolate(const float *a, const float *b, float u, int components, bool rotation, float *out)
+{
+	if (!rotation) {
+		for (int c = 0; c < components; c++) { out[c] = a[c] + (b[c] - a[c]) * u; }
+		return;
+	}
+
+	float to[4] = { b[0], b[1], b[2], b[3] };
+	float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+	if (cosine < 0.f) {
+		for (int c = 0; c < 4; c++) { to[c] = -to[c]; }
+		cosine = -cosine;
+	}
+	float wa = 1.f - u, wb = u;
+	if (cosine < 0.9995f) {
+		const float angle = std::acos(cosine);
+		wa = std::sin(wa * angle) / std::sin(angle);
+		wb = std::sin(wb * angle) / std::sin(angle);
+	}
+	for (int c = 0; c < 4; c++) { out[c] = wa * a[c] + wb * to[c]; }
+	normalize(out);
+}
+
+static float key_error(const float *a, const float *b, int components, bool rotation)
+{
+	if (rotation) {
+		const float cosine = std::abs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+		return 2.f * std::acos(std::min(cosine, 1.f));
+	}
+
+	float error = 0.f;
+	for (int c = 0; c < components; c++) { error = std::max(error, std::abs(a[c] - b[c])); }
+
+	return error;
+}
+
+// cubic spline outputs are in-tangent, value and out-tangent per key, the curve is sampled at a fixed rate
+static void bake_cubic(struct keyframes &keys, float fps, bool rotation)
+{
+	const size_t count = keys.times.size();
+	const int n = keys.components;
+	std::vector<float> times, values;
+	if (count < 2) {
+		if (count == 1) { values.assign(keys.values.begin() + n, keys.values.begin() + 2 * n); }
+		keys.values.swap(values);
+		return;
+	}
+
+	const float start = keys.times.front();
+	const float end = keys.times.back();
+	const size_t steps = size_t(std::ceil((end - start) * fps));
+	size_t k = 0;
+	for (size_t s = 0; s <= steps; s++) {
+		const float t = (s == steps) ? end : start + float(s) / fps;
+		while (k + 2 < count && keys.times[k + 1] < t) { k++; }
+		const float dt = keys.times[k + 1] - keys.times[k];
+		const float u = dt > 0.f ? std::min(std::max((t - keys.times[k]) / dt, 0.f), 1.f) : 0.f;
+		const float u2 = u * u, u3 = u2 * u;
+		const float *p0 = &keys.values[(k * 3 + 1) * n];
+		const float *m0 = &keys.values[(k * 3 + 2) * n];
+		const float *p1 = &keys.values[((k + 1) * 3 + 1) * n];
+		const float *m1 = &keys.values[((k + 1) * 3) * n];
+		float value[4];
+		for (int c = 0; c < n; c++) {
+			value[c] = (2.f * u3 - 3.f * u2 + 1.f) * p0[c] + (u3 - 2.f * u2 + u) * dt * m0[c] + (3.f * u2 - 2.f * u3) * p1[c] + (u3 - u2) * dt * m1[c];
+		}
+		if (rotation) { normalize(value); }
+		times.push_back(t);
+		values.insert(values.end(), value, value + n);
+	}
+
+	keys.times.swap(times);
+	keys.values.swap(values);
+}
+
+// the value before each STEP key is held until just before it, so linear playback jumps there
+static void bake_step(struct keyframes &keys)
+{
+	const int n = keys.components;
+	std::vector<float> times, values;
+	for (size_t i = 0; i < keys.times.size(); i++) {
+		const float gap = i > 0 ? keys.times[i] - keys.times[i - 1] : 0.f;
+		const float hold = std::min(STEP_EPSILON, 0.5f * gap);
+		if (hold > 0.f) {
+			times.push_back(keys.times[i] - hold);
+			values.insert(values.end(), keys.values.begin() + (i - 1) * n, keys.values.begin() + i * n);
+		}
+		times.push_back(keys.times[i]);
+		values.insert(values.end(), keys.values.begin() + i * n, keys.values.begin() + (i + 1) * n);
+	}
+
+	keys.times.swap(times);
+	keys.values.swap(values);
+}
+
+// drops every key that interpolating its kept neighbours reproduces within tolerance
+static void reduce_keys(struct keyframes &keys, bool rotation, float tolerance)
+{
+	const size_t count = keys.times.size();
+	const int n = keys.components;
+	if (count < 3) { return; }
+
+	std::vector<size_t> kept = { 0 };
+	size_t anchor = 0;
+	for (size_t i = 1; i + 1 < count; i++) {
+		const float *a = &keys.values[anchor * n];
+		const float *b = &keys.values[(i + 1) * n];
+		const float span = keys.times[i + 1] - keys.times[anchor];
+		bool removable = span > 0.f;
+		for (size_t j = anchor + 1; j <= i && removable; j++) {
+			float value[4];
+			interpolate(a, b, (keys.times[j] - keys.times[anchor]) / span, n, rotation, value);
+			removable = key_error(value, &keys.values[j * n], n, rotation) <= tolerance;
+		}
+		if (!removable) {
+			kept.push_back(i);
+			anchor = i;
+		}
+	}
+	kept.push_back(count - 1);
+
+	std::vector<float> times, values;
+	for (size_t k : kept) {
+		times.push_back(keys.times[k]);
+		values.insert(values.end(), keys.values.begin() + k * n, keys.values.begin() + (k + 1) * n);
+	}
+	keys.times.swap(times);
+	keys.values.swap(values);
+}
+
+// baked to linear keys, reduced and written as a new sampler, -1 if the sampler can't be read
+static int build_sampler(struct glb_builder &builder, const tinygltf::Model &model, const tinygltf::AnimationSampler &sampler, bool rotation, const struct optimize_options *options, tinygltf::Animation &out)
+{
+	struct accessor_view inputs, outputs;
+	if (!view_accessor(model, sampler.input, &inputs) || !view_accessor(model, sampler.output, &outputs)) { return -1; }
+	const size_t n = rotation ? 4 : 3;
+	const bool cubic = sampler.interpolation == "CUBICSPLINE";
+	if (inputs.components != 1 || size_t(outputs.components) != n || outputs.count != inputs.count * (cubic ? 3 : 1)) { return -1; }
+
+	struct keyframes keys;
+	keys.components = int(n);
+	read_accessor(inputs, keys.times);
+	read_accessor(outputs, keys.values);
+	for (size_t i = 1; i < keys.times.size(); i++) {
+		if (!(keys.times[i] > keys.times[i - 1])) { return -1; }
+	}
+
+	if (cubic) {
+		bake_cubic(keys, options->fps, rotation);
+	} else if (sampler.interpolation == "STEP") {
+		bake_step(keys);
+	}
+	reduce_keys(keys, rotation, options->tolerance);
+	if (keys.times.empty()) { return -1; }
+
+	const struct accessor_desc timedesc = { TINYGLTF_TYPE_SCALAR, TINYGLTF_COMPONENT_TYPE_FLOAT, false, keys.times.size(), 4, 0 };
+	tinygltf::AnimationSampler baked;
+	baked.interpolation = "LINEAR";
+	baked.input = add_accessor(builder, pack_floats(keys.times), timedesc, { keys.times.front() }, { keys.times.back() });
+	if (rotation && options->quantize) {
+		const struct accessor_desc desc = { TINYGLTF_TYPE_VEC4, TINYGLTF_COMPONENT_TYPE_SHORT, true, keys.times.size(), 8, 0 };
+		std::vector<unsigned char> data(keys.times.size() * 8);
+		for (size_t i = 0; i < keys.values.size(); i++) {
+			const int16_t q = int16_t(std::round(std::min(std::max(keys.values[i], -1.f), 1.f) * 32767.f));
+			memcpy(&data[i * 2], &q, sizeof(q));
+		}
+		baked.output = add_accessor(builder, data, desc);
+	} else {
+		const struct accessor_desc desc = { accessor_type(int(n)), TINYGLTF_COMPONENT_TYPE_FLOAT, false, keys.times.size(), n * 4, 0 };
+		baked.output = add_accessor(builder, pack_floats(keys.values), desc);
+	}
+	out.samplers.push_back(baked);
+
+	return int(out.samplers.size()) - 1;
+}
+
+static void build_animations(struct glb_builder &builder, const tinygltf::Model &model, const struct optimize_options *options)
+{
+	for (const tinygltf::Animation &animation : model.animations) {
+		tinygltf::Animation out;
+		out.name = animation.name;
+		// a sampler shared by channels of the same path is baked once
+		std::map<std::pair<int, bool>, int> baked;
+		for (const tinygltf::AnimationChannel &channel : animation.channels) {
+			const bool rotation = channel.target_path == "rotation";
+			if (!rotation && channel.target_path != "translation" && channel.target_path != "scale") { continue; }
+			if (channel.sampler < 0 || size_t(channel.sampler) >= animation.samplers.size() || channel.target_node < 0) { continue; }
+
+			auto key = std::make_pair(channel.sampler, rotation);
+			auto found = baked.find(key);
+			if (found == baked.end()) {
+				found = baked.emplace(key, build_sampler(builder, model, animation.samplers[channel.sampler], rotation, options, out)).first;
+			}
+			if (found->second < 0) { continue; }
+
+			tinygltf::AnimationChannel copy;
+			copy.sampler = found->second;
+			copy.target_node = channel.target_node;
+			copy.target_path = channel.target_path;
+			out.channels.push_back(copy);
+		}
+		if (!out.channels.empty()) { builder.model.animations.push_back(out); }
+	}
+}
+
+static std::string image_mime(const tinygltf::Image &image)
+{
+	const std::vector<unsigned char> &bytes = image.image;
+	if (is_KTX2(bytes.data(), bytes.size())) { return "image/ktx2"; }
+	if (bytes.size() >= 4 && memcmp(bytes.data(), "\x89PNG", 4) == 0) { return "image/png"; }
+	if (bytes.size() >= 2 && bytes[0] == 0xFF && bytes[1] == 0xD8) { return "image/jpeg"; }
+
+	return image.mimeType;
+}
+
+static int store_image(struct glb_builder &builder, const std::vector<unsigned char> &bytes, const std::string &mime)
+{
+	tinygltf::Image image;
+	image.bufferView = add_view(builder, bytes.data(), bytes.size(), 0, 0);
+	image.mimeType = mime;
+	builder.model.images.push_back(image);
+
+	return int(builder.model.images.size()) - 1;
+}
+
+// the full mip chain block compressed in the format the importer would pick, -1 if the image can't be decoded
+static int compress_image(struct glb_builder &builder, const tinygltf::Image &image, enum bcn_format format, struct memory_budget *budget)
+{
+	const size_t bytes = OPTIMIZE_IMAGE_FACTOR * size_t(std::max(image.width, 1)) * size_t(std::max(image.height, 1)) * 4;
+	reserve(budget, bytes, true);
+
+	int index = -1;
+	int width, height, nchannels;
+	unsigned char *pixels = stbi_load_from_memory(image.image.data(), int(image.image.size()), &width, &height, &nchannels, 4);
+	if (pixels) {
+		uint32_t levels = 0;
+		std::vector<unsigned char> blocks = compress_chain(pixels, width, height, format, &levels);
+		stbi_image_free(pixels);
+		std::vector<unsigned char> ktx;
+		if (pack_KTX2(format, width, height, levels, blocks.data(), OPTIMIZE_ZSTD_LEVEL, ktx)) { index = store_image(builder, ktx, "image/ktx2"); }
+	}
+
+	release(budget, bytes, true);
+
+	return index;
+}
+
+static int add_sampler(struct glb_builder &builder, const tinygltf::Model &model, int index)
+{
+	if (index < 0 || size_t(index) >= model.samplers.size()) { return -1; }
+	const tinygltf::Sampler &sampler = model.samplers[index];
+	const std::vector<int> key = { sampler.minFilter, sampler.magFilter, sampler.wrapS, sampler.wrapT };
+	auto found = builder.samplers.find(key);
+	if (found != builder.samplers.end()) { return found->second; }
+
+	tinygltf::Sampler out;
+	out.minFilter = sampler.minFilter;
+	out.magFilter = sampler.magFilter;
+	out.wrapS = sampler.wrapS;
+	out.wrapT = sampler.wrapT;
+	builder.model.samplers.push_back(out);
+
+	return builder.samplers[key] = int(builder.model.samplers.size()) - 1;
+}
+
+// images are stored once per content and format, textures once per image and sampler
+// block compressed images go next to their original, the original stays the texture's source
+static void build_textures(struct glb_builder &builder, const tinygltf::Model &model, const struct optimize_options *options, struct memory_budget *budget, std::vector<int> &texturemap)
+{
+	std::vector<enum bcn_format> formats;
+	gltf::texture_formats(model, formats);
+
+	std::map<std::pair<uint64_t, int>, int> images; /* content hash and block format, -1 for images kept as they are */
+	auto add_image = [&](int source, int format) -> int {
+		if (source < 0 || size_t(source) >= model.images.size() || model.images[source].image.empty()) { return -1; }
+		const tinygltf::Image &image = model.images[source];
+		const auto key = std::make_pair(hash_bytes(image.image.data(), image.image.size()), format);
+		auto found = images.find(key);
+		if (found != images.end()) { return found->second; }
+		const int index = (format < 0) ? store_image(builder, image.image, image_mime(image)) : compress_image(builder, image, bcn_format(format), budget);
+		images[key] = index;
+		return index;
+	};
+
+	std::map<std::vector<int>, int> textures;
+	for (size_t i = 0; i < model.textures.size(); i++) {
+		const tinygltf::Texture &texture = model.textures[i];
+		const int source = gltf::texture_source(texture);
+		const bool packed = source > -1 && size_t(source) < model.images.size() && is_KTX2(model.images[source].image.data(), model.images[source].image.size());
+		int ktx2 = -1, plain = -1;
+		if (packed) {
+			ktx2 = add_image(source, -1);
+			if (texture.source != source) { plain = add_image(texture.source, -1); }
+		} else if (options->textures) {
+			/* the private extension is only read by this viewer, other loaders keep sampling the original */
+			ktx2 = add_image(source, int(formats[i]));
+			plain = add_image(source, -1);
+		} else {
+			plain = add_image(source, -1);
+		}
+
+		const int sampler = add_sampler(builder, model, texture.sampler);
+		const std::vector<int> key = { ktx2, plain, sampler };
+		auto found = textures.find(key);
+		if (found != textures.end()) {
+			texturemap.push_back(found->second);
+			continue;
+		}
+
+		tinygltf::Texture out;
+		out.name = texture.name;
+		out.sampler = sampler;
+		out.source = plain;
+		if (ktx2 > -1) {
+			out.extensions[KTX2_TEXTURE_EXTENSION] = tinygltf::Value(tinygltf::Value::Object{ { "source", tinygltf::Value(ktx2) } });
+			builder.ktx2 = true;
+			builder.fallbacks &= plain > -1;
+		}
+		builder.model.textures.push_back(out);
+		textures[key] = int(builder.model.textures.size()) - 1;
+		texturemap.push_back(textures[key]);
+	}
+}
+
+// texCoord, scale and strength of a texture reference are only kept in the parameters
+static double texture_parameter(const tinygltf::ParameterMap &values, const char *name, const char *field, double fallback)
+{
+	auto found = values.find(name);
+	if (found == values.end()) { return fallback; }
+	auto value = found->second.json_double_value.find(field);
+
+	return (value != found->second.json_double_value.end()) ? value->second : fallback;
+}
+
+static tinygltf::Material copy_material(const tinygltf::Material &material, const std::vector<int> &texturemap)
+{
+	auto texture = [&](int index) { return (index > -1 && size_t(index) < texturemap.size()) ? texturemap[index] : -1; };
+
+	tinygltf::Material out;
+	out.name = material.name;
+	out.alphaMode = material.alphaMode;
+	out.alphaCutoff = material.alphaCutoff;
+	out.doubleSided = material.doubleSided;
+	out.emissiveFactor = (material.emissiveFactor.size() == 3) ? material.emissiveFactor : std::vector<double>{ 0.0, 0.0, 0.0 };
+
+	const tinygltf::PbrMetallicRoughness &pbr = material.pbrMetallicRoughness;
+	if (pbr.baseColorFactor.size() == 4) { out.pbrMetallicRoughness.baseColorFactor = pbr.baseColorFactor; }
+	out.pbrMetallicRoughness.metallicFactor = pbr.metallicFactor;
+	out.pbrMetallicRoughness.roughnessFactor = pbr.roughnessFactor;
+	out.pbrMetallicRoughness.baseColorTexture.index = texture(pbr.baseColorTexture.index);
+	out.pbrMetallicRoughness.baseColorTexture.texCoord = int(texture_parameter(material.values, "baseColorTexture", "texCoord", 0.0));
+	out.pbrMetallicRoughness.metallicRoughnessTexture.index = texture(pbr.metallicRoughnessTexture.index);
+	out.pbrMetallicRoughness.metallicRoughnessTexture.texCoord = int(texture_parameter(material.values, "metallicRoughnessTexture", "texCoord", 0.0));
+	out.normalTexture.index = texture(material.normalTexture.index);
+	out.normalTexture.texCoord = int(texture_parameter(material.additionalValues, "normalTexture", "texCoord", 0.0));
+	out.normalTexture.scale = texture_parameter(material.additionalValues, "normalTexture", "scale", 1.0);
+	out.occlusionTexture.index = texture(material.occlusionTexture.index);
+	out.occlusionTexture.texCoord = int(texture_parameter(material.additionalValues, "occlusionTexture", "texCoord", 0.0));
+	out.occlusionTexture.strength = texture_parameter(material.additionalValues, "occlusionTexture", "strength", 1.0);
+	out.emissiveTexture.index = texture(material.emissiveTexture.index);
+	out.emissiveTexture.texCoord = int(texture_parameter(material.additionalValues, "emissiveTexture", "texCoord", 0.0));
+
+	return out;
+}
+
+static bool build_model(struct glb_builder &builder, const tinygltf::Model &model, const struct optimize_options *options, struct memory_budget *budget, std::string *err)
+{
+	tinygltf::Model &out = builder.model;
+	out.asset.version = "2.0";
+	out.asset.generator = "gltfviewer --optimize";
+	out.buffers.emplace_back();
+
+	std::vector<int> texturemap;
+	build_textures(builder, model, options, budget, texturemap);
+	for (const tinygltf::Material &material : model.materials) { out.materials.push_back(copy_material(material, texturemap)); }
+
+	// only meshes that nodes use are written, the same primitives are read once
+	std::vector<int> meshmap(model.meshes.size(), -1);
+	std::map<std::string, int> sources;
+	for (const tinygltf::Node &node : model.nodes) {
+		if (node.mesh < 0 || meshmap[node.mesh] > -1) { continue; }
+		const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+		std::string key;
+		for (const tinygltf::Primitive &primitive : mesh.primitives) { key += primitive_key(primitive); }
+		auto found = sources.find(key);
+		if (found != sources.end()) {
+			meshmap[node.mesh] = found->second;
+			continue;
+		}
+		meshmap[node.mesh] = build_mesh(builder, model, mesh, options->quantize, err);
+		if (meshmap[node.mesh] < 0) { return false; }
+		sources[key] = meshmap[node.mesh];
+	}
+
+	// the importer has no cameras or morph targets, they are left out
+	for (const tinygltf::Node &node : model.nodes) {
+		out.nodes.push_back(node);
+		out.nodes.back().mesh = (node.mesh > -1) ? meshmap[node.mesh] : -1;
+		out.nodes.back().camera = -1;
+		out.nodes.back().weights.clear();
+	}
+	for (const tinygltf::Skin &skin : model.skins) {
+		out.skins.push_back(skin);
+		out.skins.back().inverseBindMatrices = copy_accessor(builder, model, skin.inverseBindMatrices);
+	}
+	build_animations(builder, model, options);
+	out.scenes = model.scenes;
+	out.defaultScene = model.defaultScene;
+	out.lights = model.lights;
+
+	if (builder.quantized) {
+		out.extensionsUsed.push_back("KHR_mesh_quantization");
+		out.extensionsRequired.push_back("KHR_mesh_quantization");
+	}
+	/* BCn payloads aren't allowed under KHR_texture_basisu, validators and Basis transcoders would reject them */
+	if (builder.ktx2) {
+		out.extensionsUsed.push_back(KTX2_TEXTURE_EXTENSION);
+		if (!builder.fallbacks) { out.extensionsRequired.push_back(KTX2_TEXTURE_EXTENSION); }
+	}
+	if (!out.lights.empty()) {
+		out.extensionsUsed.push_back("KHR_lights_punctual");
+		/* the writer only adds its lights to existing root extensions, which it then replaces */
+		out.extensions["KHR_lights_punctual"] = tinygltf::Value(tinygltf::Value::Object());
+	}
+
+	return true;
+}
+
+// buffers and images are the bulk of a model, the rest is freed with it
+static void free_model(tinygltf::Model &model)
+{
+	std::vector<tinygltf::Buffer>().swap(model.buffers);
+	std::vector<tinygltf::Image>().swap(model.images);
+}
+
+static bool convert_file(const struct optimize_job &job, const struct optimize_options *options, struct memory_budget *budget, struct file_result *result)
+{
+	tinygltf::Model input;
+	std::string err, warn;
+	auto start = std::chrono::steady_clock::now();
+	if (!read_gltf_file(job.input.string(), &input, &err, &warn, gltf::keep_encoded_image, nullptr)) {
+		result->error = err;
+		return false;
+	}
+	result->before.parse = elapsed_ms(start);
+	result->before.bytes = job.bytes;
+	measure_model(input, &result->before);
+
+	struct glb_builder builder;
+	if (!build_model(builder, input, options, budget, &result->error)) { return false; }
+	free_model(input);
+
+	// written next to the output first so a failed write never leaves a truncated file behind
+	std::error_code error;
+	std::filesystem::create_directories(job.output.parent_path(), error);
+	const std::string tmppath = job.output.string() + ".tmp";
+	{
+		std::ofstream file(tmppath, std::ios::binary);
+		tinygltf::TinyGLTF writer;
+		if (!file || !writer.WriteGltfSceneToStream(&builder.model, file, false, true) || !file.flush()) {
+			result->error = "can't write " + tmppath;
+			std::filesystem::remove(tmppath, error);
+			return false;
+		}
+	}
+	free_model(builder.model);
+	std::filesystem::rename(tmppath, job.output, error);
+	if (error) {
+		result->error = "can't write " + job.output.string() + ": " + error.message();
+		return false;
+	}
+
+	// the importer has to take the file as it was written
+	tinygltf::Model check;
+	start = std::chrono::steady_clock::now();
+	if (!read_gltf_file(job.output.string(), &check, &err, &warn, gltf::keep_encoded_image, nullptr)) {
+		result->error = "the optimized file can't be read: " + err;
+		return false;
+	}
+	result->after.parse = elapsed_ms(start);
+	result->after.bytes = std::filesystem::file_size(job.output, error);
+	measure_model(check, &result->after);
+
+	gltf::Model model;
+	if (!model.load(check, false)) {
+		result->error = "the importer rejected the optimized file";
+		return false;
+	}
+
+	return true;
+}
+
+// bytes of a glTF file and the external buffers and images it names, data URIs are part of the file
+static size_t input_bytes(const std::filesystem::path &path)
+{
+	std::error_code error;
+	size_t bytes = std::filesystem::file_size(path, error);
+	if (error) { return 0; }
+	if (path.extension() != ".gltf" && path.extension() != ".GLTF") { return bytes; }
+
+	std::ifstream file(path, std::ios::binary);
+	const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	for (size_t at = text.find("\"uri\""); at != std::string::npos; at = text.find("\"uri\"", at + 5)) {
+		const size_t open = text.find('"', at + 5);
+		const size_t close = (open != std::string::npos) ? text.find('"', open + 1) : std::string::npos;
+		if (close == std::string::npos) { break; }
+		if (text.compare(open + 1, 5, "data:") == 0) { continue; }
+		const size_t size = std::filesystem::file_size(path.parent_path() / text.substr(open + 1, close - open - 1), error);
+		if (!error) { bytes += size; }
+	}
+
+	return bytes;
+}
+
+static bool is_gltf(const std::filesystem::path &path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	return extension == ".gltf" || extension == ".glb";
+}
+
+// files keep their place below the directory they were found in, outputs already in the output directory are skipped
+static void gather_jobs(const std::vector<std::string> &paths, const std::string &outdir, std::vector<struct optimize_job> &jobs)
+{
+	std::error_code error;
+	const std::filesystem::path outroot = std::filesystem::weakly_canonical(outdir, error);
+	// inputs that map to the same output (a.gltf and a.glb, or the same name below two directories) are numbered
+	std::map<std::string, std::string> outputs;
+	auto add = [&](const std::filesystem::path &input, std::filesystem::path relative) {
+		relative.replace_extension(".glb");
+		const std::filesystem::path wanted = (std::filesystem::path(outdir) / relative).lexically_normal();
+		std::filesystem::path output = wanted;
+		for (int n = 1; outputs.count(output.string()); n++) {
+			output = (wanted.parent_path() / wanted.stem()).string() + "-" + std::to_string(n) + ".glb";
+		}
+		if (output != wanted) {
+			std::cerr << "warning: " << input.string() << " and " << outputs[wanted.string()] << " both map to " << wanted.string() << ", writing " << output.string() << std::endl;
+		}
+		outputs[output.string()] = input.string();
+		jobs.push_back({ input, output, input_bytes(input) });
+	};
+
+	for (const std::string &path : paths) {
+		if (!std::filesystem::is_directory(path, error)) {
+			add(path, std::filesystem::path(path).filename());
+			continue;
+		}
+		for (const auto &entry : std::filesystem::recursive_directory_iterator(path, error)) {
+			if (!entry.is_regular_file() || !is_gltf(entry.path())) { continue; }
+			const std::filesystem::path canonical = std::filesystem::weakly_canonical(entry.path(), error);
+			auto inside = std::mismatch(outroot.begin(), outroot.end(), canonical.begin(), canonical.end());
+			if (!outroot.empty() && inside.first == outroot.end()) { continue; }
+			add(entry.path(), std::filesystem::relative(entry.path(), path, error));
+		}
+	}
+}
+
+static json stats_json(const struct asset_stats &stats)
+{
+	return {
+		{ "bytes", stats.bytes },
+		{ "geometry_bytes", stats.geometry },
+		{ "image_bytes", stats.images },
+		{ "animation_bytes", stats.animation },
+		{ "draws", stats.draws },
+		{ "triangles", stats.triangles },
+		{ "vertices", stats.vertices },
+		{ "shaded_vertices", stats.shaded },
+		{ "meshes", stats.meshes },
+		{ "textures", stats.textures },
+		{ "parse_ms", stats.parse }
+	};
+}
+
+static bool write_report(const std::string &fpath, const std::vector<struct optimize_job> &jobs, const std::vector<struct file_result> &results)
+{
+	json files = json::array();
+	for (size_t i = 0; i < jobs.size(); i++) {
+		json entry = {
+			{ "input", jobs[i].input.string() },
+			{ "output", jobs[i].output.string() },
+			{ "ok", results[i].ok },
+			{ "ms", results[i].ms }
+		};
+		if (results[i].ok) {
+			entry["before"] = stats_json(results[i].before);
+			entry["after"] = stats_json(results[i].after);
+		} else {
+			entry["error"] = results[i].error;
+		}
+		files.push_back(entry);
+	}
+	const json root = {
+		{ "vertex_cache", VCACHE_SIMULATED },
+		{ "files", files }
+	};
+
+	std::ofstream file(fpath);
+	if (!file) {
+		std::cerr << "error: can't write optimize report " << fpath << std::endl;
+		return false;
+	}
+	file << root.dump(1, '\t') << std::endl;
+
+	return bool(file);
+}
+
+static double shaded_per_triangle(const struct asset_stats &stats)
+{
+	return double(stats.shaded) / double(std::max<uint64_t>(stats.triangles, 1));
+}
+
+int run_optimize(const struct optimize_options *options, const std::vector<std::string> &paths)
+{
+	std::vector<struct optimize_job> jobs;
+	gather_jobs(paths, options->outdir, jobs);
+	if (jobs.empty()) {
+		std::cerr << "error: no glTF files to optimize" << std::endl;
+		return 1;
+	}
+	// the largest files start first so the small ones fill the budget around them
+	std::stable_sort(jobs.begin(), jobs.end(), [](const struct optimize_job &a, const struct optimize_job &b) { return a.bytes > b.bytes; });
+
+	struct memory_budget budget;
+	budget.limit = options->budget;
+	std::vector<struct file_result> results(jobs.size());
+	std::mutex printing;
+	auto start = std::chrono::steady_clock::now();
+
+	parallel_for(jobs.size(), [&](size_t i) {
+		struct file_result &result = results[i];
+		const auto filestart = std::chrono::steady_clock::now();
+		const size_t reserved = OPTIMIZE_FILE_FACTOR * std::max<size_t>(jobs[i].bytes, 1);
+		reserve(&budget, reserved, false);
+		result.ok = convert_file(jobs[i], options, &budget, &result);
+		release(&budget, reserved, false);
+		result.ms = elapsed_ms(filestart);
+
+		std::lock_guard<std::mutex> guard(printing);
+		while (!result.error.empty() && result.error.back() == '\n') { result.error.pop_back(); }
+		if (!result.ok) {
+			std::cerr << "error: " << jobs[i].input.string() << ": " << result.error << std::endl;
+			return;
+		}
+		printf("%s: %.2f -> %.2f MB, %u -> %u draws, %.2f -> %.2f shaded vertices per triangle, parse %.1f -> %.1f ms\n",
+			jobs[i].output.string().c_str(), MB(result.before.bytes), MB(result.after.bytes), result.before.draws, result.after.draws,
+			shaded_per_triangle(result.before), shaded_per_triangle(result.after), result.before.parse, result.after.parse);
+	});
+
+	int failed = 0;
+	size_t before = 0, after = 0;
+	for (const struct file_result &result : results) {
+		if (!result.ok) {
+			failed++;
+			continue;
+		}
+		before += result.before.bytes;
+		after += result.after.bytes;
+	}
+	printf("%zu of %zu files optimized in %.2f s, %.2f -> %.2f MB\n", jobs.size() - failed, jobs.size(), elapsed_ms(start) * 1e-3, MB(before), MB(after));
+
+	if (!options->report.empty() && !write_report(options->report, jobs, results)) { failed++; }
+
+	return failed;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct optimize_options {
+	std::string outdir = "optimized";
+	std::string report; /* JSON report of every file, none if empty */
+	size_t budget = size_t(2048) << 20; /* bytes the files being converted may hold together */
+	float fps = 30.f; /* rate cubic spline and step animations are baked at */
+	float tolerance = 1e-4f; /* error a removed keyframe may cause, in model units and radians */
+	bool textures = true; /* add a block compressed KTX2 copy of every image for the importer */
+	bool quantize = true; /* KHR_mesh_quantization attributes and normalized rotations */
+};
+
+// writes an engine ready GLB for every glTF or GLB file, directories are searched for them
+// files are converted on all cores and a report of their size and draw cost before and after is printed
+// returns the number of files that failed
+int run_optimize(const struct optimize_options *options, const std::vector<std::string> &paths);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// true on the threads of a parallel_for, nested calls run on them instead of starting more threads
+inline thread_local bool parallel_worker = false;
+
+// runs fn(i) for every i below count, indices are handed out to the hardware threads one at a time
+template <typename F>
+void parallel_for(size_t count, F fn)
+{
+	size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+	nthreads = std::min(nthreads, count);
+
+	if (nthreads <= 1 || parallel_worker) {
+		for (size_t i = 0; i < count; i++) { fn(i); }
+		return;
+	}
+
+	std::atomic<size_t> next{0};
+	auto worker = [&]() {
+		parallel_worker = true;
+		for (size_t i = next++; i < count; i = next++) { fn(i); }
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < nthreads; i++) { workers.emplace_back(worker); }
+	for (auto &thread : workers) { thread.join(); }
+}
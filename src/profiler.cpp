@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "external/imgui.h"
+
+#include "profiler.hpp"
+
+// single producer ring, readers copy the published part and drop what was overwritten meanwhile
+struct profile_ring {
+	std::string name;
+	std::atomic<uint64_t> head{0};
+	std::atomic<bool> owned{true};
+	uint32_t depth = 0;
+	struct profile_event events[PROFILE_RING];
+};
+
+// gives the ring back when its thread exits, short lived workers reuse rings instead of adding new ones
+struct ring_owner {
+	struct profile_ring *ring = nullptr;
+	~ring_owner() { if (ring) { ring->owned = false; } }
+};
+
+struct gpu_frame {
+	GLuint queries[2 * PROFILE_GPU_SCOPES];
+	const char *names[PROFILE_GPU_SCOPES];
+	uint32_t depths[PROFILE_GPU_SCOPES];
+	uint32_t count;
+	int64_t offset; /* CPU minus GPU clock when the frame started */
+};
+
+std::atomic<bool> profiling{true};
+
+static const auto epoch = std::chrono::steady_clock::now();
+
+static struct {
+	std::mutex lock; /* only taken when a thread gets its ring */
+	std::vector<struct profile_ring*> rings;
+} registry;
+
+static thread_local struct ring_owner owner;
+
+static struct {
+	struct profile_ring *ring = nullptr;
+	struct gpu_frame frames[PROFILE_GPU_FRAMES];
+	uint32_t current = 0;
+	uint32_t depth = 0;
+	bool initialized = false;
+} gpu;
+
+int64_t profile_now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static struct profile_ring *claim_ring(const char *name)
+{
+	std::lock_guard<std::mutex> guard(registry.lock);
+	for (struct profile_ring *ring : registry.rings) {
+		bool expected = false;
+		if (ring->name == name && ring->owned.compare_exchange_strong(expected, true)) { return ring; }
+	}
+	struct profile_ring *ring = new profile_ring;
+	ring->name = name;
+	registry.rings.push_back(ring);
+
+	return ring;
+}
+
+static struct profile_ring *thread_ring(void)
+{
+	if (owner.ring == nullptr) { owner.ring = claim_ring("worker"); }
+
+	return owner.ring;
+}
+
+void profile_thread(const char *name)
+{
+	if (owner.ring) { owner.ring->owned = false; }
+	owner.ring = claim_ring(name);
+}
+
+static void push_event(struct profile_ring *ring, const struct profile_event &event)
+{
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	ring->events[head % PROFILE_RING] = event;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+profile_scope::profile_scope(const char *scopename) : name(scopename), start(0), active(profiling)
+{
+	if (!active) { return; }
+	thread_ring()->depth++;
+	start = profile_now();
+}
+
+profile_scope::~profile_scope()
+{
+	if (!active) { return; }
+	struct profile_ring *ring = thread_ring();
+	ring->depth--;
+	push_event(ring, { name, start, profile_now(), ring->depth });
+}
+
+gpu_scope::gpu_scope(const char *scopename) : slot(-1)
+{
+	if (!profiling || !gpu.initialized) { return; }
+	struct gpu_frame &frame = gpu.frames[gpu.current];
+	if (frame.count >= PROFILE_GPU_SCOPES) { return; }
+
+	slot = int32_t(frame.count++);
+	frame.names[slot] = scopename;
+	frame.depths[slot] = gpu.depth++;
+	glQueryCounter(frame.queries[2 * slot], GL_TIMESTAMP);
+}
+
+gpu_scope::~gpu_scope()
+{
+	if (slot < 0) { return; }
+	glQueryCounter(gpu.frames[gpu.current].queries[2 * slot + 1], GL_TIMESTAMP);
+	gpu.depth--;
+}
+
+void gpu_profile_frame(void)
+{
+	if (!gpu.initialized) {
+		for (struct gpu_frame &frame : gpu.frames) {
+			glGenQueries(2 * PROFILE_GPU_SCOPES, frame.queries);
+			frame.count = 0;
+		}
+		gpu.ring = claim_ring("GPU");
+		gpu.initialized = true;
+	}
+
+	gpu.current = (gpu.current + 1) % PROFILE_GPU_FRAMES;
+	struct gpu_frame &frame = gpu.frames[gpu.current];
+
+	// this frame slot was issued PROFILE_GPU_FRAMES ago, the results are there by now
+	for (uint32_t i = 0; i < frame.count; i++) {
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+		push_event(gpu.ring, { frame.names[i], int64_t(start) + frame.offset, int64_t(end) + frame.offset, frame.depths[i] });
+	}
+	frame.count = 0;
+
+	GLint64 now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &now);
+	frame.offset = profile_now() - now;
+}
+
+void gpu_profile_shutdown(void)
+{
+	if (!gpu.initialized) { return; }
+	for (struct gpu_frame &frame : gpu.frames) { glDeleteQueries(2 * PROFILE_GPU_SCOPES, frame.queries); }
+	gpu.ring->owned = false;
+	gpu.initialized = false;
+}
+
+static void copy_ring(struct profile_ring *ring, int64_t since, std::vector<struct profile_event> &events)
+{
+	const uint64_t head = ring->head.load(std::memory_order_acquire);
+	const uint64_t first = head > PROFILE_RING ? head - PROFILE_RING : 0;
+	std::vector<struct profile_event> copied;
+	copied.reserve(head - first);
+	for (uint64_t i = first; i < head; i++) { copied.push_back(ring->events[i % PROFILE_RING]); }
+
+	// anything the writer lapped while copying is garbage, including the slot of event after it may be writing now
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t after = ring->head.load(std::memory_order_relaxed);
+	const uint64_t valid = after + 1 > PROFILE_RING ? after + 1 - PROFILE_RING : 0;
+	for (uint64_t i = std::max(first, valid); i < head; i++) {
+		const struct profile_event &event = copied[i - first];
+		if (event.end >= since) { events.push_back(event); }
+	}
+}
+
+std::vector<struct profile_track> profile_snapshot(int64_t since)
+{
+	std::vector<struct profile_ring*> rings;
+	{
+		std::lock_guard<std::mutex> guard(registry.lock);
+		rings = registry.rings;
+	}
+
+	std::vector<struct profile_track> tracks;
+	for (struct profile_ring *ring : rings) {
+		struct profile_track track;
+		track.name = ring->name;
+		copy_ring(ring, since, track.events);
+		// events are pushed when they end, parents come after their children
+		std::sort(track.events.begin(), track.events.end(), [](const struct profile_event &a, const struct profile_event &b) {
+			return a.start < b.start;
+		});
+		tracks.push_back(std::move(track));
+	}
+
+	return tracks;
+}
+
+static void write_escaped(FILE *fp, const char *text)
+{
+	for (const char *c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') { fputc('\\', fp); }
+		fputc(*c, fp);
+	}
+}
+
+bool export_chrome_trace(const char *fpath)
+{
+	FILE *fp = fopen(fpath, "w");
+	if (fp == nullptr) {
+		fprintf(stderr, "error: can't write trace '%s'\n", fpath);
+		return false;
+	}
+
+	const std::vector<struct profile_track> tracks = profile_snapshot(0);
+	fprintf(fp, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t tid = 0; tid < tracks.size(); tid++) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"", first ? "" : ",\n", tid);
+		write_escaped(fp, tracks[tid].name.c_str());
+		fprintf(fp, "\"}}");
+		first = false;
+		for (const struct profile_event &event : tracks[tid].events) {
+			fprintf(fp, ",\n{\"name\":\"");
+			write_escaped(fp, event.name);
+			fprintf(fp, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}", tid, double(event.start) * 1e-3, double(event.end - event.start) * 1e-3);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	return fclose(fp) == 0;
+}
+
+static ImU32 scope_color(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	for (const char *c = name; *c; c++) { hash = (hash ^ uint8_t(*c)) * 16777619u; }
+
+	return IM_COL32(96 + (hash & 0x7f), 96 + ((hash >> 8) & 0x7f), 96 + ((hash >> 16) & 0x7f), 255);
+}
+
+void profiler_window(void)
+{
+	static float windowms = 50.f;
+	static bool paused = false;
+	static int64_t pausedat = 0;
+	static char tracepath[256] = "trace.json";
+
+	ImGui::Begin("Profiler");
+	bool enabled = profiling;
+	if (ImGui::Checkbox("record", &enabled)) { profiling = enabled; }
+	ImGui::SameLine();
+	if (ImGui::Checkbox("pause view", &paused)) { pausedat = profile_now(); }
+	ImGui::SliderFloat("window (ms)", &windowms, 5.f, 500.f);
+	ImGui::InputText("trace file", tracepath, sizeof(tracepath));
+	ImGui::SameLine();
+	if (ImGui::Button("Export")) { export_chrome_trace(tracepath); }
+
+	// the GPU track lags a few frames, the view ends a little in the past so every track is complete
+	const int64_t end = (paused ? pausedat : profile_now()) - 4 * 16666667ll;
+	const int64_t start = end - int64_t(windowms * 1e6f);
+	const std::vector<struct profile_track> tracks = profile_snapshot(start);
+
+	ImDrawList *draw = ImGui::GetWindowDrawList();
+	const float width = std::max(ImGui::GetContentRegionAvail().x, 1.f);
+	const float rowheight = ImGui::GetTextLineHeight() + 2.f;
+	const float pixelsperns = width / float(end - start);
+	for (const struct profile_track &track : tracks) {
+		if (track.events.empty()) { continue; }
+		uint32_t depth = 0;
+		for (const struct profile_event &event : track.events) { depth = std::max(depth, event.depth); }
+
+		ImGui::Text("%s", track.name.c_str());
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::Dummy(ImVec2(width, rowheight * float(depth + 1)));
+		for (const struct profile_event &event : track.events) {
+			if (event.start > end) { continue; }
+			const float x0 = origin.x + std::max(float(event.start - start) * pixelsperns, 0.f);
+			const float x1 = origin.x + std::min(float(event.end - start) * pixelsperns, width);
+			const float y0 = origin.y + rowheight * float(event.depth);
+			if (x1 - x0 < 1.f) { continue; }
+			draw->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y0 + rowheight - 1.f), scope_color(event.name));
+			if (x1 - x0 > 30.f) {
+				draw->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowheight), true);
+				draw->AddText(ImVec2(x0 + 2.f, y0), IM_COL32(0, 0, 0, 255), event.name);
+				draw->PopClipRect();
+			}
+			if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowheight))) {
+				ImGui::SetTooltip("%s: %.3f ms", event.name, double(event.end - event.start) * 1e-6);
+			}
+		}
+	}
+
+	ImGui::End();
+}
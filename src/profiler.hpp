@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// events each thread keeps, older ones are overwritten
+#define PROFILE_RING 16384
+// GPU scopes are read back this many frames late so the queries never stall
+#define PROFILE_GPU_FRAMES 4
+#define PROFILE_GPU_SCOPES 32
+
+// names have to be string literals or otherwise outlive the profiler
+struct profile_event {
+	const char *name;
+	int64_t start; /* ns since the profiler started */
+	int64_t end;
+	uint32_t depth;
+};
+
+// events of one thread, or of the GPU, oldest first
+struct profile_track {
+	std::string name;
+	std::vector<struct profile_event> events;
+};
+
+extern std::atomic<bool> profiling;
+
+int64_t profile_now(void);
+// names the track of the calling thread
+void profile_thread(const char *name);
+
+// nestable CPU scope, one ring push when it ends
+struct profile_scope {
+	const char *name;
+	int64_t start;
+	bool active;
+	profile_scope(const char *scopename);
+	~profile_scope();
+};
+
+// GL thread only, timestamps around the commands of a pass
+struct gpu_scope {
+	int32_t slot;
+	gpu_scope(const char *scopename);
+	~gpu_scope();
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) struct profile_scope PROFILE_CONCAT(profilescope, __LINE__)(name)
+#define PROFILE_GPU(name) struct gpu_scope PROFILE_CONCAT(gpuscope, __LINE__)(name)
+
+// GL thread, once per frame before any GPU scope, collects the queries of PROFILE_GPU_FRAMES frames ago
+void gpu_profile_frame(void);
+void gpu_profile_shutdown(void);
+
+// copies of the events that ended after since, safe from any thread while the rings are written
+std::vector<struct profile_track> profile_snapshot(int64_t since);
+
+// every event still in the rings as Chrome trace JSON (chrome://tracing, Perfetto)
+bool export_chrome_trace(const char *fpath);
+
+// rolling flame view of the last milliseconds of every track
+void profiler_window(void);
@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "texcache.hpp"
+#include "progcache.hpp"
+
+static const char PROGCACHE_MAGIC[4] = { 'G', 'L', 'P', 'B' };
+
+static struct {
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+	std::atomic<size_t> rejected{0};
+	std::atomic<size_t> stores{0};
+} counters;
+
+static std::string cache_path(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+	return std::string(PROGCACHE_DIR) + name;
+}
+
+// drivers without a binary format can't cache anything
+static bool binaries_supported(void)
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+	return formats > 0;
+}
+
+uint64_t program_key(const GLenum *types, const char **sources, size_t count)
+{
+	/* a driver update invalidates every binary */
+	std::string key;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const GLubyte *value = glGetString(name);
+		key += value ? reinterpret_cast<const char*>(value) : "";
+		key += '\n';
+	}
+	for (size_t i = 0; i < count; i++) {
+		key += std::to_string(types[i]);
+		key += '\n';
+		key += sources[i];
+		key += '\0';
+	}
+
+	return hash_bytes(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+}
+
+GLuint load_program_binary(uint64_t key)
+{
+	if (!binaries_supported()) {
+		counters.misses++;
+		return 0;
+	}
+
+	FILE *fp = fopen(cache_path(key).c_str(), "rb");
+	if (fp == nullptr) {
+		counters.misses++;
+		return 0;
+	}
+
+	char magic[4];
+	uint32_t format = 0;
+	uint32_t length = 0;
+	bool valid = fread(magic, 1, 4, fp) == 4 && memcmp(magic, PROGCACHE_MAGIC, 4) == 0;
+	valid = valid && fread(&format, sizeof(format), 1, fp) == 1;
+	valid = valid && fread(&length, sizeof(length), 1, fp) == 1;
+	std::vector<unsigned char> binary(valid ? length : 0);
+	valid = valid && fread(binary.data(), 1, binary.size(), fp) == binary.size();
+	fclose(fp);
+
+	if (!valid) {
+		counters.rejected++;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), GLsizei(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		/* the driver changed in a way the key missed, compile and overwrite it */
+		glDeleteProgram(program);
+		counters.rejected++;
+		return 0;
+	}
+
+	counters.hits++;
+
+	return program;
+}
+
+void store_program_binary(uint64_t key, GLuint program)
+{
+	if (!binaries_supported()) { return; }
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) { return; }
+
+	std::vector<unsigned char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(PROGCACHE_DIR, error);
+	const std::string path = cache_path(key);
+	const std::string tmppath = path + ".tmp";
+
+	FILE *fp = fopen(tmppath.c_str(), "wb");
+	if (fp == nullptr) { return; }
+	const uint32_t header[2] = { uint32_t(format), uint32_t(length) };
+	bool written = fwrite(PROGCACHE_MAGIC, 1, 4, fp) == 4;
+	written = written && fwrite(header, sizeof(header), 1, fp) == 1;
+	written = written && fwrite(binary.data(), 1, size_t(length), fp) == size_t(length);
+	fclose(fp);
+
+	if (written) {
+		std::filesystem::rename(tmppath, path, error);
+		counters.stores++;
+	} else {
+		std::filesystem::remove(tmppath, error);
+	}
+}
+
+struct program_cache_stats program_cache_statistics(void)
+{
+	struct program_cache_stats stats;
+	stats.hits = counters.hits;
+	stats.misses = counters.misses;
+	stats.rejected = counters.rejected;
+	stats.stores = counters.stores;
+
+	return stats;
+}
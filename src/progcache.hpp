@@ -0,0 +1,21 @@
+#pragma once
+
+// linked program binaries are kept here, keyed by their sources and the driver that built them
+#define PROGCACHE_DIR "cache/programs/"
+
+struct program_cache_stats {
+	size_t hits;
+	size_t misses;
+	size_t rejected; /* binaries the driver refused, the program was compiled instead */
+	size_t stores;
+};
+
+// key of a program from its shader stages and sources, includes GL vendor, renderer and version
+uint64_t program_key(const GLenum *types, const char **sources, size_t count);
+
+// linked program from the cache or 0, never reports errors since compiling is the fallback
+GLuint load_program_binary(uint64_t key);
+// program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+void store_program_binary(uint64_t key, GLuint program);
+
+struct program_cache_stats program_cache_statistics(void);
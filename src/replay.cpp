@@ -0,0 +1,322 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "external/json.hpp"
+
+#include "shader.hpp"
+#include "gltf.h"
+#include "frame.hpp"
+#include "replay.hpp"
+
+using json = nlohmann::json;
+
+#define CAPTURE_VERSION 1
+
+static json vec3_json(const glm::vec3 &v)
+{
+	return json::array({ v.x, v.y, v.z });
+}
+
+static glm::vec3 json_vec3(const json &j)
+{
+	return glm::vec3(j.at(0).get<float>(), j.at(1).get<float>(), j.at(2).get<float>());
+}
+
+bool save_capture(const std::string &fpath, const struct capture *capture)
+{
+	json samples = json::array();
+	for (const struct capture_sample &sample : capture->samples) {
+		samples.push_back({
+			{ "time", sample.time },
+			{ "eye", vec3_json(sample.eye) },
+			{ "target", vec3_json(sample.target) },
+			{ "up", vec3_json(sample.up) },
+			{ "animation", sample.animation },
+			{ "timeline", sample.timeline },
+			{ "scale", sample.scale }
+		});
+	}
+	const json root = {
+		{ "version", CAPTURE_VERSION },
+		{ "files", capture->files },
+		{ "fovy", capture->fovy },
+		{ "near", capture->near },
+		{ "far", capture->far },
+		{ "samples", samples }
+	};
+
+	std::ofstream file(fpath);
+	if (!file) {
+		std::cerr << "error: can't write capture " << fpath << std::endl;
+		return false;
+	}
+	file << root.dump(1, '\t') << std::endl;
+
+	return bool(file);
+}
+
+bool load_capture(const std::string &fpath, struct capture *capture)
+{
+	std::ifstream file(fpath);
+	if (!file) {
+		std::cerr << "error: can't read capture " << fpath << std::endl;
+		return false;
+	}
+
+	try {
+		json root;
+		file >> root;
+		if (root.at("version").get<int>() != CAPTURE_VERSION) {
+			std::cerr << "error: capture " << fpath << " has an unknown version" << std::endl;
+			return false;
+		}
+		capture->files = root.at("files").get<std::vector<std::string>>();
+		capture->fovy = root.at("fovy").get<float>();
+		capture->near = root.at("near").get<float>();
+		capture->far = root.at("far").get<float>();
+		capture->samples.clear();
+		for (const json &entry : root.at("samples")) {
+			struct capture_sample sample;
+			sample.time = entry.at("time").get<float>();
+			sample.eye = json_vec3(entry.at("eye"));
+			sample.target = json_vec3(entry.at("target"));
+			sample.up = json_vec3(entry.at("up"));
+			sample.animation = entry.at("animation").get<int>();
+			sample.timeline = entry.at("timeline").get<float>();
+			sample.scale = entry.at("scale").get<float>();
+			capture->samples.push_back(sample);
+		}
+	} catch (const std::exception &err) {
+		std::cerr << "error: malformed capture " << fpath << ": " << err.what() << std::endl;
+		return false;
+	}
+
+	if (capture->samples.empty()) {
+		std::cerr << "error: capture " << fpath << " has no frames" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+struct capture_sample sample_capture(const struct capture *capture, float time)
+{
+	const std::vector<struct capture_sample> &samples = capture->samples;
+	auto later = std::upper_bound(samples.begin(), samples.end(), time, [](float t, const struct capture_sample &sample) {
+		return t < sample.time;
+	});
+	if (later == samples.begin()) { return samples.front(); }
+
+	const struct capture_sample &before = *(later - 1);
+	struct capture_sample sample = before;
+	sample.time = time;
+	if (later == samples.end()) { return sample; }
+	// the recorded timeline wraps at the end of the animation, running on from the earlier sample keeps it continuous
+	sample.timeline = before.timeline + (time - before.time);
+
+	const float span = later->time - before.time;
+	const float t = span > 0.f ? (time - before.time) / span : 0.f;
+	sample.eye = glm::mix(before.eye, later->eye, t);
+	sample.target = glm::mix(before.target, later->target, t);
+	sample.up = glm::normalize(glm::mix(before.up, later->up, t));
+
+	return sample;
+}
+
+uint32_t replay_frames(const struct capture *capture, float step)
+{
+	if (capture->samples.empty() || step <= 0.f) { return 0; }
+
+	return uint32_t(capture->samples.back().time / step) + 1;
+}
+
+void count_draws(const struct frame_packet &packet, struct frame_metrics *metrics)
+{
+	metrics->draws = uint32_t(packet.draws.size());
+	metrics->triangles = 0;
+	for (const struct draw_t &draw : packet.draws) { metrics->triangles += uint64_t(draw.count) / 3; }
+}
+
+struct replay_timer gen_replay_timer(void)
+{
+	struct replay_timer timer;
+	glGenQueries(2 * REPLAY_QUERIES, timer.queries);
+	std::fill(timer.frames, timer.frames + REPLAY_QUERIES, -1);
+	timer.next = 0;
+
+	return timer;
+}
+
+void delete_replay_timer(struct replay_timer *timer)
+{
+	glDeleteQueries(2 * REPLAY_QUERIES, timer->queries);
+}
+
+static void read_query(struct replay_timer *timer, uint32_t slot, std::vector<struct frame_metrics> &metrics)
+{
+	if (timer->frames[slot] < 0) { return; }
+
+	GLuint64 start = 0, end = 0;
+	glGetQueryObjectui64v(timer->queries[2 * slot], GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(timer->queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+	if (size_t(timer->frames[slot]) < metrics.size()) { metrics[timer->frames[slot]].gpums = float(double(end - start) * 1e-6); }
+	timer->frames[slot] = -1;
+}
+
+void begin_replay_timer(struct replay_timer *timer, uint32_t frame, std::vector<struct frame_metrics> &metrics)
+{
+	read_query(timer, timer->next, metrics);
+	timer->frames[timer->next] = int32_t(frame);
+	glQueryCounter(timer->queries[2 * timer->next], GL_TIMESTAMP);
+}
+
+void end_replay_timer(struct replay_timer *timer)
+{
+	glQueryCounter(timer->queries[2 * timer->next + 1], GL_TIMESTAMP);
+	timer->next = (timer->next + 1) % REPLAY_QUERIES;
+}
+
+void finish_replay_timer(struct replay_timer *timer, std::vector<struct frame_metrics> &metrics)
+{
+	for (uint32_t i = 0; i < REPLAY_QUERIES; i++) { read_query(timer, (timer->next + i) % REPLAY_QUERIES, metrics); }
+}
+
+struct metric_summary {
+	double mean;
+	double p95;
+	double max;
+};
+
+static struct metric_summary summarize(std::vector<double> values)
+{
+	struct metric_summary summary = {};
+	if (values.empty()) { return summary; }
+
+	std::sort(values.begin(), values.end());
+	for (double value : values) { summary.mean += value; }
+	summary.mean /= double(values.size());
+	summary.p95 = values[std::min(values.size() - 1, size_t(0.95 * double(values.size())))];
+	summary.max = values.back();
+
+	return summary;
+}
+
+// the order the results are written and compared in, counts have to match since the replay is deterministic
+static const struct {
+	const char *name;
+	bool counted;
+} METRICS[] = {
+	{ "cpu_ms", false },
+	{ "gl_ms", false },
+	{ "gpu_ms", false },
+	{ "draws", true },
+	{ "triangles", true }
+};
+
+static std::vector<double> metric_values(const std::vector<struct frame_metrics> &metrics, size_t index)
+{
+	std::vector<double> values;
+	for (const struct frame_metrics &frame : metrics) {
+		const double all[] = { frame.cpums, frame.glms, frame.gpums, double(frame.draws), double(frame.triangles) };
+		values.push_back(all[index]);
+	}
+
+	return values;
+}
+
+static json summary_json(const std::vector<struct frame_metrics> &metrics)
+{
+	json summary = json::object();
+	for (size_t i = 0; i < sizeof(METRICS) / sizeof(METRICS[0]); i++) {
+		const struct metric_summary s = summarize(metric_values(metrics, i));
+		summary[METRICS[i].name] = { { "mean", s.mean }, { "p95", s.p95 }, { "max", s.max } };
+	}
+
+	return summary;
+}
+
+bool write_replay_results(const std::string &fpath, const struct replay_options *options, const std::vector<struct frame_metrics> &metrics)
+{
+	json fields = json::array();
+	for (const auto &metric : METRICS) { fields.push_back(metric.name); }
+	json frames = json::array();
+	for (const struct frame_metrics &frame : metrics) {
+		frames.push_back({ frame.cpums, frame.glms, frame.gpums, frame.draws, frame.triangles });
+	}
+	const json root = {
+		{ "capture", options->capture },
+		{ "step", options->step },
+		{ "headless", options->headless },
+		{ "width", options->width },
+		{ "height", options->height },
+		{ "summary", summary_json(metrics) },
+		{ "fields", fields },
+		{ "frames", frames }
+	};
+
+	std::ofstream file(fpath);
+	if (!file) {
+		std::cerr << "error: can't write replay results " << fpath << std::endl;
+		return false;
+	}
+	file << root.dump(1, '\t') << std::endl;
+
+	return bool(file);
+}
+
+bool compare_replay_baseline(const std::string &fpath, float tolerance, const std::vector<struct frame_metrics> &metrics)
+{
+	json baseline;
+	try {
+		std::ifstream file(fpath);
+		if (!file) {
+			std::cerr << "error: can't read baseline " << fpath << std::endl;
+			return false;
+		}
+		file >> baseline;
+		baseline = baseline.at("summary");
+	} catch (const std::exception &err) {
+		std::cerr << "error: malformed baseline " << fpath << ": " << err.what() << std::endl;
+		return false;
+	}
+
+	const json current = summary_json(metrics);
+	bool passed = true;
+	printf("%-12s %-5s %12s %12s %9s\n", "metric", "", "baseline", "current", "change");
+	for (const auto &metric : METRICS) {
+		const char *name = metric.name;
+		if (baseline.find(name) == baseline.end()) { continue; }
+		for (const char *stat : { "mean", "p95" }) {
+			const double before = baseline[name].value(stat, 0.0);
+			const double after = current[name][stat].get<double>();
+			const double change = before > 0.0 ? (after - before) / before : (after > 0.0 ? 1.0 : 0.0);
+			const bool failed = metric.counted ? std::abs(change) > tolerance : change > tolerance;
+			printf("%-12s %-5s %12.3f %12.3f %+8.1f%%%s\n", name, stat, before, after, 100.0 * change, failed ? "  REGRESSED" : "");
+			passed &= !failed;
+		}
+	}
+
+	return passed;
+}
+
+bool report_replay(const struct replay_options *options, const std::vector<struct frame_metrics> &metrics)
+{
+	printf("replayed %zu frames of %s\n", metrics.size(), options->capture.c_str());
+	if (!options->results.empty() && !write_replay_results(options->results, options, metrics)) { return false; }
+	if (options->baseline.empty()) { return true; }
+
+	const bool passed = compare_replay_baseline(options->baseline, options->tolerance, metrics);
+	printf("%s against %s with a tolerance of %.0f%%\n", passed ? "passed" : "regressed", options->baseline.c_str(), 100.f * options->tolerance);
+
+	return passed;
+}
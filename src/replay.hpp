@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define REPLAY_DEFAULT_STEP (1.f / 60.f) /* seconds of capture per replayed frame */
+#define REPLAY_DEFAULT_TOLERANCE 0.1f /* relative change against the baseline that still passes */
+#define REPLAY_QUERIES 4 /* GPU timers in flight, read back a few frames late */
+
+struct frame_packet;
+
+// state of the simulation at one frame of a recording
+struct capture_sample {
+	float time; /* seconds since the recording started */
+	glm::vec3 eye;
+	glm::vec3 target;
+	glm::vec3 up;
+	int animation;
+	float timeline; /* animation time at this frame */
+	float scale;
+};
+
+struct capture {
+	std::vector<std::string> files; /* every model loaded while recording, replays load them up front */
+	float fovy;
+	float near;
+	float far;
+	std::vector<struct capture_sample> samples;
+};
+
+bool save_capture(const std::string &fpath, const struct capture *capture);
+bool load_capture(const std::string &fpath, struct capture *capture);
+
+// the recorded state at any time, the camera is interpolated and the timeline runs on from the earlier sample
+struct capture_sample sample_capture(const struct capture *capture, float time);
+uint32_t replay_frames(const struct capture *capture, float step);
+
+struct frame_metrics {
+	float cpums; /* simulation and recording */
+	float glms; /* submission on the GL thread */
+	float gpums; /* scene on the GPU */
+	uint32_t draws;
+	uint64_t triangles;
+};
+
+void count_draws(const struct frame_packet &packet, struct frame_metrics *metrics);
+
+// GL thread only, times the scene of every replayed frame with timestamps since dynamic resolution already has a timer running
+struct replay_timer {
+	GLuint queries[2 * REPLAY_QUERIES];
+	int32_t frames[REPLAY_QUERIES]; /* replay frame of each query, -1 if free */
+	uint32_t next;
+};
+
+struct replay_timer gen_replay_timer(void);
+void delete_replay_timer(struct replay_timer *timer);
+// starts timing a frame, the query it replaces is read back into its frame first
+void begin_replay_timer(struct replay_timer *timer, uint32_t frame, std::vector<struct frame_metrics> &metrics);
+void end_replay_timer(struct replay_timer *timer);
+// waits for the queries still in flight
+void finish_replay_timer(struct replay_timer *timer, std::vector<struct frame_metrics> &metrics);
+
+enum session_mode {
+	SESSION_LIVE,
+	SESSION_RECORD,
+	SESSION_REPLAY
+};
+
+// what the viewer records or replays instead of following the input
+struct replay_session {
+	enum session_mode mode = SESSION_LIVE;
+	struct capture capture; /* filled while recording, played back while replaying */
+	float step = REPLAY_DEFAULT_STEP;
+	std::vector<struct frame_metrics> metrics; /* one per replayed frame */
+};
+
+struct replay_options {
+	std::string capture;
+	std::string results; /* JSON of every frame and the summary, not written if empty */
+	std::string baseline; /* results of an earlier replay to compare with */
+	float tolerance = REPLAY_DEFAULT_TOLERANCE;
+	float step = REPLAY_DEFAULT_STEP;
+	bool headless = false;
+	int width = 1920;
+	int height = 1080;
+};
+
+bool write_replay_results(const std::string &fpath, const struct replay_options *options, const std::vector<struct frame_metrics> &metrics);
+// prints every summary next to the baseline, false if a time grew or a count changed by more than the tolerance
+bool compare_replay_baseline(const std::string &fpath, float tolerance, const std::vector<struct frame_metrics> &metrics);
+// writes the results and compares them with the baseline if the options ask for it, false if anything failed
+bool report_replay(const struct replay_options *options, const std::vector<struct frame_metrics> &metrics);
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/vec3.hpp>
@@ -7,6 +8,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "progcache.hpp"
 #include "shader.hpp"
 
 static const GLchar *importshader(const char *fpath)
@@ -41,29 +43,46 @@ Shader::Shader(struct shaderinfo *shaders)
 	}
 }
 
+static void release_sources(std::vector<const GLchar*> &sources)
+{
+	for (const GLchar *source : sources) { delete [] source; }
+	sources.clear();
+}
+
 GLuint Shader::loadshaders(shaderinfo *shaders)
 {
 	if (shaders == NULL) { return 0; }
 
-	GLuint program = glCreateProgram();
+	// all sources are needed up front for the cache key
+	std::vector<GLenum> types;
+	std::vector<const GLchar*> sources;
+	for (shaderinfo *entry = shaders; entry->type != GL_NONE; ++entry) {
+		const GLchar *source = importshader(entry->fpath);
+		if (source == NULL) {
+			release_sources(sources);
+			return 0;
+		}
+		types.push_back(entry->type);
+		sources.push_back(source);
+	}
+
+	const uint64_t key = program_key(types.data(), sources.data(), sources.size());
+	GLuint program = load_program_binary(key);
+	if (program) {
+		release_sources(sources);
+		return program;
+	}
+
+	program = glCreateProgram();
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	shaderinfo *entry = shaders;
-	while (entry->type != GL_NONE) {
+	for (size_t i = 0; i < sources.size(); i++, entry++) {
 		GLuint shader = glCreateShader(entry->type);
 
 		entry->shader = shader;
 
-		const GLchar *source = importshader(entry->fpath);
-		if (source == NULL) {
-			for (entry = shaders; entry->type != GL_NONE; ++entry) {
-				glDeleteShader(entry->shader);
-				entry->shader = 0;
-			}
-			return 0;
-		}
-
-		glShaderSource(shader, 1, &source, NULL);
-		delete [] source;
+		glShaderSource(shader, 1, &sources[i], NULL);
 
 		glCompileShader(shader);
 
@@ -78,14 +97,15 @@ GLuint Shader::loadshaders(shaderinfo *shaders)
 			std::cerr << "error: shader compilation failed: " << log << std::endl;
 			delete [] log;
 
+			release_sources(sources);
 			return 0;
 		}
 
 		glAttachShader(program, shader);
-
-		entry++;
 	}
 
+	release_sources(sources);
+
 	glLinkProgram(program);
 
 	GLint linked;
@@ -107,6 +127,8 @@ GLuint Shader::loadshaders(shaderinfo *shaders)
 		return 0;
 	}
 
+	store_program_binary(key, program);
+
 	return program;
 }
 
@@ -7,12 +7,39 @@ struct shaderinfo {
 class Shader {
 public:
 	Shader(struct shaderinfo *shaders);
+	// takes over an already linked program
+	Shader(GLuint linked) : program(linked) {}
 	void bind(void) { glUseProgram(program); }
 	void uniform_mat4(const GLchar *name, glm::mat4 matrix) 
 	{
 		glUseProgram(program);
 		glUniformMatrix4fv(glGetUniformLocation(program, name), 1, GL_FALSE, &matrix[0][0]);
 	}
+	void uniform_mat3(const GLchar *name, glm::mat3 matrix)
+	{
+		glUseProgram(program);
+		glUniformMatrix3fv(glGetUniformLocation(program, name), 1, GL_FALSE, &matrix[0][0]);
+	}
+	void uniform_vec4(const GLchar *name, glm::vec4 vector) const
+	{
+		glUseProgram(program);
+		glUniform4fv(glGetUniformLocation(program, name), 1, glm::value_ptr(vector));
+	}
+	void uniform_uint(const GLchar *name, GLuint value) const
+	{
+		glUseProgram(program);
+		glUniform1ui(glGetUniformLocation(program, name), value);
+	}
+	void uniform_float(const GLchar *name, float value) const
+	{
+		glUseProgram(program);
+		glUniform1f(glGetUniformLocation(program, name), value);
+	}
+	void uniform_vec2(const GLchar *name, glm::vec2 vector) const
+	{
+		glUseProgram(program);
+		glUniform2fv(glGetUniformLocation(program, name), 1, glm::value_ptr(vector));
+	}
 	void uniform_vec3(const GLchar *name, glm::vec3 vector) const
 	{
 		glUseProgram(program);
@@ -23,6 +50,11 @@ public:
 	glUseProgram(program);
 	glUniformMatrix4fv(glGetUniformLocation(program, name), count, GL_FALSE, glm::value_ptr(matrices[0]));
  	}
+	void uniform_array_vec3(const GLchar *name, unsigned int count, const glm::vec3 *vectors) const
+	{
+		glUseProgram(program);
+		glUniform3fv(glGetUniformLocation(program, name), count, glm::value_ptr(vectors[0]));
+	}
 	void uniform_bool(const GLchar *name, bool boolean) const
 	{
 	glUseProgram(program);
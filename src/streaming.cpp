@@ -0,0 +1,388 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "dds.hpp"
+#include "texture.hpp"
+#include "streaming.hpp"
+#include "profiler.hpp"
+#include "memory.hpp"
+
+#define NO_LEVEL UINT32_MAX
+
+struct streamed_t {
+	GLuint texture;
+	struct DDS_file file;
+	GLenum format;
+	std::vector<size_t> offsets; /* of every level in the mapped file */
+	uint32_t levels;
+	uint32_t floor; /* first level that is always resident */
+	uint32_t resident; /* finest uploaded level, [resident, levels) are valid */
+	uint32_t wanted; /* finest level requested this frame */
+	uint32_t pending; /* level queued to the reader */
+	uint64_t lastused; /* frame of the last request */
+	bool sparse;
+	uint32_t sparse_levels; /* levels from here on are the sparse mip tail */
+};
+
+struct read_t {
+	uint32_t handle;
+	uint32_t level;
+	const unsigned char *src; /* inside the mapping */
+	size_t size;
+	std::vector<unsigned char> data;
+};
+
+static struct {
+	bool enabled = false;
+	size_t budget = STREAM_DEFAULT_BUDGET;
+	size_t resident = 0;
+	size_t evictions = 0;
+	uint64_t frame = 0;
+	std::vector<streamed_t> textures;
+	std::unordered_map<GLuint, uint32_t> handles;
+
+	std::thread reader;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool running = false;
+	std::deque<read_t> requests;
+	std::vector<read_t> completed;
+} streamer;
+
+static inline size_t level_size(const streamed_t &s, uint32_t level)
+{
+	return DDS_level_size(&s.file.header, level);
+}
+
+// without sparse storage glTexStorage allocated the whole chain up front, it is counted against the budget from the start
+static inline size_t resident_cost(const streamed_t &s, uint32_t level)
+{
+	return s.sparse ? level_size(s, level) : 0;
+}
+
+// copy levels out of the mapping so page faults and disk reads happen on this thread
+static void read_levels(void)
+{
+	profile_thread("stream reader");
+	while (true) {
+		read_t request;
+		{
+			std::unique_lock<std::mutex> guard(streamer.lock);
+			streamer.wake.wait(guard, [] { return !streamer.running || !streamer.requests.empty(); });
+			if (!streamer.running) { return; }
+			request = std::move(streamer.requests.front());
+			streamer.requests.pop_front();
+		}
+
+		/* files stay mapped until the reader is joined */
+		{
+			PROFILE_SCOPE("read level");
+			request.data.assign(request.src, request.src + request.size);
+		}
+		memory_add(MEMORY_STREAMING, request.data.size());
+
+		std::lock_guard<std::mutex> guard(streamer.lock);
+		streamer.completed.push_back(std::move(request));
+	}
+}
+
+void stream_init(size_t budget)
+{
+	streamer.budget = budget;
+	streamer.enabled = true;
+	streamer.running = true;
+	streamer.reader = std::thread(read_levels);
+}
+
+void stream_shutdown(void)
+{
+	if (!streamer.enabled) { return; }
+
+	{
+		std::lock_guard<std::mutex> guard(streamer.lock);
+		streamer.running = false;
+	}
+	streamer.wake.notify_all();
+	streamer.reader.join();
+
+	/* the streamer owns its textures, reads that never got uploaded are dropped */
+	for (const read_t &read : streamer.completed) { memory_sub(MEMORY_STREAMING, read.data.size()); }
+	streamer.completed.clear();
+	streamer.requests.clear();
+	for (streamed_t &s : streamer.textures) {
+		gpu_memory_untrack(GPU_MEMORY_TEXTURE, s.texture);
+		glDeleteTextures(1, &s.texture);
+		unmap_DDS(&s.file);
+	}
+	streamer.textures.clear();
+	streamer.handles.clear();
+	streamer.resident = 0;
+	streamer.evictions = 0;
+	streamer.frame = 0;
+	streamer.enabled = false;
+}
+
+bool stream_enabled(void)
+{
+	return streamer.enabled;
+}
+
+void stream_set_budget(size_t budget)
+{
+	streamer.budget = budget;
+}
+
+// sparse textures only use the pages of their resident levels and the mip tail
+static void track_streamed(const streamed_t &s)
+{
+	size_t bytes = 0;
+	const uint32_t first = s.sparse ? std::min(s.resident, s.sparse_levels) : 0;
+	for (uint32_t level = first; level < s.levels; level++) { bytes += level_size(s, level); }
+	gpu_memory_track(GPU_MEMORY_TEXTURE, s.texture, bytes, s.format, s.sparse ? "streamed sparse texture" : "streamed texture");
+}
+
+static void commit_level(streamed_t &s, uint32_t level, bool commit)
+{
+	/* the mip tail is committed once and stays */
+	if (!s.sparse || level >= s.sparse_levels) { return; }
+
+	GLsizei width = std::max(1u, s.file.header.width >> level);
+	GLsizei height = std::max(1u, s.file.header.height >> level);
+	glBindTexture(GL_TEXTURE_2D, s.texture);
+	glTexPageCommitmentARB(GL_TEXTURE_2D, level, 0, 0, 0, width, height, 1, commit ? GL_TRUE : GL_FALSE);
+}
+
+static void upload_level(streamed_t &s, uint32_t level, const unsigned char *data)
+{
+	commit_level(s, level, true);
+
+	GLsizei width = std::max(1u, s.file.header.width >> level);
+	GLsizei height = std::max(1u, s.file.header.height >> level);
+	glBindTexture(GL_TEXTURE_2D, s.texture);
+	glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, s.format, GLsizei(level_size(s, level)), data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+	s.resident = level;
+	streamer.resident += resident_cost(s, level);
+	if (s.sparse) { track_streamed(s); }
+}
+
+static void evict_level(streamed_t &s)
+{
+	const uint32_t level = s.resident;
+	s.resident++;
+	glBindTexture(GL_TEXTURE_2D, s.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, s.resident);
+	commit_level(s, level, false);
+
+	streamer.resident -= resident_cost(s, level);
+	streamer.evictions++;
+	if (s.sparse) { track_streamed(s); }
+}
+
+// pages that can be committed one level at a time, only if the texture is a multiple of the page size
+static bool sparse_storage(GLenum format, uint32_t width, uint32_t height)
+{
+	if (!GLEW_ARB_sparse_texture) { return false; }
+
+	GLint count = 0;
+	glGetInternalformativ(GL_TEXTURE_2D, format, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &count);
+	if (count < 1) { return false; }
+
+	GLint pagewidth = 0;
+	GLint pageheight = 0;
+	glGetInternalformativ(GL_TEXTURE_2D, format, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &pagewidth);
+	glGetInternalformativ(GL_TEXTURE_2D, format, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &pageheight);
+
+	return pagewidth > 0 && pageheight > 0 && width % pagewidth == 0 && height % pageheight == 0;
+}
+
+GLuint stream_texture(const char *fpath)
+{
+	streamed_t s{};
+	if (map_DDS(fpath, &s.file) == false) { return 0; }
+
+	const struct DDS *header = &s.file.header;
+	if (header->cubemap || header->array_size > 1 || !DDS_format(header, &s.format)) {
+		unmap_DDS(&s.file);
+		return 0;
+	}
+
+	s.levels = header->mip_levels;
+	size_t offset = 0;
+	for (uint32_t level = 0; level < s.levels; level++) {
+		s.offsets.push_back(offset);
+		offset += DDS_level_size(header, level);
+	}
+
+	s.floor = s.levels - 1;
+	while (s.floor > 0 && std::max(header->width, header->height) >> (s.floor - 1) <= STREAM_RESIDENT_SIZE) { s.floor--; }
+
+	s.sparse = sparse_storage(s.format, header->width, header->height);
+
+	glGenTextures(1, &s.texture);
+	glBindTexture(GL_TEXTURE_2D, s.texture);
+	if (s.sparse) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+		glTexParameteri(GL_TEXTURE_2D, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+	}
+	glTexStorage2D(GL_TEXTURE_2D, s.levels, s.format, header->width, header->height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, s.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	if (s.sparse) {
+		GLint sparse_levels = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_NUM_SPARSE_LEVELS_ARB, &sparse_levels);
+		s.sparse_levels = uint32_t(sparse_levels);
+		if (s.sparse_levels < s.levels) {
+			GLsizei width = std::max(1u, header->width >> s.sparse_levels);
+			GLsizei height = std::max(1u, header->height >> s.sparse_levels);
+			glTexPageCommitmentARB(GL_TEXTURE_2D, s.sparse_levels, 0, 0, 0, width, height, 1, GL_TRUE);
+		}
+		/* the committed tail might reach above the resident size */
+		s.floor = std::min(s.floor, s.sparse_levels);
+	}
+
+	if (!s.sparse) {
+		for (uint32_t level = 0; level < s.levels; level++) { streamer.resident += level_size(s, level); }
+	}
+
+	/* only the low mips are uploaded up front */
+	s.resident = s.levels;
+	for (uint32_t level = s.levels; level-- > s.floor; ) {
+		upload_level(s, level, s.file.data + s.offsets[level]);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	s.wanted = s.floor;
+	s.pending = NO_LEVEL;
+	track_streamed(s);
+
+	const GLuint texture = s.texture;
+	streamer.handles[texture] = uint32_t(streamer.textures.size());
+	streamer.textures.push_back(std::move(s));
+
+	return texture;
+}
+
+void stream_request(GLuint texture, float pixels)
+{
+	auto found = streamer.handles.find(texture);
+	if (found == streamer.handles.end()) { return; }
+
+	streamed_t &s = streamer.textures[found->second];
+	const float size = float(std::max(s.file.header.width, s.file.header.height));
+	uint32_t level = 0;
+	if (pixels < size) {
+		level = uint32_t(std::log2(size / std::max(pixels, 1.f)));
+	}
+
+	s.wanted = std::min(s.wanted, std::min(level, s.floor));
+	s.lastused = streamer.frame;
+}
+
+// lowest level a texture can drop to, levels in use this frame are kept
+static inline uint32_t evict_limit(const streamed_t &s)
+{
+	return (s.lastused == streamer.frame) ? s.wanted : s.floor;
+}
+
+// drop levels finer than needed, textures nobody asked for this frame go first, least recently used first
+// only sparse textures give memory back when a level is dropped
+static bool make_room(size_t bytes)
+{
+	if (streamer.resident + bytes <= streamer.budget) { return true; }
+
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < streamer.textures.size(); i++) {
+		const streamed_t &s = streamer.textures[i];
+		if (s.sparse && s.resident < evict_limit(s)) { candidates.push_back(i); }
+	}
+	std::sort(candidates.begin(), candidates.end(), [](uint32_t a, uint32_t b) {
+		return streamer.textures[a].lastused < streamer.textures[b].lastused;
+	});
+
+	for (uint32_t handle : candidates) {
+		streamed_t &s = streamer.textures[handle];
+		while (s.resident < evict_limit(s) && streamer.resident + bytes > streamer.budget) { evict_level(s); }
+		if (streamer.resident + bytes <= streamer.budget) { return true; }
+	}
+
+	return false;
+}
+
+void stream_update(void)
+{
+	if (!streamer.enabled) { return; }
+
+	std::vector<read_t> completed;
+	{
+		std::lock_guard<std::mutex> guard(streamer.lock);
+		completed.swap(streamer.completed);
+	}
+
+	for (read_t &read : completed) {
+		memory_sub(MEMORY_STREAMING, read.data.size());
+		streamed_t &s = streamer.textures[read.handle];
+		s.pending = NO_LEVEL;
+		/* the texture might have been evicted or lost interest while the read was in flight */
+		if (read.level + 1 != s.resident || read.level < s.wanted) { continue; }
+		if (make_room(resident_cost(s, read.level))) {
+			upload_level(s, read.level, read.data.data());
+		}
+	}
+
+	std::vector<read_t> requests;
+	for (uint32_t i = 0; i < streamer.textures.size(); i++) {
+		streamed_t &s = streamer.textures[i];
+		if (s.lastused == streamer.frame && s.wanted < s.resident && s.pending == NO_LEVEL) {
+			const uint32_t level = s.resident - 1;
+			if (make_room(resident_cost(s, level))) {
+				s.pending = level;
+				requests.push_back(read_t{ i, level, s.file.data + s.offsets[level], level_size(s, level), {} });
+			}
+		}
+	}
+
+	/* a lowered budget takes effect right away */
+	if (streamer.resident > streamer.budget) { make_room(0); }
+	for (streamed_t &s : streamer.textures) { s.wanted = s.floor; }
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!requests.empty()) {
+		std::lock_guard<std::mutex> guard(streamer.lock);
+		for (read_t &request : requests) { streamer.requests.push_back(std::move(request)); }
+	}
+	streamer.wake.notify_one();
+
+	streamer.frame++;
+}
+
+struct stream_stats stream_statistics(void)
+{
+	struct stream_stats stats = {};
+	stats.budget = streamer.budget;
+	stats.resident = streamer.resident;
+	stats.textures = streamer.textures.size();
+	stats.evictions = streamer.evictions;
+	for (const streamed_t &s : streamer.textures) {
+		if (s.pending != NO_LEVEL) { stats.pending++; }
+	}
+
+	return stats;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// default byte budget of the streamed mip levels
+#define STREAM_DEFAULT_BUDGET (256u << 20)
+// levels this size and smaller are uploaded on load and never evicted
+#define STREAM_RESIDENT_SIZE 64
+
+struct stream_stats {
+	size_t budget;
+	size_t resident; /* bytes of the committed levels of sparse textures and the whole chain of the others */
+	size_t pending; /* levels queued to the reader */
+	size_t textures;
+	size_t evictions; /* levels dropped since the start */
+};
+
+// a texture and the pixels its primitive covers on screen, recorded by the simulation for stream_request
+struct mip_request {
+	GLuint texture;
+	float pixels;
+};
+
+// starts the background reader, textures only stream after this is called
+void stream_init(size_t budget);
+// stops the reader and deletes every streamed texture, call it after the models using them are gone
+void stream_shutdown(void);
+bool stream_enabled(void);
+void stream_set_budget(size_t budget);
+
+// texture of a 2D DDS file with only its smallest levels resident, the file stays mapped for later reads
+GLuint stream_texture(const char *fpath);
+
+// the primitive using texture covers about this many pixels on screen this frame
+void stream_request(GLuint texture, float pixels);
+
+// once per frame on the GL thread: uploads finished reads, evicts least recently used levels and queues new reads
+void stream_update(void);
+
+struct stream_stats stream_statistics(void);
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "external/stb_image.h"
+
+#include "dds.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "texcache.hpp"
+#include "streaming.hpp"
+#include "memory.hpp"
+
+static const char *format_name(enum bcn_format format)
+{
+	switch (format) {
+	case BCN_BC4: return "bc4";
+	case BCN_BC5: return "bc5";
+	case BCN_BC7: return "bc7";
+	case BCN_BC7_SRGB: return "bc7s";
+	}
+
+	return "unknown";
+}
+
+// GL textures already uploaded this session, keyed on content hash and block format
+static std::map<std::pair<uint64_t, enum bcn_format>, GLuint> registry;
+
+static inline uint64_t mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// 64 bit hash of a byte string, consumes 8 bytes per step
+uint64_t hash_bytes(const unsigned char *data, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ (len * 0x100000001b3ULL);
+
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		h = (h ^ mix64(word)) * 0x100000001b3ULL;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, data + i, len - i);
+
+	return mix64(h ^ mix64(tail));
+}
+
+static std::string cache_path(uint64_t hash, enum bcn_format format)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx_%s.dds", (unsigned long long)hash, format_name(format));
+
+	return std::string(TEXCACHE_DIR) + name;
+}
+
+std::vector<unsigned char> compress_chain(const unsigned char *rgba, uint32_t width, uint32_t height, enum bcn_format format, uint32_t *levels)
+{
+	enum mip_filter filter = MIP_LINEAR;
+	if (format == BCN_BC7_SRGB) {
+		filter = MIP_SRGB;
+	} else if (format == BCN_BC5) {
+		filter = MIP_NORMAL;
+	}
+
+	std::vector<std::vector<unsigned char>> chain = gen_mipchain(rgba, width, height, 4, filter);
+
+	size_t size = 0;
+	for (uint32_t level = 0; level < chain.size(); level++) {
+		size += bcn_image_size(format, std::max(1u, width >> level), std::max(1u, height >> level));
+	}
+
+	std::vector<unsigned char> blocks(size);
+	size_t offset = 0;
+	for (uint32_t level = 0; level < chain.size(); level++) {
+		const uint32_t levelwidth = std::max(1u, width >> level);
+		const uint32_t levelheight = std::max(1u, height >> level);
+		bcn_compress(format, chain[level].data(), levelwidth, levelheight, blocks.data() + offset);
+		offset += bcn_image_size(format, levelwidth, levelheight);
+	}
+
+	*levels = uint32_t(chain.size());
+
+	return blocks;
+}
+
+GLuint find_texture(uint64_t hash, enum bcn_format format)
+{
+	auto found = registry.find(std::make_pair(hash, format));
+
+	return (found != registry.end()) ? found->second : 0;
+}
+
+void register_texture(uint64_t hash, enum bcn_format format, GLuint texture)
+{
+	registry[std::make_pair(hash, format)] = texture;
+}
+
+void clear_textures(void)
+{
+	for (const auto &entry : registry) {
+		gpu_memory_untrack(GPU_MEMORY_TEXTURE, entry.second);
+		glDeleteTextures(1, &entry.second);
+	}
+	registry.clear();
+}
+
+GLuint cached_texture(const unsigned char *encoded, size_t len, uint64_t hash, enum bcn_format format)
+{
+	const std::string path = cache_path(hash, format);
+
+	// warm load, the encoded image doesn't need to be touched
+	if (std::filesystem::exists(path)) {
+		GLuint texture = stream_enabled() ? stream_texture(path.c_str()) : load_DDS_texture(path.c_str());
+		if (texture) { return texture; }
+	}
+
+	int width, height, nchannels;
+	unsigned char *pixels = stbi_load_from_memory(encoded, int(len), &width, &height, &nchannels, 4);
+	if (pixels == nullptr) {
+		std::cerr << "error: could not decode image: " << stbi_failure_reason() << std::endl;
+		return 0;
+	}
+	struct memory_scope decoded(MEMORY_TEXTURES, size_t(width) * height * 4);
+
+	struct DDS header = {};
+	header.width = width;
+	header.height = height;
+	header.dxt_codec = FOURCC_DX10;
+	header.dxgi_format = bcn_dxgi_format(format);
+	header.array_size = 1;
+	header.linear_size = uint32_t(bcn_image_size(format, width, height));
+
+	std::vector<unsigned char> blocks = compress_chain(pixels, width, height, format, &header.mip_levels);
+	header.data_size = blocks.size();
+
+	stbi_image_free(pixels);
+
+	// write to a temporary file first so a failed write never leaves a truncated entry behind
+	std::error_code error;
+	std::filesystem::create_directories(TEXCACHE_DIR, error);
+	const std::string tmppath = path + ".tmp";
+	if (write_DDS(tmppath.c_str(), &header, blocks.data())) {
+		std::filesystem::rename(tmppath, path, error);
+		/* the fresh cache entry can be streamed like a warm one */
+		if (!error && stream_enabled()) {
+			GLuint texture = stream_texture(path.c_str());
+			if (texture) { return texture; }
+		}
+	} else {
+		std::filesystem::remove(tmppath, error);
+	}
+
+	return gen_DDS_texture(&header, blocks.data());
+}
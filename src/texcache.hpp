@@ -0,0 +1,21 @@
+#pragma once
+
+#include "bcn.hpp"
+
+// block compressed copies of glTF images are kept here as DDS files
+#define TEXCACHE_DIR "cache/textures/"
+
+uint64_t hash_bytes(const unsigned char *data, size_t len);
+
+// full mip chain of RGBA8 pixels in a block compressed format, levels are stored one after another as in a DDS file
+std::vector<unsigned char> compress_chain(const unsigned char *rgba, uint32_t width, uint32_t height, enum bcn_format format, uint32_t *levels);
+
+// texture of an encoded image (PNG, JPEG, ...) in a block compressed format, hash is hash_bytes of the encoded image
+// the image is only decoded and compressed if it is not in the cache yet
+GLuint cached_texture(const unsigned char *encoded, size_t len, uint64_t hash, enum bcn_format format);
+
+// textures shared by every loaded model, keyed by image content hash and block format
+GLuint find_texture(uint64_t hash, enum bcn_format format);
+void register_texture(uint64_t hash, enum bcn_format format, GLuint texture);
+// deletes every registered texture, at the end of batch runs that load one model after another
+void clear_textures(void);
@@ -1,9 +1,15 @@
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/gl.h>
 
 #include "dds.hpp"
+#include "mipmap.hpp"
 #include "texture.hpp"
+#include "memory.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "external/stb_image.h"
 
@@ -14,6 +20,7 @@ GLuint load_TGA_cubemap(const char *fpath[6])
 	glGenTextures(1, &texture);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
 
+	size_t bytes = 0;
 	for (int face = 0; face < 6; face++) {
 		GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
 		int width, height, nchannels;
@@ -21,6 +28,7 @@ GLuint load_TGA_cubemap(const char *fpath[6])
 		if (image) {
 			glTexImage2D(target, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
 			stbi_image_free(image);
+			bytes += texture_storage_size(GL_RGB8, width, height, 1, 1);
 
 		} else {
 			std::cerr << "cubemap error: failed to load " << fpath[face] << std::endl;
@@ -28,93 +36,212 @@ GLuint load_TGA_cubemap(const char *fpath[6])
 		}
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, texture, bytes, GL_RGB8, "cubemap");
 
 	return texture;
 }
 
-GLuint load_DDS_texture(const char *fpath)
+// find the compressed GL format of a DDS pixel format
+bool DDS_format(const struct DDS *header, GLenum *format)
+{
+	switch (header->dxt_codec) {
+	case FOURCC_DXT1: *format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; return true;
+	case FOURCC_DXT3: *format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; return true;
+	case FOURCC_DXT5: *format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; return true;
+	case FOURCC_ATI1: *format = GL_COMPRESSED_RED_RGTC1; return true;
+	case FOURCC_BC4U: *format = GL_COMPRESSED_RED_RGTC1; return true;
+	case FOURCC_ATI2: *format = GL_COMPRESSED_RG_RGTC2; return true;
+	case FOURCC_BC5U: *format = GL_COMPRESSED_RG_RGTC2; return true;
+	case FOURCC_DX10:
+		switch (header->dxgi_format) {
+		case DXGI_FORMAT_BC1_UNORM: *format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; return true;
+		case DXGI_FORMAT_BC1_UNORM_SRGB: *format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; return true;
+		case DXGI_FORMAT_BC2_UNORM: *format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; return true;
+		case DXGI_FORMAT_BC2_UNORM_SRGB: *format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; return true;
+		case DXGI_FORMAT_BC3_UNORM: *format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; return true;
+		case DXGI_FORMAT_BC3_UNORM_SRGB: *format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; return true;
+		case DXGI_FORMAT_BC4_UNORM: *format = GL_COMPRESSED_RED_RGTC1; return true;
+		case DXGI_FORMAT_BC4_SNORM: *format = GL_COMPRESSED_SIGNED_RED_RGTC1; return true;
+		case DXGI_FORMAT_BC5_UNORM: *format = GL_COMPRESSED_RG_RGTC2; return true;
+		case DXGI_FORMAT_BC5_SNORM: *format = GL_COMPRESSED_SIGNED_RG_RGTC2; return true;
+		case DXGI_FORMAT_BC6H_UF16: *format = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT; return true;
+		case DXGI_FORMAT_BC6H_SF16: *format = GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT; return true;
+		case DXGI_FORMAT_BC7_UNORM: *format = GL_COMPRESSED_RGBA_BPTC_UNORM; return true;
+		case DXGI_FORMAT_BC7_UNORM_SRGB: *format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; return true;
+		}
+	}
+
+	return false;
+}
+
+GLenum DDS_target(const struct DDS *header)
+{
+	if (header->cubemap) {
+		return (header->array_size > 1) ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+	}
+
+	return (header->array_size > 1) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+// allocates immutable storage for every level, then fills it face by face
+GLuint gen_DDS_texture(const struct DDS *header, const unsigned char *image)
 {
-	struct DDS header;
-	unsigned char *image = load_DDS(fpath, &header);
-	if (image == nullptr) { return 0; }
-
-	/* find valid DXT format*/
-	uint32_t components = (header.dxt_codec == FOURCC_DXT1) ? 3 : 4;
-	uint32_t format;
-	uint32_t block_size;
-	switch (header.dxt_codec) {
-	case FOURCC_DXT1: format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; block_size = 8; break;
-	case FOURCC_DXT3: format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; block_size = 16; break;
-	case FOURCC_DXT5: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; block_size = 16; break;
-	default:
-	std::cerr << "error: no valid DXT format found for " << fpath << std::endl;
-	delete [] image;
-	return 0;
-	};
-
-	/* now make the opengl texture */
+	GLenum format;
+	if (DDS_format(header, &format) == false) { return 0; }
+
+	const GLenum target = DDS_target(header);
+	const uint32_t faces = header->cubemap ? 6 : 1;
+	const uint32_t layers = std::max(1u, header->array_size);
+	const bool layered = (target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY);
+
 	GLuint texture;
 
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindTexture(target, texture);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.mip_levels-1);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	if (layered) {
+		glTexStorage3D(target, header->mip_levels, format, header->width, header->height, layers * faces);
+	} else {
+		glTexStorage2D(target, header->mip_levels, format, header->width, header->height);
+	}
 
-	unsigned int offset = 0;
-	for (unsigned int i = 0; i < header.mip_levels; i++) {
-		if (header.width <= 4 || header.height <= 4) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i-1);
-		break;
+	const unsigned char *data = image;
+	for (uint32_t layer = 0; layer < layers; layer++) {
+		for (uint32_t face = 0; face < faces; face++) {
+			for (uint32_t level = 0; level < header->mip_levels; level++) {
+				GLsizei width = std::max(1u, header->width >> level);
+				GLsizei height = std::max(1u, header->height >> level);
+				GLsizei size = GLsizei(DDS_level_size(header, level));
+				if (layered) {
+					glCompressedTexSubImage3D(target, level, 0, 0, layer * faces + face, width, height, 1, format, size, data);
+				} else if (header->cubemap) {
+					glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, width, height, format, size, data);
+				} else {
+					glCompressedTexSubImage2D(target, level, 0, 0, width, height, format, size, data);
+				}
+				data += size;
+			}
 		}
-		/* now to actually get the compressed image into opengl */
-		unsigned int size = ((header.width+3)/4) * ((header.height+3)/4) * block_size;
-		glCompressedTexImage2D(GL_TEXTURE_2D, i, format,
-		header.width, header.height, 0, size, image + offset);
-
-		offset += size;
-		header.width = header.width/2;
-		header.height = header.height/2;
 	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	const GLint wrap = header->cubemap ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header->mip_levels-1);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
 
-	delete [] image;
+	glBindTexture(target, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, texture, texture_storage_size(format, header->width, header->height, header->mip_levels, layers * faces), format, header->cubemap ? "cubemap" : "texture");
 
 	return texture;
 }
 
-// generate mip mapped texture
-GLuint gen_texture(struct image_t *image, GLenum internalformat, GLenum format, GLenum type)
+GLuint load_DDS_texture(const char *fpath)
 {
-	GLuint texture;
+	struct DDS_file file;
+	if (map_DDS(fpath, &file) == false) { return 0; }
 
-	GLsizei NUM_MIPMAPS = 6;
+	GLuint texture = gen_DDS_texture(&file.header, file.data);
+	if (texture == 0) {
+		std::cerr << "error: no valid compressed format found for " << fpath << std::endl;
+	}
+
+	unmap_DDS(&file);
+
+	return texture;
+}
+
+GLuint shared_sampler(GLint minfilter, GLint magfilter, GLint wraps, GLint wrapt)
+{
+	static std::map<std::tuple<GLint, GLint, GLint, GLint>, GLuint> samplers;
+
+	auto key = std::make_tuple(minfilter, magfilter, wraps, wrapt);
+	auto found = samplers.find(key);
+	if (found != samplers.end()) { return found->second; }
+
+	GLuint sampler;
+	glGenSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minfilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magfilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wraps);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrapt);
+
+	samplers[key] = sampler;
+
+	return sampler;
+}
+
+// generate mip mapped texture, the full chain is filtered on the CPU
+GLuint gen_texture(struct image_t *image, enum mip_filter filter)
+{
+	static const GLenum FORMATS[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	static const GLenum LINEAR_FORMATS[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+	static const GLenum SRGB_FORMATS[4] = { GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 };
+
+	if (image->nchannels < 1 || image->nchannels > 4) { return 0; }
+
+	// there are no 1 and 2 channel sRGB formats, grey color images are expanded to RGB and grey alpha to RGBA
+	struct image_t expanded = *image;
+	std::vector<unsigned char> pixels;
+	if (filter == MIP_SRGB && image->nchannels < 3) {
+		expanded.nchannels = image->nchannels + 2;
+		pixels.resize(image->width * image->height * expanded.nchannels);
+		for (size_t i = 0; i < image->width * image->height; i++) {
+			const unsigned char *src = image->data + i * image->nchannels;
+			unsigned char *dst = &pixels[i * expanded.nchannels];
+			dst[0] = dst[1] = dst[2] = src[0];
+			if (image->nchannels == 2) { dst[3] = src[1]; }
+		}
+		expanded.data = pixels.data();
+		image = &expanded;
+	}
+
+	const GLenum format = FORMATS[image->nchannels-1];
+	const GLenum internalformat = (filter == MIP_SRGB) ? SRGB_FORMATS[image->nchannels-1] : LINEAR_FORMATS[image->nchannels-1];
+
+	std::vector<std::vector<unsigned char>> levels = gen_mipchain(image->data, image->width, image->height, image->nchannels, filter);
+	size_t chainsize = 0;
+	for (const std::vector<unsigned char> &level : levels) { chainsize += level.size(); }
+	struct memory_scope chain(MEMORY_TEXTURES, chainsize);
+
+	GLuint texture;
 
 	glGenTextures(1, &texture);
 	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexStorage2D(GL_TEXTURE_2D, NUM_MIPMAPS, internalformat, image->width, image->height);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, format, type, image->data);
-
- 	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexStorage2D(GL_TEXTURE_2D, levels.size(), internalformat, image->width, image->height);
+
+	// rows of 1 and 3 channel images aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t level = 0; level < levels.size(); level++) {
+		GLsizei width = std::max(size_t(1), image->width >> level);
+		GLsizei height = std::max(size_t(1), image->height >> level);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, levels[level].data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
  	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	// grey data reads the same in every channel, grey alpha keeps its alpha
+	if (image->nchannels < 3) {
+		const GLint GREY[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		const GLint GREY_ALPHA[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, image->nchannels == 1 ? GREY : GREY_ALPHA);
+	}
 
 	glBindTexture(GL_TEXTURE_2D, 0);
+	gpu_memory_track(GPU_MEMORY_TEXTURE, texture, texture_storage_size(internalformat, image->width, image->height, levels.size(), 1), internalformat, "texture");
 
 	return texture;
 }
@@ -1,3 +1,5 @@
+#include "mipmap.hpp"
+
 struct image_t {
 	unsigned char *data;
 	unsigned int nchannels;
@@ -5,7 +7,15 @@ struct image_t {
 	size_t height;
 };
 
+// 2D textures, arrays and cubemaps, bind to the target DDS_target gives
 GLuint load_DDS_texture(const char *fpath);
+GLenum DDS_target(const struct DDS *header);
+bool DDS_format(const struct DDS *header, GLenum *format);
+GLuint gen_DDS_texture(const struct DDS *header, const unsigned char *image);
 GLuint load_TGA_cubemap(const char *fpath[6]);
 
-GLuint gen_texture(struct image_t *image, GLenum internalformat, GLenum format, GLenum type);
+// sampler objects are shared between every texture with the same state
+GLuint shared_sampler(GLint minfilter, GLint magfilter, GLint wraps, GLint wrapt);
+
+// 8 bit texture with a full CPU filtered mip chain, sized internal format by channel count and color space
+GLuint gen_texture(struct image_t *image, enum mip_filter filter);
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "progcache.hpp"
+#include "shader.hpp"
+#include "variants.hpp"
+
+static const struct {
+	enum shader_feature feature;
+	const char *define;
+} DEFINES[] = {
+	{ FEATURE_SKINNED, "SKINNED" },
+	{ FEATURE_UV, "HAS_UV" },
+	{ FEATURE_BASECOLOR_MAP, "HAS_BASECOLOR_MAP" },
+	{ FEATURE_METALROUGH_MAP, "HAS_METALROUGH_MAP" },
+	{ FEATURE_NORMAL_MAP, "HAS_NORMAL_MAP" },
+	{ FEATURE_ALPHA_MASK, "ALPHA_MASK" },
+	{ FEATURE_ALPHA_BLEND, "ALPHA_BLEND" },
+};
+
+struct variant_t {
+	enum { PENDING, READY, FAILED } state = PENDING;
+	uint64_t key = 0;
+	GLuint program = 0;
+	GLuint shaders[2] = {};
+	Shader *shader = nullptr;
+};
+
+static struct {
+	std::string sources[2]; /* vertex and fragment, without defines */
+	std::unordered_map<uint32_t, struct variant_t> variants;
+	bool parallel = false;
+} library;
+
+static const GLenum STAGES[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+
+static bool read_source(const char *fpath, std::string &source)
+{
+	std::ifstream file(fpath, std::ios::binary);
+	if (!file) {
+		std::cerr << "error: to open file '" << fpath << "'" << std::endl;
+		return false;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	source = stream.str();
+
+	return true;
+}
+
+// the defines have to follow the #version line
+static std::string specialize(const std::string &source, uint32_t features)
+{
+	std::string defines;
+	for (const auto &entry : DEFINES) {
+		if (features & entry.feature) { defines += std::string("#define ") + entry.define + "\n"; }
+	}
+
+	size_t version = source.find("#version");
+	size_t line = version == std::string::npos ? 0 : source.find('\n', version);
+	if (line == std::string::npos) { return source + "\n" + defines; }
+	if (version != std::string::npos) { line++; }
+
+	return source.substr(0, line) + defines + source.substr(line);
+}
+
+static void print_log(GLuint object, bool program)
+{
+	GLint len = 0;
+	if (program) {
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &len);
+	} else {
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &len);
+	}
+	std::string log(len + 1, '\0');
+	if (program) {
+		glGetProgramInfoLog(object, len, NULL, &log[0]);
+	} else {
+		glGetShaderInfoLog(object, len, NULL, &log[0]);
+	}
+	std::cerr << log.c_str() << std::endl;
+}
+
+// submits compilation and linking without asking for any status, which lets the driver work in the background
+static void start_variant(uint32_t features, struct variant_t &variant)
+{
+	std::string stages[2] = { specialize(library.sources[0], features), specialize(library.sources[1], features) };
+	const char *sources[2] = { stages[0].c_str(), stages[1].c_str() };
+	variant.key = program_key(STAGES, sources, 2);
+
+	variant.program = load_program_binary(variant.key);
+	if (variant.program) {
+		variant.state = variant_t::READY;
+		variant.shader = new Shader(variant.program);
+		return;
+	}
+
+	variant.program = glCreateProgram();
+	glProgramParameteri(variant.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (int i = 0; i < 2; i++) {
+		variant.shaders[i] = glCreateShader(STAGES[i]);
+		glShaderSource(variant.shaders[i], 1, &sources[i], NULL);
+		glCompileShader(variant.shaders[i]);
+		glAttachShader(variant.program, variant.shaders[i]);
+	}
+	glLinkProgram(variant.program);
+}
+
+static void finish_variant(uint32_t features, struct variant_t &variant)
+{
+	bool ok = true;
+	for (GLuint shader : variant.shaders) {
+		GLint compiled;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled) {
+			std::cerr << "error: shader compilation failed for variant " << features << ": ";
+			print_log(shader, false);
+			ok = false;
+		}
+	}
+
+	GLint linked = GL_FALSE;
+	if (ok) {
+		glGetProgramiv(variant.program, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			std::cerr << "error: shader linking failed for variant " << features << ": ";
+			print_log(variant.program, true);
+		}
+	}
+
+	for (GLuint &shader : variant.shaders) {
+		glDetachShader(variant.program, shader);
+		glDeleteShader(shader);
+		shader = 0;
+	}
+
+	if (!linked) {
+		glDeleteProgram(variant.program);
+		variant.program = 0;
+		variant.state = variant_t::FAILED;
+		return;
+	}
+
+	store_program_binary(variant.key, variant.program);
+	variant.state = variant_t::READY;
+	variant.shader = new Shader(variant.program);
+}
+
+static struct variant_t &compile_now(uint32_t features)
+{
+	struct variant_t &variant = library.variants[features];
+	if (variant.state == variant_t::PENDING) {
+		if (variant.program == 0) { start_variant(features, variant); }
+		if (variant.state == variant_t::PENDING) { finish_variant(features, variant); }
+	}
+
+	return variant;
+}
+
+bool variants_init(const char *vertpath, const char *fragpath)
+{
+	if (!read_source(vertpath, library.sources[0]) || !read_source(fragpath, library.sources[1])) { return false; }
+
+	library.parallel = GLEW_KHR_parallel_shader_compile;
+	// let the driver pick its thread count
+	if (library.parallel) { glMaxShaderCompilerThreadsKHR(0xffffffff); }
+
+	// every fallback, static and skinned in each alpha mode
+	bool ok = true;
+	for (uint32_t skinning : { 0u, uint32_t(FEATURE_SKINNED) }) {
+		for (uint32_t alpha : { 0u, uint32_t(FEATURE_ALPHA_MASK), uint32_t(FEATURE_ALPHA_BLEND) }) {
+			ok = compile_now(skinning | alpha).state == variant_t::READY && ok;
+		}
+	}
+
+	return ok;
+}
+
+void variants_shutdown(void)
+{
+	for (auto &entry : library.variants) {
+		struct variant_t &variant = entry.second;
+		for (GLuint shader : variant.shaders) { glDeleteShader(shader); }
+		delete variant.shader;
+		glDeleteProgram(variant.program);
+	}
+	library.variants.clear();
+}
+
+void request_variant(uint32_t features)
+{
+	if (library.variants.count(features)) { return; }
+
+	struct variant_t &variant = library.variants[features];
+	start_variant(features, variant);
+	// without the extension the first status query would block anyway
+	if (variant.state == variant_t::PENDING && !library.parallel) { finish_variant(features, variant); }
+}
+
+void poll_variants(void)
+{
+	for (auto &entry : library.variants) {
+		struct variant_t &variant = entry.second;
+		if (variant.state != variant_t::PENDING) { continue; }
+		GLint done = GL_TRUE;
+		if (library.parallel) { glGetProgramiv(variant.program, GL_COMPLETION_STATUS_KHR, &done); }
+		if (done) { finish_variant(entry.first, variant); }
+	}
+}
+
+void finish_variants(void)
+{
+	for (auto &entry : library.variants) {
+		if (entry.second.state == variant_t::PENDING) { finish_variant(entry.first, entry.second); }
+	}
+}
+
+Shader *variant_shader(uint32_t features)
+{
+	auto found = library.variants.find(features);
+	if (found == library.variants.end()) {
+		request_variant(features);
+		found = library.variants.find(features);
+	}
+	if (found->second.state == variant_t::READY) { return found->second.shader; }
+
+	found = library.variants.find(features & FEATURE_FALLBACK_MASK);
+	if (found != library.variants.end() && found->second.state == variant_t::READY) {
+		return found->second.shader;
+	}
+
+	return nullptr;
+}
+
+struct variant_stats variant_statistics(void)
+{
+	struct variant_stats stats = {};
+	for (const auto &entry : library.variants) {
+		switch (entry.second.state) {
+		case variant_t::READY: stats.ready++; break;
+		case variant_t::PENDING: stats.pending++; break;
+		case variant_t::FAILED: stats.failed++; break;
+		}
+	}
+	stats.parallel = library.parallel;
+
+	return stats;
+}
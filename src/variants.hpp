@@ -0,0 +1,40 @@
+#pragma once
+
+class Shader;
+
+// each feature becomes a #define in the shader sources, every combination in use is its own program
+enum shader_feature {
+	FEATURE_SKINNED = 1 << 0,
+	FEATURE_UV = 1 << 1,
+	FEATURE_BASECOLOR_MAP = 1 << 2,
+	FEATURE_METALROUGH_MAP = 1 << 3,
+	FEATURE_NORMAL_MAP = 1 << 4,
+	FEATURE_ALPHA_MASK = 1 << 5,
+	FEATURE_ALPHA_BLEND = 1 << 6,
+};
+
+// features a stand-in keeps while the wanted variant compiles, the vertex inputs have to match
+// and the alpha mode too, or cut out and blended materials would pop once their variant is ready
+#define FEATURE_FALLBACK_MASK (FEATURE_SKINNED | FEATURE_ALPHA_MASK | FEATURE_ALPHA_BLEND)
+
+struct variant_stats {
+	size_t ready;
+	size_t pending;
+	size_t failed;
+	bool parallel; /* compiled by driver threads through KHR_parallel_shader_compile */
+};
+
+// loads the sources and compiles the fallback variants right away, false if they don't link
+bool variants_init(const char *vertpath, const char *fragpath);
+void variants_shutdown(void);
+
+// starts compiling a variant nobody asked for before
+void request_variant(uint32_t features);
+// finishes variants the driver is done with, call once per frame
+void poll_variants(void);
+// blocks until every requested variant is linked, for offline rendering where nothing may use a fallback
+void finish_variants(void);
+// program of a variant once it is linked, its fallback before that, nullptr if neither works
+Shader *variant_shader(uint32_t features);
+
+struct variant_stats variant_statistics(void);
@@ -0,0 +1,114 @@
+#include <cstring>
+#include <vector>
+
+#include "vcache.hpp"
+
+struct tipsify_state {
+	std::vector<uint32_t> live; /* triangles left that use each vertex */
+	std::vector<uint32_t> stamp; /* time each vertex entered the cache */
+	std::vector<uint32_t> deadends; /* recently used vertices to restart from */
+	uint32_t time = VCACHE_SIZE + 1;
+	uint32_t cursor = 0; /* lowest vertex that may still have live triangles */
+};
+
+// the candidate that stays in the cache longest while its triangles are emitted, else a recent vertex with triangles left
+static uint32_t next_fan(struct tipsify_state &state, const std::vector<uint32_t> &candidates, uint32_t vertexcount)
+{
+	uint32_t best = VCACHE_UNUSED;
+	int64_t priority = -1;
+	for (uint32_t v : candidates) {
+		if (state.live[v] == 0) { continue; }
+		int64_t p = 0;
+		const int64_t age = int64_t(state.time) - state.stamp[v];
+		if (age + 2 * int64_t(state.live[v]) <= VCACHE_SIZE) { p = age; }
+		if (p > priority) {
+			priority = p;
+			best = v;
+		}
+	}
+	if (best != VCACHE_UNUSED) { return best; }
+
+	while (!state.deadends.empty()) {
+		const uint32_t v = state.deadends.back();
+		state.deadends.pop_back();
+		if (state.live[v] > 0) { return v; }
+	}
+	for (; state.cursor < vertexcount; state.cursor++) {
+		if (state.live[state.cursor] > 0) { return state.cursor; }
+	}
+
+	return VCACHE_UNUSED;
+}
+
+void optimize_vertex_cache(uint32_t *indices, size_t count, uint32_t vertexcount)
+{
+	const size_t triangles = count / 3;
+	if (triangles < 2 || vertexcount == 0) { return; }
+
+	struct tipsify_state state;
+	state.live.assign(vertexcount, 0);
+	state.stamp.assign(vertexcount, 0);
+	for (size_t i = 0; i < triangles * 3; i++) { state.live[indices[i]]++; }
+
+	// triangles of each vertex, first[v] is where its list starts
+	std::vector<uint32_t> first(size_t(vertexcount) + 1, 0);
+	for (uint32_t v = 0; v < vertexcount; v++) { first[v + 1] = first[v] + state.live[v]; }
+	std::vector<uint32_t> adjacency(triangles * 3);
+	std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < triangles * 3; i++) { adjacency[fill[indices[i]]++] = uint32_t(i / 3); }
+
+	std::vector<bool> emitted(triangles, false);
+	std::vector<uint32_t> order;
+	order.reserve(triangles * 3);
+	std::vector<uint32_t> candidates;
+	uint32_t fan = indices[0];
+	while (fan != VCACHE_UNUSED) {
+		candidates.clear();
+		for (uint32_t k = first[fan]; k < first[fan + 1]; k++) {
+			const uint32_t triangle = adjacency[k];
+			if (emitted[triangle]) { continue; }
+			emitted[triangle] = true;
+			for (uint32_t c = 0; c < 3; c++) {
+				const uint32_t v = indices[triangle * 3 + c];
+				order.push_back(v);
+				state.deadends.push_back(v);
+				candidates.push_back(v);
+				state.live[v]--;
+				if (state.time - state.stamp[v] > VCACHE_SIZE) { state.stamp[v] = state.time++; }
+			}
+		}
+		fan = next_fan(state, candidates, vertexcount);
+	}
+
+	memcpy(indices, order.data(), order.size() * sizeof(uint32_t));
+}
+
+uint32_t optimize_vertex_fetch(uint32_t *indices, size_t count, uint32_t vertexcount, std::vector<uint32_t> &remap)
+{
+	remap.assign(vertexcount, VCACHE_UNUSED);
+	uint32_t next = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t &target = remap[indices[i]];
+		if (target == VCACHE_UNUSED) { target = next++; }
+		indices[i] = target;
+	}
+
+	return next;
+}
+
+uint64_t simulate_vertex_cache(const uint32_t *indices, size_t count, uint32_t vertexcount, uint32_t cachesize)
+{
+	// a vertex is still cached while fewer than cachesize misses came after its own
+	std::vector<uint64_t> entered(vertexcount, 0);
+	uint64_t misses = 0;
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t v = indices[i];
+		if (v >= vertexcount) { continue; }
+		if (entered[v] == 0 || misses - entered[v] >= cachesize) {
+			misses++;
+			entered[v] = misses;
+		}
+	}
+
+	return misses;
+}
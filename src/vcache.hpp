@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// post-transform cache size the triangle order is tuned for, small enough to suit every GPU
+#define VCACHE_SIZE 16
+// cache size the draw cost estimates are simulated with
+#define VCACHE_SIMULATED 32
+#define VCACHE_UNUSED 0xffffffffu
+
+// reorders the triangles of an index list so consecutive ones share vertices (Tipsify, Sander et al. 2007)
+// every index has to be below vertexcount
+void optimize_vertex_cache(uint32_t *indices, size_t count, uint32_t vertexcount);
+
+// renumbers vertices in the order the triangles first use them, remap[old] is the new index or VCACHE_UNUSED
+// returns the number of vertices still used
+uint32_t optimize_vertex_fetch(uint32_t *indices, size_t count, uint32_t vertexcount, std::vector<uint32_t> &remap);
+
+// vertex shader runs of an index list on a FIFO cache with the given number of entries
+uint64_t simulate_vertex_cache(const uint32_t *indices, size_t count, uint32_t vertexcount, uint32_t cachesize);
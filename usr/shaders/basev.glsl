@@ -1,16 +1,25 @@
 #version 430 core
 
+// features are defined by the variant system: SKINNED, HAS_UV
+
 #define MAX_JOINT_MATRICES 128
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec3 normal;
+#ifdef HAS_UV
 layout(location = 2) in vec2 texcoord;
+#endif
+#ifdef SKINNED
 layout(location = 3) in ivec4 joints;
 layout(location = 4) in vec4 weights;
+#endif
 
 uniform mat4 project, view, model;
+#ifdef SKINNED
 uniform mat4 u_joint_matrix[MAX_JOINT_MATRICES];
-uniform bool skinned;
+#else
+uniform mat3 normalmatrix;
+#endif
 
 out VERTEX {
 	vec3 worldpos;
@@ -18,25 +27,36 @@ out VERTEX {
 	vec2 texcoord;
 } vertex;
 
+// transpose of the inverse scaled by the determinant, the normal is normalized anyway
+mat3 cofactor(mat3 m)
+{
+	return mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+}
+
 void main(void)
 {
-	//vertex.normal = normal;
+#ifdef HAS_UV
 	vertex.texcoord = texcoord;
+#else
+	vertex.texcoord = vec2(0.0);
+#endif
+
+#ifdef SKINNED
+	mat4 skin_matrix =
+	weights.x * u_joint_matrix[int(joints.x)] +
+	weights.y * u_joint_matrix[int(joints.y)] +
+	weights.z * u_joint_matrix[int(joints.z)] +
+	weights.w * u_joint_matrix[int(joints.w)];
+
+	mat4 world = model * skin_matrix;
+	// the cofactor is scaled by the determinant, mirrored joints would flip the normal
+	vertex.normal = normalize(sign(determinant(mat3(world))) * cofactor(mat3(world)) * normal);
+#else
+	mat4 world = model;
+	vertex.normal = normalize(normalmatrix * normal);
+#endif
 
-	if (skinned == true) {
-		mat4 skin_matrix =
-		weights.x * u_joint_matrix[int(joints.x)] +
-		weights.y * u_joint_matrix[int(joints.y)] +
-		weights.z * u_joint_matrix[int(joints.z)] +
-		weights.w * u_joint_matrix[int(joints.w)];
-
-		vec4 pos = view * model * skin_matrix * position;
-		vertex.normal = normalize(mat3(transpose(inverse(model * skin_matrix))) * normal);
-		vertex.worldpos = vec4(model * skin_matrix * position).xyz;
-		gl_Position = project * pos;
-	} else {
-		vertex.normal = normalize(mat3(transpose(inverse(model))) * normal);
-		vertex.worldpos = vec4(model * position).xyz;
-		gl_Position = project * view * model * position;
-	}
+	vec4 worldpos = world * position;
+	vertex.worldpos = worldpos.xyz;
+	gl_Position = project * view * worldpos;
 }
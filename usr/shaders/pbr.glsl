@@ -1,13 +1,24 @@
 #version 430 core
 // shader source : https://github.com/KhronosGroup/glTF-Sample-Viewer/blob/master/src/shaders/metallic-roughness.frag
+// features are defined by the variant system: HAS_BASECOLOR_MAP, HAS_METALROUGH_MAP, HAS_NORMAL_MAP, ALPHA_MASK, ALPHA_BLEND
 
 out vec4 fcolor;
 
 layout(binding = 0) uniform sampler2D base;
 layout(binding = 1) uniform sampler2D metallicroughness;
 layout(binding = 2) uniform sampler2D normalmap;
+layout(binding = 3) uniform samplerCube prefiltered;
+layout(binding = 4) uniform sampler2D brdflut;
+uniform vec3 irradiance[9];      // SH9 of the environment irradiance, already divided by pi
+uniform float prefilteredlod;    // mip level of roughness 1
 uniform vec3 basedcolor;
+uniform float basealpha;
+uniform float metallicfactor;
+uniform float roughnessfactor;
 uniform vec3 campos;
+#ifdef ALPHA_MASK
+uniform float alphacutoff;
+#endif
 
 in VERTEX {
 	vec3 worldpos;
@@ -27,13 +38,33 @@ struct MaterialInfo
 	vec3 specularColor;           // color contribution from specular lighting
 };
 
+// matches struct light_data in lighting.hpp
 struct Light
 {
-	vec3 direction;
-	vec3 color;
-	float intensity;
+	vec4 position;                // xyz world position, w range
+	vec4 color;                   // rgb color times intensity, w type
+	vec4 direction;               // xyz direction the light points at, w spot angle scale
+	vec4 spot;                    // x spot angle offset
 };
 
+const int LIGHT_DIRECTIONAL = 0;
+const int LIGHT_POINT = 1;
+const int LIGHT_SPOT = 2;
+
+// must match lighting.hpp
+const uint CLUSTER_X = 16;
+const uint CLUSTER_Y = 9;
+const uint CLUSTER_Z = 24;
+
+// directional lights come first, the clusters index the point and spot lights after them
+layout(std430, binding = 0) readonly buffer Lights { Light lights[]; };
+layout(std430, binding = 1) readonly buffer Clusters { uvec2 clusters[]; };
+layout(std430, binding = 2) readonly buffer LightIndices { uint lightindices[]; };
+
+uniform mat4 view;
+uniform uint directionalcount;
+uniform vec4 clustergrid;        // tile width and height in pixels, depth slice scale and bias
+
 struct AngularInfo
 {
 	float NdotL;                  // cos angle between normal and light direction
@@ -128,9 +159,60 @@ vec3 getPointShade(vec3 pointToLight, MaterialInfo materialInfo, vec3 normal, ve
 
 vec3 applyDirectionalLight(Light light, MaterialInfo materialInfo, vec3 normal, vec3 view)
 {
-	vec3 pointToLight = -light.direction;
+	vec3 pointToLight = -light.direction.xyz;
+	vec3 shade = getPointShade(pointToLight, materialInfo, normal, view);
+	return light.color.rgb * shade;
+}
+
+// https://github.com/KhronosGroup/glTF/blob/master/extensions/2.0/Khronos/KHR_lights_punctual/README.md#range-property
+float getRangeAttenuation(float range, float distance)
+{
+	return clamp(1.0 - pow(distance / range, 4.0), 0.0, 1.0) / pow(distance, 2.0);
+}
+
+float getSpotAttenuation(vec3 pointToLight, Light light)
+{
+	float cd = dot(normalize(light.direction.xyz), normalize(-pointToLight));
+	float attenuation = clamp(cd * light.direction.w + light.spot.x, 0.0, 1.0);
+	return attenuation * attenuation;
+}
+
+vec3 applyLocalLight(Light light, MaterialInfo materialInfo, vec3 normal, vec3 position, vec3 view)
+{
+	vec3 pointToLight = light.position.xyz - position;
+	float attenuation = getRangeAttenuation(light.position.w, length(pointToLight));
+	if (int(light.color.w) == LIGHT_SPOT) { attenuation *= getSpotAttenuation(pointToLight, light); }
 	vec3 shade = getPointShade(pointToLight, materialInfo, normal, view);
-	return light.intensity * light.color * shade;
+	return attenuation * light.color.rgb * shade;
+}
+
+vec3 getIrradiance(vec3 n)
+{
+	return irradiance[0] * 0.282095
+		+ irradiance[1] * 0.488603 * n.y
+		+ irradiance[2] * 0.488603 * n.z
+		+ irradiance[3] * 0.488603 * n.x
+		+ irradiance[4] * 1.092548 * n.x * n.y
+		+ irradiance[5] * 1.092548 * n.y * n.z
+		+ irradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ irradiance[7] * 1.092548 * n.x * n.z
+		+ irradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// split sum approximation, the prefiltered levels and the LUT are baked on the CPU
+vec3 getIBLContribution(MaterialInfo materialInfo, vec3 n, vec3 v)
+{
+	float NdotV = clamp(dot(n, v), 0.0, 1.0);
+	vec2 brdf = texture(brdflut, vec2(NdotV, materialInfo.perceptualRoughness)).rg;
+	vec3 reflection = normalize(reflect(-v, n));
+
+	vec3 diffuseLight = max(getIrradiance(n), vec3(0.0));
+	vec3 specularLight = textureLod(prefiltered, reflection, materialInfo.perceptualRoughness * prefilteredlod).rgb;
+
+	vec3 diffuse = diffuseLight * materialInfo.diffuseColor;
+	vec3 specular = specularLight * (materialInfo.specularColor * brdf.x + brdf.y);
+
+	return diffuse + specular;
 }
 
 vec3 LINEARtoSRGB(vec3 color)
@@ -138,6 +220,29 @@ vec3 LINEARtoSRGB(vec3 color)
 	return pow(color, vec3(INV_GAMMA));
 }
 
+#ifdef HAS_NORMAL_MAP
+// tangent frame from screen space derivatives, the vertices carry no tangents
+vec3 perturbNormal(vec3 n, vec3 position, vec2 uv)
+{
+	vec3 dp1 = dFdx(position);
+	vec3 dp2 = dFdy(position);
+	vec2 duv1 = dFdx(uv);
+	vec2 duv2 = dFdy(uv);
+
+	vec3 dp2perp = cross(dp2, n);
+	vec3 dp1perp = cross(n, dp1);
+	vec3 t = dp2perp * duv1.x + dp1perp * duv2.x;
+	vec3 b = dp2perp * duv1.y + dp1perp * duv2.y;
+	float invmax = inversesqrt(max(max(dot(t, t), dot(b, b)), 1e-12));
+
+	// two channel normal maps only store x and y
+	vec2 xy = texture(normalmap, uv).rg * 2.0 - 1.0;
+	vec3 tangentnormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+
+	return normalize(mat3(t * invmax, b * invmax, n) * tangentnormal);
+}
+#endif
+
 void main(void)
 {
 	float perceptualRoughness = 0.0;
@@ -147,14 +252,26 @@ void main(void)
 	vec3 specularColor= vec3(0.0);
 	vec3 f0 = vec3(0.04);
 
-	vec4 mrSample = texture2D(metallicroughness, fragment.texcoord);
-	mrSample.rgb = pow(mrSample.rgb, vec3(INV_GAMMA));
-	perceptualRoughness = mrSample.g * 1.0;
-	metallic = mrSample.b * 1.0;
-
-	baseColor = texture2D(base, fragment.texcoord);
-	baseColor.rgb += basedcolor;
-	baseColor.rgb = pow(baseColor.rgb, vec3(GAMMA));
+#ifdef HAS_METALROUGH_MAP
+	vec4 mrSample = texture(metallicroughness, fragment.texcoord);
+	perceptualRoughness = mrSample.g * roughnessfactor;
+	metallic = mrSample.b * metallicfactor;
+#else
+	perceptualRoughness = roughnessfactor;
+	metallic = metallicfactor;
+#endif
+
+	// base color maps are sRGB textures and already linear when sampled
+	baseColor = vec4(pow(basedcolor, vec3(GAMMA)), basealpha);
+#ifdef HAS_BASECOLOR_MAP
+	vec4 baseSample = texture(base, fragment.texcoord);
+	baseColor.rgb += baseSample.rgb;
+	baseColor.a *= baseSample.a;
+#endif
+
+#ifdef ALPHA_MASK
+	if (baseColor.a < alphacutoff) { discard; }
+#endif
 
 	diffuseColor = baseColor.rgb * (vec3(1.0) - f0) * (1.0 - metallic);
 
@@ -185,16 +302,31 @@ void main(void)
 
 	// LIGHTING
 	vec3 color = vec3(0.0, 0.0, 0.0);
+#ifdef HAS_NORMAL_MAP
+	vec3 normal = perturbNormal(normalize(fragment.normal), fragment.worldpos, fragment.texcoord);
+#else
 	vec3 normal = fragment.normal;
-	vec3 view = normalize(campos - fragment.worldpos);
+#endif
+	vec3 viewdir = normalize(campos - fragment.worldpos);
 
-	Light light = Light(
-		vec3(-0.7399, -0.6428, -0.1983),
-		vec3(1.0, 0.9, 0.8),
-		3.4
-	);
+	for (uint i = 0; i < directionalcount; i++) {
+		color += applyDirectionalLight(lights[i], materialInfo, normal, viewdir);
+	}
 
-	color += applyDirectionalLight(light, materialInfo, normal, view);
+	color += getIBLContribution(materialInfo, normalize(normal), viewdir);
+
+	// only the lights binned into the cluster of this fragment
+	float depth = -(view * vec4(fragment.worldpos, 1.0)).z;
+	uvec3 cell = uvec3(gl_FragCoord.xy / clustergrid.xy, max(log(depth) * clustergrid.z + clustergrid.w, 0.0));
+	cell = min(cell, uvec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+	uvec2 cluster = clusters[cell.x + CLUSTER_X * (cell.y + CLUSTER_Y * cell.z)];
+	for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+		color += applyLocalLight(lights[lightindices[i]], materialInfo, normal, fragment.worldpos, viewdir);
+	}
 
+#ifdef ALPHA_BLEND
+	fcolor = vec4(LINEARtoSRGB(color), baseColor.a);
+#else
 	fcolor = vec4(LINEARtoSRGB(color), 1.0);
+#endif
 }
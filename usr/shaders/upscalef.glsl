@@ -0,0 +1,30 @@
+#version 430 core
+
+// bilinear upscale of the rendered region followed by a clamped unsharp mask
+
+out vec4 fcolor;
+
+in vec2 texcoord;
+
+layout(binding = 0) uniform sampler2D scene;
+uniform vec2 region;             // rendered part of the scene texture in texture coordinates
+uniform vec2 texel;              // size of one scene texel in texture coordinates
+uniform float sharpness;         // 0 is a plain bilinear upscale
+
+void main(void)
+{
+	vec2 uv = clamp(texcoord * region, 0.5 * texel, region - 0.5 * texel);
+
+	vec3 center = texture(scene, uv).rgb;
+	vec3 north = texture(scene, min(uv + vec2(0.0, texel.y), region - 0.5 * texel)).rgb;
+	vec3 south = texture(scene, max(uv - vec2(0.0, texel.y), 0.5 * texel)).rgb;
+	vec3 east = texture(scene, min(uv + vec2(texel.x, 0.0), region - 0.5 * texel)).rgb;
+	vec3 west = texture(scene, max(uv - vec2(texel.x, 0.0), 0.5 * texel)).rgb;
+
+	// clamping to the neighbourhood keeps the sharpening from ringing around edges
+	vec3 lo = min(center, min(min(north, south), min(east, west)));
+	vec3 hi = max(center, max(max(north, south), max(east, west)));
+	vec3 sharpened = center + sharpness * (4.0 * center - north - south - east - west);
+
+	fcolor = vec4(clamp(sharpened, lo, hi), 1.0);
+}
@@ -0,0 +1,11 @@
+#version 430 core
+
+// fullscreen triangle without vertex buffers
+out vec2 texcoord;
+
+void main(void)
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	texcoord = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}